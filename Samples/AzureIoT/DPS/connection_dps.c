@@ -29,6 +29,7 @@
 #include "eventloop_timer_utilities.h"
 #include "connection.h"
 #include "connection_dps.h"
+#include "dps_cache.h"
 
 static void InitializeProvisioningClient(void);
 static void CleanupProvisioningClient(void);
@@ -38,6 +39,8 @@ static void RegisterDeviceCallback(PROV_DEVICE_RESULT registerResult, const char
 static void ProvisioningTimerHandler(EventLoopTimer *timer);
 static void TimeoutTimerHandler(EventLoopTimer *timer);
 static void OnRegisterComplete(void);
+static bool ConnectWithCachedAssignment(void);
+static IOTHUB_DEVICE_CLIENT_LL_HANDLE CreateIoTHubClient(void);
 
 static ExitCode_CallbackType failureCallbackFunction = NULL;
 static Connection_StatusCallbackType connectionStatusCallback = NULL;
@@ -54,6 +57,19 @@ static PROV_DEVICE_RESULT dpsRegisterStatus = PROV_DEVICE_RESULT_INVALID_STATE;
 static char iotHubUri[MAX_HUB_URI_LENGTH + 1];
 static char scopeId[MAX_SCOPEID_LENGTH + 1];
 static char azureSphereModelId[MAX_MODELID_LENGTH + 1];
+static char assignedDeviceId[DPS_CACHE_MAX_DEVICEID_LENGTH + 1];
+
+// A cached assignment is used for this long before the device registers with DPS again.
+static const time_t CachedAssignmentMaxAgeSeconds = 7 * 24 * 60 * 60;
+// Connection attempts with a cached assignment which may fail for reasons other than the
+// credentials, such as the IoT Hub no longer existing, before the device registers with DPS.
+static const int MaxCachedAssignmentFailures = 3;
+
+static bool cacheAssignment = false;
+static uint32_t cacheStorageOffset = 0;
+static bool usingCachedAssignment = false;
+static bool cachedAssignmentAuthenticated = false;
+static int cachedAssignmentFailures = 0;
 
 PROV_DEVICE_LL_HANDLE provHandle = NULL;
 static const char dpsUrl[] = "global.azure-devices-provisioning.net";
@@ -89,6 +105,9 @@ ExitCode Connection_Initialise(EventLoop *el, Connection_StatusCallbackType stat
     }
     strncpy(scopeId, config->scopeId, MAX_SCOPEID_LENGTH);
 
+    cacheAssignment = config->cacheAssignment;
+    cacheStorageOffset = config->cacheStorageOffset;
+
     if (NULL != modelId) {
         if (strnlen(modelId, MAX_MODELID_LENGTH) == MAX_MODELID_LENGTH) {
             Log_Debug("ERROR: Model ID length exceeds maximum of %d\n", MAX_MODELID_LENGTH);
@@ -133,6 +152,11 @@ void Connection_Start(void)
         return;
     }
 
+    if (cacheAssignment && ConnectWithCachedAssignment()) {
+        return;
+    }
+    usingCachedAssignment = false;
+
     InitializeProvisioningClient();
     if (provHandle == NULL) {
         Log_Debug("ERROR: Failed to create and initialize device provisioning client\n");
@@ -212,13 +236,21 @@ static void RegisterDeviceCallback(PROV_DEVICE_RESULT registerResult, const char
         if (callbackHubUri != NULL) {
             size_t uriSize = strlen(callbackHubUri);
             if (uriSize > MAX_HUB_URI_LENGTH) {
-                Log_Debug("ERROR: IoT Hub URI size (%u bytes) exceeds maximum (%u bytes).\n",
+                Log_Debug("ERROR: IoT Hub URI size (%zu bytes) exceeds maximum (%d bytes).\n",
                           uriSize, MAX_HUB_URI_LENGTH);
+                iotHubUri[0] = '\0';
                 return;
             }
-            strncpy(iotHubUri, callbackHubUri, strlen(callbackHubUri));
+            memcpy(iotHubUri, callbackHubUri, uriSize + 1);
         } else {
             Log_Debug("ERROR: Device registration did not return an IoT Hub URI\n");
+            iotHubUri[0] = '\0';
+        }
+
+        if (deviceId != NULL && strlen(deviceId) <= DPS_CACHE_MAX_DEVICEID_LENGTH) {
+            strcpy(assignedDeviceId, deviceId);
+        } else {
+            assignedDeviceId[0] = '\0';
         }
     }
 }
@@ -326,15 +358,63 @@ static void OnRegisterComplete(void)
     if (dpsRegisterStatus != PROV_DEVICE_RESULT_OK) {
         Log_Debug("ERROR: Failed to register device with provisioning service: %s\n",
                   PROV_DEVICE_RESULTStrings(dpsRegisterStatus));
-        goto cleanup;
+    } else {
+        if (cacheAssignment && iotHubUri[0] != '\0') {
+            DpsCache_Save(cacheStorageOffset, scopeId, iotHubUri, assignedDeviceId);
+        }
+        iothubClientHandle = CreateIoTHubClient();
     }
 
-    iothubClientHandle =
+    if (iothubClientHandle != NULL) {
+        connectionStatusCallback(Connection_Complete, iothubClientHandle);
+    } else {
+        connectionStatusCallback(Connection_Failed, NULL);
+    }
+
+    CleanupProvisioningClient();
+}
+
+/// <summary>
+///     Connects to the IoT Hub in the cached DPS assignment, if there is one, without registering
+///     with DPS.
+/// </summary>
+/// <returns>true if a cached assignment was used; false if the device must register.</returns>
+static bool ConnectWithCachedAssignment(void)
+{
+    DpsCache_Assignment assignment;
+    if (!DpsCache_Load(cacheStorageOffset, scopeId, CachedAssignmentMaxAgeSeconds, &assignment)) {
+        return false;
+    }
+
+    Log_Debug("INFO: Using cached DPS assignment to IoT Hub %s\n", assignment.hubHostname);
+    strcpy(iotHubUri, assignment.hubHostname);
+    usingCachedAssignment = true;
+    cachedAssignmentAuthenticated = false;
+
+    connectionStatusCallback(Connection_Started, NULL);
+
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iothubClientHandle = CreateIoTHubClient();
+    if (iothubClientHandle != NULL) {
+        connectionStatusCallback(Connection_Complete, iothubClientHandle);
+    } else {
+        connectionStatusCallback(Connection_Failed, NULL);
+    }
+    return true;
+}
+
+/// <summary>
+///     Creates an IoT Hub client for the hub in iotHubUri, authenticating with the DAA
+///     certificate.
+/// </summary>
+/// <returns>The client, or NULL on failure.</returns>
+static IOTHUB_DEVICE_CLIENT_LL_HANDLE CreateIoTHubClient(void)
+{
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iothubClientHandle =
         IoTHubDeviceClient_LL_CreateWithAzureSphereFromDeviceAuth(iotHubUri, &MQTT_Protocol);
 
     if (iothubClientHandle == NULL) {
         Log_Debug("ERROR: Failed to create client IoT Hub Client Handle\n");
-        goto cleanup;
+        return NULL;
     }
 
     // Use DAA cert when connecting - requires the SetDeviceId option to be set on the
@@ -344,20 +424,20 @@ static void OnRegisterComplete(void)
         iothubClientHandle, "SetDeviceId", &deviceIdForDaaCertUsage);
     if (iothubResult != IOTHUB_CLIENT_OK) {
         IoTHubDeviceClient_LL_Destroy(iothubClientHandle);
-        iothubClientHandle = NULL;
         Log_Debug("ERROR: Failed to set Device ID on IoT Hub Client: %s\n",
                   IOTHUB_CLIENT_RESULTStrings(iothubResult));
-        goto cleanup;
+        return NULL;
     }
 
-    // Sets auto URL encoding on IoT Hub Client
+    // Sets auto URL encoding on IoT Hub Client. Failing to set this or the model ID is logged, but
+    // the client is still used.
     static bool urlAutoEncodeDecode = true;
     if ((iothubResult = IoTHubDeviceClient_LL_SetOption(
              iothubClientHandle, OPTION_AUTO_URL_ENCODE_DECODE, &urlAutoEncodeDecode)) !=
         IOTHUB_CLIENT_OK) {
         Log_Debug("ERROR: Failed to set auto Url encode option on IoT Hub Client: %s\n",
                   IOTHUB_CLIENT_RESULTStrings(iothubResult));
-        goto cleanup;
+        return iothubClientHandle;
     }
 
     // Sets model ID on IoT Hub Client
@@ -365,17 +445,39 @@ static void OnRegisterComplete(void)
                                                         azureSphereModelId)) != IOTHUB_CLIENT_OK) {
         Log_Debug("ERROR: Failed to set the Model ID on IoT Hub Client: %s\n",
                   IOTHUB_CLIENT_RESULTStrings(iothubResult));
-        goto cleanup;
     }
 
-cleanup:
-    if (iothubClientHandle != NULL) {
-        connectionStatusCallback(Connection_Complete, iothubClientHandle);
-    } else {
-        connectionStatusCallback(Connection_Failed, NULL);
+    return iothubClientHandle;
+}
+
+void Connection_ReportAuthenticationStatus(IOTHUB_CLIENT_CONNECTION_STATUS status,
+                                           IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason)
+{
+    if (!usingCachedAssignment) {
+        return;
     }
 
-    CleanupProvisioningClient();
+    if (status == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED) {
+        cachedAssignmentAuthenticated = true;
+        cachedAssignmentFailures = 0;
+        return;
+    }
+
+    // If the hub rejects the device, it has probably been assigned elsewhere. Other failures
+    // only count against the cached assignment if it has not worked in this connection.
+    bool credentialsRejected = reason == IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL ||
+                               reason == IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED;
+    if (!credentialsRejected &&
+        (cachedAssignmentAuthenticated ||
+         ++cachedAssignmentFailures < MaxCachedAssignmentFailures)) {
+        return;
+    }
+
+    Log_Debug("WARNING: Could not authenticate with the cached DPS assignment; the device will "
+              "register with DPS.\n");
+    DpsCache_Invalidate(cacheStorageOffset);
+    usingCachedAssignment = false;
+    cachedAssignmentFailures = 0;
 }
 
 void Connection_Cleanup(void) {}
@@ -0,0 +1,70 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// Caches the result of a Device Provisioning Service registration in the application's mutable
+// storage, so that a restarted application can connect straight to the IoT Hub which the device
+// was assigned to, rather than registering with DPS again.
+//
+// The cache is one fixed-size record in a region of the mutable storage file. It is tied to the
+// DPS ID scope which produced it, and expires after a maximum age.
+
+#define DPS_CACHE_MAX_SCOPEID_LENGTH 32
+#define DPS_CACHE_MAX_HOSTNAME_LENGTH 512
+#define DPS_CACHE_MAX_DEVICEID_LENGTH 128
+
+/// <summary>
+/// A cached DPS assignment.
+/// </summary>
+typedef struct {
+    /// <summary>Hostname of the assigned IoT Hub.</summary>
+    char hubHostname[DPS_CACHE_MAX_HOSTNAME_LENGTH + 1];
+    /// <summary>Device ID the device was registered with.</summary>
+    char deviceId[DPS_CACHE_MAX_DEVICEID_LENGTH + 1];
+    /// <summary>Time at which the device was assigned, by the device's clock.</summary>
+    time_t assignedTime;
+} DpsCache_Assignment;
+
+// Size of the region of the mutable storage file which the cache needs.
+#define DPS_CACHE_REGION_SIZE 768
+
+/// <summary>
+/// Size of the region of the mutable storage file which the cache needs; DPS_CACHE_REGION_SIZE.
+/// </summary>
+uint32_t DpsCache_GetRegionSize(void);
+
+/// <summary>
+/// Load the cached assignment for an ID scope.
+/// </summary>
+/// <param name="storageOffset">Offset of the cache's region in the mutable storage file.</param>
+/// <param name="scopeId">The DPS ID scope.</param>
+/// <param name="maxAgeSeconds">Maximum age of a usable assignment. If the clock is earlier than
+/// the assignment time, as it can be before the clock has been set, the assignment is
+/// used.</param>
+/// <param name="assignment">Receives the assignment.</param>
+/// <returns>true if there is a usable assignment for the ID scope; otherwise false.</returns>
+bool DpsCache_Load(uint32_t storageOffset, const char *scopeId, time_t maxAgeSeconds,
+                   DpsCache_Assignment *assignment);
+
+/// <summary>
+/// Save an assignment for an ID scope, replacing any cached assignment. The assignment time is
+/// the current time.
+/// </summary>
+/// <param name="storageOffset">Offset of the cache's region in the mutable storage file.</param>
+/// <param name="scopeId">The DPS ID scope.</param>
+/// <param name="hubHostname">Hostname of the assigned IoT Hub.</param>
+/// <param name="deviceId">Device ID the device was registered with, or NULL if unknown.</param>
+/// <returns>true on success; otherwise false.</returns>
+bool DpsCache_Save(uint32_t storageOffset, const char *scopeId, const char *hubHostname,
+                   const char *deviceId);
+
+/// <summary>
+/// Discard the cached assignment, so that the device registers with DPS on its next connection.
+/// </summary>
+/// <param name="storageOffset">Offset of the cache's region in the mutable storage file.</param>
+void DpsCache_Invalidate(uint32_t storageOffset);
@@ -1,6 +1,7 @@
 /* Copyright (c) Microsoft Corporation. All rights reserved.
    Licensed under the MIT License. */
 
+#include <assert.h>
 #include <getopt.h>
 #include <stdlib.h>
 
@@ -9,6 +10,8 @@
 #include "options.h"
 #include "exitcodes.h"
 #include "connection_dps.h"
+#include "dps_cache.h"
+#include "mutable_storage_layout.h"
 
 static ExitCode ValidateUserConfiguration(void);
 
@@ -17,8 +20,14 @@ static const char *cmdLineArgsUsageText =
     "The command line arguments for the application shoud be set in app_manifest.json as below:\n"
     "\" CmdArgs \": [\"--ScopeID\", \"<scope_id>\"]\n";
 
+// The DPS assignment is cached in its region of the mutable storage file; see
+// mutable_storage_layout.h.
+static_assert(DPS_CACHE_REGION_SIZE <= DPS_CACHE_STORAGE_SIZE,
+              "The DPS assignment cache does not fit in its region of mutable storage.");
+
 static const char *scopeId = NULL;
-static Connection_Dps_Config config = {.scopeId = NULL};
+static Connection_Dps_Config config = {
+    .scopeId = NULL, .cacheAssignment = true, .cacheStorageOffset = DPS_CACHE_STORAGE_OFFSET};
 
 ExitCode Options_ParseArgs(int argc, char *argv[])
 {
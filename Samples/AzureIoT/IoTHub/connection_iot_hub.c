@@ -90,6 +90,11 @@ void Connection_Start(void)
     }
 }
 
+void Connection_ReportAuthenticationStatus(IOTHUB_CLIENT_CONNECTION_STATUS status,
+                                           IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason)
+{
+}
+
 void Connection_Cleanup(void) {}
 
 /// <summary>
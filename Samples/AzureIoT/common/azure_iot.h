@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include <time.h>
+
 #include <applibs/eventloop.h>
 #include "exitcodes.h"
 
@@ -21,12 +23,31 @@ typedef void (*AzureIoT_ConnectionStatusCallbackType)(bool connected);
 /// queued, if any.</param>
 typedef void (*AzureIoT_SendTelemetryCallbackType)(bool success, void *context);
 
+/// <summary>
+/// Callback type for a function to be invoked with a batched telemetry reading which was not sent;
+/// see <see cref="AzureIoT_SendBatchedTelemetry" />.
+/// </summary>
+/// <param name="jsonReading">The reading, as a NULL-terminated JSON object.</param>
+/// <param name="iso8601DateTimeString">Timestamp of the reading, or NULL if it has none.</param>
+typedef void (*AzureIoT_BatchedTelemetryUnsentCallbackType)(const char *jsonReading,
+                                                            const char *iso8601DateTimeString);
+
 /// <summary>
 /// Callback type for a function to be invoked when a device twin message is received.
 /// </summary>
 /// <param name="deviceTwinContent">The device twin, as a NULL-terminated JSON string.</param>
 typedef void (*AzureIoT_DeviceTwinReceivedCallbackType)(const char *deviceTwinContent);
 
+/// <summary>
+/// Callback type for a function to be invoked when a device twin message is received, with the
+/// payload as received from the IoT Hub. Unlike <see cref="AzureIoT_DeviceTwinReceivedCallbackType"
+/// />, the payload is not copied, so its size is not limited.
+/// </summary>
+/// <param name="payload">The device twin, as JSON which is not NULL-terminated.</param>
+/// <param name="payloadSize">Size of the payload.</param>
+typedef void (*AzureIoT_DeviceTwinPayloadReceivedCallbackType)(const unsigned char *payload,
+                                                               size_t payloadSize);
+
 /// <summary>
 /// Callback type for a function to be invoked when a device twin update is sent to the IoT Hub,
 /// or when a send attempt fails.
@@ -65,6 +86,11 @@ typedef struct {
     /// </summary>
     AzureIoT_DeviceTwinReceivedCallbackType deviceTwinReceivedCallbackFunction;
     /// <summary>
+    /// Function called with the raw payload when a Device Twin message is received from the Azure
+    /// IoT Hub. If set, it is called instead of deviceTwinReceivedCallbackFunction.
+    /// </summary>
+    AzureIoT_DeviceTwinPayloadReceivedCallbackType deviceTwinPayloadReceivedCallbackFunction;
+    /// <summary>
     /// Function called when the Azure IoT Hub acknowledges receipt of a Device Twin report
     /// </summary>
     AzureIoT_DeviceTwinReportStateAckCallbackType deviceTwinReportStateAckCallbackTypeFunction;
@@ -76,6 +102,11 @@ typedef struct {
     /// Function called when the Azure IoT Hub invokes a device method
     /// </summary>
     AzureIoT_DeviceMethodCallbackType deviceMethodCallbackFunction;
+    /// <summary>
+    /// Function called with each batched telemetry reading which could not be sent, so that the
+    /// application can keep it, for example in persistent storage
+    /// </summary>
+    AzureIoT_BatchedTelemetryUnsentCallbackType batchedTelemetryUnsentCallbackFunction;
 } AzureIoT_Callbacks;
 
 /// <summary>
@@ -95,9 +126,133 @@ typedef enum {
     /// <summary>
     /// The operation failed for another reason not explicitly listed
     /// </summary>
-    AzureIoT_Result_OtherFailure
+    AzureIoT_Result_OtherFailure,
+
+    /// <summary>
+    /// The operation could not be performed as too many messages are waiting to be sent; it may
+    /// be retried once earlier messages have been confirmed
+    /// </summary>
+    AzureIoT_Result_Busy
 } AzureIoT_Result;
 
+/// <summary>
+/// Counts of Device Twin reports, and of what was published for them.
+/// </summary>
+typedef struct {
+    /// <summary>Calls to <see cref="AzureIoT_DeviceTwinReportState" /> which were
+    /// queued.</summary>
+    unsigned long reportsRequested;
+    /// <summary>Total length of the JSON passed to those calls.</summary>
+    unsigned long bytesRequested;
+    /// <summary>Reported state updates published to the IoT Hub.</summary>
+    unsigned long publishes;
+    /// <summary>Total length of the published updates.</summary>
+    unsigned long bytesPublished;
+    /// <summary>Debounce windows whose reports changed nothing, so nothing was
+    /// published.</summary>
+    unsigned long publishesSkipped;
+} AzureIoT_DeviceTwinReportStats;
+
+/// <summary>
+/// Counts of telemetry readings sent in batches by <see cref="AzureIoT_SendBatchedTelemetry" />.
+/// </summary>
+typedef struct {
+    /// <summary>Readings added to a batch.</summary>
+    unsigned long readingsBatched;
+    /// <summary>Batches sent as telemetry messages.</summary>
+    unsigned long batchesSent;
+    /// <summary>Of those, batches sent because the next reading would have exceeded the byte
+    /// budget, rather than because the oldest reading reached the maximum age.</summary>
+    unsigned long batchesSentFull;
+    /// <summary>Total length of the batches sent.</summary>
+    unsigned long bytesSent;
+    /// <summary>Readings passed back to the application unsent, with the
+    /// batchedTelemetryUnsentCallbackFunction.</summary>
+    unsigned long readingsUnsent;
+} AzureIoT_TelemetryBatchStats;
+
+/// <summary>
+/// How often IoTHubDeviceClient_LL_DoWork is called, to let the Azure IoT SDK send and receive.
+/// </summary>
+typedef enum {
+    /// <summary>Every 100 ms.</summary>
+    AzureIoT_DoWorkPolicy_Fixed = 0,
+    /// <summary>As soon as a message has been handed to the SDK, then often while a confirmation
+    /// is pending or the client is authenticating, backing off to every few seconds when
+    /// idle.</summary>
+    AzureIoT_DoWorkPolicy_Adaptive = 1
+} AzureIoT_DoWorkPolicy;
+
+/// <summary>
+/// Counts of DoWork calls, and of the time from handing telemetry or a Device Twin report to the
+/// SDK until its confirmation.
+/// </summary>
+typedef struct {
+    /// <summary>Calls to IoTHubDeviceClient_LL_DoWork.</summary>
+    unsigned long doWorkCalls;
+    /// <summary>Telemetry messages and reports which were confirmed, or failed.</summary>
+    unsigned long confirmations;
+    /// <summary>Total time to confirmation, in milliseconds.</summary>
+    unsigned long totalConfirmLatencyMs;
+    /// <summary>Longest time to confirmation, in milliseconds.</summary>
+    unsigned long maxConfirmLatencyMs;
+} AzureIoT_DoWorkStats;
+
+/// <summary>
+/// Counts of attempts to connect to the IoT Hub, and of the time from starting an attempt until
+/// the client is authenticated.
+/// </summary>
+typedef struct {
+    /// <summary>Connection attempts started.</summary>
+    unsigned long connectAttempts;
+    /// <summary>Attempts which ended with the client authenticated.</summary>
+    unsigned long connects;
+    /// <summary>Attempts which failed.</summary>
+    unsigned long connectFailures;
+    /// <summary>Connections lost after the client was authenticated.</summary>
+    unsigned long disconnects;
+    /// <summary>Total time from the start of an attempt to authentication, in
+    /// milliseconds.</summary>
+    unsigned long totalConnectLatencyMs;
+    /// <summary>Longest time from the start of an attempt to authentication, in
+    /// milliseconds.</summary>
+    unsigned long maxConnectLatencyMs;
+    /// <summary>The most recent delay before a reconnection attempt, in milliseconds.</summary>
+    unsigned long lastRetryDelayMs;
+} AzureIoT_ConnectionStats;
+
+/// <summary>
+/// Number of buckets in <see cref="AzureIoT_TelemetryWindowStats.latencyHistogram" />.
+/// </summary>
+#define AZURE_IOT_LATENCY_BUCKETS 18
+
+/// <summary>
+/// Counts of telemetry messages held back by the send window, and a histogram of the time from
+/// handing a message to the SDK until its confirmation.
+/// </summary>
+typedef struct {
+    /// <summary>Messages handed to the SDK and awaiting confirmation.</summary>
+    unsigned int inFlight;
+    /// <summary>Most messages awaiting confirmation at once.</summary>
+    unsigned int peakInFlight;
+    /// <summary>Messages waiting for a slot in the window.</summary>
+    unsigned int deferred;
+    /// <summary>Most messages waiting for a slot at once.</summary>
+    unsigned int peakDeferred;
+    /// <summary>Messages which had to wait for a slot.</summary>
+    unsigned long deferredSends;
+    /// <summary>Messages refused with <see cref="AzureIoT_Result_Busy" />.</summary>
+    unsigned long busyRejections;
+    /// <summary>Bucket 0 counts confirmations within 1 ms, bucket i those from 2^(i-1) ms up to
+    /// 2^i ms, and the last bucket also counts all longer ones.</summary>
+    unsigned long latencyHistogram[AZURE_IOT_LATENCY_BUCKETS];
+    /// <summary>Median time to confirmation, in milliseconds: the upper bound of its
+    /// bucket, or 0 if nothing has been confirmed.</summary>
+    unsigned long latencyP50Ms;
+    /// <summary>99th percentile time to confirmation, in milliseconds, likewise.</summary>
+    unsigned long latencyP99Ms;
+} AzureIoT_TelemetryWindowStats;
+
 /// <summary>
 ///     Initialize the Azure IoT Hub connection.
 /// </summary>
@@ -121,6 +276,8 @@ void AzureIoT_Cleanup(void);
 ///     function will return immediately, and then call the
 ///     <see cref="AzureIoT_SendTelemetryCallbackType" /> (passed to
 ///     <see cref="AzureIoT_Initialize" />) to indicate success or failure.
+///     If the send window is full, the telemetry is held until a slot is free; see
+///     <see cref="AzureIoT_SetTelemetryWindow" />.
 /// </summary>
 /// <param name="jsonMessage">The telemetry to send, as a JSON string.</param>
 /// <param name="iso8601DateTimeString">
@@ -132,13 +289,117 @@ void AzureIoT_Cleanup(void);
 AzureIoT_Result AzureIoT_SendTelemetry(const char *jsonMessage, const char *iso8601DateTimeString,
                                        void *context);
 
+/// <summary>
+///     Enqueue binary telemetry, such as CBOR, to send to the Azure IoT Hub; otherwise like
+///     <see cref="AzureIoT_SendTelemetry" />. The IoT Hub only decodes JSON bodies itself, so
+///     message routing queries on the body do not apply to binary telemetry.
+/// </summary>
+/// <param name="data">The telemetry to send, which is copied.</param>
+/// <param name="length">Length of the telemetry in bytes.</param>
+/// <param name="contentType">The content type of the telemetry, for example
+///     "application/cbor".</param>
+/// <param name="iso8601DateTimeString">
+///     Timestamp for the event as an ISO 8601 date/time string; if NULL, no timestamp will be
+///     included with the message.
+/// </param>
+/// <param name="context">An optional context, which will be passed to the callback.</param>
+/// <returns>An <see cref="AzureIoT_Result" /> indicating success or failure.</returns>
+AzureIoT_Result AzureIoT_SendBinaryTelemetry(const unsigned char *data, size_t length,
+                                             const char *contentType,
+                                             const char *iso8601DateTimeString, void *context);
+
 /// <summary>
 ///     Enqueue a report containing Device Twin properties to send to the Azure IoT Hub. The report
 ///     is not sent immediately; the function will return immediately, and then call the
 ///     <see cref="AzureIoT_DeviceTwinReportStateAckCallbackType" /> (passed to
 ///     <see cref="AzureIoT_Initialize" />) to indicate success or failure.
+///     Reports made within a short debounce window are merged, and only the properties whose
+///     values differ from those last published are sent, as a JSON merge patch.
 /// </summary>
 /// <param name="jsonState">A JSON string representing the device twin properties to report.</param>
 /// <param name="context">An optional context, which will be passed to the callback.</param>
 /// <returns>An <see cref="AzureIoT_Result" /> indicating success or failure.</returns>
 AzureIoT_Result AzureIoT_DeviceTwinReportState(const char *jsonState, void *context);
+
+/// <summary>
+///     Get counts of the Device Twin reports requested and published so far.
+/// </summary>
+/// <param name="stats">Receives the counts.</param>
+void AzureIoT_GetDeviceTwinReportStats(AzureIoT_DeviceTwinReportStats *stats);
+
+/// <summary>
+///     Enable or disable batching of the readings passed to
+///     <see cref="AzureIoT_SendBatchedTelemetry" />. A batch is sent as one telemetry message,
+///     holding a JSON array of the readings, when the next reading would take it over
+///     <paramref name="maxBytes" />, or when its oldest reading reaches
+///     <paramref name="maxAge" />, whichever comes first. Any batched readings are sent first.
+/// </summary>
+/// <param name="maxBytes">Maximum size of a batch message, in bytes; 0 to disable batching, in
+/// which case each reading is sent as it arrives.</param>
+/// <param name="maxAge">Maximum time to hold a reading before sending its batch.</param>
+/// <returns>true on success; false if the batch could not be allocated, or the readings already
+/// batched could not be sent.</returns>
+bool AzureIoT_ConfigureTelemetryBatching(size_t maxBytes, const struct timespec *maxAge);
+
+/// <summary>
+///     Add a telemetry reading to the current batch; see
+///     <see cref="AzureIoT_ConfigureTelemetryBatching" />. Each reading in the batch carries its
+///     timestamp as a "timestamp" member, and the batch message's creation time is that of its
+///     oldest reading. Readings which are not JSON objects, or which do not fit in a batch, are
+///     sent straight away, as by <see cref="AzureIoT_SendTelemetry" />. Events which should not be
+///     delayed should be sent with <see cref="AzureIoT_SendTelemetry" />.
+///     The <see cref="AzureIoT_SendTelemetryCallbackType" /> is called for each batch, with a NULL
+///     context.
+///     If a batch cannot be sent, the connection is lost, or <see cref="AzureIoT_Cleanup" /> is
+///     called, the readings in the batch are passed back one by one to the
+///     batchedTelemetryUnsentCallbackFunction, if it is set, and removed from the batch; otherwise
+///     sending the batch is retried after its maximum age, and it is lost at cleanup.
+/// </summary>
+/// <param name="jsonReading">The reading, as a JSON object.</param>
+/// <param name="iso8601DateTimeString">Timestamp for the reading as an ISO 8601 date/time string,
+/// or NULL.</param>
+/// <returns>An <see cref="AzureIoT_Result" /> indicating success or failure. The reading is not
+/// batched unless the device is connected, so that the caller can keep it if it is not.</returns>
+AzureIoT_Result AzureIoT_SendBatchedTelemetry(const char *jsonReading,
+                                              const char *iso8601DateTimeString);
+
+/// <summary>
+///     Get counts of the telemetry readings batched and sent so far.
+/// </summary>
+/// <param name="stats">Receives the counts.</param>
+void AzureIoT_GetTelemetryBatchStats(AzureIoT_TelemetryBatchStats *stats);
+
+/// <summary>
+///     Set how often the Azure IoT SDK is given time to send and receive. The default is
+///     <see cref="AzureIoT_DoWorkPolicy_Fixed" />. Call after <see cref="AzureIoT_Initialize" />.
+/// </summary>
+/// <param name="policy">The DoWork policy.</param>
+void AzureIoT_SetDoWorkPolicy(AzureIoT_DoWorkPolicy policy);
+
+/// <summary>
+///     Get counts of DoWork calls and confirmation latencies so far.
+/// </summary>
+/// <param name="stats">Receives the counts.</param>
+void AzureIoT_GetDoWorkStats(AzureIoT_DoWorkStats *stats);
+
+/// <summary>
+///     Get counts of connection attempts and their latencies so far.
+/// </summary>
+/// <param name="stats">Receives the counts.</param>
+void AzureIoT_GetConnectionStats(AzureIoT_ConnectionStats *stats);
+
+/// <summary>
+///     Limit the number of telemetry messages awaiting confirmation from the IoT Hub. Messages
+///     sent while the window is full are held, in order, and handed to the SDK as earlier ones are
+///     confirmed. Once the held messages reach their limit too, sending telemetry fails with
+///     <see cref="AzureIoT_Result_Busy" />. By default there is no limit.
+/// </summary>
+/// <param name="maxInFlight">Most messages awaiting confirmation, or 0 for no limit.</param>
+/// <param name="maxDeferred">Most messages held waiting for a slot.</param>
+void AzureIoT_SetTelemetryWindow(unsigned int maxInFlight, unsigned int maxDeferred);
+
+/// <summary>
+///     Get the state of the telemetry send window, and confirmation latencies so far.
+/// </summary>
+/// <param name="stats">Receives the counts.</param>
+void AzureIoT_GetTelemetryWindowStats(AzureIoT_TelemetryWindowStats *stats);
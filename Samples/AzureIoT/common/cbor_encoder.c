@@ -0,0 +1,232 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include "cbor_encoder.h"
+
+// Major types, in the top three bits of the initial byte.
+enum {
+    MajorType_UnsignedInt = 0,
+    MajorType_NegativeInt = 1,
+    MajorType_TextString = 3,
+    MajorType_Array = 4,
+    MajorType_Map = 5
+};
+
+// Initial bytes of major type 7.
+enum {
+    Simple_False = 0xF4,
+    Simple_True = 0xF5,
+    Simple_Null = 0xF6,
+    Simple_Half = 0xF9,
+    Simple_Single = 0xFA,
+    Simple_Double = 0xFB,
+    Simple_Break = 0xFF
+};
+
+// The additional information of an indefinite-length container's initial byte.
+static const uint8_t IndefiniteLength = 31;
+
+static void Write(CborEncoder *encoder, const uint8_t *bytes, size_t length)
+{
+    if (encoder->overflow || encoder->size - encoder->length < length) {
+        encoder->overflow = true;
+        return;
+    }
+
+    memcpy(encoder->buffer + encoder->length, bytes, length);
+    encoder->length += length;
+}
+
+/// <summary>
+///     Writes an initial byte and the big-endian value which follows it, in as few bytes as
+///     possible.
+/// </summary>
+static void WriteHead(CborEncoder *encoder, uint8_t majorType, uint64_t value)
+{
+    uint8_t head[9];
+    size_t valueLength;
+    if (value < 24) {
+        head[0] = (uint8_t)(majorType << 5 | value);
+        valueLength = 0;
+    } else if (value <= UINT8_MAX) {
+        head[0] = (uint8_t)(majorType << 5 | 24);
+        valueLength = 1;
+    } else if (value <= UINT16_MAX) {
+        head[0] = (uint8_t)(majorType << 5 | 25);
+        valueLength = 2;
+    } else if (value <= UINT32_MAX) {
+        head[0] = (uint8_t)(majorType << 5 | 26);
+        valueLength = 4;
+    } else {
+        head[0] = (uint8_t)(majorType << 5 | 27);
+        valueLength = 8;
+    }
+
+    for (size_t i = valueLength; i > 0; --i) {
+        head[i] = (uint8_t)value;
+        value >>= 8;
+    }
+    Write(encoder, head, 1 + valueLength);
+}
+
+static void WriteFloatBits(CborEncoder *encoder, uint8_t initialByte, uint64_t bits,
+                           size_t length)
+{
+    uint8_t bytes[9];
+    bytes[0] = initialByte;
+    for (size_t i = length; i > 0; --i) {
+        bytes[i] = (uint8_t)bits;
+        bits >>= 8;
+    }
+    Write(encoder, bytes, 1 + length);
+}
+
+/// <summary>
+///     Converts a single-precision value to half precision, if that loses nothing.
+/// </summary>
+/// <returns>true if <paramref name="half" /> was set.</returns>
+static bool SingleToHalf(float value, uint16_t *half)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+    int32_t exponent = (int32_t)((bits >> 23) & 0xFF);
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (exponent == 0xFF) {
+        // Infinity; NaN is handled by the caller.
+        *half = (uint16_t)(sign | 0x7C00);
+        return true;
+    }
+    if (exponent == 0) {
+        // Zero, or a single-precision subnormal, which is far below the half-precision range.
+        *half = sign;
+        return mantissa == 0;
+    }
+
+    int32_t halfExponent = exponent - 127 + 15;
+    if (halfExponent >= 31) {
+        return false;
+    }
+    if (halfExponent >= 1) {
+        // Half precision keeps the top 10 of the 23 mantissa bits.
+        if ((mantissa & 0x1FFF) != 0) {
+            return false;
+        }
+        *half = (uint16_t)(sign | (uint32_t)halfExponent << 10 | mantissa >> 13);
+        return true;
+    }
+
+    // A half-precision subnormal is m * 2^-24, for m below 2^10.
+    int32_t shift = 14 - halfExponent;
+    uint32_t significand = mantissa | 0x800000;
+    if (shift > 24 || (significand & ((1u << shift) - 1)) != 0) {
+        return false;
+    }
+    *half = (uint16_t)(sign | significand >> shift);
+    return true;
+}
+
+void CborEncoder_Init(CborEncoder *encoder, uint8_t *buffer, size_t size)
+{
+    encoder->buffer = buffer;
+    encoder->size = size;
+    encoder->length = 0;
+    encoder->overflow = false;
+}
+
+void CborEncoder_StartMap(CborEncoder *encoder, size_t pairCount)
+{
+    if (pairCount == CBOR_ENCODER_INDEFINITE_LENGTH) {
+        uint8_t initialByte = MajorType_Map << 5 | IndefiniteLength;
+        Write(encoder, &initialByte, 1);
+        return;
+    }
+
+    WriteHead(encoder, MajorType_Map, pairCount);
+}
+
+void CborEncoder_StartArray(CborEncoder *encoder, size_t count)
+{
+    if (count == CBOR_ENCODER_INDEFINITE_LENGTH) {
+        uint8_t initialByte = MajorType_Array << 5 | IndefiniteLength;
+        Write(encoder, &initialByte, 1);
+        return;
+    }
+
+    WriteHead(encoder, MajorType_Array, count);
+}
+
+void CborEncoder_EndIndefinite(CborEncoder *encoder)
+{
+    uint8_t initialByte = Simple_Break;
+    Write(encoder, &initialByte, 1);
+}
+
+void CborEncoder_Int(CborEncoder *encoder, int64_t value)
+{
+    if (value >= 0) {
+        WriteHead(encoder, MajorType_UnsignedInt, (uint64_t)value);
+    } else {
+        // -1 - value, which cannot overflow even for INT64_MIN.
+        WriteHead(encoder, MajorType_NegativeInt, (uint64_t)(-(value + 1)));
+    }
+}
+
+void CborEncoder_Float(CborEncoder *encoder, double value)
+{
+    if (isnan(value)) {
+        WriteFloatBits(encoder, Simple_Half, 0x7E00, 2);
+        return;
+    }
+
+    // Converting a double outside the range of float is undefined, so check the range first.
+    if (isinf(value) || (value >= -FLT_MAX && value <= FLT_MAX && (double)(float)value == value)) {
+        float single = (float)value;
+        uint16_t half;
+        if (SingleToHalf(single, &half)) {
+            WriteFloatBits(encoder, Simple_Half, half, 2);
+        } else {
+            uint32_t bits;
+            memcpy(&bits, &single, sizeof(bits));
+            WriteFloatBits(encoder, Simple_Single, bits, 4);
+        }
+        return;
+    }
+
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    WriteFloatBits(encoder, Simple_Double, bits, 8);
+}
+
+void CborEncoder_String(CborEncoder *encoder, const char *string)
+{
+    CborEncoder_StringN(encoder, string, strlen(string));
+}
+
+void CborEncoder_StringN(CborEncoder *encoder, const char *string, size_t length)
+{
+    WriteHead(encoder, MajorType_TextString, length);
+    Write(encoder, (const uint8_t *)string, length);
+}
+
+void CborEncoder_Bool(CborEncoder *encoder, bool value)
+{
+    uint8_t initialByte = value ? Simple_True : Simple_False;
+    Write(encoder, &initialByte, 1);
+}
+
+void CborEncoder_Null(CborEncoder *encoder)
+{
+    uint8_t initialByte = Simple_Null;
+    Write(encoder, &initialByte, 1);
+}
+
+size_t CborEncoder_Finish(const CborEncoder *encoder)
+{
+    return encoder->overflow ? 0 : encoder->length;
+}
@@ -0,0 +1,116 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A streaming CBOR (RFC 8949) encoder which writes into a caller-supplied buffer and does not
+// allocate. Values are written in order: a map of two pairs, for example, is
+// CborEncoder_StartMap(encoder, 2) followed by key, value, key, value. Containers whose size is not
+// known up front may be started with CBOR_ENCODER_INDEFINITE_LENGTH and closed with
+// CborEncoder_EndIndefinite.
+//
+// Integers and floating-point values use the shortest encoding which represents them exactly, so
+// a float which is exactly representable as a half-precision value takes three bytes.
+//
+// Running out of space is sticky: later values are not written, and CborEncoder_Finish reports the
+// failure, so a message can be encoded without checking every call.
+
+/// <summary>
+/// Pass as the count to <see cref="CborEncoder_StartMap" /> or
+/// <see cref="CborEncoder_StartArray" /> for a container closed by
+/// <see cref="CborEncoder_EndIndefinite" />.
+/// </summary>
+#define CBOR_ENCODER_INDEFINITE_LENGTH SIZE_MAX
+
+/// <summary>
+/// Encoder state. Initialize with <see cref="CborEncoder_Init" />. The members are internal and
+/// should not be accessed directly.
+/// </summary>
+typedef struct {
+    uint8_t *buffer;
+    size_t size;
+    size_t length;
+    bool overflow;
+} CborEncoder;
+
+/// <summary>
+/// Initialize an encoder for a new message.
+/// </summary>
+/// <param name="encoder">The encoder.</param>
+/// <param name="buffer">Buffer to encode into.</param>
+/// <param name="size">Size of <paramref name="buffer" /> in bytes.</param>
+void CborEncoder_Init(CborEncoder *encoder, uint8_t *buffer, size_t size);
+
+/// <summary>
+/// Start a map; the next 2 * <paramref name="pairCount" /> values are its keys and values.
+/// </summary>
+/// <param name="encoder">The encoder.</param>
+/// <param name="pairCount">Number of key/value pairs, or CBOR_ENCODER_INDEFINITE_LENGTH.</param>
+void CborEncoder_StartMap(CborEncoder *encoder, size_t pairCount);
+
+/// <summary>
+/// Start an array; the next <paramref name="count" /> values are its elements.
+/// </summary>
+/// <param name="encoder">The encoder.</param>
+/// <param name="count">Number of elements, or CBOR_ENCODER_INDEFINITE_LENGTH.</param>
+void CborEncoder_StartArray(CborEncoder *encoder, size_t count);
+
+/// <summary>
+/// Close the innermost map or array started with CBOR_ENCODER_INDEFINITE_LENGTH.
+/// </summary>
+/// <param name="encoder">The encoder.</param>
+void CborEncoder_EndIndefinite(CborEncoder *encoder);
+
+/// <summary>
+/// Write an integer.
+/// </summary>
+/// <param name="encoder">The encoder.</param>
+/// <param name="value">The integer.</param>
+void CborEncoder_Int(CborEncoder *encoder, int64_t value);
+
+/// <summary>
+/// Write a floating-point value, as half, single or double precision: the shortest which
+/// represents it exactly. Every NaN is written as the half-precision quiet NaN.
+/// </summary>
+/// <param name="encoder">The encoder.</param>
+/// <param name="value">The value.</param>
+void CborEncoder_Float(CborEncoder *encoder, double value);
+
+/// <summary>
+/// Write a NULL-terminated UTF-8 text string.
+/// </summary>
+/// <param name="encoder">The encoder.</param>
+/// <param name="string">The string.</param>
+void CborEncoder_String(CborEncoder *encoder, const char *string);
+
+/// <summary>
+/// Write a UTF-8 text string of the given length.
+/// </summary>
+/// <param name="encoder">The encoder.</param>
+/// <param name="string">The string, which need not be NULL-terminated.</param>
+/// <param name="length">Length of the string in bytes.</param>
+void CborEncoder_StringN(CborEncoder *encoder, const char *string, size_t length);
+
+/// <summary>
+/// Write a boolean.
+/// </summary>
+/// <param name="encoder">The encoder.</param>
+/// <param name="value">The value.</param>
+void CborEncoder_Bool(CborEncoder *encoder, bool value);
+
+/// <summary>
+/// Write null.
+/// </summary>
+/// <param name="encoder">The encoder.</param>
+void CborEncoder_Null(CborEncoder *encoder);
+
+/// <summary>
+/// Get the length of the encoded message.
+/// </summary>
+/// <param name="encoder">The encoder.</param>
+/// <returns>The number of bytes written to the buffer, or 0 if it was too small.</returns>
+size_t CborEncoder_Finish(const CborEncoder *encoder);
@@ -12,8 +12,16 @@
 #include "parson.h"
 
 #include "azure_iot.h"
+#include "cbor_encoder.h"
+#include "device_methods.h"
+#include "eventloop_timer_utilities.h"
+#include "json_arena.h"
+#include "json_stream.h"
 #include "cloud.h"
 #include "exitcodes.h"
+#include "mutable_storage_layout.h"
+#include "telemetry_queue.h"
+#include "utc_timestamp.h"
 
 // This file implements the interface described in cloud.h in terms of an Azure IoT Hub.
 // Specifically, it translates Azure IoT Hub specific concepts (events, device twin messages, device
@@ -23,12 +31,19 @@
 static const char azureSphereModelId[] = "dtmi:com:example:azuresphere:thermometer;1";
 
 // Azure IoT Hub callback handlers
-static void DeviceTwinCallbackHandler(const char *nullTerminatedJsonString);
+static void DeviceTwinCallbackHandler(const unsigned char *payload, size_t payloadSize);
+static void DesiredTelemetryUploadEnabledHandler(const char *path, const JsonStream_Value *value,
+                                                 void *context);
+static void DesiredVersionHandler(const char *path, const JsonStream_Value *value, void *context);
 static void DeviceTwinReportStateAckCallbackTypeHandler(bool success, void *context);
-static int DeviceMethodCallbackHandler(const char *methodName, const unsigned char *payload,
-                                       size_t payloadSize, unsigned char **response,
-                                       size_t *responseSize);
+static int DisplayAlertMethodHandler(const unsigned char *payload, size_t payloadSize,
+                                     const char **response, size_t *responseSize,
+                                     void *context);
+static void SendTelemetryCallbackHandler(bool success, void *context);
 static void ConnectionChangedCallbackHandler(bool connected);
+static void BatchedTelemetryUnsentCallbackHandler(const char *jsonReading,
+                                                  const char *utcDateTime);
+static void TelemetryDrainTimerEventHandler(EventLoopTimer *timer);
 
 // Default handlers for cloud events
 static void DefaultTelemetryUploadEnabledChangedHandler(bool uploadEnabled, bool fromCloud);
@@ -45,15 +60,84 @@ static Cloud_ConnectionChangedCallbackType connectionChangedCallbackFunction =
 
 // Utility functions
 static Cloud_Result AzureIoTToCloudResult(AzureIoT_Result result);
-static bool BuildUtcDateTimeString(char *outputBuffer, size_t outputBufferSize, time_t t);
+static const char *BuildUtcDateTimeString(time_t t);
+static const char *SerializeOutgoingMessage(const JSON_Value *value, char **allocatedMessage);
+static Cloud_Result SendOrQueueTelemetry(const char *jsonMessage, const char *utcDateTime,
+                                         bool batched);
+static void CompleteTelemetryDrainBurst(void);
 
 // Constants
-#define MAX_PAYLOAD_SIZE 512
 #define DATETIME_BUFFER_SIZE 128
+#define JSON_ARENA_SIZE 2048
+#define MESSAGE_BUFFER_SIZE 1024
+// Temperatures are reported to hundredths of a degree rather than every digit of the float.
+#define TEMPERATURE_DECIMALS 2
+#define CBOR_MESSAGE_BUFFER_SIZE 64
+static const char CborContentType[] = "application/cbor";
+// Telemetry which cannot be sent while the device is offline is queued in its region of mutable
+// storage (see mutable_storage_layout.h), and sent in bursts of TELEMETRY_DRAIN_BURST messages once
+// the connection is back.
+#define TELEMETRY_QUEUE_DROP_POLICY TelemetryQueue_DropPolicy_DropOldest
+// The queue's header is written once every TELEMETRY_QUEUE_FLUSH_INTERVAL queued messages rather
+// than for each one, so a crash or power loss while offline loses at most the last
+// TELEMETRY_QUEUE_FLUSH_INTERVAL - 1 of them; Cloud_Cleanup writes it on a normal exit.
+#define TELEMETRY_QUEUE_FLUSH_INTERVAL 8
+#define TELEMETRY_DRAIN_BURST 8
+static const struct timespec TelemetryDrainInterval = {.tv_sec = 0, .tv_nsec = 250 * 1000 * 1000};
+// Temperature readings are sent in batches of up to this many bytes, or once the oldest reading in
+// the batch is this old. Events, such as the thermometer being moved, are not batched.
+#define TELEMETRY_BATCH_MAX_BYTES 1024
+static const struct timespec TelemetryBatchMaxAge = {.tv_sec = 60, .tv_nsec = 0};
+// At most this many telemetry messages await confirmation from the IoT Hub, so that a slow uplink
+// cannot grow the SDK's queue without bound. Up to TELEMETRY_WINDOW_MAX_DEFERRED more are held
+// until there is room, and after that sending telemetry fails with Cloud_Result_Busy.
+#define TELEMETRY_WINDOW_MAX_IN_FLIGHT 8
+#define TELEMETRY_WINDOW_MAX_DEFERRED 16
 
 // State
 static unsigned int lastAckedVersion = 0;
 static char dateTimeBuffer[DATETIME_BUFFER_SIZE];
+static UtcTimestamp utcTimestamp;
+static bool isCloudConnected = false;
+static ExitCode_CallbackType failureCallbackFunction = NULL;
+
+// Queued telemetry, and the state of the burst of it currently being sent. Messages are only
+// removed from the queue once the IoT Hub has acknowledged the whole burst, so a message may be
+// sent more than once, but is not lost.
+static TelemetryQueue telemetryQueue = {.fd = -1};
+static EventLoopTimer *telemetryDrainTimer = NULL;
+static int queuedTelemetryContext; // Address passed as the context of queued telemetry sends.
+static size_t drainInFlight = 0;
+static size_t drainAcknowledged = 0;
+static bool drainBurstFailed = false;
+static uint32_t droppedBeforeDrainBurst = 0;
+
+// Drain rate of the most recent recovery, from reconnection until the queue was empty.
+static struct timespec drainStartTime;
+static unsigned long drainedSinceReconnect = 0;
+static unsigned long lastDrainCount = 0;
+static unsigned long lastDrainMilliseconds = 0;
+
+// Desired properties read from a device twin message. The complete twin nests them under
+// "desired", whereas a desired property update has them at the root.
+typedef struct {
+    int thermometerTelemetryUploadEnabled; // -1 if absent
+    unsigned int desiredVersion;
+} DesiredProperties;
+
+static const JsonStream_PathHandler desiredPropertyHandlers[] = {
+    {"desired.thermometerTelemetryUploadEnabled", DesiredTelemetryUploadEnabledHandler},
+    {"desired.$version", DesiredVersionHandler},
+    {"thermometerTelemetryUploadEnabled", DesiredTelemetryUploadEnabledHandler},
+    {"$version", DesiredVersionHandler}};
+
+// Outgoing messages are built, serialized and freed in this arena rather than on the heap.
+static unsigned char jsonArenaBuffer[JSON_ARENA_SIZE];
+static JsonArena jsonArena;
+
+// Outgoing messages are serialized into this buffer; the Azure IoT SDK copies them before
+// AzureIoT_SendTelemetry and AzureIoT_DeviceTwinReportState return.
+static char messageBuffer[MESSAGE_BUFFER_SIZE];
 
 ExitCode Cloud_Initialize(EventLoop *el, void *backendContext,
                           ExitCode_CallbackType failureCallback,
@@ -75,19 +159,112 @@ ExitCode Cloud_Initialize(EventLoop *el, void *backendContext,
         connectionChangedCallbackFunction = connectionChangedCallback;
     }
 
+    JsonArena_Init(&jsonArena, jsonArenaBuffer, sizeof(jsonArenaBuffer));
+    UtcTimestamp_Init(&utcTimestamp);
+
+    failureCallbackFunction = failureCallback;
+    if (!TelemetryQueue_Open(&telemetryQueue, TELEMETRY_QUEUE_STORAGE_OFFSET,
+                             TELEMETRY_QUEUE_REGION_SIZE, TELEMETRY_QUEUE_DROP_POLICY,
+                             MESSAGE_BUFFER_SIZE - 1)) {
+        Log_Debug("WARNING: Telemetry will not be queued while offline.\n");
+    }
+    TelemetryQueue_SetFlushInterval(&telemetryQueue, TELEMETRY_QUEUE_FLUSH_INTERVAL);
+
+    telemetryDrainTimer = CreateEventLoopDisarmedTimer(el, &TelemetryDrainTimerEventHandler);
+    if (telemetryDrainTimer == NULL) {
+        return ExitCode_Init_TelemetryDrainTimer;
+    }
+    SetEventLoopTimerName(telemetryDrainTimer, "TelemetryDrain");
+
+    if (!DeviceMethods_Register("displayAlert", DisplayAlertMethodHandler, NULL)) {
+        return ExitCode_Init_DeviceMethods;
+    }
+
     AzureIoT_Callbacks callbacks = {
         .connectionStatusCallbackFunction = ConnectionChangedCallbackHandler,
-        .deviceTwinReceivedCallbackFunction = DeviceTwinCallbackHandler,
+        .deviceTwinPayloadReceivedCallbackFunction = DeviceTwinCallbackHandler,
         .deviceTwinReportStateAckCallbackTypeFunction = DeviceTwinReportStateAckCallbackTypeHandler,
-        .sendTelemetryCallbackFunction = NULL,
-        .deviceMethodCallbackFunction = DeviceMethodCallbackHandler};
+        .sendTelemetryCallbackFunction = SendTelemetryCallbackHandler,
+        .deviceMethodCallbackFunction = DeviceMethods_Dispatch,
+        .batchedTelemetryUnsentCallbackFunction = BatchedTelemetryUnsentCallbackHandler};
+
+    ExitCode exitCode =
+        AzureIoT_Initialize(el, failureCallback, azureSphereModelId, backendContext, callbacks);
+    if (exitCode != ExitCode_Success) {
+        return exitCode;
+    }
+
+    AzureIoT_SetTelemetryWindow(TELEMETRY_WINDOW_MAX_IN_FLIGHT, TELEMETRY_WINDOW_MAX_DEFERRED);
+
+    if (!AzureIoT_ConfigureTelemetryBatching(TELEMETRY_BATCH_MAX_BYTES, &TelemetryBatchMaxAge)) {
+        Log_Debug("WARNING: Telemetry readings will be sent individually.\n");
+    }
 
-    return AzureIoT_Initialize(el, failureCallback, azureSphereModelId, backendContext, callbacks);
+    // Only wake up for the Azure IoT SDK when there is something to send or receive.
+    AzureIoT_SetDoWorkPolicy(AzureIoT_DoWorkPolicy_Adaptive);
+
+    return ExitCode_Success;
 }
 
 void Cloud_Cleanup(void)
 {
     AzureIoT_Cleanup();
+    DisposeEventLoopTimer(telemetryDrainTimer);
+
+    TelemetryQueue_Close(&telemetryQueue);
+    Log_Debug("INFO: Telemetry queue: %u messages held, %lu queued, %lu sent, %u dropped, peak %u, "
+              "%lu header writes; last recovery sent %lu messages in %lu ms.\n",
+              telemetryQueue.count, telemetryQueue.enqueued, telemetryQueue.dequeued,
+              telemetryQueue.dropped, telemetryQueue.peakCount, telemetryQueue.headerWrites,
+              lastDrainCount, lastDrainMilliseconds);
+
+    DeviceMethods_Stats methodStats;
+    DeviceMethods_GetStats(&methodStats);
+    Log_Debug("INFO: Direct methods: %zu registered; %lu invocations, %lu unknown; buffers %zu "
+              "and %zu bytes after %lu growths.\n",
+              methodStats.methodCount, methodStats.invocations, methodStats.unknownInvocations,
+              methodStats.payloadBufferSize, methodStats.responseBufferSize,
+              methodStats.bufferGrowths);
+    DeviceMethods_Cleanup();
+
+    AzureIoT_TelemetryBatchStats batchStats;
+    AzureIoT_GetTelemetryBatchStats(&batchStats);
+    Log_Debug("INFO: Telemetry batches: %lu readings in %lu messages (%lu full), %lu bytes; %lu "
+              "readings queued unsent.\n",
+              batchStats.readingsBatched, batchStats.batchesSent, batchStats.batchesSentFull,
+              batchStats.bytesSent, batchStats.readingsUnsent);
+
+    AzureIoT_ConnectionStats connectionStats;
+    AzureIoT_GetConnectionStats(&connectionStats);
+    Log_Debug("INFO: Azure IoT connection: %lu attempts, %lu connected (mean %lu ms, max %lu ms), "
+              "%lu failed, %lu lost; last retry delay %lu ms.\n",
+              connectionStats.connectAttempts, connectionStats.connects,
+              connectionStats.connects > 0
+                  ? connectionStats.totalConnectLatencyMs / connectionStats.connects
+                  : 0,
+              connectionStats.maxConnectLatencyMs, connectionStats.connectFailures,
+              connectionStats.disconnects, connectionStats.lastRetryDelayMs);
+
+    AzureIoT_DoWorkStats doWorkStats;
+    AzureIoT_GetDoWorkStats(&doWorkStats);
+    Log_Debug("INFO: Azure IoT DoWork: %lu calls; %lu confirmations, mean %lu ms, max %lu ms.\n",
+              doWorkStats.doWorkCalls, doWorkStats.confirmations,
+              doWorkStats.confirmations > 0
+                  ? doWorkStats.totalConfirmLatencyMs / doWorkStats.confirmations
+                  : 0,
+              doWorkStats.maxConfirmLatencyMs);
+
+    AzureIoT_TelemetryWindowStats windowStats;
+    AzureIoT_GetTelemetryWindowStats(&windowStats);
+    Log_Debug("INFO: Telemetry window: peak %u in flight, peak %u deferred; %lu deferred, %lu "
+              "refused as busy; confirmed in p50 %lu ms, p99 %lu ms.\n",
+              windowStats.peakInFlight, windowStats.peakDeferred, windowStats.deferredSends,
+              windowStats.busyRejections, windowStats.latencyP50Ms, windowStats.latencyP99Ms);
+
+    Log_Debug("INFO: JSON arena: %zu messages, %zu allocations, %zu heap fallbacks, peak %zu of "
+              "%zu bytes.\n",
+              jsonArena.scopeCount, jsonArena.allocationCount, jsonArena.fallbackCount,
+              jsonArena.peakUsed, jsonArena.size);
 }
 
 static Cloud_Result AzureIoTToCloudResult(AzureIoT_Result result)
@@ -97,6 +274,8 @@ static Cloud_Result AzureIoTToCloudResult(AzureIoT_Result result)
         return Cloud_Result_OK;
     case AzureIoT_Result_NoNetwork:
         return Cloud_Result_NoNetwork;
+    case AzureIoT_Result_Busy:
+        return Cloud_Result_Busy;
     case AzureIoT_Result_OtherFailure:
     default:
         return Cloud_Result_OtherFailure;
@@ -105,49 +284,78 @@ static Cloud_Result AzureIoTToCloudResult(AzureIoT_Result result)
 
 Cloud_Result Cloud_SendTelemetry(const Cloud_Telemetry *telemetry, time_t timestamp)
 {
-    char *utcDateTime = NULL;
-    if (timestamp != -1) {
-        BuildUtcDateTimeString(dateTimeBuffer, sizeof(dateTimeBuffer), timestamp);
-        utcDateTime = dateTimeBuffer;
-    }
+    const char *utcDateTime = BuildUtcDateTimeString(timestamp);
+
+    bool inArena = JsonArena_Begin(&jsonArena);
 
     JSON_Value *telemetryValue = json_value_init_object();
     JSON_Object *telemetryRoot = json_value_get_object(telemetryValue);
-    json_object_dotset_number(telemetryRoot, "temperature", telemetry->temperature);
-    char *serializedTelemetry = json_serialize_to_string(telemetryValue);
-    AzureIoT_Result aziotResult = AzureIoT_SendTelemetry(serializedTelemetry, utcDateTime, NULL);
-    Cloud_Result result = AzureIoTToCloudResult(aziotResult);
+    json_object_dotset_number_fixed(telemetryRoot, "temperature", telemetry->temperature,
+                                    TEMPERATURE_DECIMALS);
+    char *allocatedMessage = NULL;
+    const char *serializedTelemetry = SerializeOutgoingMessage(telemetryValue, &allocatedMessage);
+    Cloud_Result result = SendOrQueueTelemetry(serializedTelemetry, utcDateTime, true);
 
-    json_free_serialized_string(serializedTelemetry);
+    json_free_serialized_string(allocatedMessage);
     json_value_free(telemetryValue);
 
+    if (inArena) {
+        JsonArena_End(&jsonArena);
+    }
+
     return result;
 }
 
-Cloud_Result Cloud_SendThermometerMovedEvent(time_t timestamp)
+Cloud_Result Cloud_SendTelemetryBinary(const Cloud_Telemetry *telemetry, time_t timestamp)
 {
-    char *utcDateTime = NULL;
-    if (timestamp != -1) {
-        BuildUtcDateTimeString(dateTimeBuffer, sizeof(dateTimeBuffer), timestamp);
-        utcDateTime = dateTimeBuffer;
+    const char *utcDateTime = BuildUtcDateTimeString(timestamp);
+
+    // The temperature is a float, so it is sent as one: exactly, in at most 4 bytes.
+    uint8_t message[CBOR_MESSAGE_BUFFER_SIZE];
+    CborEncoder encoder;
+    CborEncoder_Init(&encoder, message, sizeof(message));
+    CborEncoder_StartMap(&encoder, 1);
+    CborEncoder_String(&encoder, "temperature");
+    CborEncoder_Float(&encoder, telemetry->temperature);
+    size_t length = CborEncoder_Finish(&encoder);
+    if (length == 0) {
+        Log_Debug("ERROR: Telemetry does not fit in the CBOR message buffer.\n");
+        return Cloud_Result_OtherFailure;
     }
 
+    return AzureIoTToCloudResult(
+        AzureIoT_SendBinaryTelemetry(message, length, CborContentType, utcDateTime, NULL));
+}
+
+Cloud_Result Cloud_SendThermometerMovedEvent(time_t timestamp)
+{
+    const char *utcDateTime = BuildUtcDateTimeString(timestamp);
+
+    bool inArena = JsonArena_Begin(&jsonArena);
+
     JSON_Value *thermometerMovedValue = json_value_init_object();
     JSON_Object *thermometerMovedRoot = json_value_get_object(thermometerMovedValue);
     json_object_dotset_boolean(thermometerMovedRoot, "thermometerMoved", 1);
-    char *serializedDeviceMoved = json_serialize_to_string(thermometerMovedValue);
-    AzureIoT_Result aziotResult = AzureIoT_SendTelemetry(serializedDeviceMoved, utcDateTime, NULL);
-    Cloud_Result result = AzureIoTToCloudResult(aziotResult);
+    char *allocatedMessage = NULL;
+    const char *serializedDeviceMoved =
+        SerializeOutgoingMessage(thermometerMovedValue, &allocatedMessage);
+    Cloud_Result result = SendOrQueueTelemetry(serializedDeviceMoved, utcDateTime, false);
 
-    json_free_serialized_string(serializedDeviceMoved);
+    json_free_serialized_string(allocatedMessage);
     json_value_free(thermometerMovedValue);
 
+    if (inArena) {
+        JsonArena_End(&jsonArena);
+    }
+
     return result;
 }
 
 Cloud_Result Cloud_SendThermometerTelemetryUploadEnabledChangedEvent(bool uploadEnabled,
                                                                      bool fromCloud)
 {
+    bool inArena = JsonArena_Begin(&jsonArena);
+
     JSON_Value *thermometerTelemetryUploadValue = json_value_init_object();
     JSON_Object *thermometerTelemetryUploadRoot =
         json_value_get_object(thermometerTelemetryUploadValue);
@@ -177,50 +385,189 @@ Cloud_Result Cloud_SendThermometerTelemetryUploadEnabledChangedEvent(bool upload
         "thermometerTelemetryUploadEnabled.ad", // ackDescription
         fromCloud ? "Updated from Device Twin's desired value." : "Updated locally on the device.");
 
-    char *serializedTelemetryUpload = json_serialize_to_string(thermometerTelemetryUploadValue);
+    char *allocatedMessage = NULL;
+    const char *serializedTelemetryUpload =
+        SerializeOutgoingMessage(thermometerTelemetryUploadValue, &allocatedMessage);
     AzureIoT_Result aziotResult = AzureIoT_DeviceTwinReportState(serializedTelemetryUpload, NULL);
     Cloud_Result result = AzureIoTToCloudResult(aziotResult);
 
-    json_free_serialized_string(serializedTelemetryUpload);
+    json_free_serialized_string(allocatedMessage);
     json_value_free(thermometerTelemetryUploadValue);
 
+    if (inArena) {
+        JsonArena_End(&jsonArena);
+    }
+
     return result;
 }
 
 Cloud_Result Cloud_SendDeviceDetails(const char *serialNumber)
 {
     // Send static device twin properties when connection is established.
+    bool inArena = JsonArena_Begin(&jsonArena);
+
     JSON_Value *deviceDetailsValue = json_value_init_object();
     JSON_Object *deviceDetailsRoot = json_value_get_object(deviceDetailsValue);
     json_object_dotset_string(deviceDetailsRoot, "serialNumber", serialNumber);
-    char *serializedDeviceDetails = json_serialize_to_string(deviceDetailsValue);
+    char *allocatedMessage = NULL;
+    const char *serializedDeviceDetails =
+        SerializeOutgoingMessage(deviceDetailsValue, &allocatedMessage);
     AzureIoT_Result aziotResult = AzureIoT_DeviceTwinReportState(serializedDeviceDetails, NULL);
     Cloud_Result result = AzureIoTToCloudResult(aziotResult);
 
-    json_free_serialized_string(serializedDeviceDetails);
+    json_free_serialized_string(allocatedMessage);
     json_value_free(deviceDetailsValue);
 
+    if (inArena) {
+        JsonArena_End(&jsonArena);
+    }
+
     return result;
 }
 
-static bool BuildUtcDateTimeString(char *outputBuffer, size_t outputBufferSize, time_t t)
+/// <summary>
+///     Serializes an outgoing message into messageBuffer, or onto the heap if it does not fit.
+/// </summary>
+/// <param name="value">The JSON value to serialize.</param>
+/// <param name="allocatedMessage">Receives the heap copy, which the caller must free with
+///     json_free_serialized_string, or NULL if messageBuffer was used.</param>
+/// <returns>The serialized message, or NULL on failure.</returns>
+static const char *SerializeOutgoingMessage(const JSON_Value *value, char **allocatedMessage)
 {
-    // Format string to create an ISO 8601 time.  This corresponds to the DTDL datetime schema item.
-    static const char *ISO8601Format = "%Y-%m-%dT%H:%M:%SZ";
+    *allocatedMessage = NULL;
+    if (json_serialize_to_buffer_n(value, messageBuffer, sizeof(messageBuffer), NULL) ==
+        JSONSuccess) {
+        return messageBuffer;
+    }
 
-    bool result;
+    *allocatedMessage = json_serialize_to_string(value);
+    return *allocatedMessage;
+}
 
-    struct tm *currentTimeTm;
-    currentTimeTm = gmtime(&t);
+/// <summary>
+///     Sends telemetry to the IoT Hub or, if the device is offline, queues it to be sent once the
+///     device is connected again.
+/// </summary>
+/// <param name="jsonMessage">The telemetry to send.</param>
+/// <param name="utcDateTime">Timestamp of the telemetry, or NULL.</param>
+/// <param name="batched">Whether the telemetry may be batched with other readings.</param>
+/// <returns>Cloud_Result_OK if the telemetry was sent or queued.</returns>
+static Cloud_Result SendOrQueueTelemetry(const char *jsonMessage, const char *utcDateTime,
+                                         bool batched)
+{
+    if (jsonMessage == NULL) {
+        return Cloud_Result_OtherFailure;
+    }
 
-    if (strftime(outputBuffer, outputBufferSize, ISO8601Format, currentTimeTm) == 0) {
-        Log_Debug("ERROR: strftime: %s (%d)\n", errno, strerror(errno));
-        result = false;
-    } else {
-        result = true;
+    AzureIoT_Result aziotResult = batched
+                                      ? AzureIoT_SendBatchedTelemetry(jsonMessage, utcDateTime)
+                                      : AzureIoT_SendTelemetry(jsonMessage, utcDateTime, NULL);
+    if (aziotResult == AzureIoT_Result_OK || isCloudConnected) {
+        return AzureIoTToCloudResult(aziotResult);
     }
 
-    return result;
+    if (!TelemetryQueue_Push(&telemetryQueue, jsonMessage, utcDateTime)) {
+        return AzureIoTToCloudResult(aziotResult);
+    }
+
+    Log_Debug("INFO: Offline; queued telemetry (%u messages queued).\n", telemetryQueue.count);
+    return Cloud_Result_OK;
+}
+
+/// <summary>
+///     Telemetry drain timer event: send the next burst of queued telemetry.
+/// </summary>
+static void TelemetryDrainTimerEventHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        failureCallbackFunction(ExitCode_TelemetryDrainTimer_Consume);
+        return;
+    }
+
+    if (!isCloudConnected || drainInFlight > 0) {
+        return;
+    }
+
+    drainAcknowledged = 0;
+    drainBurstFailed = false;
+    droppedBeforeDrainBurst = telemetryQueue.dropped;
+
+    TelemetryQueue_Cursor cursor;
+    TelemetryQueue_StartRead(&telemetryQueue, &cursor);
+    while (drainInFlight < TELEMETRY_DRAIN_BURST && cursor.remaining > 0) {
+        if (!TelemetryQueue_Read(&telemetryQueue, &cursor, messageBuffer, sizeof(messageBuffer),
+                                 dateTimeBuffer, sizeof(dateTimeBuffer))) {
+            // A message which cannot be read now never will be, so once it reaches the front of
+            // the queue, drop it rather than retry it forever.
+            if (drainInFlight > 0 || !TelemetryQueue_Discard(&telemetryQueue)) {
+                break;
+            }
+            Log_Debug("WARNING: Dropped a queued telemetry message which could not be read.\n");
+            droppedBeforeDrainBurst = telemetryQueue.dropped;
+            TelemetryQueue_StartRead(&telemetryQueue, &cursor);
+            continue;
+        }
+
+        const char *utcDateTime = dateTimeBuffer[0] != '\0' ? dateTimeBuffer : NULL;
+        if (AzureIoT_SendTelemetry(messageBuffer, utcDateTime, &queuedTelemetryContext) !=
+            AzureIoT_Result_OK) {
+            break;
+        }
+        ++drainInFlight;
+    }
+
+    if (drainInFlight == 0 && telemetryQueue.count > 0) {
+        // Nothing could be sent; try again later.
+        SetEventLoopTimerOneShot(telemetryDrainTimer, &TelemetryDrainInterval);
+    }
+}
+
+/// <summary>
+///     Called when every message of a drain burst has been acknowledged or has failed.
+/// </summary>
+static void CompleteTelemetryDrainBurst(void)
+{
+    if (!drainBurstFailed) {
+        // Messages dropped from the front of the queue while the burst was in flight were part of
+        // the burst, and are already gone.
+        uint32_t droppedDuringBurst = telemetryQueue.dropped - droppedBeforeDrainBurst;
+        size_t sent = drainAcknowledged > droppedDuringBurst ? drainAcknowledged - droppedDuringBurst
+                                                             : 0;
+        TelemetryQueue_Pop(&telemetryQueue, sent);
+        drainedSinceReconnect += drainAcknowledged;
+    }
+
+    if (telemetryQueue.count > 0) {
+        SetEventLoopTimerOneShot(telemetryDrainTimer, &TelemetryDrainInterval);
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    lastDrainCount = drainedSinceReconnect;
+    lastDrainMilliseconds = (unsigned long)((now.tv_sec - drainStartTime.tv_sec) * 1000 +
+                                            (now.tv_nsec - drainStartTime.tv_nsec) / 1000000);
+    Log_Debug("INFO: Sent %lu queued telemetry messages in %lu ms (%.1f messages/s).\n",
+              lastDrainCount, lastDrainMilliseconds,
+              lastDrainMilliseconds > 0 ? lastDrainCount * 1000.0 / lastDrainMilliseconds : 0.0);
+}
+
+/// <summary>
+///     Formats a time as an ISO 8601 UTC time, which corresponds to the DTDL datetime schema item.
+/// </summary>
+/// <param name="t">The time, or (time_t) -1 for none.</param>
+/// <returns>The formatted time, which is valid until the next call, or NULL.</returns>
+static const char *BuildUtcDateTimeString(time_t t)
+{
+    if (t == -1) {
+        return NULL;
+    }
+
+    const char *utcDateTime = UtcTimestamp_Format(&utcTimestamp, t);
+    if (utcDateTime == NULL) {
+        Log_Debug("ERROR: Cannot format time %lld as UTC.\n", (long long)t);
+    }
+    return utcDateTime;
 }
 
 static void DefaultTelemetryUploadEnabledChangedHandler(bool uploadEnabled, bool fromCloud)
@@ -243,55 +590,102 @@ static void DefaultConnectionChangedHandler(bool connected)
               connected ? "true" : "false");
 }
 
+static void SendTelemetryCallbackHandler(bool success, void *context)
+{
+    if (context != &queuedTelemetryContext || drainInFlight == 0) {
+        return;
+    }
+
+    if (success) {
+        ++drainAcknowledged;
+    } else {
+        drainBurstFailed = true;
+    }
+
+    if (--drainInFlight == 0) {
+        CompleteTelemetryDrainBurst();
+    }
+}
+
 static void ConnectionChangedCallbackHandler(bool connected)
 {
+    isCloudConnected = connected;
+
+    if (connected && telemetryQueue.count > 0) {
+        // A burst which was in flight when the connection dropped has been failed by the Azure IoT
+        // SDK, and will be sent again.
+        drainedSinceReconnect = 0;
+        clock_gettime(CLOCK_MONOTONIC, &drainStartTime);
+        Log_Debug("INFO: Sending %u queued telemetry messages.\n", telemetryQueue.count);
+        SetEventLoopTimerOneShot(telemetryDrainTimer, &TelemetryDrainInterval);
+    }
+
     connectionChangedCallbackFunction(connected);
 }
 
-static void DeviceTwinCallbackHandler(const char *nullTerminatedJsonString)
+/// <summary>
+///     Keeps a batched reading which the Azure IoT module could not send in the telemetry queue,
+///     so that it survives until it can be sent, as telemetry sent while offline does.
+/// </summary>
+static void BatchedTelemetryUnsentCallbackHandler(const char *jsonReading, const char *utcDateTime)
 {
-    JSON_Value *rootProperties = NULL;
-    rootProperties = json_parse_string(nullTerminatedJsonString);
-    if (rootProperties == NULL) {
-        Log_Debug("WARNING: Cannot parse the string as JSON content.\n");
-        goto cleanup;
+    if (!TelemetryQueue_Push(&telemetryQueue, jsonReading, utcDateTime)) {
+        Log_Debug("WARNING: Could not queue an unsent telemetry reading.\n");
+        return;
     }
 
-    JSON_Object *rootObject = json_value_get_object(rootProperties);
-    JSON_Object *desiredProperties = json_object_dotget_object(rootObject, "desired");
-    if (desiredProperties == NULL) {
-        desiredProperties = rootObject;
+    if (isCloudConnected && drainInFlight == 0) {
+        SetEventLoopTimerOneShot(telemetryDrainTimer, &TelemetryDrainInterval);
     }
+}
 
-    // If we have a desired property for the "thermometerTelemetryUploadEnabled" property, let's
-    // process it.
-    if (rootObject != NULL) {
-
-        int thermometerTelemetryUploadEnabledValue =
-            json_object_dotget_boolean(desiredProperties, "thermometerTelemetryUploadEnabled");
-
-        if (thermometerTelemetryUploadEnabledValue != -1) {
+static void DesiredTelemetryUploadEnabledHandler(const char *path, const JsonStream_Value *value,
+                                                 void *context)
+{
+    DesiredProperties *desired = context;
+    if (value->type == JsonStream_ValueType_Boolean) {
+        desired->thermometerTelemetryUploadEnabled = value->boolean ? 1 : 0;
+    }
+}
 
-            unsigned int desiredVersion =
-                (unsigned int)json_object_dotget_number(desiredProperties, "$version");
+static void DesiredVersionHandler(const char *path, const JsonStream_Value *value, void *context)
+{
+    DesiredProperties *desired = context;
+    if (value->type == JsonStream_ValueType_Number) {
+        desired->desiredVersion = (unsigned int)value->number;
+    }
+}
 
-            // If there is a desired property change (including at boot, restart and
-            // reconnection), the device should implement the logic that decides whether it has
-            // to be applied or not. In this sample, we model this logic as an always-true
-            // clause, just as a place holder for an actual logic (if any needed).
-            if (1) {
+static void DeviceTwinCallbackHandler(const unsigned char *payload, size_t payloadSize)
+{
+    // The device twin is streamed rather than parsed into a JSON_Value, so that only the
+    // properties of interest are extracted, without allocating.
+    DesiredProperties desired = {.thermometerTelemetryUploadEnabled = -1, .desiredVersion = 0};
+    JsonStream_Result parseResult =
+        JsonStream_Parse((const char *)payload, payloadSize, desiredPropertyHandlers,
+                         sizeof(desiredPropertyHandlers) / sizeof(desiredPropertyHandlers[0]),
+                         NULL, 0, &desired);
+    if (parseResult != JsonStream_Result_OK) {
+        Log_Debug("WARNING: Cannot parse the string as JSON content.\n");
+        return;
+    }
 
-                // If accepted, the device must ack the desired version number.
-                lastAckedVersion = desiredVersion;
-                thermometerTelemetryUploadEnabledChangedCallbackFunction(
-                    thermometerTelemetryUploadEnabledValue == 1, true);
-            }
+    // If we have a desired property for the "thermometerTelemetryUploadEnabled" property, let's
+    // process it.
+    if (desired.thermometerTelemetryUploadEnabled != -1) {
+
+        // If there is a desired property change (including at boot, restart and
+        // reconnection), the device should implement the logic that decides whether it has
+        // to be applied or not. In this sample, we model this logic as an always-true
+        // clause, just as a place holder for an actual logic (if any needed).
+        if (1) {
+
+            // If accepted, the device must ack the desired version number.
+            lastAckedVersion = desired.desiredVersion;
+            thermometerTelemetryUploadEnabledChangedCallbackFunction(
+                desired.thermometerTelemetryUploadEnabled == 1, true);
         }
     }
-
-cleanup:
-    // Release the allocated memory.
-    json_value_free(rootProperties);
 }
 
 static void DeviceTwinReportStateAckCallbackTypeHandler(bool success, void *context)
@@ -303,36 +697,20 @@ static void DeviceTwinReportStateAckCallbackTypeHandler(bool success, void *cont
     }
 }
 
-static int DeviceMethodCallbackHandler(const char *methodName, const unsigned char *payload,
-                                       size_t payloadSize, unsigned char **response,
-                                       size_t *responseSize)
+static int DisplayAlertMethodHandler(const unsigned char *payload, size_t payloadSize,
+                                     const char **response, size_t *responseSize,
+                                     void *context)
 {
-    int result;
-    char *responseString;
-    static char nullTerminatedPayload[MAX_PAYLOAD_SIZE + 1];
-
-    size_t actualPayloadSize = payloadSize > MAX_PAYLOAD_SIZE ? MAX_PAYLOAD_SIZE : payloadSize;
-
-    strncpy(nullTerminatedPayload, payload, actualPayloadSize);
-    nullTerminatedPayload[actualPayloadSize] = '\0';
-
-    if (strcmp("displayAlert", methodName) == 0) {
-
-        displayAlertCallbackFunction(nullTerminatedPayload);
-
-        responseString =
-            "\"Alert message displayed successfully.\""; // must be a JSON string (in quotes)
-        result = 200;
-    } else {
-        // All other method names are ignored
-        responseString = "{}";
-        result = -1;
+    char *alertMessage = DeviceMethods_CopyPayload(payload, payloadSize);
+    if (alertMessage == NULL) {
+        *response = "\"Alert message could not be displayed.\"";
+        *responseSize = strlen(*response);
+        return 500;
     }
 
-    // if 'response' is non-NULL, the Azure IoT library frees it after use, so copy it to heap
-    *responseSize = strlen(responseString);
-    *response = malloc(*responseSize);
-    memcpy(*response, responseString, *responseSize);
+    displayAlertCallbackFunction(alertMessage);
 
-    return result;
+    *response = "\"Alert message displayed successfully.\""; // must be a JSON string (in quotes)
+    *responseSize = strlen(*response);
+    return 200;
 }
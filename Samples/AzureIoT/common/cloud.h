@@ -58,7 +58,12 @@ typedef enum {
     /// <summary>
     /// The operation failed for another reason not explicitly listed
     /// </summary>
-    Cloud_Result_OtherFailure
+    Cloud_Result_OtherFailure,
+
+    /// <summary>
+    /// The operation could not be performed as too many messages are waiting to be sent
+    /// </summary>
+    Cloud_Result_Busy
 } Cloud_Result;
 
 /// <summary>
@@ -92,7 +97,8 @@ ExitCode Cloud_Initialize(
 void Cloud_Cleanup(void);
 
 /// <summary>
-/// Queue sending telemtry to the cloud backend.
+/// Queue sending telemtry to the cloud backend. While the device is offline, the telemetry is
+/// held in mutable storage, and sent with its original timestamp once the device reconnects.
 /// </summary>
 /// <param name="telemetry">A pointer to a <see cref="Cloud_Telemetry" /> structure to send.</param>
 /// <param name="timestamp">
@@ -102,7 +108,22 @@ void Cloud_Cleanup(void);
 Cloud_Result Cloud_SendTelemetry(const Cloud_Telemetry *telemetry, time_t timestamp);
 
 /// <summary>
-/// Queue sending an event to the cloud indicating that the device location has changed.
+/// Queue sending telemetry to the cloud backend encoded as CBOR, with the content type
+/// application/cbor, rather than as JSON. The message is smaller and cheaper to encode, but the
+/// backend must decode it itself: IoT Hub message routing on the body, and IoT Central, only
+/// understand JSON. Unlike <see cref="Cloud_SendTelemetry" />, the telemetry is neither batched
+/// nor held while the device is offline.
+/// </summary>
+/// <param name="telemetry">A pointer to a <see cref="Cloud_Telemetry" /> structure to send.</param>
+/// <param name="timestamp">
+///     Timestamp for the telemetry event, or (time_t) -1 for no timestamp.
+/// </param>
+/// <returns>A <see cref="Cloud_Result" /> indicating success or failure.</returns>
+Cloud_Result Cloud_SendTelemetryBinary(const Cloud_Telemetry *telemetry, time_t timestamp);
+
+/// <summary>
+/// Queue sending an event to the cloud indicating that the device location has changed. Like
+/// telemetry, the event is held in mutable storage while the device is offline.
 /// </summary>
 /// <param name="timestamp">Timestamp for the move event, or (time_t) -1 for no timestamp.</param>
 /// <returns>A <see cref="Cloud_Result" /> indicating success or failure.</returns>
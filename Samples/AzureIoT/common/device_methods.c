@@ -0,0 +1,255 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <applibs/log.h>
+
+#include "device_methods.h"
+
+typedef struct {
+    /// <summary>Name of the method, or NULL if the slot is empty.</summary>
+    char *name;
+    size_t nameLength;
+    uint32_t hash;
+    DeviceMethods_HandlerType handler;
+    void *context;
+} MethodEntry;
+
+typedef struct {
+    char *data;
+    size_t size;
+} GrowableBuffer;
+
+// The table's capacity is a power of two, and it is kept at most half full so that probe
+// sequences stay short.
+#define INITIAL_TABLE_CAPACITY 16
+#define MIN_BUFFER_SIZE 64
+
+static MethodEntry *methodTable = NULL;
+static size_t methodTableCapacity = 0;
+static size_t methodCount = 0;
+
+static GrowableBuffer payloadBuffer = {NULL, 0};
+static GrowableBuffer responseBuffer = {NULL, 0};
+
+static unsigned long invocations = 0;
+static unsigned long unknownInvocations = 0;
+static unsigned long bufferGrowths = 0;
+
+static const char defaultResponse[] = "{}";
+
+/// <summary>
+///     FNV-1a hash of a method name, which also measures its length.
+/// </summary>
+static uint32_t HashName(const char *name, size_t *length)
+{
+    uint32_t hash = 2166136261u;
+    const unsigned char *bytes = (const unsigned char *)name;
+    size_t i = 0;
+    for (; bytes[i] != '\0'; ++i) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    *length = i;
+    return hash;
+}
+
+/// <summary>
+///     Finds the slot which holds a name, or the empty slot where it would be inserted.
+/// </summary>
+static MethodEntry *FindSlot(MethodEntry *table, size_t capacity, const char *name,
+                             size_t nameLength, uint32_t hash)
+{
+    size_t mask = capacity - 1;
+    size_t index = hash & mask;
+    while (table[index].name != NULL) {
+        if (table[index].hash == hash && table[index].nameLength == nameLength &&
+            memcmp(table[index].name, name, nameLength) == 0) {
+            break;
+        }
+        index = (index + 1) & mask;
+    }
+    return &table[index];
+}
+
+static bool GrowTable(void)
+{
+    size_t newCapacity =
+        methodTableCapacity == 0 ? INITIAL_TABLE_CAPACITY : methodTableCapacity * 2;
+    MethodEntry *newTable = calloc(newCapacity, sizeof(MethodEntry));
+    if (newTable == NULL) {
+        return false;
+    }
+
+    for (size_t i = 0; i < methodTableCapacity; ++i) {
+        if (methodTable[i].name != NULL) {
+            *FindSlot(newTable, newCapacity, methodTable[i].name, methodTable[i].nameLength,
+                      methodTable[i].hash) = methodTable[i];
+        }
+    }
+
+    free(methodTable);
+    methodTable = newTable;
+    methodTableCapacity = newCapacity;
+    return true;
+}
+
+/// <summary>
+///     Ensures a buffer holds at least a number of bytes, growing it geometrically.
+/// </summary>
+static char *ReserveBuffer(GrowableBuffer *buffer, size_t size)
+{
+    if (size > DEVICE_METHODS_MAX_BUFFER_SIZE) {
+        Log_Debug("ERROR: Direct method buffer of %zu bytes requested; the limit is %d.\n", size,
+                  DEVICE_METHODS_MAX_BUFFER_SIZE);
+        return NULL;
+    }
+
+    if (size <= buffer->size) {
+        return buffer->data;
+    }
+
+    size_t newSize = buffer->size < MIN_BUFFER_SIZE ? MIN_BUFFER_SIZE : buffer->size * 2;
+    while (newSize < size) {
+        newSize *= 2;
+    }
+    if (newSize > DEVICE_METHODS_MAX_BUFFER_SIZE) {
+        newSize = DEVICE_METHODS_MAX_BUFFER_SIZE;
+    }
+
+    char *newData = realloc(buffer->data, newSize);
+    if (newData == NULL) {
+        Log_Debug("ERROR: Could not allocate a direct method buffer of %zu bytes.\n", newSize);
+        return NULL;
+    }
+
+    buffer->data = newData;
+    buffer->size = newSize;
+    ++bufferGrowths;
+    return newData;
+}
+
+bool DeviceMethods_Register(const char *methodName, DeviceMethods_HandlerType handler,
+                            void *context)
+{
+    size_t nameLength;
+    uint32_t hash = HashName(methodName, &nameLength);
+
+    if ((methodCount + 1) * 2 > methodTableCapacity && !GrowTable()) {
+        Log_Debug("ERROR: Could not register direct method %s: out of memory.\n", methodName);
+        return false;
+    }
+
+    MethodEntry *entry = FindSlot(methodTable, methodTableCapacity, methodName, nameLength, hash);
+    if (entry->name == NULL) {
+        entry->name = malloc(nameLength + 1);
+        if (entry->name == NULL) {
+            Log_Debug("ERROR: Could not register direct method %s: out of memory.\n", methodName);
+            return false;
+        }
+        memcpy(entry->name, methodName, nameLength + 1);
+        entry->nameLength = nameLength;
+        entry->hash = hash;
+        ++methodCount;
+    }
+
+    entry->handler = handler;
+    entry->context = context;
+    return true;
+}
+
+void DeviceMethods_Cleanup(void)
+{
+    for (size_t i = 0; i < methodTableCapacity; ++i) {
+        free(methodTable[i].name);
+    }
+    free(methodTable);
+    methodTable = NULL;
+    methodTableCapacity = 0;
+    methodCount = 0;
+
+    free(payloadBuffer.data);
+    payloadBuffer.data = NULL;
+    payloadBuffer.size = 0;
+    free(responseBuffer.data);
+    responseBuffer.data = NULL;
+    responseBuffer.size = 0;
+}
+
+int DeviceMethods_Dispatch(const char *methodName, const unsigned char *payload,
+                           size_t payloadSize, unsigned char **response, size_t *responseSize)
+{
+    const char *handlerResponse = NULL;
+    size_t handlerResponseSize = 0;
+    int result = -1;
+
+    MethodEntry *entry = NULL;
+    if (methodCount > 0) {
+        size_t nameLength;
+        uint32_t hash = HashName(methodName, &nameLength);
+        entry = FindSlot(methodTable, methodTableCapacity, methodName, nameLength, hash);
+    }
+
+    if (entry != NULL && entry->name != NULL) {
+        ++invocations;
+        result = entry->handler(payload, payloadSize, &handlerResponse, &handlerResponseSize,
+                                entry->context);
+    } else {
+        // All other method names are ignored
+        ++unknownInvocations;
+    }
+
+    if (handlerResponse == NULL) {
+        handlerResponse = defaultResponse;
+        handlerResponseSize = sizeof(defaultResponse) - 1;
+    }
+
+    // The Azure IoT library frees the response after use, so it must be on the heap.
+    *response = malloc(handlerResponseSize);
+    if (*response == NULL) {
+        Log_Debug("ERROR: Could not allocate a direct method response of %zu bytes.\n",
+                  handlerResponseSize);
+        *responseSize = 0;
+        return result;
+    }
+    memcpy(*response, handlerResponse, handlerResponseSize);
+    *responseSize = handlerResponseSize;
+
+    return result;
+}
+
+char *DeviceMethods_CopyPayload(const unsigned char *payload, size_t payloadSize)
+{
+    if (payloadSize >= DEVICE_METHODS_MAX_BUFFER_SIZE) {
+        Log_Debug("ERROR: Direct method payload of %zu bytes is too large.\n", payloadSize);
+        return NULL;
+    }
+
+    char *copy = ReserveBuffer(&payloadBuffer, payloadSize + 1);
+    if (copy == NULL) {
+        return NULL;
+    }
+
+    if (payloadSize > 0) {
+        memcpy(copy, payload, payloadSize);
+    }
+    copy[payloadSize] = '\0';
+    return copy;
+}
+
+char *DeviceMethods_GetResponseBuffer(size_t size)
+{
+    return ReserveBuffer(&responseBuffer, size);
+}
+
+void DeviceMethods_GetStats(DeviceMethods_Stats *stats)
+{
+    stats->methodCount = methodCount;
+    stats->invocations = invocations;
+    stats->unknownInvocations = unknownInvocations;
+    stats->bufferGrowths = bufferGrowths;
+    stats->payloadBufferSize = payloadBuffer.size;
+    stats->responseBufferSize = responseBuffer.size;
+}
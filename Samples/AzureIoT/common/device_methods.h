@@ -0,0 +1,108 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Dispatches Azure IoT Hub direct methods to handlers registered by name. Names are held in an
+// open-addressing hash table which grows as methods are registered, so dispatch costs one hash
+// and usually one comparison however many methods there are.
+//
+// Handlers build their responses in a buffer which the module keeps between invocations, and
+// can get a NULL-terminated copy of the payload from a second such buffer; both grow to the
+// largest size needed and are then reused, so a burst of invocations does not allocate per call.
+// The Azure IoT C SDK takes ownership of the response it is given and frees it once it has been
+// sent, so the final response is still copied into one exact-size allocation for the SDK.
+
+/// <summary>
+/// Largest payload or response a handler can be given buffer space for; this is the largest
+/// direct method payload which Azure IoT Hub accepts.
+/// </summary>
+#define DEVICE_METHODS_MAX_BUFFER_SIZE (128 * 1024)
+
+/// <summary>
+/// Function signature for direct method handlers.
+/// </summary>
+/// <param name="payload">Payload of the invocation, which is not NULL-terminated.</param>
+/// <param name="payloadSize">Size of the payload.</param>
+/// <param name="response">(out) The JSON response. It may point to a string constant, or to
+/// memory from <see cref="DeviceMethods_GetResponseBuffer" />; it must remain valid until the
+/// handler returns. If it is left NULL, the response is "{}".</param>
+/// <param name="responseSize">(out) Size of the response.</param>
+/// <param name="context">The context given to <see cref="DeviceMethods_Register" />.</param>
+/// <returns>Status code of the invocation, which is returned to the caller of the method.</returns>
+typedef int (*DeviceMethods_HandlerType)(const unsigned char *payload, size_t payloadSize,
+                                         const char **response, size_t *responseSize,
+                                         void *context);
+
+/// <summary>
+/// Direct method statistics.
+/// </summary>
+typedef struct {
+    /// <summary>Number of registered methods.</summary>
+    size_t methodCount;
+    /// <summary>Invocations of registered methods.</summary>
+    unsigned long invocations;
+    /// <summary>Invocations of method names which are not registered.</summary>
+    unsigned long unknownInvocations;
+    /// <summary>Times the payload or response buffer had to grow.</summary>
+    unsigned long bufferGrowths;
+    /// <summary>Current sizes of the payload and response buffers.</summary>
+    size_t payloadBufferSize;
+    size_t responseBufferSize;
+} DeviceMethods_Stats;
+
+/// <summary>
+/// Register a handler for a direct method, replacing any handler already registered for the name.
+/// </summary>
+/// <param name="methodName">Name of the method; it is copied.</param>
+/// <param name="handler">Function to call when the method is invoked.</param>
+/// <param name="context">Context to pass to the handler.</param>
+/// <returns>true on success; false if there was not enough memory.</returns>
+bool DeviceMethods_Register(const char *methodName, DeviceMethods_HandlerType handler,
+                            void *context);
+
+/// <summary>
+/// Remove all registered methods and free the module's buffers.
+/// </summary>
+void DeviceMethods_Cleanup(void);
+
+/// <summary>
+/// Invoke the handler registered for a method. This has the signature of
+/// AzureIoT_DeviceMethodCallbackType, so it can be given to AzureIoT_Initialize directly.
+/// </summary>
+/// <param name="methodName">Name of the method, as a NULL-terminated string.</param>
+/// <param name="payload">Payload for the invocation, if any.</param>
+/// <param name="payloadSize">Size of the payload.</param>
+/// <param name="response">(out) The response, allocated with malloc; the caller frees it.</param>
+/// <param name="responseSize">(out) Size of the response.</param>
+/// <returns>The handler's status code, or -1 if the method is not registered.</returns>
+int DeviceMethods_Dispatch(const char *methodName, const unsigned char *payload,
+                           size_t payloadSize, unsigned char **response, size_t *responseSize);
+
+/// <summary>
+/// Get a NULL-terminated copy of a payload, for handlers which need one. The copy is valid until
+/// the handler returns, and may be modified.
+/// </summary>
+/// <param name="payload">The payload given to the handler.</param>
+/// <param name="payloadSize">Size of the payload.</param>
+/// <returns>The copy, or NULL if the payload is not smaller than
+/// <see cref="DEVICE_METHODS_MAX_BUFFER_SIZE" /> or there was not enough memory.</returns>
+char *DeviceMethods_CopyPayload(const unsigned char *payload, size_t payloadSize);
+
+/// <summary>
+/// Get a buffer in which a handler can build its response. The buffer is valid until the handler
+/// returns, and its contents are not preserved between invocations.
+/// </summary>
+/// <param name="size">Number of bytes needed.</param>
+/// <returns>The buffer, or NULL if <paramref name="size" /> is larger than
+/// <see cref="DEVICE_METHODS_MAX_BUFFER_SIZE" /> or there was not enough memory.</returns>
+char *DeviceMethods_GetResponseBuffer(size_t size);
+
+/// <summary>
+/// Get direct method statistics.
+/// </summary>
+/// <param name="stats">Receives the statistics.</param>
+void DeviceMethods_GetStats(DeviceMethods_Stats *stats);
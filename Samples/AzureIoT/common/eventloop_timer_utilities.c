@@ -2,6 +2,7 @@
    Licensed under the MIT License. */
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include <errno.h>
@@ -14,39 +15,626 @@
 
 #include "eventloop_timer_utilities.h"
 
-static int SetTimerPeriod(int timerFd, const struct timespec *initial,
-                          const struct timespec *repeat);
+static const uint64_t NanosecondsPerSecond = 1000000000ULL;
 
-static int SetTimerPeriod(int timerFd, const struct timespec *initial,
-                          const struct timespec *repeat)
+static uint64_t TimespecToNanoseconds(const struct timespec *ts)
 {
-    static const struct timespec nullTimeSpec = {.tv_sec = 0, .tv_nsec = 0};
-    struct itimerspec newValue = {.it_value = initial ? *initial : nullTimeSpec,
-                                  .it_interval = repeat ? *repeat : nullTimeSpec};
+    return (uint64_t)ts->tv_sec * NanosecondsPerSecond + (uint64_t)ts->tv_nsec;
+}
+
+static uint64_t GetMonotonicNanoseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return TimespecToNanoseconds(&now);
+}
+
+// Statistics and the list of live timers are shared by both implementations, and are defined
+// after them.
+static void RegisterTimer(EventLoopTimer *timer);
+static void UnregisterTimer(EventLoopTimer *timer);
+static void RecordTimerExpirations(EventLoopTimer *timer, uint64_t expirations, uint64_t latencyNs);
+
+#if defined(EVENTLOOP_TIMER_SHARED_TIMERFD)
+
+// In this mode every EventLoopTimer registered on an EventLoop shares a single timerfd. The armed
+// timers are kept in two binary min-heaps, one ordered by latest expiry (deadline plus slack) and
+// one by deadline. The timerfd is armed (with an absolute CLOCK_MONOTONIC deadline) to expire when
+// the first timer in the latest expiry order can no longer be deferred. Every timer whose deadline
+// has passed is then dispatched in the same wakeup, taken in turn from the front of the deadline
+// order. This costs one file descriptor and one kernel wakeup per batch of due timers, rather than
+// one of each per timer, and O(log n) per timer armed or dispatched.
+
+static const size_t TimerNotQueued = SIZE_MAX;
+
+typedef struct EventLoopTimerQueue EventLoopTimerQueue;
+
+typedef enum {
+    TimerOrder_LatestExpiry,
+    TimerOrder_Deadline,
+    TimerOrderCount
+} TimerOrder;
+
+typedef struct {
+    TimerOrder order;
+    EventLoopTimer **timers;
+    size_t count;
+    size_t capacity;
+} TimerHeap;
+
+struct EventLoopTimer {
+    EventLoopTimerQueue *queue;
+    EventLoopTimerHandler handler;
+    // Absolute CLOCK_MONOTONIC time at which the timer next expires.
+    uint64_t deadlineNs;
+    // Interval between expirations, or zero for a one-shot timer.
+    uint64_t periodNs;
+    // How long after deadlineNs the expiration may be deferred so it can share a wakeup, as
+    // requested; see GetSlackNanoseconds.
+    uint64_t slackNs;
+    // Position in each of queue->heaps, or TimerNotQueued if the timer is disarmed.
+    size_t heapIndex[TimerOrderCount];
+    // Expirations dispatched to the handler but not yet consumed.
+    uint64_t pendingExpirations;
+    const char *name;
+    EventLoopTimerStats stats;
+    EventLoopTimer *prevTimer;
+    EventLoopTimer *nextTimer;
+};
+
+struct EventLoopTimerQueue {
+    EventLoop *eventLoop;
+    int fd;
+    EventRegistration *registration;
+    // The armed timers, in each order.
+    TimerHeap heaps[TimerOrderCount];
+    // Number of timers (armed or disarmed) which reference this queue.
+    size_t timerCount;
+    // Deadline currently programmed into the timerfd, or zero if disarmed.
+    uint64_t armedDeadlineNs;
+    // Set while timer handlers are being invoked, so the timerfd is re-armed once afterwards and
+    // so the queue is not freed from under the dispatch loop.
+    bool isDispatching;
+    bool isDisposePending;
+    EventLoopTimerQueue *next;
+};
+
+// One queue per event loop; applications normally only have one event loop.
+static EventLoopTimerQueue *timerQueues = NULL;
+
+static EventLoopTimerWakeupStats wakeupStats = {0};
+
+/// <summary>
+/// How long the timer's expiration may be deferred. For a periodic timer this is at most half the
+/// period, so that deferral never costs it an expiration.
+/// </summary>
+static uint64_t GetSlackNanoseconds(const EventLoopTimer *timer)
+{
+    if (timer->periodNs != 0 && timer->slackNs > timer->periodNs / 2) {
+        return timer->periodNs / 2;
+    }
+    return timer->slackNs;
+}
+
+/// <summary>
+/// Latest time at which the timer may be dispatched.
+/// </summary>
+static uint64_t GetLatestExpiryNanoseconds(const EventLoopTimer *timer)
+{
+    return timer->deadlineNs + GetSlackNanoseconds(timer);
+}
+
+static uint64_t GetHeapKey(const TimerHeap *heap, size_t index)
+{
+    const EventLoopTimer *timer = heap->timers[index];
+    return heap->order == TimerOrder_Deadline ? timer->deadlineNs
+                                              : GetLatestExpiryNanoseconds(timer);
+}
+
+static void HeapSwap(TimerHeap *heap, size_t a, size_t b)
+{
+    EventLoopTimer *temp = heap->timers[a];
+    heap->timers[a] = heap->timers[b];
+    heap->timers[b] = temp;
+    heap->timers[a]->heapIndex[heap->order] = a;
+    heap->timers[b]->heapIndex[heap->order] = b;
+}
+
+static void HeapSiftUp(TimerHeap *heap, size_t index)
+{
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (GetHeapKey(heap, parent) <= GetHeapKey(heap, index)) {
+            break;
+        }
+        HeapSwap(heap, parent, index);
+        index = parent;
+    }
+}
+
+static void HeapSiftDown(TimerHeap *heap, size_t index)
+{
+    for (;;) {
+        size_t smallest = index;
+        size_t left = 2 * index + 1;
+        size_t right = left + 1;
+        if (left < heap->count && GetHeapKey(heap, left) < GetHeapKey(heap, smallest)) {
+            smallest = left;
+        }
+        if (right < heap->count && GetHeapKey(heap, right) < GetHeapKey(heap, smallest)) {
+            smallest = right;
+        }
+        if (smallest == index) {
+            break;
+        }
+        HeapSwap(heap, index, smallest);
+        index = smallest;
+    }
+}
+
+/// <summary>
+/// Restore the timer's position in the heap after its key has changed.
+/// </summary>
+static void HeapUpdate(TimerHeap *heap, EventLoopTimer *timer)
+{
+    size_t index = timer->heapIndex[heap->order];
+    if (index == TimerNotQueued) {
+        return;
+    }
+
+    HeapSiftUp(heap, index);
+    HeapSiftDown(heap, timer->heapIndex[heap->order]);
+}
+
+static int HeapInsert(TimerHeap *heap, EventLoopTimer *timer)
+{
+    if (heap->count == heap->capacity) {
+        size_t newCapacity = heap->capacity == 0 ? 8 : heap->capacity * 2;
+        EventLoopTimer **newTimers = realloc(heap->timers, newCapacity * sizeof(EventLoopTimer *));
+        if (newTimers == NULL) {
+            return -1;
+        }
+        heap->timers = newTimers;
+        heap->capacity = newCapacity;
+    }
+
+    size_t index = heap->count++;
+    heap->timers[index] = timer;
+    timer->heapIndex[heap->order] = index;
+    HeapSiftUp(heap, index);
+    return 0;
+}
+
+static void HeapRemove(TimerHeap *heap, EventLoopTimer *timer)
+{
+    size_t index = timer->heapIndex[heap->order];
+    if (index == TimerNotQueued) {
+        return;
+    }
+
+    timer->heapIndex[heap->order] = TimerNotQueued;
+    heap->count--;
+    if (index == heap->count) {
+        return;
+    }
+
+    // Move the last element into the hole, then restore the heap property in whichever
+    // direction is needed.
+    heap->timers[index] = heap->timers[heap->count];
+    heap->timers[index]->heapIndex[heap->order] = index;
+    HeapUpdate(heap, heap->timers[index]);
+}
+
+static int QueueInsertTimer(EventLoopTimerQueue *queue, EventLoopTimer *timer)
+{
+    for (TimerOrder order = 0; order < TimerOrderCount; ++order) {
+        if (HeapInsert(&queue->heaps[order], timer) == -1) {
+            while (order-- > 0) {
+                HeapRemove(&queue->heaps[order], timer);
+            }
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void QueueRemoveTimer(EventLoopTimerQueue *queue, EventLoopTimer *timer)
+{
+    for (TimerOrder order = 0; order < TimerOrderCount; ++order) {
+        HeapRemove(&queue->heaps[order], timer);
+    }
+}
+
+/// <summary>
+/// Find the armed timer with the earliest deadline, if it is at or before
+/// <paramref name="nowNs" />.
+/// </summary>
+static EventLoopTimer *FindDueTimer(const EventLoopTimerQueue *queue, uint64_t nowNs)
+{
+    const TimerHeap *heap = &queue->heaps[TimerOrder_Deadline];
+    if (heap->count == 0 || heap->timers[0]->deadlineNs > nowNs) {
+        return NULL;
+    }
+
+    return heap->timers[0];
+}
+
+/// <summary>
+/// Program the queue's timerfd to expire at the earliest latest expiry of any armed timer, or
+/// disarm it if no timers are armed.
+/// </summary>
+static int ArmQueueTimerFd(EventLoopTimerQueue *queue)
+{
+    // The dispatch loop re-arms the timerfd once all due timers have been handled.
+    if (queue->isDispatching) {
+        return 0;
+    }
+
+    const TimerHeap *heap = &queue->heaps[TimerOrder_LatestExpiry];
+    uint64_t deadlineNs = heap->count > 0 ? GetLatestExpiryNanoseconds(heap->timers[0]) : 0;
+    if (deadlineNs == queue->armedDeadlineNs) {
+        return 0;
+    }
 
-    if (timerfd_settime(timerFd, /* flags */ 0, &newValue, /* old_value */ NULL) == -1) {
+    struct itimerspec newValue = {
+        .it_value = {.tv_sec = (time_t)(deadlineNs / NanosecondsPerSecond),
+                     .tv_nsec = (long)(deadlineNs % NanosecondsPerSecond)},
+        .it_interval = {.tv_sec = 0, .tv_nsec = 0}};
+
+    if (timerfd_settime(queue->fd, TFD_TIMER_ABSTIME, &newValue, /* old_value */ NULL) == -1) {
         Log_Debug("ERROR: Could not set timer period: %s (%d).\n", strerror(errno), errno);
         return -1;
     }
 
+    queue->armedDeadlineNs = deadlineNs;
+    return 0;
+}
+
+static void FreeTimerQueue(EventLoopTimerQueue *queue)
+{
+    for (EventLoopTimerQueue **link = &timerQueues; *link != NULL; link = &(*link)->next) {
+        if (*link == queue) {
+            *link = queue->next;
+            break;
+        }
+    }
+
+    EventLoop_UnregisterIo(queue->eventLoop, queue->registration);
+
+    if (queue->fd != -1) {
+        close(queue->fd);
+    }
+
+    for (TimerOrder order = 0; order < TimerOrderCount; ++order) {
+        free(queue->heaps[order].timers);
+    }
+    free(queue);
+}
+
+// This satisfies the EventLoopIoCallback signature.
+static void TimerQueueCallback(EventLoop *el, int fd, EventLoop_IoEvents events, void *context)
+{
+    EventLoopTimerQueue *queue = (EventLoopTimerQueue *)context;
+
+    // Clear the timerfd's readable state; the expiration count is recomputed from the heap.
+    uint64_t timerData = 0;
+    if (read(queue->fd, &timerData, sizeof(timerData)) == -1 && errno != EAGAIN) {
+        Log_Debug("ERROR: Could not read timerfd %s (%d).\n", strerror(errno), errno);
+    }
+
+    // The timerfd has fired, so it is no longer armed.
+    queue->armedDeadlineNs = 0;
+    queue->isDispatching = true;
+
+    // Dispatch every timer which is due, not just the one whose slack ran out, so that timers
+    // with nearby deadlines share this wakeup.
+    uint64_t nowNs = GetMonotonicNanoseconds();
+    uint64_t dispatched = 0;
+    EventLoopTimer *timer;
+    while ((timer = FindDueTimer(queue, nowNs)) != NULL) {
+        uint64_t expirations = 1;
+        uint64_t lastDeadlineNs = timer->deadlineNs;
+
+        if (timer->periodNs != 0) {
+            // Skip any periods which have already elapsed, as a periodic timerfd does, and
+            // schedule the next expiration in place. This dispatch serves the last elapsed
+            // expiration; an earlier one is only missed if its slack has also run out, since
+            // deferral within the slack is not an overrun.
+            uint64_t lateNs = nowNs - timer->deadlineNs;
+            uint64_t elapsedPeriods = lateNs / timer->periodNs;
+            uint64_t slackNs = GetSlackNanoseconds(timer);
+            if (lateNs > slackNs) {
+                uint64_t missed = (lateNs - slackNs + timer->periodNs - 1) / timer->periodNs;
+                expirations += missed < elapsedPeriods ? missed : elapsedPeriods;
+            }
+            lastDeadlineNs += elapsedPeriods * timer->periodNs;
+            timer->deadlineNs = lastDeadlineNs + timer->periodNs;
+            for (TimerOrder order = 0; order < TimerOrderCount; ++order) {
+                HeapSiftDown(&queue->heaps[order], timer->heapIndex[order]);
+            }
+        } else {
+            QueueRemoveTimer(queue, timer);
+        }
+
+        timer->pendingExpirations += expirations;
+        ++dispatched;
+
+        // Earlier handlers in this wakeup delay later ones, so measure latency per handler.
+        uint64_t dispatchNs = GetMonotonicNanoseconds();
+        RecordTimerExpirations(timer, expirations,
+                               dispatchNs > lastDeadlineNs ? dispatchNs - lastDeadlineNs : 0);
+
+        // The handler may re-arm, disarm or dispose of this or any other timer.
+        timer->handler(timer);
+    }
+
+    queue->isDispatching = false;
+
+    ++wakeupStats.wakeups;
+    wakeupStats.expirations += dispatched;
+    if (dispatched > 1) {
+        wakeupStats.wakeupsAvoided += dispatched - 1;
+    }
+
+    if (queue->isDisposePending) {
+        FreeTimerQueue(queue);
+        return;
+    }
+
+    ArmQueueTimerFd(queue);
+}
+
+static EventLoopTimerQueue *AcquireTimerQueue(EventLoop *eventLoop)
+{
+    for (EventLoopTimerQueue *queue = timerQueues; queue != NULL; queue = queue->next) {
+        if (queue->eventLoop == eventLoop && !queue->isDisposePending) {
+            queue->timerCount++;
+            return queue;
+        }
+    }
+
+    EventLoopTimerQueue *queue = calloc(1, sizeof(EventLoopTimerQueue));
+    if (queue == NULL) {
+        return NULL;
+    }
+
+    for (TimerOrder order = 0; order < TimerOrderCount; ++order) {
+        queue->heaps[order].order = order;
+    }
+
+    queue->eventLoop = eventLoop;
+    queue->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (queue->fd == -1) {
+        Log_Debug("ERROR: Unable to create timer: %s (%d).\n", strerror(errno), errno);
+        free(queue);
+        return NULL;
+    }
+
+    queue->registration =
+        EventLoop_RegisterIo(eventLoop, queue->fd, EventLoop_Input, TimerQueueCallback, queue);
+    if (queue->registration == NULL) {
+        Log_Debug("ERROR: Unable to register timer event: %s (%d).\n", strerror(errno), errno);
+        close(queue->fd);
+        free(queue);
+        return NULL;
+    }
+
+    queue->timerCount = 1;
+    queue->next = timerQueues;
+    timerQueues = queue;
+    return queue;
+}
+
+static void ReleaseTimerQueue(EventLoopTimerQueue *queue)
+{
+    if (--queue->timerCount > 0) {
+        return;
+    }
+
+    if (queue->isDispatching) {
+        queue->isDisposePending = true;
+        return;
+    }
+
+    FreeTimerQueue(queue);
+}
+
+/// <summary>
+/// Arm or disarm a timer. A NULL or zero <paramref name="initial" /> disarms the timer, matching
+/// timerfd_settime.
+/// </summary>
+static int ScheduleTimer(EventLoopTimer *timer, const struct timespec *initial,
+                         const struct timespec *repeat)
+{
+    EventLoopTimerQueue *queue = timer->queue;
+
+    QueueRemoveTimer(queue, timer);
+    timer->pendingExpirations = 0;
+
+    uint64_t initialNs = initial ? TimespecToNanoseconds(initial) : 0;
+    if (initialNs != 0) {
+        timer->deadlineNs = GetMonotonicNanoseconds() + initialNs;
+        timer->periodNs = repeat ? TimespecToNanoseconds(repeat) : 0;
+        if (QueueInsertTimer(queue, timer) == -1) {
+            Log_Debug("ERROR: Could not set timer period: %s (%d).\n", strerror(errno), errno);
+            return -1;
+        }
+    }
+
+    return ArmQueueTimerFd(queue);
+}
+
+EventLoopTimer *CreateEventLoopPeriodicTimer(EventLoop *eventLoop, EventLoopTimerHandler handler,
+                                             const struct timespec *period)
+{
+    return CreateEventLoopPeriodicTimerWithSlack(eventLoop, handler, period, NULL);
+}
+
+EventLoopTimer *CreateEventLoopPeriodicTimerWithSlack(EventLoop *eventLoop,
+                                                      EventLoopTimerHandler handler,
+                                                      const struct timespec *period,
+                                                      const struct timespec *slack)
+{
+    if (handler == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    EventLoopTimer *timer = malloc(sizeof(EventLoopTimer));
+    if (timer == NULL) {
+        return NULL;
+    }
+
+    timer->handler = handler;
+    timer->deadlineNs = 0;
+    timer->periodNs = 0;
+    timer->slackNs = slack ? TimespecToNanoseconds(slack) : 0;
+    for (TimerOrder order = 0; order < TimerOrderCount; ++order) {
+        timer->heapIndex[order] = TimerNotQueued;
+    }
+    timer->pendingExpirations = 0;
+    timer->name = NULL;
+    memset(&timer->stats, 0, sizeof(timer->stats));
+
+    timer->queue = AcquireTimerQueue(eventLoop);
+    if (timer->queue == NULL) {
+        free(timer);
+        return NULL;
+    }
+
+    RegisterTimer(timer);
+
+    if (ScheduleTimer(timer, /* initial */ period, /* repeat */ period) == -1) {
+        DisposeEventLoopTimer(timer);
+        return NULL;
+    }
+
+    return timer;
+}
+
+EventLoopTimer *CreateEventLoopDisarmedTimer(EventLoop *eventLoop, EventLoopTimerHandler handler)
+{
+    return CreateEventLoopPeriodicTimer(eventLoop, handler, NULL);
+}
+
+void DisposeEventLoopTimer(EventLoopTimer *timer)
+{
+    if (timer == NULL) {
+        return;
+    }
+
+    EventLoopTimerQueue *queue = timer->queue;
+    QueueRemoveTimer(queue, timer);
+    ArmQueueTimerFd(queue);
+    ReleaseTimerQueue(queue);
+
+    UnregisterTimer(timer);
+    free(timer);
+}
+
+int ConsumeEventLoopTimerEvent(EventLoopTimer *timer)
+{
+    if (timer->pendingExpirations == 0) {
+        // Matches a read from a non-blocking timerfd which has not expired.
+        errno = EAGAIN;
+        Log_Debug("ERROR: Could not read timerfd %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+
+    timer->pendingExpirations = 0;
     return 0;
 }
 
+int SetEventLoopTimerPeriod(EventLoopTimer *timer, const struct timespec *period)
+{
+    return ScheduleTimer(timer, /* initial */ period, /* repeat */ period);
+}
+
+int SetEventLoopTimerOneShot(EventLoopTimer *timer, const struct timespec *delay)
+{
+    return ScheduleTimer(timer, /* initial */ delay, /* repeat */ NULL);
+}
+
+int DisarmEventLoopTimer(EventLoopTimer *timer)
+{
+    return ScheduleTimer(timer, /* initial */ NULL, /* repeat */ NULL);
+}
+
+int SetEventLoopTimerSlack(EventLoopTimer *timer, const struct timespec *slack)
+{
+    timer->slackNs = slack ? TimespecToNanoseconds(slack) : 0;
+
+    // The timer's latest expiry has moved, so restore its position in that order.
+    HeapUpdate(&timer->queue->heaps[TimerOrder_LatestExpiry], timer);
+
+    return ArmQueueTimerFd(timer->queue);
+}
+
+#else // !EVENTLOOP_TIMER_SHARED_TIMERFD
+
+static EventLoopTimerWakeupStats wakeupStats = {0};
+
 struct EventLoopTimer {
     EventLoop *eventLoop;
     EventLoopTimerHandler handler;
     int fd;
     EventRegistration *registration;
+    // The timerfd only reports how many expirations have occurred, so track the deadlines it was
+    // armed with in order to measure dispatch latency. deadlineNs is zero if disarmed.
+    uint64_t deadlineNs;
+    uint64_t periodNs;
+    // When the handler was last invoked.
+    uint64_t dispatchNs;
+    const char *name;
+    EventLoopTimerStats stats;
+    EventLoopTimer *prevTimer;
+    EventLoopTimer *nextTimer;
 };
 
+static int SetTimerPeriod(EventLoopTimer *timer, const struct timespec *initial,
+                          const struct timespec *repeat);
+
+static int SetTimerPeriod(EventLoopTimer *timer, const struct timespec *initial,
+                          const struct timespec *repeat)
+{
+    static const struct timespec nullTimeSpec = {.tv_sec = 0, .tv_nsec = 0};
+    struct itimerspec newValue = {.it_value = initial ? *initial : nullTimeSpec,
+                                  .it_interval = repeat ? *repeat : nullTimeSpec};
+
+    if (timerfd_settime(timer->fd, /* flags */ 0, &newValue, /* old_value */ NULL) == -1) {
+        Log_Debug("ERROR: Could not set timer period: %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+
+    uint64_t initialNs = TimespecToNanoseconds(&newValue.it_value);
+    timer->deadlineNs = initialNs != 0 ? GetMonotonicNanoseconds() + initialNs : 0;
+    timer->periodNs = TimespecToNanoseconds(&newValue.it_interval);
+
+    return 0;
+}
+
 // This satisfies the EventLoopIoCallback signature.
 static void TimerCallback(EventLoop *el, int fd, EventLoop_IoEvents events, void *context)
 {
     EventLoopTimer *timer = (EventLoopTimer *)context;
 
+    // Each timer has its own timerfd, so every expiration is a separate wakeup.
+    ++wakeupStats.wakeups;
+    ++wakeupStats.expirations;
+
+    timer->dispatchNs = GetMonotonicNanoseconds();
     timer->handler(timer);
 }
 
+EventLoopTimer *CreateEventLoopPeriodicTimerWithSlack(EventLoop *eventLoop,
+                                                      EventLoopTimerHandler handler,
+                                                      const struct timespec *period,
+                                                      const struct timespec *slack)
+{
+    // Slack only has an effect when timers share a timerfd.
+    return CreateEventLoopPeriodicTimer(eventLoop, handler, period);
+}
+
 EventLoopTimer *CreateEventLoopPeriodicTimer(EventLoop *eventLoop, EventLoopTimerHandler handler,
                                              const struct timespec *period)
 {
@@ -66,6 +654,12 @@ EventLoopTimer *CreateEventLoopPeriodicTimer(EventLoop *eventLoop, EventLoopTime
     // Initialize to unused values in case have to clean up partially initialized object.
     timer->fd = -1;
     timer->registration = NULL;
+    timer->deadlineNs = 0;
+    timer->periodNs = 0;
+    timer->dispatchNs = 0;
+    timer->name = NULL;
+    memset(&timer->stats, 0, sizeof(timer->stats));
+    RegisterTimer(timer);
 
     timer->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
     if (timer->fd == -1) {
@@ -73,7 +667,7 @@ EventLoopTimer *CreateEventLoopPeriodicTimer(EventLoop *eventLoop, EventLoopTime
         goto failed;
     }
 
-    if (SetTimerPeriod(timer->fd, /* initial */ period, /* repeat */ period) == -1) {
+    if (SetTimerPeriod(timer, /* initial */ period, /* repeat */ period) == -1) {
         goto failed;
     }
 
@@ -108,6 +702,7 @@ void DisposeEventLoopTimer(EventLoopTimer *timer)
         close(timer->fd);
     }
 
+    UnregisterTimer(timer);
     free(timer);
 }
 
@@ -120,20 +715,165 @@ int ConsumeEventLoopTimerEvent(EventLoopTimer *timer)
         return -1;
     }
 
+    // timerData is the number of expirations since the last read. Work out when the most recent
+    // of them was due, and so when the timerfd will next expire.
+    uint64_t latencyNs = 0;
+    if (timer->deadlineNs != 0 && timerData > 0) {
+        uint64_t lastDeadlineNs = timer->deadlineNs + (timerData - 1) * timer->periodNs;
+        if (timer->dispatchNs > lastDeadlineNs) {
+            latencyNs = timer->dispatchNs - lastDeadlineNs;
+        }
+        timer->deadlineNs = timer->periodNs != 0 ? lastDeadlineNs + timer->periodNs : 0;
+    }
+
+    RecordTimerExpirations(timer, timerData, latencyNs);
     return 0;
 }
 
 int SetEventLoopTimerPeriod(EventLoopTimer *timer, const struct timespec *period)
 {
-    return SetTimerPeriod(timer->fd, /* initial */ period, /* repeat */ period);
+    return SetTimerPeriod(timer, /* initial */ period, /* repeat */ period);
 }
 
 int SetEventLoopTimerOneShot(EventLoopTimer *timer, const struct timespec *delay)
 {
-    return SetTimerPeriod(timer->fd, /* initial */ delay, /* repeat */ NULL);
+    return SetTimerPeriod(timer, /* initial */ delay, /* repeat */ NULL);
 }
 
 int DisarmEventLoopTimer(EventLoopTimer *timer)
 {
-    return SetTimerPeriod(timer->fd, /* initial */ NULL, /* repeat */ NULL);
+    return SetTimerPeriod(timer, /* initial */ NULL, /* repeat */ NULL);
+}
+
+int SetEventLoopTimerSlack(EventLoopTimer *timer, const struct timespec *slack)
+{
+    return 0;
+}
+
+#endif // EVENTLOOP_TIMER_SHARED_TIMERFD
+
+void GetEventLoopTimerWakeupStats(EventLoopTimerWakeupStats *stats)
+{
+    *stats = wakeupStats;
+}
+
+// Every live timer, most recently created first, so that statistics can be enumerated.
+static EventLoopTimer *allTimers = NULL;
+
+static EventLoopTimerStatsHandler statsReporterHandler = NULL;
+static void *statsReporterContext = NULL;
+
+static void RegisterTimer(EventLoopTimer *timer)
+{
+    timer->prevTimer = NULL;
+    timer->nextTimer = allTimers;
+    if (allTimers != NULL) {
+        allTimers->prevTimer = timer;
+    }
+    allTimers = timer;
+}
+
+static void UnregisterTimer(EventLoopTimer *timer)
+{
+    if (timer->prevTimer != NULL) {
+        timer->prevTimer->nextTimer = timer->nextTimer;
+    } else {
+        allTimers = timer->nextTimer;
+    }
+
+    if (timer->nextTimer != NULL) {
+        timer->nextTimer->prevTimer = timer->prevTimer;
+    }
+}
+
+/// <summary>
+/// Bucket 0 counts latencies under 1us; bucket i counts latencies in [2^(i-1), 2^i) us; the last
+/// bucket also counts everything longer.
+/// </summary>
+static size_t GetLatencyBucket(uint64_t latencyNs)
+{
+    uint64_t latencyUs = latencyNs / 1000;
+    size_t bucket = 0;
+    while (latencyUs != 0 && bucket < EVENTLOOP_TIMER_LATENCY_BUCKETS - 1) {
+        latencyUs >>= 1;
+        ++bucket;
+    }
+
+    return bucket;
+}
+
+static void RecordTimerExpirations(EventLoopTimer *timer, uint64_t expirations, uint64_t latencyNs)
+{
+    if (expirations == 0) {
+        return;
+    }
+
+    timer->stats.expirations += expirations;
+    if (expirations > 1) {
+        ++timer->stats.overruns;
+        timer->stats.missedExpirations += expirations - 1;
+    }
+
+    ++timer->stats.latencyHistogram[GetLatencyBucket(latencyNs)];
+    if (latencyNs > timer->stats.maxLatencyNs) {
+        timer->stats.maxLatencyNs = latencyNs;
+    }
+}
+
+int SetEventLoopTimerName(EventLoopTimer *timer, const char *name)
+{
+    timer->name = name;
+    return 0;
+}
+
+int GetEventLoopTimerStats(const EventLoopTimer *timer, EventLoopTimerStats *stats)
+{
+    *stats = timer->stats;
+    return 0;
+}
+
+void ResetEventLoopTimerStats(EventLoopTimer *timer)
+{
+    memset(&timer->stats, 0, sizeof(timer->stats));
+}
+
+void EnumerateEventLoopTimerStats(EventLoopTimerStatsHandler handler, void *context)
+{
+    EventLoopTimer *timer = allTimers;
+    while (timer != NULL) {
+        // Fetch the next timer first, in case the handler disposes of this one.
+        EventLoopTimer *nextTimer = timer->nextTimer;
+        handler(timer, timer->name, &timer->stats, context);
+        timer = nextTimer;
+    }
+}
+
+static void StatsReporterTimerEventHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        return;
+    }
+
+    EnumerateEventLoopTimerStats(statsReporterHandler, statsReporterContext);
+}
+
+EventLoopTimer *CreateEventLoopTimerStatsReporter(EventLoop *eventLoop,
+                                                  const struct timespec *period,
+                                                  EventLoopTimerStatsHandler handler, void *context)
+{
+    if (handler == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    statsReporterHandler = handler;
+    statsReporterContext = context;
+
+    EventLoopTimer *timer =
+        CreateEventLoopPeriodicTimer(eventLoop, &StatsReporterTimerEventHandler, period);
+    if (timer != NULL) {
+        SetEventLoopTimerName(timer, "TimerStatsReporter");
+    }
+
+    return timer;
 }
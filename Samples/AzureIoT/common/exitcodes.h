@@ -55,6 +55,19 @@ typedef enum {
 
     ExitCode_Init_AzureIoTDoWorkTimer = 30,
     ExitCode_AzureIoTDoWorkTimer_Consume = 31,
+
+    ExitCode_Init_TimerStatsReporter = 32,
+
+    ExitCode_Init_AzureIoTReportStateTimer = 33,
+    ExitCode_AzureIoTReportStateTimer_Consume = 34,
+
+    ExitCode_Init_TelemetryDrainTimer = 35,
+    ExitCode_TelemetryDrainTimer_Consume = 36,
+
+    ExitCode_Init_AzureIoTTelemetryBatchTimer = 37,
+    ExitCode_AzureIoTTelemetryBatchTimer_Consume = 38,
+
+    ExitCode_Init_DeviceMethods = 39,
 } ExitCode;
 
 /// <summary>
@@ -0,0 +1,109 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "parson.h"
+
+#include "json_arena.h"
+
+static const size_t ArenaAlignment = alignof(max_align_t);
+
+// Arena which backs parson's allocations, or NULL outside a scope.
+static JsonArena *activeArena = NULL;
+
+static size_t AlignUp(size_t value)
+{
+    return (value + ArenaAlignment - 1) & ~(ArenaAlignment - 1);
+}
+
+static bool IsInArena(const JsonArena *arena, const void *ptr)
+{
+    uintptr_t address = (uintptr_t)ptr;
+    uintptr_t start = (uintptr_t)arena->buffer;
+    return address >= start && address < start + arena->size;
+}
+
+static void *JsonArenaMalloc(size_t size)
+{
+    JsonArena *arena = activeArena;
+    size_t offset = AlignUp(arena->used);
+
+    if (offset > arena->size || size > arena->size - offset) {
+        ++arena->fallbackCount;
+        return malloc(size);
+    }
+
+    arena->lastAllocationOffset = offset;
+    arena->used = offset + size;
+    if (arena->used > arena->peakUsed) {
+        arena->peakUsed = arena->used;
+    }
+    ++arena->allocationCount;
+
+    return arena->buffer + offset;
+}
+
+static void JsonArenaFree(void *ptr)
+{
+    JsonArena *arena = activeArena;
+
+    if (ptr == NULL) {
+        return;
+    }
+
+    if (!IsInArena(arena, ptr)) {
+        free(ptr);
+        return;
+    }
+
+    // Space is only reclaimed when the most recent allocation is freed, which is the common case
+    // for temporary buffers; everything else is reclaimed by JsonArena_End.
+    if ((unsigned char *)ptr == arena->buffer + arena->lastAllocationOffset) {
+        arena->used = arena->lastAllocationOffset;
+    }
+}
+
+void JsonArena_Init(JsonArena *arena, void *buffer, size_t size)
+{
+    // Align the start of the buffer so that every allocation is suitably aligned.
+    uintptr_t start = (uintptr_t)buffer;
+    size_t padding = (size_t)(AlignUp(start) - start);
+
+    arena->buffer = (unsigned char *)buffer + (padding < size ? padding : size);
+    arena->size = padding < size ? size - padding : 0;
+    arena->used = 0;
+    arena->lastAllocationOffset = 0;
+    arena->peakUsed = 0;
+    arena->scopeCount = 0;
+    arena->allocationCount = 0;
+    arena->fallbackCount = 0;
+}
+
+bool JsonArena_Begin(JsonArena *arena)
+{
+    if (activeArena != NULL) {
+        return false;
+    }
+
+    activeArena = arena;
+    arena->used = 0;
+    arena->lastAllocationOffset = 0;
+    json_set_allocation_functions(JsonArenaMalloc, JsonArenaFree);
+    return true;
+}
+
+void JsonArena_End(JsonArena *arena)
+{
+    if (activeArena != arena) {
+        return;
+    }
+
+    json_set_allocation_functions(malloc, free);
+    activeArena = NULL;
+    arena->used = 0;
+    arena->lastAllocationOffset = 0;
+    ++arena->scopeCount;
+}
@@ -0,0 +1,63 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A bump allocator for parson. Between JsonArena_Begin and JsonArena_End, every allocation which
+// parson makes is carved from a caller-supplied buffer, and freeing is a no-op; JsonArena_End
+// releases all of it at once. This lets a build-serialize-free cycle run without touching the
+// heap, which avoids fragmenting it. Allocations which do not fit in the buffer fall back to
+// malloc.
+//
+// Parson's allocation functions are global, so only one arena scope may be active at a time, and
+// the scope must not span calls which keep JSON values or serialized strings beyond it.
+
+/// <summary>
+/// Arena state. Initialize with <see cref="JsonArena_Init" />. The members are statistics which
+/// may be read, but should not be modified directly.
+/// </summary>
+typedef struct {
+    /// <summary>Start of the buffer, aligned for any type.</summary>
+    unsigned char *buffer;
+    /// <summary>Usable size of the buffer.</summary>
+    size_t size;
+    /// <summary>Bytes allocated in the current scope.</summary>
+    size_t used;
+    /// <summary>Offset of the most recent allocation, which can be freed in place.</summary>
+    size_t lastAllocationOffset;
+    /// <summary>Highest value of <see cref="used" /> over all scopes.</summary>
+    size_t peakUsed;
+    /// <summary>Number of scopes which have been completed.</summary>
+    size_t scopeCount;
+    /// <summary>Number of allocations served from the buffer, over all scopes.</summary>
+    size_t allocationCount;
+    /// <summary>Number of allocations which did not fit and fell back to malloc.</summary>
+    size_t fallbackCount;
+} JsonArena;
+
+/// <summary>
+/// Initialize an arena over a buffer.
+/// </summary>
+/// <param name="arena">The arena.</param>
+/// <param name="buffer">Memory for the arena, which must outlive it.</param>
+/// <param name="size">Size of <paramref name="buffer" /> in bytes.</param>
+void JsonArena_Init(JsonArena *arena, void *buffer, size_t size);
+
+/// <summary>
+/// Start a scope in which parson allocates from the arena.
+/// </summary>
+/// <param name="arena">The arena.</param>
+/// <returns>true on success; false if a scope is already active.</returns>
+bool JsonArena_Begin(JsonArena *arena);
+
+/// <summary>
+/// End the scope started by <see cref="JsonArena_Begin" />. Parson reverts to malloc and free,
+/// and all memory allocated from the arena in the scope is released at once. Any JSON values
+/// and serialized strings created in the scope must not be used afterwards; those which fell
+/// back to malloc must be freed before this is called.
+/// </summary>
+/// <param name="arena">The arena.</param>
+void JsonArena_End(JsonArena *arena);
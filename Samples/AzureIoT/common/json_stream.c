@@ -0,0 +1,623 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json_stream.h"
+
+// What the tokenizer expects next.
+enum {
+    State_Value,
+    State_ArrayFirstValue,
+    State_ObjectFirstKey,
+    State_ObjectKey,
+    State_Colon,
+    State_AfterValue,
+    State_String,
+    State_Escape,
+    State_Unicode,
+    State_Number,
+    State_Literal,
+    State_Done
+};
+
+// Position within the JSON number grammar.
+enum {
+    NumberState_Sign,
+    NumberState_Zero,
+    NumberState_Integer,
+    NumberState_Point,
+    NumberState_Fraction,
+    NumberState_Exponent,
+    NumberState_ExponentSign,
+    NumberState_ExponentDigits
+};
+
+static bool IsWhitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool IsDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static JsonStream_Result Fail(JsonStream *stream, JsonStream_Result result)
+{
+    stream->result = result;
+    return result;
+}
+
+static const JsonStream_PathHandler *FindHandler(const JsonStream *stream)
+{
+    if (stream->pathOverflow) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < stream->handlerCount; ++i) {
+        const char *path = stream->handlers[i].path;
+        if (strncmp(path, stream->path, stream->pathLength) == 0 &&
+            path[stream->pathLength] == '\0') {
+            return &stream->handlers[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void Report(JsonStream *stream, const JsonStream_Value *value)
+{
+    stream->path[stream->pathLength] = '\0';
+    stream->match->handler(stream->path, value, stream->context);
+}
+
+static void AppendPath(JsonStream *stream, const char *data, size_t length)
+{
+    if (stream->pathOverflow) {
+        return;
+    }
+
+    if (length > JSON_STREAM_MAX_PATH_LENGTH - stream->pathLength) {
+        stream->pathOverflow = true;
+        return;
+    }
+
+    memcpy(stream->path + stream->pathLength, data, length);
+    stream->pathLength += length;
+}
+
+// Reset the path to that of the innermost container, ready for a key or "[]" to be appended.
+static void BeginChildPath(JsonStream *stream)
+{
+    size_t containerPathLength = stream->containerPathLengths[stream->depth - 1];
+    stream->pathOverflow = containerPathLength == SIZE_MAX;
+    stream->pathLength = stream->pathOverflow ? 0 : containerPathLength;
+}
+
+// Append unescaped string content to the key being read, or to the token buffer if the string is
+// a value at a registered path.
+static bool AppendDecoded(JsonStream *stream, const char *data, size_t length)
+{
+    if (stream->inKey) {
+        AppendPath(stream, data, length);
+        return true;
+    }
+
+    if (stream->match == NULL) {
+        return true;
+    }
+
+    // Without a token buffer, strings are reported empty so that handlers can skip them.
+    if (stream->tokenBuffer == NULL) {
+        return true;
+    }
+
+    if (length >= stream->tokenBufferSize - stream->tokenLength) {
+        return false;
+    }
+
+    memcpy(stream->tokenBuffer + stream->tokenLength, data, length);
+    stream->tokenLength += length;
+    return true;
+}
+
+static JsonStream_Result AppendCodePoint(JsonStream *stream, unsigned int codePoint)
+{
+    char utf8[4];
+    size_t length;
+
+    if (codePoint < 0x80) {
+        utf8[0] = (char)codePoint;
+        length = 1;
+    } else if (codePoint < 0x800) {
+        utf8[0] = (char)(0xC0 | (codePoint >> 6));
+        utf8[1] = (char)(0x80 | (codePoint & 0x3F));
+        length = 2;
+    } else if (codePoint < 0x10000) {
+        utf8[0] = (char)(0xE0 | (codePoint >> 12));
+        utf8[1] = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+        utf8[2] = (char)(0x80 | (codePoint & 0x3F));
+        length = 3;
+    } else {
+        utf8[0] = (char)(0xF0 | (codePoint >> 18));
+        utf8[1] = (char)(0x80 | ((codePoint >> 12) & 0x3F));
+        utf8[2] = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+        utf8[3] = (char)(0x80 | (codePoint & 0x3F));
+        length = 4;
+    }
+
+    if (!AppendDecoded(stream, utf8, length)) {
+        return Fail(stream, JsonStream_Result_TokenTooLong);
+    }
+
+    return JsonStream_Result_OK;
+}
+
+static JsonStream_Result EndUnicodeEscape(JsonStream *stream)
+{
+    unsigned int codePoint = stream->codePoint;
+
+    if (stream->highSurrogate != 0) {
+        if (codePoint < 0xDC00 || codePoint > 0xDFFF) {
+            return Fail(stream, JsonStream_Result_SyntaxError);
+        }
+        codePoint = 0x10000 + ((stream->highSurrogate - 0xD800) << 10) + (codePoint - 0xDC00);
+        stream->highSurrogate = 0;
+    } else if (codePoint >= 0xD800 && codePoint <= 0xDBFF) {
+        // The low surrogate must follow as another escape.
+        stream->highSurrogate = codePoint;
+        return JsonStream_Result_OK;
+    } else if (codePoint >= 0xDC00 && codePoint <= 0xDFFF) {
+        return Fail(stream, JsonStream_Result_SyntaxError);
+    }
+
+    return AppendCodePoint(stream, codePoint);
+}
+
+static void EndValue(JsonStream *stream)
+{
+    stream->match = NULL;
+    stream->state = stream->depth == 0 ? State_Done : State_AfterValue;
+}
+
+static JsonStream_Result OpenContainer(JsonStream *stream, char bracket)
+{
+    if (stream->depth == JSON_STREAM_MAX_DEPTH) {
+        return Fail(stream, JsonStream_Result_TooDeep);
+    }
+
+    if (stream->match != NULL) {
+        JsonStream_Value value = {
+            .type = bracket == '{' ? JsonStream_ValueType_Object : JsonStream_ValueType_Array};
+        Report(stream, &value);
+        stream->match = NULL;
+    }
+
+    stream->containers[stream->depth] = bracket;
+    stream->containerPathLengths[stream->depth] =
+        stream->pathOverflow ? SIZE_MAX : stream->pathLength;
+    ++stream->depth;
+    stream->state = bracket == '{' ? State_ObjectFirstKey : State_ArrayFirstValue;
+    return JsonStream_Result_OK;
+}
+
+static JsonStream_Result CloseContainer(JsonStream *stream, char bracket)
+{
+    char openingBracket = bracket == '}' ? '{' : '[';
+    if (stream->depth == 0 || stream->containers[stream->depth - 1] != openingBracket) {
+        return Fail(stream, JsonStream_Result_SyntaxError);
+    }
+
+    --stream->depth;
+    EndValue(stream);
+    return JsonStream_Result_OK;
+}
+
+static void BeginKey(JsonStream *stream)
+{
+    BeginChildPath(stream);
+    if (stream->pathLength > 0) {
+        AppendPath(stream, ".", 1);
+    }
+    stream->inKey = true;
+    stream->state = State_String;
+}
+
+static JsonStream_Result AppendNumber(JsonStream *stream, char c)
+{
+    if (stream->match != NULL) {
+        if (stream->numberLength == JSON_STREAM_MAX_NUMBER_LENGTH) {
+            return Fail(stream, JsonStream_Result_TokenTooLong);
+        }
+        stream->number[stream->numberLength++] = c;
+    }
+
+    return JsonStream_Result_OK;
+}
+
+static JsonStream_Result BeginValue(JsonStream *stream, char c)
+{
+    if (stream->depth > 0 && stream->containers[stream->depth - 1] == '[') {
+        BeginChildPath(stream);
+        AppendPath(stream, "[]", 2);
+    }
+
+    stream->match = FindHandler(stream);
+
+    switch (c) {
+    case '{':
+    case '[':
+        return OpenContainer(stream, c);
+    case '"':
+        stream->inKey = false;
+        stream->tokenLength = 0;
+        stream->state = State_String;
+        return JsonStream_Result_OK;
+    case 't':
+        stream->literal = "true";
+        break;
+    case 'f':
+        stream->literal = "false";
+        break;
+    case 'n':
+        stream->literal = "null";
+        break;
+    default:
+        if (c != '-' && !IsDigit(c)) {
+            return Fail(stream, JsonStream_Result_SyntaxError);
+        }
+        stream->numberLength = 0;
+        stream->numberState = c == '-'   ? NumberState_Sign
+                              : c == '0' ? NumberState_Zero
+                                         : NumberState_Integer;
+        stream->state = State_Number;
+        return AppendNumber(stream, c);
+    }
+
+    stream->literalIndex = 1;
+    stream->state = State_Literal;
+    return JsonStream_Result_OK;
+}
+
+static JsonStream_Result EndString(JsonStream *stream)
+{
+    if (stream->inKey) {
+        stream->inKey = false;
+        stream->state = State_Colon;
+        return JsonStream_Result_OK;
+    }
+
+    if (stream->match != NULL) {
+        JsonStream_Value value = {.type = JsonStream_ValueType_String,
+                                  .string = "",
+                                  .stringLength = stream->tokenLength};
+        if (stream->tokenBuffer != NULL) {
+            stream->tokenBuffer[stream->tokenLength] = '\0';
+            value.string = stream->tokenBuffer;
+        }
+        Report(stream, &value);
+    }
+
+    EndValue(stream);
+    return JsonStream_Result_OK;
+}
+
+static JsonStream_Result EndNumber(JsonStream *stream)
+{
+    switch (stream->numberState) {
+    case NumberState_Zero:
+    case NumberState_Integer:
+    case NumberState_Fraction:
+    case NumberState_ExponentDigits:
+        break;
+    default:
+        return Fail(stream, JsonStream_Result_SyntaxError);
+    }
+
+    if (stream->match != NULL) {
+        stream->number[stream->numberLength] = '\0';
+        JsonStream_Value value = {.type = JsonStream_ValueType_Number,
+                                  .number = strtod(stream->number, NULL)};
+        Report(stream, &value);
+    }
+
+    EndValue(stream);
+    return JsonStream_Result_OK;
+}
+
+static void EndLiteral(JsonStream *stream)
+{
+    if (stream->match != NULL) {
+        JsonStream_Value value = {.type = JsonStream_ValueType_Boolean};
+        if (stream->literal[0] == 't') {
+            value.boolean = true;
+        } else if (stream->literal[0] == 'n') {
+            value.type = JsonStream_ValueType_Null;
+        }
+        Report(stream, &value);
+    }
+
+    EndValue(stream);
+}
+
+// Advance the number grammar by one character. Returns false if the character does not continue
+// the number, in which case it terminates it.
+static bool AdvanceNumber(JsonStream *stream, char c)
+{
+    bool isExponent = c == 'e' || c == 'E';
+
+    switch (stream->numberState) {
+    case NumberState_Sign:
+        if (!IsDigit(c)) {
+            return false;
+        }
+        stream->numberState = c == '0' ? NumberState_Zero : NumberState_Integer;
+        return true;
+    case NumberState_Zero:
+    case NumberState_Integer:
+        if (IsDigit(c) && stream->numberState == NumberState_Integer) {
+            return true;
+        }
+        if (c == '.') {
+            stream->numberState = NumberState_Point;
+            return true;
+        }
+        if (isExponent) {
+            stream->numberState = NumberState_Exponent;
+            return true;
+        }
+        return false;
+    case NumberState_Point:
+    case NumberState_Fraction:
+        if (IsDigit(c)) {
+            stream->numberState = NumberState_Fraction;
+            return true;
+        }
+        if (isExponent && stream->numberState == NumberState_Fraction) {
+            stream->numberState = NumberState_Exponent;
+            return true;
+        }
+        return false;
+    case NumberState_Exponent:
+        if (c == '+' || c == '-') {
+            stream->numberState = NumberState_ExponentSign;
+            return true;
+        }
+        // Fall through.
+    case NumberState_ExponentSign:
+    case NumberState_ExponentDigits:
+        if (IsDigit(c)) {
+            stream->numberState = NumberState_ExponentDigits;
+            return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+static JsonStream_Result ProcessEscape(JsonStream *stream, char c)
+{
+    char unescaped;
+
+    switch (c) {
+    case '"':
+    case '\\':
+    case '/':
+        unescaped = c;
+        break;
+    case 'b':
+        unescaped = '\b';
+        break;
+    case 'f':
+        unescaped = '\f';
+        break;
+    case 'n':
+        unescaped = '\n';
+        break;
+    case 'r':
+        unescaped = '\r';
+        break;
+    case 't':
+        unescaped = '\t';
+        break;
+    case 'u':
+        stream->codePoint = 0;
+        stream->unicodeDigits = 0;
+        stream->state = State_Unicode;
+        return JsonStream_Result_OK;
+    default:
+        return Fail(stream, JsonStream_Result_SyntaxError);
+    }
+
+    if (stream->highSurrogate != 0) {
+        return Fail(stream, JsonStream_Result_SyntaxError);
+    }
+
+    stream->state = State_String;
+    if (!AppendDecoded(stream, &unescaped, 1)) {
+        return Fail(stream, JsonStream_Result_TokenTooLong);
+    }
+
+    return JsonStream_Result_OK;
+}
+
+static JsonStream_Result ProcessChar(JsonStream *stream, char c)
+{
+    switch (stream->state) {
+    case State_Value:
+        if (IsWhitespace(c)) {
+            return JsonStream_Result_OK;
+        }
+        return BeginValue(stream, c);
+
+    case State_ArrayFirstValue:
+        if (IsWhitespace(c)) {
+            return JsonStream_Result_OK;
+        }
+        if (c == ']') {
+            return CloseContainer(stream, c);
+        }
+        return BeginValue(stream, c);
+
+    case State_ObjectFirstKey:
+    case State_ObjectKey:
+        if (IsWhitespace(c)) {
+            return JsonStream_Result_OK;
+        }
+        if (c == '}' && stream->state == State_ObjectFirstKey) {
+            return CloseContainer(stream, c);
+        }
+        if (c != '"') {
+            return Fail(stream, JsonStream_Result_SyntaxError);
+        }
+        BeginKey(stream);
+        return JsonStream_Result_OK;
+
+    case State_Colon:
+        if (IsWhitespace(c)) {
+            return JsonStream_Result_OK;
+        }
+        if (c != ':') {
+            return Fail(stream, JsonStream_Result_SyntaxError);
+        }
+        stream->state = State_Value;
+        return JsonStream_Result_OK;
+
+    case State_AfterValue:
+        if (IsWhitespace(c)) {
+            return JsonStream_Result_OK;
+        }
+        if (c == ',') {
+            stream->state =
+                stream->containers[stream->depth - 1] == '{' ? State_ObjectKey : State_Value;
+            return JsonStream_Result_OK;
+        }
+        if (c == '}' || c == ']') {
+            return CloseContainer(stream, c);
+        }
+        return Fail(stream, JsonStream_Result_SyntaxError);
+
+    case State_String:
+        if (stream->highSurrogate != 0 && c != '\\') {
+            return Fail(stream, JsonStream_Result_SyntaxError);
+        }
+        if (c == '"') {
+            return EndString(stream);
+        }
+        if (c == '\\') {
+            stream->state = State_Escape;
+            return JsonStream_Result_OK;
+        }
+        if ((unsigned char)c < 0x20) {
+            return Fail(stream, JsonStream_Result_SyntaxError);
+        }
+        if (!AppendDecoded(stream, &c, 1)) {
+            return Fail(stream, JsonStream_Result_TokenTooLong);
+        }
+        return JsonStream_Result_OK;
+
+    case State_Escape:
+        return ProcessEscape(stream, c);
+
+    case State_Unicode:
+        if (IsDigit(c)) {
+            stream->codePoint = (stream->codePoint << 4) | (unsigned int)(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            stream->codePoint = (stream->codePoint << 4) | (unsigned int)(c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            stream->codePoint = (stream->codePoint << 4) | (unsigned int)(c - 'A' + 10);
+        } else {
+            return Fail(stream, JsonStream_Result_SyntaxError);
+        }
+        if (++stream->unicodeDigits < 4) {
+            return JsonStream_Result_OK;
+        }
+        stream->state = State_String;
+        return EndUnicodeEscape(stream);
+
+    case State_Number:
+        if (AdvanceNumber(stream, c)) {
+            return AppendNumber(stream, c);
+        }
+        // The character ends the number, and is then processed in the state which follows it.
+        if (EndNumber(stream) != JsonStream_Result_OK) {
+            return stream->result;
+        }
+        return ProcessChar(stream, c);
+
+    case State_Literal:
+        if (c != stream->literal[stream->literalIndex]) {
+            return Fail(stream, JsonStream_Result_SyntaxError);
+        }
+        if (stream->literal[++stream->literalIndex] == '\0') {
+            EndLiteral(stream);
+        }
+        return JsonStream_Result_OK;
+
+    case State_Done:
+        if (IsWhitespace(c)) {
+            return JsonStream_Result_OK;
+        }
+        return Fail(stream, JsonStream_Result_SyntaxError);
+
+    default:
+        return Fail(stream, JsonStream_Result_SyntaxError);
+    }
+}
+
+void JsonStream_Init(JsonStream *stream, const JsonStream_PathHandler *handlers,
+                     size_t handlerCount, char *tokenBuffer, size_t tokenBufferSize,
+                     void *context)
+{
+    memset(stream, 0, sizeof(*stream));
+    stream->handlers = handlers;
+    stream->handlerCount = handlerCount;
+    stream->context = context;
+    if (tokenBuffer != NULL && tokenBufferSize > 0) {
+        stream->tokenBuffer = tokenBuffer;
+        stream->tokenBufferSize = tokenBufferSize;
+    }
+    stream->state = State_Value;
+    stream->result = JsonStream_Result_OK;
+}
+
+JsonStream_Result JsonStream_Feed(JsonStream *stream, const char *data, size_t length)
+{
+    for (size_t i = 0; i < length && stream->result == JsonStream_Result_OK; ++i) {
+        ProcessChar(stream, data[i]);
+    }
+
+    return stream->result;
+}
+
+JsonStream_Result JsonStream_Finish(JsonStream *stream)
+{
+    if (stream->result != JsonStream_Result_OK) {
+        return stream->result;
+    }
+
+    // A number at the root is only terminated by the end of the input.
+    if (stream->state == State_Number && stream->depth == 0) {
+        EndNumber(stream);
+    }
+
+    if (stream->result == JsonStream_Result_OK && stream->state != State_Done) {
+        Fail(stream, JsonStream_Result_Incomplete);
+    }
+
+    return stream->result;
+}
+
+JsonStream_Result JsonStream_Parse(const char *data, size_t length,
+                                   const JsonStream_PathHandler *handlers, size_t handlerCount,
+                                   char *tokenBuffer, size_t tokenBufferSize, void *context)
+{
+    JsonStream stream;
+    JsonStream_Init(&stream, handlers, handlerCount, tokenBuffer, tokenBufferSize, context);
+    JsonStream_Feed(&stream, data, length);
+    return JsonStream_Finish(&stream);
+}
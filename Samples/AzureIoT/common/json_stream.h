@@ -0,0 +1,161 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A streaming JSON tokenizer which does not allocate. Instead of building a parson DOM, the
+// caller registers the paths it is interested in, and a handler is invoked as each matching value
+// streams past. Input may be fed in chunks of any size; the tokenizer resumes where the previous
+// chunk left off, so a payload never needs to be copied into one contiguous buffer.
+//
+// A path names a value by the keys which lead to it, separated by '.', for example
+// "desired.NextFlavor.Name". The root value has the empty path "". Elements of an array share the
+// path of the array followed by "[]", for example "items[]" or "items[].name". Keys longer than
+// JSON_STREAM_MAX_PATH_LENGTH in total never match.
+
+#define JSON_STREAM_MAX_DEPTH 32
+#define JSON_STREAM_MAX_PATH_LENGTH 127
+#define JSON_STREAM_MAX_NUMBER_LENGTH 63
+
+/// <summary>
+/// Type of a value passed to a <see cref="JsonStream_ValueCallbackType" />.
+/// </summary>
+typedef enum {
+    /// <summary>An object starts; its members are reported separately.</summary>
+    JsonStream_ValueType_Object,
+    /// <summary>An array starts; its elements are reported separately.</summary>
+    JsonStream_ValueType_Array,
+    JsonStream_ValueType_String,
+    JsonStream_ValueType_Number,
+    JsonStream_ValueType_Boolean,
+    JsonStream_ValueType_Null
+} JsonStream_ValueType;
+
+/// <summary>
+/// A value at a registered path. Only the member which matches <see cref="type" /> is set.
+/// </summary>
+typedef struct {
+    JsonStream_ValueType type;
+    /// <summary>The unescaped, NULL-terminated string, valid only during the callback.</summary>
+    const char *string;
+    /// <summary>Length of <see cref="string" />, which may itself contain NULL
+    /// characters.</summary>
+    size_t stringLength;
+    double number;
+    bool boolean;
+} JsonStream_Value;
+
+/// <summary>
+/// Callback type for a function to be invoked when a value at a registered path is found.
+/// </summary>
+/// <param name="path">The path of the value.</param>
+/// <param name="value">The value.</param>
+/// <param name="context">The context supplied to <see cref="JsonStream_Init" />.</param>
+typedef void (*JsonStream_ValueCallbackType)(const char *path, const JsonStream_Value *value,
+                                             void *context);
+
+/// <summary>
+/// A path of interest, and the function to invoke for values found at it.
+/// </summary>
+typedef struct {
+    const char *path;
+    JsonStream_ValueCallbackType handler;
+} JsonStream_PathHandler;
+
+/// <summary>
+/// Result of feeding input to the tokenizer. Errors are sticky: once an error has been returned,
+/// all further calls return it until the tokenizer is initialized again.
+/// </summary>
+typedef enum {
+    JsonStream_Result_OK,
+    /// <summary>The input ended before the value was complete.</summary>
+    JsonStream_Result_Incomplete,
+    JsonStream_Result_SyntaxError,
+    /// <summary>Containers are nested more deeply than JSON_STREAM_MAX_DEPTH.</summary>
+    JsonStream_Result_TooDeep,
+    /// <summary>A string at a registered path does not fit in the token buffer, or a number at
+    /// a registered path is longer than JSON_STREAM_MAX_NUMBER_LENGTH.</summary>
+    JsonStream_Result_TokenTooLong
+} JsonStream_Result;
+
+/// <summary>
+/// Tokenizer state. Initialize with <see cref="JsonStream_Init" />. The members are internal and
+/// should not be accessed directly.
+/// </summary>
+typedef struct {
+    const JsonStream_PathHandler *handlers;
+    size_t handlerCount;
+    void *context;
+
+    /// <summary>Caller-supplied buffer for strings at registered paths.</summary>
+    char *tokenBuffer;
+    size_t tokenBufferSize;
+    size_t tokenLength;
+    char number[JSON_STREAM_MAX_NUMBER_LENGTH + 1];
+    size_t numberLength;
+
+    /// <summary>Path of the current value.</summary>
+    char path[JSON_STREAM_MAX_PATH_LENGTH + 1];
+    size_t pathLength;
+    bool pathOverflow;
+
+    /// <summary>For each open container, its bracket and the length of its path, or SIZE_MAX
+    /// if its path did not fit.</summary>
+    char containers[JSON_STREAM_MAX_DEPTH];
+    size_t containerPathLengths[JSON_STREAM_MAX_DEPTH];
+    size_t depth;
+
+    int state;
+    int numberState;
+    bool inKey;
+    const JsonStream_PathHandler *match;
+    const char *literal;
+    size_t literalIndex;
+    unsigned int codePoint;
+    unsigned int unicodeDigits;
+    unsigned int highSurrogate;
+    JsonStream_Result result;
+} JsonStream;
+
+/// <summary>
+/// Initialize a tokenizer for a new JSON text.
+/// </summary>
+/// <param name="stream">The tokenizer.</param>
+/// <param name="handlers">Paths of interest, which must outlive the tokenizer.</param>
+/// <param name="handlerCount">Number of entries in <paramref name="handlers" />.</param>
+/// <param name="tokenBuffer">Buffer in which strings at registered paths are unescaped, or NULL
+///     if no string values are needed, in which case they are reported as empty strings.</param>
+/// <param name="tokenBufferSize">Size of <paramref name="tokenBuffer" />, including space for the
+///     NULL terminator.</param>
+/// <param name="context">Context passed to the handlers.</param>
+void JsonStream_Init(JsonStream *stream, const JsonStream_PathHandler *handlers,
+                     size_t handlerCount, char *tokenBuffer, size_t tokenBufferSize,
+                     void *context);
+
+/// <summary>
+/// Feed the next chunk of input. Handlers for complete values in the chunk are invoked before
+/// this returns.
+/// </summary>
+/// <param name="stream">The tokenizer.</param>
+/// <param name="data">The chunk, which need not be NULL-terminated.</param>
+/// <param name="length">Length of the chunk in bytes.</param>
+/// <returns>JsonStream_Result_OK if the input so far is valid, or an error.</returns>
+JsonStream_Result JsonStream_Feed(JsonStream *stream, const char *data, size_t length);
+
+/// <summary>
+/// Signal the end of the input.
+/// </summary>
+/// <param name="stream">The tokenizer.</param>
+/// <returns>JsonStream_Result_OK if the input was one complete JSON value, or an error.</returns>
+JsonStream_Result JsonStream_Finish(JsonStream *stream);
+
+/// <summary>
+/// Tokenize a complete JSON text in one call; equivalent to <see cref="JsonStream_Init" />,
+/// <see cref="JsonStream_Feed" /> and <see cref="JsonStream_Finish" />.
+/// </summary>
+JsonStream_Result JsonStream_Parse(const char *data, size_t length,
+                                   const JsonStream_PathHandler *handlers, size_t handlerCount,
+                                   char *tokenBuffer, size_t tokenBufferSize, void *context);
@@ -66,6 +66,7 @@ static void DisplayAlertCallbackHandler(const char *alertMessage);
 // Timer / polling
 static EventLoop *eventLoop = NULL;
 static EventLoopTimer *telemetryTimer = NULL;
+static EventLoopTimer *timerStatsReporter = NULL;
 
 static bool isConnected = false;
 
@@ -136,6 +137,8 @@ static const char *CloudResultToString(Cloud_Result result)
         return "No network connection available";
     case Cloud_Result_OtherFailure:
         return "Other failure";
+    case Cloud_Result_Busy:
+        return "Too many messages waiting to be sent";
     }
 
     return "Unknown Cloud_Result";
@@ -207,6 +210,19 @@ static void ConnectionChangedCallbackHandler(bool connected)
     }
 }
 
+/// <summary>
+///     Log each timer's statistics. Overruns mean the event loop is not keeping up with the timer.
+/// </summary>
+static void TimerStatsCallbackHandler(EventLoopTimer *timer, const char *name,
+                                      const EventLoopTimerStats *stats, void *context)
+{
+    Log_Debug("INFO: Timer %s: %llu expirations, %llu overruns (%llu missed), "
+              "max latency %llu us.\n",
+              name != NULL ? name : "(unnamed)", (unsigned long long)stats->expirations,
+              (unsigned long long)stats->overruns, (unsigned long long)stats->missedExpirations,
+              (unsigned long long)(stats->maxLatencyNs / 1000));
+}
+
 static void TelemetryTimerCallbackHandler(EventLoopTimer *timer)
 {
     static Cloud_Telemetry telemetry = {.temperature = 50.f};
@@ -219,20 +235,20 @@ static void TelemetryTimerCallbackHandler(EventLoopTimer *timer)
     time_t now;
     time(&now);
 
-    if (isConnected) {
-        if (telemetryUploadEnabled) {
-            // Generate a simulated temperature.
-            float delta = ((float)(rand() % 41)) / 20.0f - 1.0f; // between -1.0 and +1.0
-            telemetry.temperature += delta;
-
-            Cloud_Result result = Cloud_SendTelemetry(&telemetry, now);
-            if (result != Cloud_Result_OK) {
-                Log_Debug("WARNING: Could not send thermometer telemetry to cloud: %s\n",
-                          CloudResultToString(result));
-            }
-        } else {
-            Log_Debug("INFO: Telemetry upload disabled; not sending telemetry.\n");
+    // Telemetry is sent while disconnected too; the cloud module queues it until the connection is
+    // back.
+    if (telemetryUploadEnabled) {
+        // Generate a simulated temperature.
+        float delta = ((float)(rand() % 41)) / 20.0f - 1.0f; // between -1.0 and +1.0
+        telemetry.temperature += delta;
+
+        Cloud_Result result = Cloud_SendTelemetry(&telemetry, now);
+        if (result != Cloud_Result_OK) {
+            Log_Debug("WARNING: Could not send thermometer telemetry to cloud: %s\n",
+                      CloudResultToString(result));
         }
+    } else {
+        Log_Debug("INFO: Telemetry upload disabled; not sending telemetry.\n");
     }
 }
 
@@ -262,6 +278,14 @@ static ExitCode InitPeripheralsAndHandlers(void)
     if (telemetryTimer == NULL) {
         return ExitCode_Init_TelemetryTimer;
     }
+    SetEventLoopTimerName(telemetryTimer, "Telemetry");
+
+    struct timespec timerStatsPeriod = {.tv_sec = 60, .tv_nsec = 0};
+    timerStatsReporter = CreateEventLoopTimerStatsReporter(eventLoop, &timerStatsPeriod,
+                                                           &TimerStatsCallbackHandler, NULL);
+    if (timerStatsReporter == NULL) {
+        return ExitCode_Init_TimerStatsReporter;
+    }
 
     ExitCode interfaceExitCode =
         UserInterface_Initialise(eventLoop, ButtonPressedCallbackHandler, ExitCodeCallbackHandler);
@@ -285,10 +309,18 @@ static ExitCode InitPeripheralsAndHandlers(void)
 static void ClosePeripheralsAndHandlers(void)
 {
     DisposeEventLoopTimer(telemetryTimer);
+    DisposeEventLoopTimer(timerStatsReporter);
     Cloud_Cleanup();
     UserInterface_Cleanup();
     Connection_Cleanup();
     EventLoop_Close(eventLoop);
 
+    EventLoopTimerWakeupStats wakeupStats;
+    GetEventLoopTimerWakeupStats(&wakeupStats);
+    Log_Debug("INFO: Timer wakeups: %llu, expirations: %llu, wakeups avoided: %llu.\n",
+              (unsigned long long)wakeupStats.wakeups,
+              (unsigned long long)wakeupStats.expirations,
+              (unsigned long long)wakeupStats.wakeupsAvoided);
+
     Log_Debug("Closing file descriptors\n");
 }
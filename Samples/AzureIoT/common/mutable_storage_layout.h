@@ -0,0 +1,29 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <assert.h>
+
+// Layout of the application's mutable storage file. Each region is used by one module, and the
+// regions follow one another, so resizing one moves those after it rather than overlapping them.
+
+// Size of the mutable storage file. This must match "MutableStorage": { "SizeKB": 8 } in
+// app_manifest.json, which CMakeLists.txt passes in as MANIFEST_MUTABLE_STORAGE_SIZE_KB.
+#define MUTABLE_STORAGE_SIZE (8 * 1024)
+
+#ifdef MANIFEST_MUTABLE_STORAGE_SIZE_KB
+static_assert(MUTABLE_STORAGE_SIZE == MANIFEST_MUTABLE_STORAGE_SIZE_KB * 1024,
+              "MUTABLE_STORAGE_SIZE does not match the size declared in app_manifest.json.");
+#endif
+
+// Telemetry which cannot be sent while the device is offline; see cloud.c.
+#define TELEMETRY_QUEUE_STORAGE_OFFSET 0
+#define TELEMETRY_QUEUE_REGION_SIZE (6 * 1024)
+
+// The DPS assignment cache, when the DPS connection is used; see options_dps.c.
+#define DPS_CACHE_STORAGE_OFFSET (TELEMETRY_QUEUE_STORAGE_OFFSET + TELEMETRY_QUEUE_REGION_SIZE)
+#define DPS_CACHE_STORAGE_SIZE 1024
+
+static_assert(DPS_CACHE_STORAGE_OFFSET + DPS_CACHE_STORAGE_SIZE <= MUTABLE_STORAGE_SIZE,
+              "The mutable storage regions do not fit in the size declared in app_manifest.json.");
@@ -41,6 +41,7 @@ extern "C" {
 typedef struct json_object_t JSON_Object;
 typedef struct json_array_t JSON_Array;
 typedef struct json_value_t JSON_Value;
+typedef struct json_path_t JSON_Path;
 
 enum json_value_type {
     JSONError = -1,
@@ -63,6 +64,23 @@ typedef void (*JSON_Free_Function)(void *);
    from stdlib will be used for all allocations */
 void json_set_allocation_functions(JSON_Malloc_Function malloc_fun, JSON_Free_Function free_fun);
 
+/* Node pool: freed JSON_Value, JSON_Object and JSON_Array headers are kept on a free list per type,
+ * up to max_nodes_per_type each, and reused by later values instead of going back to the heap.
+ * The pool is off (0) by default. Lowering the limit frees the excess headers, and changing the
+ * allocation functions frees them all, since they came from the old allocator. */
+typedef struct json_node_pool_stats_t {
+    size_t hits;                    /* headers reused from a free list */
+    size_t misses;                  /* headers allocated with the allocation functions */
+    size_t recycled;                /* headers put on a free list when their value was freed */
+    size_t released;                /* headers freed because their free list was full */
+    size_t pooled_nodes;            /* headers on the free lists now */
+    size_t pooled_bytes_high_water; /* most memory held on the free lists at once */
+    size_t heap_bytes_saved;        /* total size of the allocations served by hits */
+} JSON_Node_Pool_Stats;
+
+void json_set_node_pool_limit(size_t max_nodes_per_type);
+void json_get_node_pool_stats(JSON_Node_Pool_Stats *stats);
+
 /*  Parses first JSON value in a string, returns NULL in case of error */
 JSON_Value *json_parse_string(const char *string);
 
@@ -70,11 +88,39 @@ JSON_Value *json_parse_string(const char *string);
     returns NULL in case of error */
 JSON_Value *json_parse_string_with_comments(const char *string);
 
+/* Parses in place: strings are unescaped inside string, and the names and string values of the
+   result point into it rather than being copied. string must be writable, is modified even if
+   parsing fails, and must outlive the result. Values added to the result later are copied as
+   usual. */
+JSON_Value *json_parse_string_insitu(char *string);
+
 /* Serialization */
 size_t json_serialization_size(const JSON_Value *value); /* returns 0 on fail */
 JSON_Status json_serialize_to_buffer(const JSON_Value *value, char *buf, size_t buf_size_in_bytes);
 char *json_serialize_to_string(const JSON_Value *value);
 
+/* Serializes in a single pass into buf and sets *out_len to the length of the output, excluding
+   the terminator. If buf is too small, returns JSONFailure with *out_len set to the length that
+   was needed, and buf holds a truncated, terminated prefix. out_len may be NULL. */
+JSON_Status json_serialize_to_buffer_n(const JSON_Value *value, char *buf,
+                                       size_t buf_size_in_bytes, size_t *out_len);
+
+/* Growable serialization buffer. It starts with optional caller-supplied storage and moves to
+   memory from the allocation functions when that is too small. The memory is kept between calls,
+   so serializing repeatedly into the same buffer stops allocating once it is large enough. Free
+   it with json_buffer_free, while the same allocation functions are in use. */
+typedef struct json_buffer_t {
+    char *data;      /* serialized value, NUL-terminated */
+    size_t length;   /* length of data, excluding the terminator */
+    size_t capacity; /* size of data */
+    int owns_data;   /* data was allocated, rather than supplied to json_buffer_init */
+} JSON_Buffer;
+
+void json_buffer_init(JSON_Buffer *buffer, char *storage, size_t storage_size); /* storage may be
+                                                                                   NULL */
+JSON_Status json_serialize_to_growable_buffer(const JSON_Value *value, JSON_Buffer *buffer);
+void json_buffer_free(JSON_Buffer *buffer);
+
 /* Pretty serialization */
 size_t json_serialization_size_pretty(const JSON_Value *value); /* returns 0 on fail */
 JSON_Status json_serialize_to_buffer_pretty(const JSON_Value *value, char *buf,
@@ -87,6 +133,16 @@ void json_free_serialized_string(char *string); /* frees string from json_serial
 /* Comparing */
 int json_value_equals(const JSON_Value *a, const JSON_Value *b);
 
+/* JSON Merge Patch (RFC 7396) between objects.
+   json_object_merge_patch_diff returns a new object holding only what changed from "from" to "to":
+   changed members, recursively for nested objects, and null for removed members. It is empty if
+   nothing changed, and NULL on failure. Values are compared as json_value_equals does, except
+   that numbers must be exactly equal, so that no change is lost; null members of "to" cannot be
+   expressed, as in any merge patch.
+   json_object_merge_patch applies a patch to target, copying the values it adds. */
+JSON_Value *json_object_merge_patch_diff(const JSON_Object *from, const JSON_Object *to);
+JSON_Status json_object_merge_patch(JSON_Object *target, const JSON_Object *patch);
+
 /* Validation
    This is *NOT* JSON Schema. It validates json by checking if object have identically
    named fields with matching types.
@@ -122,6 +178,19 @@ double json_object_dotget_number(const JSON_Object *object,
 int json_object_dotget_boolean(const JSON_Object *object,
                                const char *name); /* returns -1 on fail */
 
+/* A dot notation path compiled once, with the length and hash of each name worked out up front,
+ so that repeated lookups walk the objects in a single pass without rescanning the path. Addresses
+ the same values as the dotget functions. The path does not refer to the string it was compiled
+ from. */
+JSON_Path *json_path_compile(const char *name);
+void json_path_free(JSON_Path *path);
+JSON_Value *json_path_get_value(const JSON_Object *object, const JSON_Path *path);
+const char *json_path_get_string(const JSON_Object *object, const JSON_Path *path);
+JSON_Object *json_path_get_object(const JSON_Object *object, const JSON_Path *path);
+JSON_Array *json_path_get_array(const JSON_Object *object, const JSON_Path *path);
+double json_path_get_number(const JSON_Object *object, const JSON_Path *path); /* returns 0 on fail */
+int json_path_get_boolean(const JSON_Object *object, const JSON_Path *path); /* returns -1 on fail */
+
 /* Functions to get available names */
 size_t json_object_get_count(const JSON_Object *object);
 const char *json_object_get_name(const JSON_Object *object, size_t index);
@@ -143,6 +212,8 @@ int json_object_dothas_value_of_type(const JSON_Object *object, const char *name
 JSON_Status json_object_set_value(JSON_Object *object, const char *name, JSON_Value *value);
 JSON_Status json_object_set_string(JSON_Object *object, const char *name, const char *string);
 JSON_Status json_object_set_number(JSON_Object *object, const char *name, double number);
+JSON_Status json_object_set_number_fixed(JSON_Object *object, const char *name, double number,
+                                        int decimals);
 JSON_Status json_object_set_boolean(JSON_Object *object, const char *name, int boolean);
 JSON_Status json_object_set_null(JSON_Object *object, const char *name);
 
@@ -151,6 +222,8 @@ JSON_Status json_object_set_null(JSON_Object *object, const char *name);
 JSON_Status json_object_dotset_value(JSON_Object *object, const char *name, JSON_Value *value);
 JSON_Status json_object_dotset_string(JSON_Object *object, const char *name, const char *string);
 JSON_Status json_object_dotset_number(JSON_Object *object, const char *name, double number);
+JSON_Status json_object_dotset_number_fixed(JSON_Object *object, const char *name, double number,
+                                           int decimals);
 JSON_Status json_object_dotset_boolean(JSON_Object *object, const char *name, int boolean);
 JSON_Status json_object_dotset_null(JSON_Object *object, const char *name);
 
@@ -206,6 +279,11 @@ JSON_Value *json_value_init_object(void);
 JSON_Value *json_value_init_array(void);
 JSON_Value *json_value_init_string(const char *string); /* copies passed string */
 JSON_Value *json_value_init_number(double number);
+/* Numbers are serialized in the shortest form which parses back to the same double. A number
+ * created with a fixed precision is instead rounded to at most decimals (0 to 15) digits after the
+ * point, dropping trailing zeros, e.g. 50.349998474121094 with 2 decimals becomes 50.35. It is
+ * rounded as printf's "%.*f" rounds it, so 2.675 (really 2.67499999999999982...) becomes 2.67. */
+JSON_Value *json_value_init_number_fixed(double number, int decimals);
 JSON_Value *json_value_init_boolean(int boolean);
 JSON_Value *json_value_init_null(void);
 JSON_Value *json_value_deep_copy(const JSON_Value *value);
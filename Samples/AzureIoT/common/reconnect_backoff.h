@@ -0,0 +1,60 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdint.h>
+
+// Randomized delays between connection attempts, so that devices which lose their connection at
+// the same moment do not retry in lockstep.
+//
+// The first delay after a reset is drawn uniformly from [0, base]. Each later delay is
+// "decorrelated jitter": drawn uniformly from [base, 3 * the previous delay], and capped. The
+// delays grow roughly geometrically while attempts keep failing, but unlike a doubling backoff,
+// devices which started together drift apart with every attempt.
+
+/// <summary>
+/// Backoff state. Initialize with <see cref="ReconnectBackoff_Init" />; the members should not be
+/// used directly.
+/// </summary>
+typedef struct {
+    /// <summary>Smallest delay after the first, in milliseconds.</summary>
+    uint32_t baseMs;
+    /// <summary>Largest delay, in milliseconds.</summary>
+    uint32_t capMs;
+    /// <summary>The previous delay, or 0 if there has been none since the last reset.</summary>
+    uint32_t previousMs;
+    /// <summary>State of the pseudo-random number generator.</summary>
+    uint32_t randomState;
+} ReconnectBackoff;
+
+/// <summary>
+/// Initialize a backoff.
+/// </summary>
+/// <param name="backoff">The backoff.</param>
+/// <param name="baseMs">Smallest delay after the first, in milliseconds.</param>
+/// <param name="capMs">Largest delay, in milliseconds; at least <paramref name="baseMs" />.</param>
+/// <param name="seed">Seed for the random delays, which should differ between devices.</param>
+void ReconnectBackoff_Init(ReconnectBackoff *backoff, uint32_t baseMs, uint32_t capMs,
+                           uint32_t seed);
+
+/// <summary>
+/// Start again from the shortest delays, after a successful connection.
+/// </summary>
+/// <param name="backoff">The backoff.</param>
+void ReconnectBackoff_Reset(ReconnectBackoff *backoff);
+
+/// <summary>
+/// Get the delay before the next attempt, after a failed attempt or a lost connection.
+/// </summary>
+/// <param name="backoff">The backoff.</param>
+/// <returns>The delay, in milliseconds.</returns>
+uint32_t ReconnectBackoff_Next(ReconnectBackoff *backoff);
+
+/// <summary>
+/// Get a delay drawn uniformly from [0, base], without advancing the backoff; for example, to
+/// spread out the attempts of devices whose network comes back at the same moment.
+/// </summary>
+/// <param name="backoff">The backoff.</param>
+/// <returns>The delay, in milliseconds.</returns>
+uint32_t ReconnectBackoff_Jitter(ReconnectBackoff *backoff);
@@ -0,0 +1,353 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <applibs/log.h>
+#include <applibs/storage.h>
+
+#include "telemetry_queue.h"
+
+// The region starts with a header of native-endian 32-bit words (the queue is only read back by the
+// device which wrote it), followed by the ring.
+enum {
+    HeaderWord_Magic,
+    HeaderWord_Capacity,
+    HeaderWord_Head,
+    HeaderWord_Used,
+    HeaderWord_Count,
+    HeaderWord_Dropped,
+    HeaderWord_Checksum,
+    HeaderWordCount
+};
+
+static const uint32_t QueueMagic = ('T' << 24) | ('Q' << 16) | ('0' << 8) | '1';
+static const uint32_t HeaderSize = HeaderWordCount * sizeof(uint32_t);
+
+// Each record is the message length (2 bytes, little-endian) and the timestamp length (1 byte),
+// followed by the timestamp and then the message, neither NULL-terminated.
+#define RECORD_HEADER_SIZE 3
+#define MAX_MESSAGE_LENGTH 0xFFFF
+#define MAX_DATETIME_LENGTH 0xFF
+
+static uint32_t HeaderChecksum(const uint32_t *words)
+{
+    // FNV-1a over the words before the checksum.
+    uint32_t hash = 2166136261u;
+    const unsigned char *bytes = (const unsigned char *)words;
+    for (size_t i = 0; i < HeaderWord_Checksum * sizeof(uint32_t); ++i) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool WriteHeader(TelemetryQueue *queue)
+{
+    uint32_t words[HeaderWordCount] = {[HeaderWord_Magic] = QueueMagic,
+                                       [HeaderWord_Capacity] = queue->capacity,
+                                       [HeaderWord_Head] = queue->head,
+                                       [HeaderWord_Used] = queue->used,
+                                       [HeaderWord_Count] = queue->count,
+                                       [HeaderWord_Dropped] = queue->dropped};
+    words[HeaderWord_Checksum] = HeaderChecksum(words);
+
+    if (pwrite(queue->fd, words, HeaderSize, queue->storageOffset) != (ssize_t)HeaderSize) {
+        Log_Debug("ERROR: Could not write the telemetry queue header: %s (%d).\n", strerror(errno),
+                  errno);
+        return false;
+    }
+    queue->unflushed = 0;
+    ++queue->headerWrites;
+    return true;
+}
+
+/// <summary>
+///     Reads or writes bytes of the ring starting at a ring offset, wrapping around its end.
+/// </summary>
+static bool TransferRing(const TelemetryQueue *queue, uint32_t position, void *buffer,
+                         uint32_t length, bool write)
+{
+    unsigned char *bytes = buffer;
+    while (length > 0) {
+        uint32_t chunk = queue->capacity - position;
+        if (chunk > length) {
+            chunk = length;
+        }
+
+        off_t fileOffset = (off_t)queue->storageOffset + HeaderSize + position;
+        ssize_t transferred = write ? pwrite(queue->fd, bytes, chunk, fileOffset)
+                                    : pread(queue->fd, bytes, chunk, fileOffset);
+        if (transferred != (ssize_t)chunk) {
+            Log_Debug("ERROR: Could not %s the telemetry queue: %s (%d).\n",
+                      write ? "write" : "read", transferred == -1 ? strerror(errno) : "short",
+                      transferred == -1 ? errno : 0);
+            return false;
+        }
+
+        bytes += chunk;
+        length -= chunk;
+        position = (position + chunk) % queue->capacity;
+    }
+    return true;
+}
+
+static bool ReadRecordHeader(const TelemetryQueue *queue, uint32_t position,
+                             uint32_t *messageLength, uint32_t *dateTimeLength)
+{
+    unsigned char header[RECORD_HEADER_SIZE];
+    if (!TransferRing(queue, position, header, sizeof(header), false)) {
+        return false;
+    }
+    *messageLength = (uint32_t)header[0] | ((uint32_t)header[1] << 8);
+    *dateTimeLength = header[2];
+    return true;
+}
+
+/// <summary>
+///     Removes the record at the head of the ring, without writing the header.
+/// </summary>
+static bool RemoveHead(TelemetryQueue *queue)
+{
+    uint32_t messageLength;
+    uint32_t dateTimeLength;
+    if (!ReadRecordHeader(queue, queue->head, &messageLength, &dateTimeLength)) {
+        return false;
+    }
+
+    uint32_t recordSize = RECORD_HEADER_SIZE + dateTimeLength + messageLength;
+    if (recordSize > queue->used) {
+        Log_Debug("ERROR: The telemetry queue is corrupt; discarding it.\n");
+        queue->head = 0;
+        queue->used = 0;
+        queue->count = 0;
+        return true;
+    }
+
+    queue->head = (queue->head + recordSize) % queue->capacity;
+    queue->used -= recordSize;
+    --queue->count;
+    return true;
+}
+
+bool TelemetryQueue_Open(TelemetryQueue *queue, uint32_t storageOffset, uint32_t regionSize,
+                         TelemetryQueue_DropPolicy dropPolicy, uint32_t maxMessageLength)
+{
+    memset(queue, 0, sizeof(*queue));
+    queue->fd = -1;
+
+    if (regionSize <= HeaderSize + RECORD_HEADER_SIZE) {
+        Log_Debug("ERROR: Telemetry queue region of %u bytes is too small.\n", regionSize);
+        return false;
+    }
+
+    queue->fd = Storage_OpenMutableFile();
+    if (queue->fd == -1) {
+        Log_Debug("ERROR: Could not open mutable storage for the telemetry queue: %s (%d).\n",
+                  strerror(errno), errno);
+        return false;
+    }
+
+    queue->storageOffset = storageOffset;
+    queue->capacity = regionSize - HeaderSize;
+    queue->flushInterval = 1;
+    queue->dropPolicy = dropPolicy;
+    queue->maxMessageLength =
+        maxMessageLength < MAX_MESSAGE_LENGTH ? maxMessageLength : MAX_MESSAGE_LENGTH;
+
+    uint32_t words[HeaderWordCount];
+    ssize_t bytesRead = pread(queue->fd, words, HeaderSize, storageOffset);
+    if (bytesRead == (ssize_t)HeaderSize && words[HeaderWord_Magic] == QueueMagic &&
+        words[HeaderWord_Checksum] == HeaderChecksum(words) &&
+        words[HeaderWord_Capacity] == queue->capacity &&
+        words[HeaderWord_Head] < queue->capacity && words[HeaderWord_Used] <= queue->capacity &&
+        words[HeaderWord_Count] <= words[HeaderWord_Used] / RECORD_HEADER_SIZE) {
+        queue->head = words[HeaderWord_Head];
+        queue->used = words[HeaderWord_Used];
+        queue->count = words[HeaderWord_Count];
+        queue->dropped = words[HeaderWord_Dropped];
+        queue->peakCount = queue->count;
+        Log_Debug("INFO: Telemetry queue recovered %u messages (%u bytes) from storage.\n",
+                  queue->count, queue->used);
+        return true;
+    }
+
+    // No queue of this size in storage, so start an empty one.
+    if (!WriteHeader(queue)) {
+        TelemetryQueue_Close(queue);
+        return false;
+    }
+    return true;
+}
+
+void TelemetryQueue_SetFlushInterval(TelemetryQueue *queue, uint32_t messages)
+{
+    queue->flushInterval = messages > 0 ? messages : 1;
+}
+
+bool TelemetryQueue_Flush(TelemetryQueue *queue)
+{
+    if (queue->fd == -1) {
+        return false;
+    }
+    return queue->unflushed == 0 || WriteHeader(queue);
+}
+
+void TelemetryQueue_Close(TelemetryQueue *queue)
+{
+    if (queue->fd != -1) {
+        TelemetryQueue_Flush(queue);
+        close(queue->fd);
+        queue->fd = -1;
+    }
+}
+
+bool TelemetryQueue_Push(TelemetryQueue *queue, const char *message,
+                         const char *iso8601DateTimeString)
+{
+    size_t messageLength = strlen(message);
+    size_t dateTimeLength = iso8601DateTimeString != NULL ? strlen(iso8601DateTimeString) : 0;
+    size_t recordSize = RECORD_HEADER_SIZE + dateTimeLength + messageLength;
+
+    if (queue->fd == -1) {
+        return false;
+    }
+
+    if (messageLength > queue->maxMessageLength || dateTimeLength > MAX_DATETIME_LENGTH ||
+        recordSize > queue->capacity) {
+        Log_Debug("WARNING: Telemetry message of %zu bytes is too large to queue.\n",
+                  messageLength);
+        ++queue->dropped;
+        ++queue->unflushed;
+        return false;
+    }
+
+    if (recordSize > queue->capacity - queue->used) {
+        if (queue->dropPolicy == TelemetryQueue_DropPolicy_DropNewest) {
+            // Only the dropped count changes, which need not be written at once.
+            ++queue->dropped;
+            ++queue->unflushed;
+            return false;
+        }
+
+        // Make room for a flush interval of messages of this size at once, so that the header is
+        // written once per interval here too, rather than for each message.
+        uint32_t room = queue->capacity / queue->flushInterval >= recordSize
+                            ? (uint32_t)recordSize * queue->flushInterval
+                            : queue->capacity;
+        while (room > queue->capacity - queue->used && queue->count > 0) {
+            if (!RemoveHead(queue)) {
+                return false;
+            }
+            ++queue->dropped;
+        }
+
+        // The new record overwrites the dropped ones, so the header must stop referring to them
+        // first; otherwise a restart during the write would recover a torn record.
+        if (!WriteHeader(queue)) {
+            return false;
+        }
+    }
+
+    unsigned char header[RECORD_HEADER_SIZE] = {(unsigned char)(messageLength & 0xFF),
+                                                (unsigned char)(messageLength >> 8),
+                                                (unsigned char)dateTimeLength};
+    uint32_t tail = (queue->head + queue->used) % queue->capacity;
+    if (!TransferRing(queue, tail, header, sizeof(header), true) ||
+        !TransferRing(queue, (tail + RECORD_HEADER_SIZE) % queue->capacity,
+                      (void *)iso8601DateTimeString, (uint32_t)dateTimeLength, true) ||
+        !TransferRing(queue, (tail + RECORD_HEADER_SIZE + dateTimeLength) % queue->capacity,
+                      (void *)message, (uint32_t)messageLength, true)) {
+        return false;
+    }
+
+    queue->used += (uint32_t)recordSize;
+    ++queue->count;
+    if (++queue->unflushed >= queue->flushInterval && !WriteHeader(queue)) {
+        queue->used -= (uint32_t)recordSize;
+        --queue->count;
+        --queue->unflushed;
+        return false;
+    }
+
+    ++queue->enqueued;
+    if (queue->count > queue->peakCount) {
+        queue->peakCount = queue->count;
+    }
+    return true;
+}
+
+void TelemetryQueue_StartRead(const TelemetryQueue *queue, TelemetryQueue_Cursor *cursor)
+{
+    cursor->position = queue->head;
+    cursor->remaining = queue->count;
+}
+
+bool TelemetryQueue_Read(const TelemetryQueue *queue, TelemetryQueue_Cursor *cursor,
+                         char *message, size_t messageSize, char *iso8601DateTimeString,
+                         size_t dateTimeSize)
+{
+    if (queue->fd == -1 || cursor->remaining == 0) {
+        return false;
+    }
+
+    uint32_t messageLength;
+    uint32_t dateTimeLength;
+    if (!ReadRecordHeader(queue, cursor->position, &messageLength, &dateTimeLength)) {
+        return false;
+    }
+
+    if (messageLength >= messageSize || dateTimeLength >= dateTimeSize) {
+        Log_Debug("ERROR: Queued telemetry message of %u bytes does not fit the buffer.\n",
+                  messageLength);
+        return false;
+    }
+
+    uint32_t position = (cursor->position + RECORD_HEADER_SIZE) % queue->capacity;
+    if (!TransferRing(queue, position, iso8601DateTimeString, dateTimeLength, false) ||
+        !TransferRing(queue, (position + dateTimeLength) % queue->capacity, message,
+                      messageLength, false)) {
+        return false;
+    }
+    iso8601DateTimeString[dateTimeLength] = '\0';
+    message[messageLength] = '\0';
+
+    cursor->position = (position + dateTimeLength + messageLength) % queue->capacity;
+    --cursor->remaining;
+    return true;
+}
+
+bool TelemetryQueue_Pop(TelemetryQueue *queue, size_t count)
+{
+    if (queue->fd == -1) {
+        return false;
+    }
+
+    while (count > 0 && queue->count > 0) {
+        if (!RemoveHead(queue)) {
+            return false;
+        }
+        ++queue->dequeued;
+        --count;
+    }
+
+    if (queue->count == 0) {
+        // Restart at the beginning of the ring, so that short bursts are not split by the wrap.
+        queue->head = 0;
+    }
+    return WriteHeader(queue);
+}
+
+bool TelemetryQueue_Discard(TelemetryQueue *queue)
+{
+    if (queue->fd == -1 || queue->count == 0 || !RemoveHead(queue)) {
+        return false;
+    }
+    ++queue->dropped;
+
+    if (queue->count == 0) {
+        queue->head = 0;
+    }
+    return WriteHeader(queue);
+}
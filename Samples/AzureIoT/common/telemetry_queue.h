@@ -0,0 +1,172 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A bounded queue of telemetry messages in the application's mutable storage, so that telemetry
+// produced while the device is offline survives until it can be sent, including across a restart.
+// Each message is stored with the ISO 8601 timestamp of the reading, so that it can still be sent
+// with its original iothub-creation-time-utc.
+//
+// The queue is a byte ring of variable-length records in a region of the mutable storage file.
+// Records are written before the header which makes them part of the queue, and records dropped to
+// make room are removed from the header before they are overwritten, so an interrupted write loses
+// at most the message being written and those dropped for it. To save flash writes, the header may
+// be written once every few messages (see TelemetryQueue_SetFlushInterval), in which case a restart
+// without TelemetryQueue_Close also loses the messages added since it was last written.
+
+/// <summary>
+/// What to do with a new message when the queue has no room for it.
+/// </summary>
+typedef enum {
+    /// <summary>Discard the oldest messages to make room.</summary>
+    TelemetryQueue_DropPolicy_DropOldest = 0,
+    /// <summary>Discard the new message.</summary>
+    TelemetryQueue_DropPolicy_DropNewest = 1
+} TelemetryQueue_DropPolicy;
+
+/// <summary>
+/// Queue state. Initialize with <see cref="TelemetryQueue_Open" />. The statistics members may be
+/// read, but no member should be modified directly.
+/// </summary>
+typedef struct {
+    /// <summary>Mutable storage file descriptor, or -1 if the queue is not open.</summary>
+    int fd;
+    /// <summary>Offset of the queue's region in the mutable storage file.</summary>
+    uint32_t storageOffset;
+    /// <summary>Size of the ring, in bytes.</summary>
+    uint32_t capacity;
+    /// <summary>Ring offset of the oldest record.</summary>
+    uint32_t head;
+    /// <summary>Bytes of the ring occupied by records.</summary>
+    uint32_t used;
+    /// <summary>Number of messages in the queue.</summary>
+    uint32_t count;
+    /// <summary>Policy applied when the queue is full.</summary>
+    TelemetryQueue_DropPolicy dropPolicy;
+    /// <summary>Length of the longest message which the queue accepts.</summary>
+    uint32_t maxMessageLength;
+    /// <summary>Messages added since the queue was opened.</summary>
+    unsigned long enqueued;
+    /// <summary>Messages removed after being sent, since the queue was opened.</summary>
+    unsigned long dequeued;
+    /// <summary>Messages discarded because the queue was full, because they were too long, or
+    /// with <see cref="TelemetryQueue_Discard" />, since the queue was created in storage; this
+    /// count persists across restarts.</summary>
+    uint32_t dropped;
+    /// <summary>Highest value of <see cref="count" /> since the queue was opened.</summary>
+    uint32_t peakCount;
+    /// <summary>Messages added between writes of the header.</summary>
+    uint32_t flushInterval;
+    /// <summary>Changes to the queue since the header was last written.</summary>
+    uint32_t unflushed;
+    /// <summary>Writes of the header since the queue was opened.</summary>
+    unsigned long headerWrites;
+} TelemetryQueue;
+
+/// <summary>
+/// Position of the next message to read with <see cref="TelemetryQueue_Read" />.
+/// </summary>
+typedef struct {
+    /// <summary>Ring offset of the next record.</summary>
+    uint32_t position;
+    /// <summary>Number of messages after the cursor.</summary>
+    uint32_t remaining;
+} TelemetryQueue_Cursor;
+
+/// <summary>
+/// Open the queue in a region of the mutable storage file, recovering any messages which were
+/// queued before the application last exited. If the region does not hold a queue of the same
+/// capacity, an empty queue is created in it.
+/// </summary>
+/// <param name="queue">The queue.</param>
+/// <param name="storageOffset">Offset of the queue's region in the mutable storage file.</param>
+/// <param name="regionSize">Size of the region, which must be large enough for the queue's
+/// header and at least one message.</param>
+/// <param name="dropPolicy">Policy to apply when the queue is full.</param>
+/// <param name="maxMessageLength">Length of the longest message to accept, excluding the NULL
+/// terminator; the buffer passed to <see cref="TelemetryQueue_Read" /> must be longer. Messages
+/// queued before the application last exited may be longer, if this has changed.</param>
+/// <returns>true on success; false on failure, in which case the queue is closed.</returns>
+bool TelemetryQueue_Open(TelemetryQueue *queue, uint32_t storageOffset, uint32_t regionSize,
+                         TelemetryQueue_DropPolicy dropPolicy, uint32_t maxMessageLength);
+
+/// <summary>
+/// Set how many messages are added between writes of the queue's header, which makes them
+/// recoverable after a restart. The header is always written when messages are removed, when
+/// messages are dropped to make room, and by <see cref="TelemetryQueue_Flush" /> and
+/// <see cref="TelemetryQueue_Close" />. With the DropOldest policy, a full queue drops enough
+/// messages to make room for this many at once. The default, 1, writes it for every message.
+/// </summary>
+/// <param name="queue">The queue.</param>
+/// <param name="messages">Number of messages, at least 1.</param>
+void TelemetryQueue_SetFlushInterval(TelemetryQueue *queue, uint32_t messages);
+
+/// <summary>
+/// Write the queue's header if it has changed since it was last written.
+/// </summary>
+/// <param name="queue">The queue.</param>
+/// <returns>true on success; false if the header could not be written.</returns>
+bool TelemetryQueue_Flush(TelemetryQueue *queue);
+
+/// <summary>
+/// Close the queue, writing its header if it has changed. The messages in it remain in storage.
+/// </summary>
+/// <param name="queue">The queue.</param>
+void TelemetryQueue_Close(TelemetryQueue *queue);
+
+/// <summary>
+/// Add a message to the back of the queue, applying the drop policy if it is full.
+/// </summary>
+/// <param name="queue">The queue.</param>
+/// <param name="message">The telemetry message, as a NULL-terminated JSON string.</param>
+/// <param name="iso8601DateTimeString">Timestamp of the message, or NULL if it has none.</param>
+/// <returns>true if the message was queued; false if it was dropped, is longer than the queue
+/// accepts, or could not be written.</returns>
+bool TelemetryQueue_Push(TelemetryQueue *queue, const char *message,
+                         const char *iso8601DateTimeString);
+
+/// <summary>
+/// Start reading messages from the front of the queue, without removing them.
+/// </summary>
+/// <param name="queue">The queue.</param>
+/// <param name="cursor">Receives the position of the oldest message.</param>
+void TelemetryQueue_StartRead(const TelemetryQueue *queue, TelemetryQueue_Cursor *cursor);
+
+/// <summary>
+/// Read the message at a cursor and advance the cursor to the next message. The cursor is
+/// invalidated by any other call which changes the queue.
+/// </summary>
+/// <param name="queue">The queue.</param>
+/// <param name="cursor">The cursor.</param>
+/// <param name="message">Receives the message, NULL-terminated.</param>
+/// <param name="messageSize">Size of <paramref name="message" />.</param>
+/// <param name="iso8601DateTimeString">Receives the timestamp, NULL-terminated; empty if the
+/// message has none.</param>
+/// <param name="dateTimeSize">Size of <paramref name="iso8601DateTimeString" />.</param>
+/// <returns>true on success; false if there are no more messages, a buffer is too small or the
+/// message could not be read.</returns>
+bool TelemetryQueue_Read(const TelemetryQueue *queue, TelemetryQueue_Cursor *cursor,
+                         char *message, size_t messageSize, char *iso8601DateTimeString,
+                         size_t dateTimeSize);
+
+/// <summary>
+/// Remove messages from the front of the queue, once they have been sent.
+/// </summary>
+/// <param name="queue">The queue.</param>
+/// <param name="count">Number of messages to remove; at most all of them are removed.</param>
+/// <returns>true on success; false if the queue could not be updated in storage.</returns>
+bool TelemetryQueue_Pop(TelemetryQueue *queue, size_t count);
+
+/// <summary>
+/// Remove the message at the front of the queue without sending it, and count it as dropped; for
+/// a message which <see cref="TelemetryQueue_Read" /> cannot read.
+/// </summary>
+/// <param name="queue">The queue.</param>
+/// <returns>true on success; false if the queue is empty or could not be updated in
+/// storage.</returns>
+bool TelemetryQueue_Discard(TelemetryQueue *queue);
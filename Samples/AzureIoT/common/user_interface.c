@@ -130,13 +130,17 @@ ExitCode UserInterface_Initialise(EventLoop *el,
         return ExitCode_Init_Led;
     }
 
-    // Set up a timer to poll for button events.
+    // Set up a timer to poll for button events. A press lasts far longer than the slack, so the
+    // poll can be deferred to share a wakeup with other timers; the slack is less than the period,
+    // so the button is still polled every millisecond.
     static const struct timespec buttonPressCheckPeriod = {.tv_sec = 0, .tv_nsec = 1000 * 1000};
-    buttonPollTimer =
-        CreateEventLoopPeriodicTimer(el, &ButtonPollTimerEventHandler, &buttonPressCheckPeriod);
+    static const struct timespec buttonPressCheckSlack = {.tv_sec = 0, .tv_nsec = 500 * 1000};
+    buttonPollTimer = CreateEventLoopPeriodicTimerWithSlack(
+        el, &ButtonPollTimerEventHandler, &buttonPressCheckPeriod, &buttonPressCheckSlack);
     if (buttonPollTimer == NULL) {
         return ExitCode_Init_ButtonPollTimer;
     }
+    SetEventLoopTimerName(buttonPollTimer, "ButtonPoll");
 
     return ExitCode_Success;
 }
@@ -0,0 +1,137 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <stddef.h>
+
+#include "utc_timestamp.h"
+
+#define SECONDS_PER_MINUTE 60
+#define SECONDS_PER_HOUR (60 * SECONDS_PER_MINUTE)
+#define SECONDS_PER_DAY (24 * SECONDS_PER_HOUR)
+#define NANOSECONDS_PER_MILLISECOND 1000000
+
+// Room after the date part for "HH:MM:SS.mmmZ" and the terminator.
+#define TIME_PART_SIZE sizeof("HH:MM:SS.mmmZ")
+
+void UtcTimestamp_Init(UtcTimestamp *timestamp)
+{
+    timestamp->text[0] = '\0';
+    timestamp->dateLength = 0;
+    timestamp->dayStart = 0;
+    timestamp->hasDay = false;
+    timestamp->hour = -1;
+    timestamp->minute = -1;
+    timestamp->second = -1;
+}
+
+/// <summary>
+///     Formats the date part for the day containing a time, with strftime so that it matches
+///     strftime for every year.
+/// </summary>
+static bool SetDay(UtcTimestamp *timestamp, time_t t)
+{
+    struct tm tm;
+    if (gmtime_r(&t, &tm) == NULL) {
+        return false;
+    }
+
+    size_t length =
+        strftime(timestamp->text, sizeof(timestamp->text) - TIME_PART_SIZE, "%Y-%m-%dT", &tm);
+    if (length == 0) {
+        timestamp->hasDay = false;
+        return false;
+    }
+
+    timestamp->dateLength = length;
+    timestamp->dayStart =
+        t - (tm.tm_hour * SECONDS_PER_HOUR + tm.tm_min * SECONDS_PER_MINUTE + tm.tm_sec);
+    timestamp->hasDay = true;
+    timestamp->hour = -1;
+    timestamp->minute = -1;
+    timestamp->second = -1;
+    timestamp->text[length + 2] = ':';
+    timestamp->text[length + 5] = ':';
+    return true;
+}
+
+static void WriteTwoDigits(char *text, int value)
+{
+    text[0] = (char)('0' + value / 10);
+    text[1] = (char)('0' + value % 10);
+}
+
+/// <summary>
+///     Brings the text up to date with a time, to the second.
+/// </summary>
+/// <returns>The position after the seconds, or NULL on failure.</returns>
+static char *FormatToSecond(UtcTimestamp *timestamp, time_t t)
+{
+    if (!timestamp->hasDay || t < timestamp->dayStart ||
+        t - timestamp->dayStart >= SECONDS_PER_DAY) {
+        if (!SetDay(timestamp, t)) {
+            return NULL;
+        }
+    }
+
+    int secondOfDay = (int)(t - timestamp->dayStart);
+    int hour = secondOfDay / SECONDS_PER_HOUR;
+    int minute = (secondOfDay / SECONDS_PER_MINUTE) % 60;
+    int second = secondOfDay % SECONDS_PER_MINUTE;
+
+    char *timePart = timestamp->text + timestamp->dateLength;
+    if (hour != timestamp->hour) {
+        WriteTwoDigits(timePart, hour);
+        timestamp->hour = hour;
+    }
+    if (minute != timestamp->minute) {
+        WriteTwoDigits(timePart + 3, minute);
+        timestamp->minute = minute;
+    }
+    if (second != timestamp->second) {
+        WriteTwoDigits(timePart + 6, second);
+        timestamp->second = second;
+    }
+
+    return timePart + 8;
+}
+
+const char *UtcTimestamp_Format(UtcTimestamp *timestamp, time_t t)
+{
+    char *end = FormatToSecond(timestamp, t);
+    if (end == NULL) {
+        return NULL;
+    }
+
+    end[0] = 'Z';
+    end[1] = '\0';
+    return timestamp->text;
+}
+
+const char *UtcTimestamp_FormatMilliseconds(UtcTimestamp *timestamp, const struct timespec *t)
+{
+    if (t->tv_nsec < 0 || t->tv_nsec >= 1000 * NANOSECONDS_PER_MILLISECOND) {
+        return NULL;
+    }
+
+    char *end = FormatToSecond(timestamp, t->tv_sec);
+    if (end == NULL) {
+        return NULL;
+    }
+
+    int milliseconds = (int)(t->tv_nsec / NANOSECONDS_PER_MILLISECOND);
+    end[0] = '.';
+    end[1] = (char)('0' + milliseconds / 100);
+    WriteTwoDigits(end + 2, milliseconds % 100);
+    end[4] = 'Z';
+    end[5] = '\0';
+    return timestamp->text;
+}
+
+const char *UtcTimestamp_NowMilliseconds(UtcTimestamp *timestamp)
+{
+    struct timespec now;
+    if (clock_gettime(CLOCK_REALTIME, &now) != 0) {
+        return NULL;
+    }
+    return UtcTimestamp_FormatMilliseconds(timestamp, &now);
+}
@@ -0,0 +1,61 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <time.h>
+
+// Formats UTC times as ISO 8601 strings, as strftime does with "%Y-%m-%dT%H:%M:%SZ", without
+// calling gmtime and strftime for every timestamp. The date is formatted once per day; within the
+// day, only the digits of the hours, minutes and seconds which have changed are rewritten.
+
+/// <summary>
+/// Formatter state. Initialize with <see cref="UtcTimestamp_Init" />; the members should not be
+/// used directly.
+/// </summary>
+typedef struct {
+    /// <summary>The formatted timestamp.</summary>
+    char text[48];
+    /// <summary>Length of the date part, including the "T".</summary>
+    size_t dateLength;
+    /// <summary>Start of the day which the date part holds.</summary>
+    time_t dayStart;
+    /// <summary>Whether the date part is valid.</summary>
+    bool hasDay;
+    /// <summary>Hours, minutes and seconds in the text, or -1 if not yet written.</summary>
+    int hour;
+    int minute;
+    int second;
+} UtcTimestamp;
+
+/// <summary>
+/// Initialize a formatter.
+/// </summary>
+/// <param name="timestamp">The formatter.</param>
+void UtcTimestamp_Init(UtcTimestamp *timestamp);
+
+/// <summary>
+/// Format a time to the second, as "YYYY-MM-DDTHH:MM:SSZ".
+/// </summary>
+/// <param name="timestamp">The formatter.</param>
+/// <param name="t">The time.</param>
+/// <returns>The formatted time, which is valid until the formatter is next used, or NULL if the
+/// time cannot be represented.</returns>
+const char *UtcTimestamp_Format(UtcTimestamp *timestamp, time_t t);
+
+/// <summary>
+/// Format a time to the millisecond, as "YYYY-MM-DDTHH:MM:SS.mmmZ".
+/// </summary>
+/// <param name="timestamp">The formatter.</param>
+/// <param name="t">The time; the fraction of a second is truncated to milliseconds.</param>
+/// <returns>The formatted time, which is valid until the formatter is next used, or NULL if the
+/// time cannot be represented.</returns>
+const char *UtcTimestamp_FormatMilliseconds(UtcTimestamp *timestamp, const struct timespec *t);
+
+/// <summary>
+/// Format the current time from CLOCK_REALTIME, to the millisecond.
+/// </summary>
+/// <param name="timestamp">The formatter.</param>
+/// <returns>The formatted time, as for <see cref="UtcTimestamp_FormatMilliseconds" />.</returns>
+const char *UtcTimestamp_NowMilliseconds(UtcTimestamp *timestamp);
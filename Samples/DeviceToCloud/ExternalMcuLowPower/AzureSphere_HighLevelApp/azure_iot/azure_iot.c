@@ -1,7 +1,11 @@
 /* Copyright (c) Microsoft Corporation. All rights reserved.
    Licensed under the MIT License. */
 
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <applibs/eventloop.h>
 #include <applibs/log.h>
@@ -13,6 +17,7 @@
 #include "eventloop_timer_utilities.h"
 #include "exitcodes.h"
 #include "connection.h"
+#include "reconnect_backoff.h"
 
 static void AzureIoTConnectTimerEventHandler(EventLoopTimer *timer);
 static void AzureIoTDoWorkTimerEventHandler(EventLoopTimer *timer);
@@ -24,6 +29,11 @@ static void SendEventCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *co
 static void DeviceTwinCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char *payload,
                                size_t payloadSize, void *userContextCallback);
 static void ReportedStateCallback(int result, void *context);
+static void AzureIoTReportStateTimerEventHandler(EventLoopTimer *timer);
+static void AzureIoTTelemetryBatchTimerEventHandler(EventLoopTimer *timer);
+static AzureIoT_Result SendTelemetryBatch(void);
+static bool ReturnTelemetryBatch(void);
+static void SendPendingReportedState(void);
 static int DeviceMethodCallback(const char *methodName, const unsigned char *payload,
                                 size_t payloadSize, unsigned char **response, size_t *responseSize,
                                 void *userContextCallback);
@@ -31,6 +41,25 @@ static int DeviceMethodCallback(const char *methodName, const unsigned char *pay
 static void ConnectionCallbackHandler(Connection_Status status,
                                       IOTHUB_DEVICE_CLIENT_LL_HANDLE clientHandle);
 static bool IsConnectionReadyToSendTelemetry(void);
+static void ScheduleDoWork(void);
+static void KickDoWork(void);
+static unsigned long RecordConfirmation(const struct timespec *sentTime);
+static AzureIoT_Result SendOrDeferTelemetry(const unsigned char *data, size_t length,
+                                            const char *contentType,
+                                            const char *iso8601DateTimeString, void *context);
+static AzureIoT_Result SendTelemetryToHub(const unsigned char *data, size_t length,
+                                          const char *contentType,
+                                          const char *iso8601DateTimeString, void *context);
+static AzureIoT_Result DeferTelemetry(const unsigned char *data, size_t length,
+                                      const char *contentType, const char *iso8601DateTimeString,
+                                      void *context);
+static bool SendDeferredTelemetry(void);
+static size_t GetLatencyBucket(unsigned long latencyMs);
+static unsigned long MillisecondsSince(const struct timespec *start);
+static void WaitForNetwork(void);
+static void ScheduleConnectAttempt(uint32_t delayMs);
+static uint32_t ScheduleReconnect(void);
+static void StartConnectAttempt(void);
 
 /// <summary>
 /// Authentication state of the client with respect to the Azure IoT Hub.
@@ -48,17 +77,49 @@ static IoTHubClientAuthenticationState iotHubClientAuthenticationState =
     IoTHubClientAuthenticationState_NotAuthenticated; // Authentication state with respect to the
                                                       // IoT Hub.
 
+/// <summary>
+/// What the connection manager is waiting for.
+/// </summary>
+typedef enum {
+    /// <summary>The network to be ready.</summary>
+    ConnectState_WaitingForNetwork = 0,
+    /// <summary>The delay before the next connection attempt.</summary>
+    ConnectState_BackingOff = 1,
+    /// <summary>A connection attempt to succeed or fail.</summary>
+    ConnectState_Connecting = 2,
+    /// <summary>The connection to be lost.</summary>
+    ConnectState_Connected = 3
+} ConnectState;
+
 // Azure IoT poll periods
-static const int AzureIoTDefaultConnectPeriodSeconds =
-    1; // check if device is connected to the internet and Azure client is setup every second
-static const int AzureIoTMinReconnectPeriodSeconds = 10;      // back off when reconnecting
-static const int AzureIoTMaxReconnectPeriodSeconds = 10 * 60; // back off limit
+// There is no notification when the network comes up, so while the device is waiting for it, it
+// is checked this often. Nothing is polled while the device is connecting or connected; losing the
+// connection is reported by the Azure IoT SDK.
+static const struct timespec AzureIoTNetworkCheckPeriod = {.tv_sec = 1, .tv_nsec = 0};
+// Delays between connection attempts; see reconnect_backoff.h.
+static const uint32_t AzureIoTReconnectBaseMs = 10 * 1000;
+static const uint32_t AzureIoTReconnectCapMs = 10 * 60 * 1000;
 static const int AzureIoTDoWorkIntervalMilliseconds =
     100; // Call IoTHubDeviceClient_LL_DoWork() every 100 ms
+// Neither poll is time-critical, so allow them to be deferred to share a wakeup with other timers.
+static const struct timespec AzureIoTConnectSlack = {.tv_sec = 0, .tv_nsec = 500 * 1000 * 1000};
+static const struct timespec AzureIoTDoWorkSlack = {.tv_sec = 0, .tv_nsec = 50 * 1000 * 1000};
+// With the adaptive DoWork policy, DoWork is called as soon as control returns to the event loop
+// after a message is handed to the SDK, then every AzureIoTDoWorkBusyPeriod while a confirmation
+// is pending or the client is authenticating. When idle, the period doubles up to
+// AzureIoTDoWorkMaxIdlePeriod, which is well within both the MQTT keepalive (240 s by default) and
+// the 30 s within which a device method must respond.
+static const struct timespec AzureIoTDoWorkKickDelay = {.tv_sec = 0, .tv_nsec = 1};
+static const struct timespec AzureIoTDoWorkBusyPeriod = {.tv_sec = 0, .tv_nsec = 20 * 1000 * 1000};
+static const struct timespec AzureIoTDoWorkMaxIdlePeriod = {.tv_sec = 4, .tv_nsec = 0};
 static const int NanosecondsPerMillisecond = 1000000;
-static int azureIoTConnectPeriodSeconds = -1;
+// Reports made within this window of the first are coalesced into one publish.
+static const struct timespec AzureIoTReportStateDebounce = {.tv_sec = 0,
+                                                            .tv_nsec = 500 * 1000 * 1000};
 static EventLoopTimer *azureIoTConnectionTimer = NULL;
 static EventLoopTimer *azureIoTDoWorkTimer = NULL;
+static EventLoopTimer *azureIoTReportStateTimer = NULL;
+static EventLoopTimer *azureIoTTelemetryBatchTimer = NULL;
 
 static IOTHUB_DEVICE_CLIENT_LL_HANDLE iothubClientHandle = NULL;
 static ExitCode_CallbackType failureCallbackFunction = NULL;
@@ -66,9 +127,95 @@ static AzureIoT_Callbacks callbacks;
 
 static Connection_Status connectionStatus = Connection_NotStarted;
 
+static ConnectState connectState = ConnectState_WaitingForNetwork;
+static bool hasConnected = false; // Whether the device has connected since initialization.
+static ReconnectBackoff reconnectBackoff;
+static struct timespec connectAttemptStartTime;
+static AzureIoT_ConnectionStats connectionStats;
+
+static AzureIoT_DoWorkPolicy doWorkPolicy = AzureIoT_DoWorkPolicy_Fixed;
+static struct timespec doWorkIdlePeriod;
+static unsigned int pendingConfirmations = 0; // Telemetry and reports awaiting confirmation.
+static AzureIoT_DoWorkStats doWorkStats;
+
+/// <summary>
+/// A telemetry message handed to the Azure IoT SDK, awaiting confirmation.
+/// </summary>
+typedef struct {
+    void *context;
+    struct timespec sentTime;
+} PendingTelemetry;
+
+/// <summary>
+/// A telemetry message waiting for a slot in the send window.
+/// </summary>
+typedef struct DeferredTelemetry {
+    struct DeferredTelemetry *next;
+    void *context;
+    size_t length;
+    // These point into data, after the message; NULL if the message is JSON, or has no timestamp.
+    const char *contentType;
+    const char *iso8601DateTimeString;
+    // The message, NULL-terminated if it is JSON.
+    unsigned char data[];
+} DeferredTelemetry;
+
+static unsigned int telemetryWindowMaxInFlight = 0; // 0 for no limit.
+static unsigned int telemetryWindowMaxDeferred = 0;
+static DeferredTelemetry *deferredTelemetryHead = NULL;
+static DeferredTelemetry *deferredTelemetryTail = NULL;
+static AzureIoT_TelemetryWindowStats telemetryWindowStats;
+static unsigned long telemetryMaxConfirmLatencyMs = 0;
+
 // Constants
 #define MAX_DEVICE_TWIN_PAYLOAD_SIZE 512
 
+/// <summary>
+/// A reported state request waiting for the debounce window to close.
+/// </summary>
+typedef struct PendingReport {
+    struct PendingReport *next;
+    void *context;
+    char jsonState[];
+} PendingReport;
+
+/// <summary>
+/// The contexts of the requests coalesced into one publish, for the acknowledgement.
+/// </summary>
+typedef struct ReportBatch {
+    struct timespec sentTime;
+    size_t count;
+    void *contexts[];
+} ReportBatch;
+
+static void CompleteReportBatch(ReportBatch *batch, bool success);
+
+static PendingReport *pendingReportsHead = NULL;
+static PendingReport *pendingReportsTail = NULL;
+static size_t pendingReportCount = 0;
+
+// Reported properties as the IoT Hub will hold them once every publish so far has succeeded.
+// Each publish carries only the merge patch from this state to the new one, unless a publish has
+// failed since the last whole state was accepted, in which case it carries the whole state.
+static JSON_Value *publishedReportedState = NULL;
+static bool publishWholeReportedState = true;
+
+static AzureIoT_DeviceTwinReportStats reportStats;
+
+// Readings collected by AzureIoT_SendBatchedTelemetry, as "[" followed by the comma-separated
+// elements; the closing "]" is added when the batch is sent. NULL if batching is disabled.
+static char *telemetryBatch = NULL;
+static size_t telemetryBatchMaxBytes = 0;
+static size_t telemetryBatchLength = 0;
+static size_t telemetryBatchReadings = 0;
+static struct timespec telemetryBatchMaxAge;
+// Each batched reading with a timestamp starts with it, as its first member.
+static const char TelemetryTimestampPrefix[] = "{\"timestamp\":\"";
+// Timestamp of the oldest reading in the batch, sent as the batch's creation time.
+static char telemetryBatchCreationTime[64];
+
+static AzureIoT_TelemetryBatchStats telemetryBatchStats;
+
 MU_DEFINE_ENUM_STRINGS_WITHOUT_INVALID(IOTHUB_CLIENT_CONNECTION_STATUS_REASON,
                                        IOTHUB_CLIENT_CONNECTION_STATUS_REASON_VALUES);
 
@@ -84,23 +231,51 @@ ExitCode AzureIoT_Initialize(EventLoop *eventLoop, ExitCode_CallbackType failure
         return connectionErrorCode;
     }
 
-    azureIoTConnectPeriodSeconds = AzureIoTDefaultConnectPeriodSeconds;
-    struct timespec azureIoTConnectPeriod = {.tv_sec = azureIoTConnectPeriodSeconds, .tv_nsec = 0};
-    azureIoTConnectionTimer = CreateEventLoopPeriodicTimer(
-        eventLoop, &AzureIoTConnectTimerEventHandler, &azureIoTConnectPeriod);
+    // Seed the backoff from both clocks, so that devices which boot together still draw
+    // different delays.
+    struct timespec realtime, monotonic;
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    clock_gettime(CLOCK_MONOTONIC, &monotonic);
+    ReconnectBackoff_Init(&reconnectBackoff, AzureIoTReconnectBaseMs, AzureIoTReconnectCapMs,
+                          (uint32_t)realtime.tv_sec * 2654435761u ^ (uint32_t)realtime.tv_nsec ^
+                              (uint32_t)monotonic.tv_nsec);
+    hasConnected = false;
+    memset(&connectionStats, 0, sizeof(connectionStats));
+
+    azureIoTConnectionTimer =
+        CreateEventLoopDisarmedTimer(eventLoop, &AzureIoTConnectTimerEventHandler);
     if (azureIoTConnectionTimer == NULL) {
         return ExitCode_Init_AzureIoTConnectionTimer;
     }
+    SetEventLoopTimerName(azureIoTConnectionTimer, "AzureIoTConnect");
+    SetEventLoopTimerSlack(azureIoTConnectionTimer, &AzureIoTConnectSlack);
+    WaitForNetwork();
 
     int azureIoTDoWorkIntervalNanoseconds =
         AzureIoTDoWorkIntervalMilliseconds * NanosecondsPerMillisecond;
     struct timespec azureIoTDoWorkPollPeriod = {.tv_sec = 0,
                                                 .tv_nsec = azureIoTDoWorkIntervalNanoseconds};
-    azureIoTDoWorkTimer = CreateEventLoopPeriodicTimer(eventLoop, &AzureIoTDoWorkTimerEventHandler,
-                                                       &azureIoTDoWorkPollPeriod);
+    azureIoTDoWorkTimer =
+        CreateEventLoopPeriodicTimerWithSlack(eventLoop, &AzureIoTDoWorkTimerEventHandler,
+                                              &azureIoTDoWorkPollPeriod, &AzureIoTDoWorkSlack);
     if (azureIoTDoWorkTimer == NULL) {
         return ExitCode_Init_AzureIoTDoWorkTimer;
     }
+    SetEventLoopTimerName(azureIoTDoWorkTimer, "AzureIoTDoWork");
+
+    azureIoTReportStateTimer =
+        CreateEventLoopDisarmedTimer(eventLoop, &AzureIoTReportStateTimerEventHandler);
+    if (azureIoTReportStateTimer == NULL) {
+        return ExitCode_Init_AzureIoTReportStateTimer;
+    }
+    SetEventLoopTimerName(azureIoTReportStateTimer, "AzureIoTReportState");
+
+    azureIoTTelemetryBatchTimer =
+        CreateEventLoopDisarmedTimer(eventLoop, &AzureIoTTelemetryBatchTimerEventHandler);
+    if (azureIoTTelemetryBatchTimer == NULL) {
+        return ExitCode_Init_AzureIoTTelemetryBatchTimer;
+    }
+    SetEventLoopTimerName(azureIoTTelemetryBatchTimer, "AzureIoTTelemetryBatch");
 
     return ExitCode_Success;
 }
@@ -109,6 +284,39 @@ void AzureIoT_Cleanup(void)
 {
     DisposeEventLoopTimer(azureIoTConnectionTimer);
     DisposeEventLoopTimer(azureIoTDoWorkTimer);
+    DisposeEventLoopTimer(azureIoTReportStateTimer);
+    DisposeEventLoopTimer(azureIoTTelemetryBatchTimer);
+
+    if (telemetryBatchReadings > 0 && !ReturnTelemetryBatch()) {
+        Log_Debug("WARNING: Discarding %zu batched telemetry readings.\n", telemetryBatchReadings);
+    }
+    free(telemetryBatch);
+    telemetryBatch = NULL;
+    telemetryBatchReadings = 0;
+
+    while (pendingReportsHead != NULL) {
+        PendingReport *report = pendingReportsHead;
+        pendingReportsHead = report->next;
+        free(report);
+    }
+    pendingReportsTail = NULL;
+    pendingReportCount = 0;
+
+    if (telemetryWindowStats.deferred > 0) {
+        Log_Debug("WARNING: Discarding %u deferred telemetry messages.\n",
+                  telemetryWindowStats.deferred);
+    }
+    while (deferredTelemetryHead != NULL) {
+        DeferredTelemetry *deferred = deferredTelemetryHead;
+        deferredTelemetryHead = deferred->next;
+        free(deferred);
+    }
+    deferredTelemetryTail = NULL;
+    telemetryWindowStats.deferred = 0;
+
+    json_value_free(publishedReportedState);
+    publishedReportedState = NULL;
+    publishWholeReportedState = true;
 }
 
 /// <summary>
@@ -135,12 +343,6 @@ static void ConnectionCallbackHandler(Connection_Status status,
 
         iothubClientHandle = clientHandle;
 
-        // Successfully connected, so make sure the polling frequency is back to the default
-        azureIoTConnectPeriodSeconds = AzureIoTDefaultConnectPeriodSeconds;
-        struct timespec azureIoTConnectPeriod = {.tv_sec = azureIoTConnectPeriodSeconds,
-                                                 .tv_nsec = 0};
-        SetEventLoopTimerPeriod(azureIoTConnectionTimer, &azureIoTConnectPeriod);
-
         // Set client authentication state to initiated. This is done to indicate that
         // SetUpAzureIoTHubClient() has been called (and so should not be called again) while the
         // client is waiting for a response via the ConnectionStatusCallback().
@@ -151,36 +353,23 @@ static void ConnectionCallbackHandler(Connection_Status status,
                                                       NULL);
         IoTHubDeviceClient_LL_SetConnectionStatusCallback(iothubClientHandle,
                                                           ConnectionStatusCallback, NULL);
+        KickDoWork();
         break;
     }
 
     case Connection_Failed: {
-
-        // If we fail to connect, reduce the polling frequency, starting at
-        // AzureIoTMinReconnectPeriodSeconds and with a backoff up to
-        // AzureIoTMaxReconnectPeriodSeconds
-        if (azureIoTConnectPeriodSeconds == AzureIoTDefaultConnectPeriodSeconds) {
-            azureIoTConnectPeriodSeconds = AzureIoTMinReconnectPeriodSeconds;
-        } else {
-            azureIoTConnectPeriodSeconds *= 2;
-            if (azureIoTConnectPeriodSeconds > AzureIoTMaxReconnectPeriodSeconds) {
-                azureIoTConnectPeriodSeconds = AzureIoTMaxReconnectPeriodSeconds;
-            }
-        }
-
-        struct timespec azureIoTConnectPeriod = {.tv_sec = azureIoTConnectPeriodSeconds,
-                                                 .tv_nsec = 0};
-        SetEventLoopTimerPeriod(azureIoTConnectionTimer, &azureIoTConnectPeriod);
-
-        Log_Debug("ERROR: Azure IoT Hub connection failed - will retry in %i seconds.\n",
-                  azureIoTConnectPeriodSeconds);
+        ++connectionStats.connectFailures;
+        uint32_t delayMs = ScheduleReconnect();
+        Log_Debug("ERROR: Azure IoT Hub connection failed - will retry in %lu ms.\n",
+                  (unsigned long)delayMs);
         break;
     }
     }
 }
 
 /// <summary>
-///     Azure timer event:  Check connection status and send telemetry
+///     Azure timer event: the network check period or a reconnection delay has elapsed, so
+///     connect if the network is up.
 /// </summary>
 static void AzureIoTConnectTimerEventHandler(EventLoopTimer *timer)
 {
@@ -191,16 +380,75 @@ static void AzureIoTConnectTimerEventHandler(EventLoopTimer *timer)
 
     // Check whether the network is up.
     bool isNetworkReady = false;
-    if (Networking_IsNetworkingReady(&isNetworkReady) != -1) {
-        if (isNetworkReady &&
-            (iotHubClientAuthenticationState == IoTHubClientAuthenticationState_NotAuthenticated)) {
-            SetUpAzureIoTHubClient();
-        }
-    } else {
+    if (Networking_IsNetworkingReady(&isNetworkReady) == -1) {
         Log_Debug("ERROR: Networking_IsNetworkingReady: %d (%s)\n", errno, strerror(errno));
         failureCallbackFunction(ExitCode_IsNetworkingReady_Failed);
         return;
     }
+
+    if (!isNetworkReady) {
+        if (connectState != ConnectState_WaitingForNetwork) {
+            WaitForNetwork();
+        }
+        return;
+    }
+
+    if (connectState == ConnectState_WaitingForNetwork && hasConnected) {
+        // Devices which lost the network together get it back together, so spread out their
+        // attempts.
+        ScheduleConnectAttempt(ReconnectBackoff_Jitter(&reconnectBackoff));
+        return;
+    }
+
+    StartConnectAttempt();
+}
+
+/// <summary>
+///     Checks the network every AzureIoTNetworkCheckPeriod until it is ready.
+/// </summary>
+static void WaitForNetwork(void)
+{
+    connectState = ConnectState_WaitingForNetwork;
+    SetEventLoopTimerPeriod(azureIoTConnectionTimer, &AzureIoTNetworkCheckPeriod);
+}
+
+/// <summary>
+///     Arms the connection timer for an attempt after a delay.
+/// </summary>
+static void ScheduleConnectAttempt(uint32_t delayMs)
+{
+    connectState = ConnectState_BackingOff;
+    // A zero delay would disarm the timer, so wait at least a nanosecond.
+    struct timespec delay = {.tv_sec = (time_t)(delayMs / 1000),
+                             .tv_nsec = (long)(delayMs % 1000) * NanosecondsPerMillisecond + 1};
+    SetEventLoopTimerOneShot(azureIoTConnectionTimer, &delay);
+}
+
+/// <summary>
+///     Schedules the next attempt after a failed attempt or a lost connection, with the next
+///     delay from the backoff.
+/// </summary>
+/// <returns>The delay, in milliseconds.</returns>
+static uint32_t ScheduleReconnect(void)
+{
+    uint32_t delayMs = ReconnectBackoff_Next(&reconnectBackoff);
+    connectionStats.lastRetryDelayMs = delayMs;
+    ScheduleConnectAttempt(delayMs);
+    return delayMs;
+}
+
+static void StartConnectAttempt(void)
+{
+    connectState = ConnectState_Connecting;
+    DisarmEventLoopTimer(azureIoTConnectionTimer);
+    ++connectionStats.connectAttempts;
+    clock_gettime(CLOCK_MONOTONIC, &connectAttemptStartTime);
+    SetUpAzureIoTHubClient();
+}
+
+void AzureIoT_GetConnectionStats(AzureIoT_ConnectionStats *stats)
+{
+    *stats = connectionStats;
 }
 
 /// <summary>
@@ -215,9 +463,110 @@ static void AzureIoTDoWorkTimerEventHandler(EventLoopTimer *timer)
 
     if (iothubClientHandle != NULL) {
         IoTHubDeviceClient_LL_DoWork(iothubClientHandle);
+        ++doWorkStats.doWorkCalls;
+    }
+
+    // Confirmations during DoWork may have freed slots in the send window.
+    if (SendDeferredTelemetry()) {
+        KickDoWork();
+    } else {
+        ScheduleDoWork();
+    }
+}
+
+void AzureIoT_SetDoWorkPolicy(AzureIoT_DoWorkPolicy policy)
+{
+    doWorkPolicy = policy;
+
+    if (policy == AzureIoT_DoWorkPolicy_Fixed) {
+        struct timespec azureIoTDoWorkPollPeriod = {
+            .tv_sec = 0, .tv_nsec = AzureIoTDoWorkIntervalMilliseconds * NanosecondsPerMillisecond};
+        SetEventLoopTimerSlack(azureIoTDoWorkTimer, &AzureIoTDoWorkSlack);
+        SetEventLoopTimerPeriod(azureIoTDoWorkTimer, &azureIoTDoWorkPollPeriod);
+    } else {
+        KickDoWork();
+    }
+}
+
+void AzureIoT_GetDoWorkStats(AzureIoT_DoWorkStats *stats)
+{
+    *stats = doWorkStats;
+}
+
+/// <summary>
+///     With the adaptive DoWork policy, arms the DoWork timer for the next call: soon if the
+///     client is waiting for the IoT Hub, otherwise after a period which grows while idle.
+/// </summary>
+static void ScheduleDoWork(void)
+{
+    if (doWorkPolicy != AzureIoT_DoWorkPolicy_Adaptive) {
+        return;
+    }
+
+    if (pendingConfirmations > 0 ||
+        iotHubClientAuthenticationState == IoTHubClientAuthenticationState_AuthenticationInitiated) {
+        doWorkIdlePeriod = AzureIoTDoWorkBusyPeriod;
+        SetEventLoopTimerSlack(azureIoTDoWorkTimer, NULL);
+        SetEventLoopTimerOneShot(azureIoTDoWorkTimer, &AzureIoTDoWorkBusyPeriod);
+        return;
+    }
+
+    SetEventLoopTimerSlack(azureIoTDoWorkTimer, &AzureIoTDoWorkSlack);
+    SetEventLoopTimerOneShot(azureIoTDoWorkTimer, &doWorkIdlePeriod);
+
+    doWorkIdlePeriod.tv_sec *= 2;
+    doWorkIdlePeriod.tv_nsec *= 2;
+    if (doWorkIdlePeriod.tv_nsec >= 1000 * NanosecondsPerMillisecond) {
+        doWorkIdlePeriod.tv_sec += 1;
+        doWorkIdlePeriod.tv_nsec -= 1000 * NanosecondsPerMillisecond;
+    }
+    if (doWorkIdlePeriod.tv_sec >= AzureIoTDoWorkMaxIdlePeriod.tv_sec) {
+        doWorkIdlePeriod = AzureIoTDoWorkMaxIdlePeriod;
     }
 }
 
+/// <summary>
+///     With the adaptive DoWork policy, calls DoWork as soon as control returns to the event loop,
+///     so that a message just handed to the SDK is sent without waiting for the next poll.
+/// </summary>
+static void KickDoWork(void)
+{
+    if (doWorkPolicy != AzureIoT_DoWorkPolicy_Adaptive) {
+        return;
+    }
+
+    doWorkIdlePeriod = AzureIoTDoWorkBusyPeriod;
+    SetEventLoopTimerSlack(azureIoTDoWorkTimer, NULL);
+    SetEventLoopTimerOneShot(azureIoTDoWorkTimer, &AzureIoTDoWorkKickDelay);
+}
+
+/// <summary>
+///     Records the confirmation of a telemetry message or report sent at the given time.
+/// </summary>
+/// <returns>The time to confirmation, in milliseconds.</returns>
+static unsigned long RecordConfirmation(const struct timespec *sentTime)
+{
+    unsigned long latencyMs = MillisecondsSince(sentTime);
+
+    if (pendingConfirmations > 0) {
+        --pendingConfirmations;
+    }
+    ++doWorkStats.confirmations;
+    doWorkStats.totalConfirmLatencyMs += latencyMs;
+    if (latencyMs > doWorkStats.maxConfirmLatencyMs) {
+        doWorkStats.maxConfirmLatencyMs = latencyMs;
+    }
+    return latencyMs;
+}
+
+static unsigned long MillisecondsSince(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long)((now.tv_sec - start->tv_sec) * 1000 +
+                           (now.tv_nsec - start->tv_nsec) / 1000000);
+}
+
 /// <summary>
 ///     Sets up the Azure IoT Hub connection (creates the iothubClientHandle)
 ///     When the SAS Token for a device expires the connection needs to be recreated
@@ -226,8 +575,14 @@ static void AzureIoTDoWorkTimerEventHandler(EventLoopTimer *timer)
 static void SetUpAzureIoTHubClient(void)
 {
     if (iothubClientHandle != NULL) {
-        IoTHubDeviceClient_LL_Destroy(iothubClientHandle);
+        // Clear the handle first: the messages failed by destroying the client must not free
+        // slots for deferred messages to be sent on it.
+        IOTHUB_DEVICE_CLIENT_LL_HANDLE clientHandle = iothubClientHandle;
         iothubClientHandle = NULL;
+        IoTHubDeviceClient_LL_Destroy(clientHandle);
+        // Destroying the client fails any messages awaiting confirmation.
+        pendingConfirmations = 0;
+        telemetryWindowStats.inFlight = 0;
     }
 
     if (connectionStatus == Connection_NotStarted || connectionStatus == Connection_Failed) {
@@ -247,12 +602,41 @@ static void ConnectionStatusCallback(IOTHUB_CLIENT_CONNECTION_STATUS result,
     Log_Debug("Azure IoT connection status: %s\n",
               IOTHUB_CLIENT_CONNECTION_STATUS_REASONStrings(reason));
 
+    Connection_ReportAuthenticationStatus(result, reason);
+
     iotHubClientAuthenticationState = result == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED
                                           ? IoTHubClientAuthenticationState_Authenticated
                                           : IoTHubClientAuthenticationState_NotAuthenticated;
 
-    if (iotHubClientAuthenticationState == IoTHubClientAuthenticationState_NotAuthenticated) {
+    if (iotHubClientAuthenticationState == IoTHubClientAuthenticationState_Authenticated) {
+        if (connectState == ConnectState_Connecting) {
+            unsigned long latencyMs = MillisecondsSince(&connectAttemptStartTime);
+            ++connectionStats.connects;
+            connectionStats.totalConnectLatencyMs += latencyMs;
+            if (latencyMs > connectionStats.maxConnectLatencyMs) {
+                connectionStats.maxConnectLatencyMs = latencyMs;
+            }
+        }
+        connectState = ConnectState_Connected;
+        hasConnected = true;
+        ReconnectBackoff_Reset(&reconnectBackoff);
+    } else {
         ConnectionCallbackHandler(Connection_NotStarted, NULL);
+
+        // The batch cannot be sent until the device reconnects, so let the application keep it.
+        ReturnTelemetryBatch();
+
+        // The SDK may report the same failure more than once; only the first starts the backoff.
+        if (connectState == ConnectState_Connecting || connectState == ConnectState_Connected) {
+            if (connectState == ConnectState_Connected) {
+                ++connectionStats.disconnects;
+            } else {
+                ++connectionStats.connectFailures;
+            }
+            uint32_t delayMs = ScheduleReconnect();
+            Log_Debug("INFO: Azure IoT Hub connection lost - will retry in %lu ms.\n",
+                      (unsigned long)delayMs);
+        }
     }
 
     if (callbacks.connectionStatusCallbackFunction != NULL) {
@@ -270,8 +654,14 @@ static void DeviceTwinCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsig
     // Statically allocate this for more predictable memory use patterns
     static char nullTerminatedJsonString[MAX_DEVICE_TWIN_PAYLOAD_SIZE + 1];
 
+    // A payload handler can stream the payload without a copy, so it has no size limit.
+    if (callbacks.deviceTwinPayloadReceivedCallbackFunction != NULL) {
+        callbacks.deviceTwinPayloadReceivedCallbackFunction(payload, payloadSize);
+        return;
+    }
+
     if (payloadSize > MAX_DEVICE_TWIN_PAYLOAD_SIZE) {
-        Log_Debug("ERROR: Device twin payload size (%u bytes) exceeds maximum (%u bytes).\n",
+        Log_Debug("ERROR: Device twin payload size (%zu bytes) exceeds maximum (%u bytes).\n",
                   payloadSize, MAX_DEVICE_TWIN_PAYLOAD_SIZE);
 
         failureCallbackFunction(ExitCode_PayloadSize_TooLarge);
@@ -305,31 +695,493 @@ AzureIoT_Result AzureIoT_SendTelemetry(const char *jsonMessage, const char *iso8
         return AzureIoT_Result_OtherFailure;
     }
 
-    IOTHUB_MESSAGE_HANDLE messageHandle = IoTHubMessage_CreateFromString(jsonMessage);
+    return SendOrDeferTelemetry((const unsigned char *)jsonMessage, strlen(jsonMessage), NULL,
+                                iso8601DateTimeString, context);
+}
+
+AzureIoT_Result AzureIoT_SendBinaryTelemetry(const unsigned char *data, size_t length,
+                                             const char *contentType,
+                                             const char *iso8601DateTimeString, void *context)
+{
+    Log_Debug("Sending Azure IoT Hub telemetry: %zu bytes of %s.\n", length, contentType);
+
+    if (IsConnectionReadyToSendTelemetry() == false) {
+        return AzureIoT_Result_NoNetwork;
+    }
+
+    if (iotHubClientAuthenticationState != IoTHubClientAuthenticationState_Authenticated) {
+        Log_Debug("WARNING: Azure IoT Hub is not authenticated. Not sending telemetry.\n");
+        return AzureIoT_Result_OtherFailure;
+    }
+
+    return SendOrDeferTelemetry(data, length, contentType, iso8601DateTimeString, context);
+}
+
+/// <summary>
+///     Hands a telemetry message to the SDK if there is a free slot in the send window, and
+///     otherwise defers it.
+/// </summary>
+/// <param name="data">The message.</param>
+/// <param name="length">Length of the message in bytes.</param>
+/// <param name="contentType">Content type of a binary message, or NULL if the message is
+///     NULL-terminated JSON.</param>
+static AzureIoT_Result SendOrDeferTelemetry(const unsigned char *data, size_t length,
+                                            const char *contentType,
+                                            const char *iso8601DateTimeString, void *context)
+{
+    // Messages already waiting go first, to keep telemetry in order.
+    if (deferredTelemetryHead != NULL ||
+        (telemetryWindowMaxInFlight != 0 &&
+         telemetryWindowStats.inFlight >= telemetryWindowMaxInFlight)) {
+        return DeferTelemetry(data, length, contentType, iso8601DateTimeString, context);
+    }
+
+    AzureIoT_Result result =
+        SendTelemetryToHub(data, length, contentType, iso8601DateTimeString, context);
+    if (result == AzureIoT_Result_OK) {
+        KickDoWork();
+    }
+    return result;
+}
+
+/// <summary>
+///     Hands a telemetry message to the SDK, taking a slot in the send window.
+/// </summary>
+static AzureIoT_Result SendTelemetryToHub(const unsigned char *data, size_t length,
+                                          const char *contentType,
+                                          const char *iso8601DateTimeString, void *context)
+{
+    IOTHUB_MESSAGE_HANDLE messageHandle = contentType == NULL
+                                              ? IoTHubMessage_CreateFromString((const char *)data)
+                                              : IoTHubMessage_CreateFromByteArray(data, length);
 
     if (messageHandle == 0) {
         Log_Debug("ERROR: unable to create a new IoTHubMessage.\n");
         return AzureIoT_Result_OtherFailure;
     }
 
+    if (contentType != NULL &&
+        IoTHubMessage_SetContentTypeSystemProperty(messageHandle, contentType) !=
+            IOTHUB_MESSAGE_OK) {
+        Log_Debug("ERROR: unable to set the content type of the IoTHubMessage.\n");
+        IoTHubMessage_Destroy(messageHandle);
+        return AzureIoT_Result_OtherFailure;
+    }
+
     if (iso8601DateTimeString != NULL) {
         IoTHubMessage_SetProperty(messageHandle, "iothub-creation-time-utc", iso8601DateTimeString);
     }
 
     AzureIoT_Result result = AzureIoT_Result_OK;
 
-    if (IoTHubDeviceClient_LL_SendEventAsync(iothubClientHandle, messageHandle, SendEventCallback,
-                                             context) != IOTHUB_CLIENT_OK) {
-        Log_Debug("ERROR: failure requesting IoTHubClient to send telemetry event.\n");
+    PendingTelemetry *pending = malloc(sizeof(PendingTelemetry));
+    if (pending == NULL) {
+        Log_Debug("ERROR: Could not allocate a pending telemetry event.\n");
         result = AzureIoT_Result_OtherFailure;
     } else {
-        Log_Debug("INFO: IoTHubClient accepted the telemetry event for delivery.\n");
+        pending->context = context;
+        clock_gettime(CLOCK_MONOTONIC, &pending->sentTime);
+        if (IoTHubDeviceClient_LL_SendEventAsync(iothubClientHandle, messageHandle,
+                                                 SendEventCallback, pending) != IOTHUB_CLIENT_OK) {
+            Log_Debug("ERROR: failure requesting IoTHubClient to send telemetry event.\n");
+            free(pending);
+            result = AzureIoT_Result_OtherFailure;
+        } else {
+            Log_Debug("INFO: IoTHubClient accepted the telemetry event for delivery.\n");
+            ++pendingConfirmations;
+            if (++telemetryWindowStats.inFlight > telemetryWindowStats.peakInFlight) {
+                telemetryWindowStats.peakInFlight = telemetryWindowStats.inFlight;
+            }
+        }
     }
 
     IoTHubMessage_Destroy(messageHandle);
     return result;
 }
 
+/// <summary>
+///     Copies a telemetry message to the end of the deferred queue, unless the queue is full.
+/// </summary>
+static AzureIoT_Result DeferTelemetry(const unsigned char *data, size_t length,
+                                      const char *contentType, const char *iso8601DateTimeString,
+                                      void *context)
+{
+    if (telemetryWindowStats.deferred >= telemetryWindowMaxDeferred) {
+        ++telemetryWindowStats.busyRejections;
+        Log_Debug("WARNING: %u telemetry messages are already waiting to be sent.\n",
+                  telemetryWindowStats.deferred);
+        return AzureIoT_Result_Busy;
+    }
+
+    // The message is followed by a NULL terminator, then the content type and the timestamp.
+    size_t contentTypeLength = contentType != NULL ? strlen(contentType) + 1 : 0;
+    size_t dateTimeLength = iso8601DateTimeString != NULL ? strlen(iso8601DateTimeString) + 1 : 0;
+    DeferredTelemetry *deferred =
+        malloc(sizeof(DeferredTelemetry) + length + 1 + contentTypeLength + dateTimeLength);
+    if (deferred == NULL) {
+        Log_Debug("ERROR: Could not allocate a deferred telemetry message.\n");
+        return AzureIoT_Result_OtherFailure;
+    }
+    deferred->next = NULL;
+    deferred->context = context;
+    deferred->length = length;
+    memcpy(deferred->data, data, length);
+    deferred->data[length] = '\0';
+    char *strings = (char *)deferred->data + length + 1;
+    deferred->contentType = NULL;
+    if (contentType != NULL) {
+        memcpy(strings, contentType, contentTypeLength);
+        deferred->contentType = strings;
+        strings += contentTypeLength;
+    }
+    deferred->iso8601DateTimeString = NULL;
+    if (iso8601DateTimeString != NULL) {
+        memcpy(strings, iso8601DateTimeString, dateTimeLength);
+        deferred->iso8601DateTimeString = strings;
+    }
+
+    if (deferredTelemetryTail == NULL) {
+        deferredTelemetryHead = deferred;
+    } else {
+        deferredTelemetryTail->next = deferred;
+    }
+    deferredTelemetryTail = deferred;
+    ++telemetryWindowStats.deferredSends;
+    if (++telemetryWindowStats.deferred > telemetryWindowStats.peakDeferred) {
+        telemetryWindowStats.peakDeferred = telemetryWindowStats.deferred;
+    }
+
+    Log_Debug("INFO: Send window full; deferred telemetry (%u messages deferred).\n",
+              telemetryWindowStats.deferred);
+    return AzureIoT_Result_OK;
+}
+
+/// <summary>
+///     Hands deferred telemetry to the SDK while there are free slots in the send window. A
+///     message which the SDK refuses is reported to the sendTelemetryCallbackFunction as failed,
+///     since its sender was told it would be sent.
+/// </summary>
+/// <returns>true if any message was handed to the SDK.</returns>
+static bool SendDeferredTelemetry(void)
+{
+    bool sent = false;
+    while (deferredTelemetryHead != NULL && iothubClientHandle != NULL &&
+           iotHubClientAuthenticationState == IoTHubClientAuthenticationState_Authenticated &&
+           (telemetryWindowMaxInFlight == 0 ||
+            telemetryWindowStats.inFlight < telemetryWindowMaxInFlight)) {
+        DeferredTelemetry *deferred = deferredTelemetryHead;
+        deferredTelemetryHead = deferred->next;
+        if (deferredTelemetryHead == NULL) {
+            deferredTelemetryTail = NULL;
+        }
+        --telemetryWindowStats.deferred;
+
+        if (SendTelemetryToHub(deferred->data, deferred->length, deferred->contentType,
+                               deferred->iso8601DateTimeString,
+                               deferred->context) == AzureIoT_Result_OK) {
+            sent = true;
+        } else if (callbacks.sendTelemetryCallbackFunction != NULL) {
+            callbacks.sendTelemetryCallbackFunction(false, deferred->context);
+        }
+        free(deferred);
+    }
+
+    return sent;
+}
+
+void AzureIoT_SetTelemetryWindow(unsigned int maxInFlight, unsigned int maxDeferred)
+{
+    telemetryWindowMaxInFlight = maxInFlight;
+    telemetryWindowMaxDeferred = maxDeferred;
+}
+
+/// <summary>
+///     Returns the upper bound, in milliseconds, of the latency bucket containing the given
+///     percentile of confirmations; no more than the longest latency seen.
+/// </summary>
+static unsigned long LatencyPercentileMs(const unsigned long *histogram, unsigned int percentile)
+{
+    unsigned long total = 0;
+    for (size_t i = 0; i < AZURE_IOT_LATENCY_BUCKETS; ++i) {
+        total += histogram[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    // The rank of the percentile, rounded up.
+    unsigned long rank = (unsigned long)(((unsigned long long)total * percentile + 99) / 100);
+    unsigned long count = 0;
+    size_t bucket = 0;
+    for (; bucket < AZURE_IOT_LATENCY_BUCKETS - 1; ++bucket) {
+        count += histogram[bucket];
+        if (count >= rank) {
+            break;
+        }
+    }
+
+    unsigned long upperBoundMs = 1UL << bucket;
+    if (bucket == AZURE_IOT_LATENCY_BUCKETS - 1 || upperBoundMs > telemetryMaxConfirmLatencyMs) {
+        return telemetryMaxConfirmLatencyMs;
+    }
+    return upperBoundMs;
+}
+
+static size_t GetLatencyBucket(unsigned long latencyMs)
+{
+    size_t bucket = 0;
+    while (latencyMs != 0 && bucket < AZURE_IOT_LATENCY_BUCKETS - 1) {
+        latencyMs >>= 1;
+        ++bucket;
+    }
+
+    return bucket;
+}
+
+void AzureIoT_GetTelemetryWindowStats(AzureIoT_TelemetryWindowStats *stats)
+{
+    *stats = telemetryWindowStats;
+    stats->latencyP50Ms = LatencyPercentileMs(telemetryWindowStats.latencyHistogram, 50);
+    stats->latencyP99Ms = LatencyPercentileMs(telemetryWindowStats.latencyHistogram, 99);
+}
+
+bool AzureIoT_ConfigureTelemetryBatching(size_t maxBytes, const struct timespec *maxAge)
+{
+    if (telemetryBatchReadings > 0 && SendTelemetryBatch() != AzureIoT_Result_OK) {
+        Log_Debug("ERROR: Could not send the telemetry batch before reconfiguring batching.\n");
+        return false;
+    }
+
+    free(telemetryBatch);
+    telemetryBatch = NULL;
+    telemetryBatchMaxBytes = 0;
+
+    if (maxBytes == 0) {
+        return true;
+    }
+
+    // Room for the closing "]" and the terminator.
+    telemetryBatch = malloc(maxBytes + 1);
+    if (telemetryBatch == NULL) {
+        Log_Debug("ERROR: Could not allocate the telemetry batch.\n");
+        return false;
+    }
+
+    telemetryBatchMaxBytes = maxBytes;
+    telemetryBatchMaxAge = *maxAge;
+    telemetryBatch[0] = '[';
+    telemetryBatchLength = 1;
+    return true;
+}
+
+AzureIoT_Result AzureIoT_SendBatchedTelemetry(const char *jsonReading,
+                                              const char *iso8601DateTimeString)
+{
+    // Only readings which are JSON objects can carry their timestamp as a member.
+    if (telemetryBatch == NULL || jsonReading[0] != '{') {
+        return AzureIoT_SendTelemetry(jsonReading, iso8601DateTimeString, NULL);
+    }
+
+    // A reading is not added to the batch if it could not be sent now, so that the caller can
+    // keep it until the device is online.
+    if (IsConnectionReadyToSendTelemetry() == false) {
+        return AzureIoT_Result_NoNetwork;
+    }
+
+    if (iotHubClientAuthenticationState != IoTHubClientAuthenticationState_Authenticated) {
+        Log_Debug("WARNING: Azure IoT Hub is not authenticated. Not sending telemetry.\n");
+        return AzureIoT_Result_OtherFailure;
+    }
+
+    // The element is the reading with a "timestamp" member inserted at the start.
+    const char *members = jsonReading + 1;
+    while (isspace((unsigned char)members[0])) {
+        ++members;
+    }
+    bool hasMembers = members[0] != '}';
+    size_t elementLength = strlen(jsonReading);
+    if (iso8601DateTimeString != NULL) {
+        elementLength = sizeof(TelemetryTimestampPrefix) - 1 + strlen(iso8601DateTimeString) + 1 +
+                        (hasMembers ? 1 : 0) + strlen(members);
+    }
+
+    // A separating comma before the element and the closing "]" after it.
+    size_t separatorLength = telemetryBatchReadings > 0 ? 1 : 0;
+    if (1 + elementLength + 1 > telemetryBatchMaxBytes) {
+        return AzureIoT_SendTelemetry(jsonReading, iso8601DateTimeString, NULL);
+    }
+
+    if (telemetryBatchLength + separatorLength + elementLength + 1 > telemetryBatchMaxBytes) {
+        AzureIoT_Result result = SendTelemetryBatch();
+        if (result != AzureIoT_Result_OK) {
+            return result;
+        }
+        ++telemetryBatchStats.batchesSentFull;
+        separatorLength = 0;
+    }
+
+    char *element = telemetryBatch + telemetryBatchLength;
+    if (separatorLength > 0) {
+        *element++ = ',';
+    }
+    if (iso8601DateTimeString != NULL) {
+        snprintf(element, elementLength + 1, "%s%s\"%s%s", TelemetryTimestampPrefix,
+                 iso8601DateTimeString, hasMembers ? "," : "", members);
+    } else {
+        memcpy(element, jsonReading, elementLength + 1);
+    }
+    telemetryBatchLength += separatorLength + elementLength;
+
+    if (telemetryBatchReadings++ == 0) {
+        if (iso8601DateTimeString != NULL &&
+            strlen(iso8601DateTimeString) < sizeof(telemetryBatchCreationTime)) {
+            strcpy(telemetryBatchCreationTime, iso8601DateTimeString);
+        } else {
+            telemetryBatchCreationTime[0] = '\0';
+        }
+        if (SetEventLoopTimerOneShot(azureIoTTelemetryBatchTimer, &telemetryBatchMaxAge) != 0) {
+            Log_Debug("ERROR: Could not arm the telemetry batch timer.\n");
+        }
+    }
+    ++telemetryBatchStats.readingsBatched;
+
+    return AzureIoT_Result_OK;
+}
+
+void AzureIoT_GetTelemetryBatchStats(AzureIoT_TelemetryBatchStats *stats)
+{
+    *stats = telemetryBatchStats;
+}
+
+/// <summary>
+///     Sends the batched readings as one telemetry message. On failure, the batch is kept, and
+///     sending it is retried after the batch's maximum age.
+/// </summary>
+static AzureIoT_Result SendTelemetryBatch(void)
+{
+    if (telemetryBatchReadings == 0) {
+        return AzureIoT_Result_OK;
+    }
+
+    telemetryBatch[telemetryBatchLength] = ']';
+    telemetryBatch[telemetryBatchLength + 1] = '\0';
+    AzureIoT_Result result = AzureIoT_SendTelemetry(
+        telemetryBatch,
+        telemetryBatchCreationTime[0] != '\0' ? telemetryBatchCreationTime : NULL, NULL);
+    telemetryBatch[telemetryBatchLength] = '\0';
+
+    if (result != AzureIoT_Result_OK) {
+        if (!ReturnTelemetryBatch()) {
+            SetEventLoopTimerOneShot(azureIoTTelemetryBatchTimer, &telemetryBatchMaxAge);
+        }
+        return result;
+    }
+
+    ++telemetryBatchStats.batchesSent;
+    telemetryBatchStats.bytesSent += telemetryBatchLength + 1;
+    telemetryBatchLength = 1;
+    telemetryBatchReadings = 0;
+    DisarmEventLoopTimer(azureIoTTelemetryBatchTimer);
+    return AzureIoT_Result_OK;
+}
+
+/// <summary>
+///     Returns the length of the JSON object or array at the start of a string, or the length of
+///     the string if it does not end.
+/// </summary>
+static size_t GetJsonElementLength(const char *json)
+{
+    size_t depth = 0;
+    bool inString = false;
+    for (size_t i = 0; json[i] != '\0'; ++i) {
+        char c = json[i];
+        if (inString) {
+            if (c == '\\' && json[i + 1] != '\0') {
+                ++i;
+            } else if (c == '"') {
+                inString = false;
+            }
+        } else if (c == '"') {
+            inString = true;
+        } else if (c == '{' || c == '[') {
+            ++depth;
+        } else if ((c == '}' || c == ']') && --depth == 0) {
+            return i + 1;
+        }
+    }
+    return strlen(json);
+}
+
+/// <summary>
+///     Passes each batched reading, with its timestamp separated out again, to the
+///     batchedTelemetryUnsentCallbackFunction, and empties the batch.
+/// </summary>
+/// <returns>true if the readings were passed back; false if there is no callback, in which case
+/// the batch is unchanged.</returns>
+static bool ReturnTelemetryBatch(void)
+{
+    if (telemetryBatchReadings == 0) {
+        return true;
+    }
+    if (callbacks.batchedTelemetryUnsentCallbackFunction == NULL) {
+        return false;
+    }
+
+    // The batch is emptied afterwards, so its elements are split up in place.
+    char *element = telemetryBatch + 1;
+    for (size_t i = 0; i < telemetryBatchReadings && element[0] == '{'; ++i) {
+        size_t elementLength = GetJsonElementLength(element);
+        char *next = element + elementLength;
+        if (next[0] != '\0') {
+            next[0] = '\0';
+            ++next;
+        }
+
+        const char *reading = element;
+        const char *dateTime = NULL;
+        static const size_t prefixLength = sizeof(TelemetryTimestampPrefix) - 1;
+        char *dateTimeEnd = strncmp(element, TelemetryTimestampPrefix, prefixLength) == 0
+                                ? strchr(element + prefixLength, '"')
+                                : NULL;
+        if (dateTimeEnd != NULL) {
+            // {"timestamp":"<dateTime>",<members>} or {"timestamp":"<dateTime>"}
+            dateTime = element + prefixLength;
+            if (dateTimeEnd[1] == ',') {
+                dateTimeEnd[1] = '{';
+                reading = dateTimeEnd + 1;
+            } else {
+                reading = "{}";
+            }
+            dateTimeEnd[0] = '\0';
+        }
+
+        callbacks.batchedTelemetryUnsentCallbackFunction(reading, dateTime);
+        ++telemetryBatchStats.readingsUnsent;
+        element = next;
+    }
+
+    Log_Debug("INFO: Returned %zu batched telemetry readings unsent.\n", telemetryBatchReadings);
+    telemetryBatch[1] = '\0';
+    telemetryBatchLength = 1;
+    telemetryBatchReadings = 0;
+    DisarmEventLoopTimer(azureIoTTelemetryBatchTimer);
+    return true;
+}
+
+/// <summary>
+///     azureIoTTelemetryBatchTimer timer event: the oldest batched reading has reached the
+///     maximum age, so send the batch.
+/// </summary>
+static void AzureIoTTelemetryBatchTimerEventHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        failureCallbackFunction(ExitCode_AzureIoTTelemetryBatchTimer_Consume);
+        return;
+    }
+
+    SendTelemetryBatch();
+}
+
 /// <summary>
 ///     Callback invoked when the Azure IoT Hub send event request is processed.
 /// </summary>
@@ -337,14 +1189,30 @@ static void SendEventCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *co
 {
     Log_Debug("INFO: Azure IoT Hub send telemetry event callback: status code %d.\n", result);
 
+    PendingTelemetry *pending = context;
+    unsigned long latencyMs = RecordConfirmation(&pending->sentTime);
+
+    // Free the message's slot in the send window; deferred messages are handed to the SDK after
+    // DoWork returns.
+    if (telemetryWindowStats.inFlight > 0) {
+        --telemetryWindowStats.inFlight;
+    }
+    ++telemetryWindowStats.latencyHistogram[GetLatencyBucket(latencyMs)];
+    if (latencyMs > telemetryMaxConfirmLatencyMs) {
+        telemetryMaxConfirmLatencyMs = latencyMs;
+    }
+
     if (callbacks.sendTelemetryCallbackFunction != NULL) {
-        callbacks.sendTelemetryCallbackFunction(result == IOTHUB_CLIENT_CONFIRMATION_OK, context);
+        callbacks.sendTelemetryCallbackFunction(result == IOTHUB_CLIENT_CONFIRMATION_OK,
+                                                pending->context);
     }
+    free(pending);
 }
 
 /// <summary>
-///     Enqueues a report containing Device Twin reported properties. The report is not sent
-///     immediately, but it is sent on the next invocation of IoTHubDeviceClient_LL_DoWork().
+///     Enqueues a report containing Device Twin reported properties. Reports are held for
+///     AzureIoTReportStateDebounce after the first, and then sent together as one merge patch from
+///     the last published state, which only contains the properties which actually changed.
 /// </summary>
 AzureIoT_Result AzureIoT_DeviceTwinReportState(const char *jsonState, void *context)
 {
@@ -358,17 +1226,165 @@ AzureIoT_Result AzureIoT_DeviceTwinReportState(const char *jsonState, void *cont
         return AzureIoT_Result_OtherFailure;
     }
 
-    if (IoTHubDeviceClient_LL_SendReportedState(
-            iothubClientHandle, (const unsigned char *)jsonState, strlen(jsonState),
-            ReportedStateCallback, context) != IOTHUB_CLIENT_OK) {
-        Log_Debug("ERROR: Azure IoT Hub client error when reporting state '%s'.\n", jsonState);
+    // Only copy the report here: the caller may be using a JSON arena, so building persistent
+    // parson values is left to the timer.
+    size_t length = strlen(jsonState);
+    PendingReport *report = malloc(sizeof(PendingReport) + length + 1);
+    if (report == NULL) {
+        Log_Debug("ERROR: Could not allocate a device twin report.\n");
         return AzureIoT_Result_OtherFailure;
     }
+    report->next = NULL;
+    report->context = context;
+    memcpy(report->jsonState, jsonState, length + 1);
+
+    if (pendingReportsTail == NULL) {
+        pendingReportsHead = report;
+        if (SetEventLoopTimerOneShot(azureIoTReportStateTimer, &AzureIoTReportStateDebounce) != 0) {
+            Log_Debug("ERROR: Could not arm the device twin report timer.\n");
+        }
+    } else {
+        pendingReportsTail->next = report;
+    }
+    pendingReportsTail = report;
+    ++pendingReportCount;
+    ++reportStats.reportsRequested;
+    reportStats.bytesRequested += length;
 
-    Log_Debug("INFO: Azure IoT Hub client accepted request to report state '%s'.\n", jsonState);
+    Log_Debug("INFO: Azure IoT Hub client queued request to report state '%s'.\n", jsonState);
     return AzureIoT_Result_OK;
 }
 
+void AzureIoT_GetDeviceTwinReportStats(AzureIoT_DeviceTwinReportStats *stats)
+{
+    *stats = reportStats;
+}
+
+/// <summary>
+///     azureIoTReportStateTimer timer event: the debounce window has closed, so publish the
+///     pending reports.
+/// </summary>
+static void AzureIoTReportStateTimerEventHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        failureCallbackFunction(ExitCode_AzureIoTReportStateTimer_Consume);
+        return;
+    }
+
+    SendPendingReportedState();
+}
+
+/// <summary>
+///     Merges the pending reports into the reported state, and publishes the merge patch from
+///     the last published state, if anything changed.
+/// </summary>
+static void SendPendingReportedState(void)
+{
+    ReportBatch *batch = malloc(sizeof(ReportBatch) + pendingReportCount * sizeof(void *));
+    JSON_Value *newState = publishedReportedState != NULL
+                               ? json_value_deep_copy(publishedReportedState)
+                               : json_value_init_object();
+    bool merged = batch != NULL && newState != NULL;
+
+    if (batch != NULL) {
+        clock_gettime(CLOCK_MONOTONIC, &batch->sentTime);
+        batch->count = 0;
+    }
+
+    while (pendingReportsHead != NULL) {
+        PendingReport *report = pendingReportsHead;
+        pendingReportsHead = report->next;
+
+        JSON_Value *patch = merged ? json_parse_string(report->jsonState) : NULL;
+        if (merged && json_value_get_type(patch) != JSONObject) {
+            // Fail just this report, which would not have been accepted on its own either.
+            Log_Debug("ERROR: Device twin report is not a JSON object: '%s'.\n",
+                      report->jsonState);
+            if (callbacks.deviceTwinReportStateAckCallbackTypeFunction != NULL) {
+                callbacks.deviceTwinReportStateAckCallbackTypeFunction(false, report->context);
+            }
+        } else {
+            if (merged &&
+                json_object_merge_patch(json_object(newState), json_object(patch)) != JSONSuccess) {
+                Log_Debug("ERROR: Could not merge a device twin report.\n");
+                merged = false;
+            }
+            if (batch != NULL) {
+                batch->contexts[batch->count++] = report->context;
+            }
+        }
+        json_value_free(patch);
+        free(report);
+    }
+    pendingReportsTail = NULL;
+    pendingReportCount = 0;
+
+    JSON_Value *delta = NULL;
+    if (merged) {
+        delta = publishWholeReportedState
+                    ? json_value_deep_copy(newState)
+                    : json_object_merge_patch_diff(json_object(publishedReportedState),
+                                                   json_object(newState));
+    }
+    if (delta == NULL) {
+        json_value_free(newState);
+        CompleteReportBatch(batch, false);
+        return;
+    }
+
+    if (json_object_get_count(json_object(delta)) == 0) {
+        // Every reported property already has this value.
+        ++reportStats.publishesSkipped;
+        json_value_free(delta);
+        json_value_free(newState);
+        CompleteReportBatch(batch, true);
+        return;
+    }
+
+    char *serializedDelta = json_serialize_to_string(delta);
+    json_value_free(delta);
+
+    if (serializedDelta == NULL || iothubClientHandle == NULL ||
+        IoTHubDeviceClient_LL_SendReportedState(
+            iothubClientHandle, (const unsigned char *)serializedDelta, strlen(serializedDelta),
+            ReportedStateCallback, batch) != IOTHUB_CLIENT_OK) {
+        Log_Debug("ERROR: Azure IoT Hub client error when reporting state.\n");
+        json_free_serialized_string(serializedDelta);
+        json_value_free(newState);
+        CompleteReportBatch(batch, false);
+        return;
+    }
+
+    Log_Debug("INFO: Azure IoT Hub client accepted request to report state '%s'.\n",
+              serializedDelta);
+    ++pendingConfirmations;
+    KickDoWork();
+    ++reportStats.publishes;
+    reportStats.bytesPublished += strlen(serializedDelta);
+    json_free_serialized_string(serializedDelta);
+
+    json_value_free(publishedReportedState);
+    publishedReportedState = newState;
+    publishWholeReportedState = false;
+}
+
+/// <summary>
+///     Calls the acknowledgement callback for each request in a batch, and frees the batch.
+/// </summary>
+static void CompleteReportBatch(ReportBatch *batch, bool success)
+{
+    if (batch == NULL) {
+        return;
+    }
+
+    if (callbacks.deviceTwinReportStateAckCallbackTypeFunction != NULL) {
+        for (size_t i = 0; i < batch->count; ++i) {
+            callbacks.deviceTwinReportStateAckCallbackTypeFunction(success, batch->contexts[i]);
+        }
+    }
+    free(batch);
+}
+
 /// <summary>
 ///     Callback invoked when the Device Twin report state request is processed by Azure IoT Hub
 ///     client.
@@ -377,9 +1393,18 @@ static void ReportedStateCallback(int result, void *context)
 {
     Log_Debug("INFO: Azure IoT Hub Device Twin reported state callback: status code %d.\n", result);
 
-    if (callbacks.deviceTwinReportStateAckCallbackTypeFunction != NULL) {
-        callbacks.deviceTwinReportStateAckCallbackTypeFunction(result != 0, context);
+    // The SDK gives the HTTP status of the IoT Hub's response, or 408 if there was none.
+    bool success = result >= 200 && result < 300;
+    if (!success) {
+        // The IoT Hub may not hold this patch, so publish the whole state next time.
+        publishWholeReportedState = true;
     }
+
+    if (context != NULL) {
+        RecordConfirmation(&((ReportBatch *)context)->sentTime);
+    }
+
+    CompleteReportBatch(context, success);
 }
 
 /// <summary>
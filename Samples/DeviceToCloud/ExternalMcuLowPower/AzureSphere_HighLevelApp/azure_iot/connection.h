@@ -64,6 +64,16 @@ ExitCode Connection_Initialise(EventLoop *el, Connection_StatusCallbackType stat
 /// </summary>
 void Connection_Start(void);
 
+/// <summary>
+/// Report the authentication status of the IoT Hub client created by the connection, as given to
+/// the client's connection status callback. Implementations which cache connection details use
+/// this to discard them when they stop working.
+/// </summary>
+/// <param name="status">Whether the client is authenticated.</param>
+/// <param name="reason">Reason for the status.</param>
+void Connection_ReportAuthenticationStatus(IOTHUB_CLIENT_CONNECTION_STATUS status,
+                                           IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason);
+
 /// <summary>
 /// Close and cleanup any resources needed by the Azure IoT Hub connection.
 /// </summary>
@@ -3,9 +3,22 @@
 
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
 /// <summary>
 /// Context data for required for provisioning and connection via DPS.
 /// </summary>
 typedef struct {
     const char *scopeId;
+    /// <summary>
+    /// Whether to cache the IoT Hub which DPS assigns the device to, and connect to it directly
+    /// until it stops accepting the device.
+    /// </summary>
+    bool cacheAssignment;
+    /// <summary>
+    /// Offset of the cache in the mutable storage file, if cacheAssignment is set. The region
+    /// must have room for DPS_CACHE_REGION_SIZE bytes.
+    /// </summary>
+    uint32_t cacheStorageOffset;
 } Connection_Dps_Config;
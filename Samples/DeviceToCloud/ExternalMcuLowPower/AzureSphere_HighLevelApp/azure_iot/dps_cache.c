@@ -0,0 +1,134 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <assert.h>
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <applibs/log.h>
+#include <applibs/storage.h>
+
+#include "dps_cache.h"
+
+// The record is stored in native byte order; it is only read back by the device which wrote it.
+typedef struct {
+    uint32_t magic;
+    uint32_t checksum;
+    int64_t assignedTime;
+    char scopeId[DPS_CACHE_MAX_SCOPEID_LENGTH + 1];
+    char hubHostname[DPS_CACHE_MAX_HOSTNAME_LENGTH + 1];
+    char deviceId[DPS_CACHE_MAX_DEVICEID_LENGTH + 1];
+} CacheRecord;
+
+static_assert(sizeof(CacheRecord) <= DPS_CACHE_REGION_SIZE,
+              "The cache record does not fit in DPS_CACHE_REGION_SIZE.");
+
+static const uint32_t CacheMagic = ('D' << 24) | ('P' << 16) | ('S' << 8) | '1';
+
+static uint32_t RecordChecksum(const CacheRecord *record)
+{
+    // FNV-1a over everything after the checksum.
+    uint32_t hash = 2166136261u;
+    const unsigned char *bytes = (const unsigned char *)&record->assignedTime;
+    size_t length = sizeof(*record) - offsetof(CacheRecord, assignedTime);
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool WriteRecord(uint32_t storageOffset, const CacheRecord *record)
+{
+    int fd = Storage_OpenMutableFile();
+    if (fd == -1) {
+        Log_Debug("ERROR: Could not open mutable storage for the DPS cache: %s (%d).\n",
+                  strerror(errno), errno);
+        return false;
+    }
+
+    bool written = pwrite(fd, record, sizeof(*record), storageOffset) == (ssize_t)sizeof(*record);
+    if (!written) {
+        Log_Debug("ERROR: Could not write the DPS cache: %s (%d).\n", strerror(errno), errno);
+    }
+    close(fd);
+    return written;
+}
+
+uint32_t DpsCache_GetRegionSize(void)
+{
+    return DPS_CACHE_REGION_SIZE;
+}
+
+bool DpsCache_Load(uint32_t storageOffset, const char *scopeId, time_t maxAgeSeconds,
+                   DpsCache_Assignment *assignment)
+{
+    int fd = Storage_OpenMutableFile();
+    if (fd == -1) {
+        Log_Debug("ERROR: Could not open mutable storage for the DPS cache: %s (%d).\n",
+                  strerror(errno), errno);
+        return false;
+    }
+
+    CacheRecord record;
+    ssize_t bytesRead = pread(fd, &record, sizeof(record), storageOffset);
+    close(fd);
+
+    if (bytesRead != (ssize_t)sizeof(record) || record.magic != CacheMagic ||
+        record.checksum != RecordChecksum(&record)) {
+        return false;
+    }
+
+    // The strings were written NULL-terminated, and are covered by the checksum.
+    if (strcmp(record.scopeId, scopeId) != 0) {
+        Log_Debug("INFO: The cached DPS assignment is for a different ID scope.\n");
+        return false;
+    }
+
+    time_t now = time(NULL);
+    if (now >= (time_t)record.assignedTime && now - (time_t)record.assignedTime > maxAgeSeconds) {
+        Log_Debug("INFO: The cached DPS assignment has expired.\n");
+        return false;
+    }
+
+    memcpy(assignment->hubHostname, record.hubHostname, sizeof(assignment->hubHostname));
+    memcpy(assignment->deviceId, record.deviceId, sizeof(assignment->deviceId));
+    assignment->assignedTime = (time_t)record.assignedTime;
+    return true;
+}
+
+bool DpsCache_Save(uint32_t storageOffset, const char *scopeId, const char *hubHostname,
+                   const char *deviceId)
+{
+    if (deviceId == NULL) {
+        deviceId = "";
+    }
+
+    if (strlen(scopeId) > DPS_CACHE_MAX_SCOPEID_LENGTH ||
+        strlen(hubHostname) > DPS_CACHE_MAX_HOSTNAME_LENGTH ||
+        strlen(deviceId) > DPS_CACHE_MAX_DEVICEID_LENGTH) {
+        Log_Debug("WARNING: DPS assignment is too large to cache.\n");
+        return false;
+    }
+
+    // Zero the whole record, so that the padding and the unused parts of the strings are
+    // deterministic for the checksum.
+    CacheRecord record;
+    memset(&record, 0, sizeof(record));
+    record.magic = CacheMagic;
+    record.assignedTime = (int64_t)time(NULL);
+    strcpy(record.scopeId, scopeId);
+    strcpy(record.hubHostname, hubHostname);
+    strcpy(record.deviceId, deviceId);
+    record.checksum = RecordChecksum(&record);
+
+    return WriteRecord(storageOffset, &record);
+}
+
+void DpsCache_Invalidate(uint32_t storageOffset)
+{
+    CacheRecord record;
+    memset(&record, 0, sizeof(record));
+    WriteRecord(storageOffset, &record);
+}
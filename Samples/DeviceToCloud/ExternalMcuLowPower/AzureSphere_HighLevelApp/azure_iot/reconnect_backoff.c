@@ -0,0 +1,65 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "reconnect_backoff.h"
+
+/// <summary>
+///     xorshift32; ample for spreading out delays, and needs no state beyond one word.
+/// </summary>
+static uint32_t NextRandom(ReconnectBackoff *backoff)
+{
+    uint32_t x = backoff->randomState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    backoff->randomState = x;
+    return x;
+}
+
+/// <summary>
+///     Returns a value drawn uniformly from [low, high].
+/// </summary>
+static uint32_t RandomBetween(ReconnectBackoff *backoff, uint32_t low, uint32_t high)
+{
+    uint64_t range = (uint64_t)high - low + 1;
+    return low + (uint32_t)(((uint64_t)NextRandom(backoff) * range) >> 32);
+}
+
+void ReconnectBackoff_Init(ReconnectBackoff *backoff, uint32_t baseMs, uint32_t capMs,
+                           uint32_t seed)
+{
+    backoff->baseMs = baseMs;
+    backoff->capMs = capMs < baseMs ? baseMs : capMs;
+    backoff->previousMs = 0;
+    // xorshift never leaves zero, so avoid starting there.
+    backoff->randomState = seed != 0 ? seed : 0x9E3779B9u;
+}
+
+void ReconnectBackoff_Reset(ReconnectBackoff *backoff)
+{
+    backoff->previousMs = 0;
+}
+
+uint32_t ReconnectBackoff_Next(ReconnectBackoff *backoff)
+{
+    uint32_t delayMs;
+    if (backoff->previousMs == 0) {
+        delayMs = RandomBetween(backoff, 0, backoff->baseMs);
+        // Later delays grow from the base, however short this one was.
+        backoff->previousMs = backoff->baseMs;
+        return delayMs;
+    }
+
+    uint64_t highMs = (uint64_t)backoff->previousMs * 3;
+    if (highMs > backoff->capMs) {
+        highMs = backoff->capMs;
+    }
+    delayMs = RandomBetween(backoff, backoff->baseMs, (uint32_t)highMs);
+    backoff->previousMs = delayMs;
+    return delayMs;
+}
+
+uint32_t ReconnectBackoff_Jitter(ReconnectBackoff *backoff)
+{
+    return RandomBetween(backoff, 0, backoff->baseMs);
+}
@@ -14,11 +14,19 @@
 #include "telemetry.h"
 
 #include "parson.h"
+#include "json_stream.h"
 
 #include "connection_dps.h"
 
 static const size_t MAX_SCOPEID_LENGTH = 16;
 
+#define MAX_FLAVOR_FIELD_LENGTH 64
+// Battery level in volts is reported to the same precision as it is logged.
+#define BATTERY_LEVEL_DECIMALS 2
+// Enough pooled parson headers for the largest message built here, so that sending telemetry
+// reuses the same headers instead of allocating them each time.
+#define JSON_NODE_POOL_LIMIT 8
+
 static const int sendTelemetryMessageIdentifier = 0x01;
 static const int acknowledgeFlavorMessageIdentifier = 0x02;
 
@@ -26,17 +34,43 @@ static bool isConnected = false;
 
 static Connection_Dps_Config dpsConfig;
 
+// Outgoing messages are serialized into this buffer, which only moves to the heap for messages
+// larger than messageStorage and then keeps the larger allocation for later messages.
+static char messageStorage[256];
+static JSON_Buffer messageBuffer;
+
 static Cloud_FlavorReceivedCallbackType flavorReceivedCallbackFunc;
 static Cloud_ConnectionStatusCallbackType connectionStatusCallbackFunc;
 static Cloud_SendTelemetryCallbackType sendTelemetryCallbackFunc = NULL;
 static Cloud_FlavorAcknowledgementCallbackType flavorAckCallbackFunc = NULL;
 
 static void HandleConnectionStatusChange(bool connected);
-static void HandleDeviceTwinCallback(const char *content);
+static void HandleDeviceTwinCallback(const unsigned char *payload, size_t payloadSize);
+static void HandleNextFlavor(const char *path, const JsonStream_Value *value, void *context);
+static void HandleNextFlavorName(const char *path, const JsonStream_Value *value, void *context);
+static void HandleNextFlavorColor(const char *path, const JsonStream_Value *value, void *context);
 static void HandleDeviceTwinUpdateAckCallback(bool success, void *context);
 static void HandleSendTelemetryCallback(bool success, void *context);
 static void SendDeviceTwinUpdate(const char *flavorName, const char *flavorColor);
 
+// The "NextFlavor" desired property read from a device twin message. The complete twin nests it
+// under "desired", whereas a desired property update has it at the root.
+typedef struct {
+    bool present;
+    bool hasName;
+    bool hasColor;
+    char name[MAX_FLAVOR_FIELD_LENGTH + 1];
+    char color[MAX_FLAVOR_FIELD_LENGTH + 1];
+} NextFlavor;
+
+static const JsonStream_PathHandler nextFlavorHandlers[] = {
+    {"desired.NextFlavor", HandleNextFlavor},
+    {"desired.NextFlavor.Name", HandleNextFlavorName},
+    {"desired.NextFlavor.Color", HandleNextFlavorColor},
+    {"NextFlavor", HandleNextFlavor},
+    {"NextFlavor.Name", HandleNextFlavorName},
+    {"NextFlavor.Color", HandleNextFlavorColor}};
+
 ExitCode Cloud_Initialize(EventLoop *el, void *backendConfiguration,
                           ExitCode_CallbackType failureCallback,
                           Cloud_ConnectionStatusCallbackType connectionStatusCallback,
@@ -45,10 +79,12 @@ ExitCode Cloud_Initialize(EventLoop *el, void *backendConfiguration,
     isConnected = false;
     connectionStatusCallbackFunc = connectionStatusCallback;
     flavorReceivedCallbackFunc = flavorReceivedCallback;
+    json_buffer_init(&messageBuffer, messageStorage, sizeof(messageStorage));
+    json_set_node_pool_limit(JSON_NODE_POOL_LIMIT);
 
     AzureIoT_Callbacks cbs = {
         .connectionStatusCallbackFunction = HandleConnectionStatusChange,
-        .deviceTwinReceivedCallbackFunction = HandleDeviceTwinCallback,
+        .deviceTwinPayloadReceivedCallbackFunction = HandleDeviceTwinCallback,
         .deviceTwinReportStateAckCallbackTypeFunction = HandleDeviceTwinUpdateAckCallback,
         .sendTelemetryCallbackFunction = HandleSendTelemetryCallback,
         .deviceMethodCallbackFunction = NULL};
@@ -64,6 +100,8 @@ ExitCode Cloud_Initialize(EventLoop *el, void *backendConfiguration,
 void Cloud_Cleanup(void)
 {
     AzureIoT_Cleanup();
+    json_buffer_free(&messageBuffer);
+    json_set_node_pool_limit(0);
 }
 
 bool Cloud_SendTelemetry(const CloudTelemetry *telemetry,
@@ -90,15 +128,18 @@ bool Cloud_SendTelemetry(const CloudTelemetry *telemetry,
     json_object_dotset_boolean(telemetryRootObject, "LowSoda", telemetry->lowSoda);
     json_object_dotset_number(telemetryRootObject, "LifetimeTotalDispenses",
                               telemetry->lifetimeTotalDispenses);
-    json_object_dotset_number(telemetryRootObject, "BatteryLevel", telemetry->batteryLevel);
+    json_object_dotset_number_fixed(telemetryRootObject, "BatteryLevel", telemetry->batteryLevel,
+                                    BATTERY_LEVEL_DECIMALS);
 
-    char *serializedTelemetry = json_serialize_to_string(telemetryRootValue);
-    AzureIoT_SendTelemetry(serializedTelemetry, NULL, (void *)&sendTelemetryMessageIdentifier);
-    json_free_serialized_string(serializedTelemetry);
+    bool serialized =
+        json_serialize_to_growable_buffer(telemetryRootValue, &messageBuffer) == JSONSuccess;
+    if (serialized) {
+        AzureIoT_SendTelemetry(messageBuffer.data, NULL, (void *)&sendTelemetryMessageIdentifier);
+    }
 
     json_value_free(telemetryRootValue);
 
-    return true;
+    return serialized;
 }
 
 bool Cloud_SendFlavorAcknowledgement(const LedColor *color, const char *flavorName,
@@ -146,27 +187,59 @@ static void HandleSendTelemetryCallback(bool success, void *context)
     }
 }
 
-static void HandleDeviceTwinCallback(const char *content)
+static void HandleNextFlavor(const char *path, const JsonStream_Value *value, void *context)
 {
-    JSON_Value *rootProperties = NULL;
-    rootProperties = json_parse_string(content);
-    if (rootProperties == NULL) {
-        Log_Debug("WARNING: Cannot parse the string as JSON content.\n");
-        goto cleanup;
+    NextFlavor *nextFlavor = context;
+    nextFlavor->present = value->type == JsonStream_ValueType_Object;
+}
+
+static void HandleNextFlavorName(const char *path, const JsonStream_Value *value, void *context)
+{
+    NextFlavor *nextFlavor = context;
+    if (value->type == JsonStream_ValueType_String) {
+        // The token buffer is the same size, so the string always fits.
+        memcpy(nextFlavor->name, value->string, value->stringLength);
+        nextFlavor->name[value->stringLength] = '\0';
+        nextFlavor->hasName = true;
+    }
+}
+
+static void HandleNextFlavorColor(const char *path, const JsonStream_Value *value, void *context)
+{
+    NextFlavor *nextFlavor = context;
+    if (value->type == JsonStream_ValueType_String) {
+        // The token buffer is the same size, so the string always fits.
+        memcpy(nextFlavor->color, value->string, value->stringLength);
+        nextFlavor->color[value->stringLength] = '\0';
+        nextFlavor->hasColor = true;
     }
+}
 
-    JSON_Object *rootObject = json_value_get_object(rootProperties);
-    JSON_Object *desiredProperties = json_object_get_object(rootObject, "desired");
-    if (desiredProperties == NULL) {
-        desiredProperties = rootObject;
+static void HandleDeviceTwinCallback(const unsigned char *payload, size_t payloadSize)
+{
+    // The device twin is streamed rather than parsed into a JSON_Value, so that only the
+    // properties of interest are extracted, without allocating.
+    static char tokenBuffer[MAX_FLAVOR_FIELD_LENGTH + 1];
+    NextFlavor nextFlavor = {0};
+    JsonStream_Result parseResult = JsonStream_Parse(
+        (const char *)payload, payloadSize, nextFlavorHandlers,
+        sizeof(nextFlavorHandlers) / sizeof(nextFlavorHandlers[0]), tokenBuffer,
+        sizeof(tokenBuffer), &nextFlavor);
+    if (parseResult == JsonStream_Result_TokenTooLong) {
+        Log_Debug("WARNING: NextFlavor name or color exceeds %d characters.\n",
+                  MAX_FLAVOR_FIELD_LENGTH);
+        return;
+    }
+    if (parseResult != JsonStream_Result_OK) {
+        Log_Debug("WARNING: Cannot parse the string as JSON content.\n");
+        return;
     }
 
     // The desired properties should have a "NextFlavor" object
-    JSON_Object *nextFlavor = json_object_get_object(desiredProperties, "NextFlavor");
-    if (nextFlavor != NULL) {
+    if (nextFlavor.present) {
 
-        const char *flavorName = json_object_dotget_string(nextFlavor, "Name");
-        const char *flavorColor = json_object_dotget_string(nextFlavor, "Color");
+        const char *flavorName = nextFlavor.hasName ? nextFlavor.name : NULL;
+        const char *flavorColor = nextFlavor.hasColor ? nextFlavor.color : NULL;
 
         if (flavorColor != NULL) {
             if (flavorName == NULL) {
@@ -204,12 +277,6 @@ static void HandleDeviceTwinCallback(const char *content)
             "WARNING: Cloud interface - reported device twin did not contain a NextFlavor desired "
             "property\n");
     }
-
-cleanup:
-    // Release the allocated memory.
-    if (rootProperties != NULL) {
-        json_value_free(rootProperties);
-    }
 }
 
 static void SendDeviceTwinUpdate(const char *flavorName, const char *flavorColor)
@@ -224,10 +291,10 @@ static void SendDeviceTwinUpdate(const char *flavorName, const char *flavorColor
         json_object_dotset_string(twinStateRoot, "NextFlavor.Color", flavorColor);
     }
 
-    char *serializedTwinState = json_serialize_to_string(twinStateValue);
-    AzureIoT_DeviceTwinReportState(serializedTwinState,
-                                   (void *)&acknowledgeFlavorMessageIdentifier);
-    json_free_serialized_string(serializedTwinState);
+    if (json_serialize_to_growable_buffer(twinStateValue, &messageBuffer) == JSONSuccess) {
+        AzureIoT_DeviceTwinReportState(messageBuffer.data,
+                                       (void *)&acknowledgeFlavorMessageIdentifier);
+    }
 
     if (twinStateValue != NULL) {
         json_value_free(twinStateValue);
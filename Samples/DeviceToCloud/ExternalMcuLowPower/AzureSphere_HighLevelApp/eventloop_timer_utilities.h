@@ -2,12 +2,24 @@
    Licensed under the MIT License. */
 
 #pragma once
+#include <stdint.h>
 #include <time.h>
 
 #include <unistd.h>
 
 #include <applibs/eventloop.h>
 
+// By default each EventLoopTimer owns a timerfd which is registered with the EventLoop. Define
+// EVENTLOOP_TIMER_SHARED_TIMERFD when building to multiplex all of the timers on an EventLoop onto
+// a single timerfd instead, which is armed for the earliest deadline. The API is identical in both
+// modes, but in the shared mode a handler which does not call
+// <see cref="ConsumeEventLoopTimerEvent" /> is not invoked again until the timer next expires.
+//
+// In the shared mode a timer may also be given slack: an expiration may be deferred by up to the
+// slack so that it is handled in the same wakeup as another timer. The slack of a periodic timer is
+// limited to half its period, so that deferral never skips an expiration. Slack is ignored in the
+// default mode, where each timer always wakes the event loop on its own.
+
 /// <summary>
 /// Opaque handle. Obtain via <see cref="CreateEventLoopPeriodicTimer" />
 /// or <see cref="CreateEventLoopDisarmedTimer" /> and dispose of via
@@ -37,6 +49,24 @@ typedef void (*EventLoopTimerHandler)(EventLoopTimer *timer);
 EventLoopTimer *CreateEventLoopPeriodicTimer(EventLoop *eventLoop, EventLoopTimerHandler handler,
                                              const struct timespec *period);
 
+/// <summary>
+/// Create a periodic timer, as <see cref="CreateEventLoopPeriodicTimer" />, which may be
+/// dispatched up to <paramref name="slack" /> after each expiry so that it can share a wakeup with
+/// other timers on the same event loop. The slack is kept if the timer is later re-armed. While the
+/// timer is periodic, slack of more than half its period is treated as half its period.
+/// </summary>
+/// <param name="eventLoop">Event loop to which the timer will be added.</param>
+/// <param name="handler">Callback to invoke when the timer expires.</param>
+/// <param name="period">Timer period, or NULL to create a disarmed timer.</param>
+/// <param name="slack">How late the timer may be dispatched, or NULL for no slack.</param>
+/// <returns>On success, pointer to new EventLoopTimer, which should be disposed of
+/// with <see cref="DisposeEventLoopTimer" />. On failure, returns NULL, with more
+/// information available in errno.</returns>.
+EventLoopTimer *CreateEventLoopPeriodicTimerWithSlack(EventLoop *eventLoop,
+                                                      EventLoopTimerHandler handler,
+                                                      const struct timespec *period,
+                                                      const struct timespec *slack);
+
 /// <summary>
 /// Create a disarmed timer. After the timer has been allocated, call
 /// <see cref="SetEventLoopTimerPeriod" /> or <see cref="SetEventLoopTimerOneShot" />
@@ -100,3 +130,121 @@ int SetEventLoopTimerOneShot(EventLoopTimer *timer, const struct timespec *delay
 /// <seealso cref="SetEventLoopTimerOneShot" />
 /// <seealso cref="SetEventLoopTimerPeriod" />
 int DisarmEventLoopTimer(EventLoopTimer *timer);
+
+/// <summary>
+/// Change how late the timer may be dispatched. This takes effect from the timer's next expiry.
+/// While the timer is periodic, slack of more than half its period is treated as half its
+/// period.
+/// </summary>
+/// <param name="timer">Timer previously allocated with <see cref="CreateEventLoopPeriodicTimer" />
+/// or <see cref="CreateEventLoopDisarmedTimer" />.</param>
+/// <param name="slack">How late the timer may be dispatched, or NULL for no slack.</param>
+/// <returns>0 on success; -1 on failure, in which case errno contains more
+/// information.</returns>
+/// <seealso cref="CreateEventLoopPeriodicTimerWithSlack" />
+int SetEventLoopTimerSlack(EventLoopTimer *timer, const struct timespec *slack);
+
+/// <summary>
+/// Counters describing how often timers have woken the event loop.
+/// </summary>
+typedef struct {
+    /// <summary>Number of times the event loop was woken to dispatch timers.</summary>
+    uint64_t wakeups;
+    /// <summary>Number of timer handler invocations.</summary>
+    uint64_t expirations;
+    /// <summary>Number of handler invocations which shared a wakeup with an earlier
+    /// one, and so did not need a wakeup of their own.</summary>
+    uint64_t wakeupsAvoided;
+} EventLoopTimerWakeupStats;
+
+/// <summary>
+/// Get the wakeup counters for all timers in the application.
+/// </summary>
+/// <param name="stats">Receives the counters.</param>
+void GetEventLoopTimerWakeupStats(EventLoopTimerWakeupStats *stats);
+
+/// <summary>
+/// Number of buckets in <see cref="EventLoopTimerStats.latencyHistogram" />.
+/// </summary>
+#define EVENTLOOP_TIMER_LATENCY_BUCKETS 24
+
+/// <summary>
+/// Per-timer counters, which can be used to tell whether the event loop is keeping up with
+/// its timers.
+/// </summary>
+typedef struct {
+    /// <summary>Total number of times the timer has expired.</summary>
+    uint64_t expirations;
+    /// <summary>Number of times the handler was invoked after more than one
+    /// expiration, because the event loop did not get to it in time.</summary>
+    uint64_t overruns;
+    /// <summary>Number of expirations which were merged into a later one by an overrun.</summary>
+    uint64_t missedExpirations;
+    /// <summary>Delay between the timer's most recent deadline and the handler being
+    /// invoked. Bucket 0 counts delays under 1us, bucket i counts delays from 2^(i-1)us up to
+    /// 2^i us, and the last bucket also counts all longer delays.</summary>
+    uint64_t latencyHistogram[EVENTLOOP_TIMER_LATENCY_BUCKETS];
+    /// <summary>Longest delay seen, in nanoseconds.</summary>
+    uint64_t maxLatencyNs;
+} EventLoopTimerStats;
+
+/// <summary>
+/// Give the timer a name for <see cref="EnumerateEventLoopTimerStats" />. The string is
+/// not copied, so it must remain valid until the timer is disposed of.
+/// </summary>
+/// <param name="timer">Successfully allocated timer.</param>
+/// <param name="name">Name of the timer, or NULL.</param>
+/// <returns>0 on success; -1 on failure, in which case errno contains more
+/// information.</returns>
+int SetEventLoopTimerName(EventLoopTimer *timer, const char *name);
+
+/// <summary>
+/// Get the timer's statistics. Expirations are counted when the handler is invoked in the
+/// shared timerfd mode, and when the handler calls <see cref="ConsumeEventLoopTimerEvent" />
+/// otherwise.
+/// </summary>
+/// <param name="timer">Successfully allocated timer.</param>
+/// <param name="stats">Receives the statistics.</param>
+/// <returns>0 on success; -1 on failure, in which case errno contains more
+/// information.</returns>
+int GetEventLoopTimerStats(const EventLoopTimer *timer, EventLoopTimerStats *stats);
+
+/// <summary>
+/// Zero the timer's statistics, for example after they have been reported.
+/// </summary>
+/// <param name="timer">Successfully allocated timer.</param>
+void ResetEventLoopTimerStats(EventLoopTimer *timer);
+
+/// <summary>
+/// Applications implement a function with this signature to receive timer statistics.
+/// </summary>
+/// <param name="timer">The timer, which the handler may reset or dispose of.</param>
+/// <param name="name">Name set with <see cref="SetEventLoopTimerName" />, or NULL.</param>
+/// <param name="stats">The timer's statistics.</param>
+/// <param name="context">Context supplied by the caller.</param>
+typedef void (*EventLoopTimerStatsHandler)(EventLoopTimer *timer, const char *name,
+                                           const EventLoopTimerStats *stats, void *context);
+
+/// <summary>
+/// Invoke <paramref name="handler" /> for every timer in the application.
+/// </summary>
+/// <param name="handler">Function to receive each timer's statistics.</param>
+/// <param name="context">Passed to <paramref name="handler" />.</param>
+void EnumerateEventLoopTimerStats(EventLoopTimerStatsHandler handler, void *context);
+
+/// <summary>
+/// Create a periodic timer which calls <see cref="EnumerateEventLoopTimerStats" />, for example
+/// so that the statistics can be logged or sent as telemetry. The application may only have one
+/// reporter at a time.
+/// </summary>
+/// <param name="eventLoop">Event loop to which the timer will be added.</param>
+/// <param name="period">How often to report statistics.</param>
+/// <param name="handler">Function to receive each timer's statistics.</param>
+/// <param name="context">Passed to <paramref name="handler" />.</param>
+/// <returns>On success, pointer to new EventLoopTimer, which should be disposed of
+/// with <see cref="DisposeEventLoopTimer" />. On failure, returns NULL, with more
+/// information available in errno.</returns>.
+EventLoopTimer *CreateEventLoopTimerStatsReporter(EventLoop *eventLoop,
+                                                  const struct timespec *period,
+                                                  EventLoopTimerStatsHandler handler,
+                                                  void *context);
@@ -51,7 +51,13 @@ typedef enum {
 
     ExitCode_Update_UpdateCallback_GetUpdateData,
     ExitCode_Update_UpdateCallback_DeferEvent,
-    ExitCode_Update_UpdateCallback_UnexpectedStatus
+    ExitCode_Update_UpdateCallback_UnexpectedStatus,
+
+    ExitCode_Init_AzureIoTReportStateTimer,
+    ExitCode_AzureIoTReportStateTimer_Consume,
+
+    ExitCode_Init_AzureIoTTelemetryBatchTimer,
+    ExitCode_AzureIoTTelemetryBatchTimer_Consume
 } ExitCode;
 
 typedef void (*ExitCode_CallbackType)(ExitCode);
@@ -137,6 +137,13 @@ static void ClosePeripheralsAndHandlers(void)
     Cloud_Cleanup();
 
     EventLoop_Close(eventLoop);
+
+    EventLoopTimerWakeupStats wakeupStats;
+    GetEventLoopTimerWakeupStats(&wakeupStats);
+    Log_Debug("INFO: Timer wakeups: %llu, expirations: %llu, wakeups avoided: %llu.\n",
+              (unsigned long long)wakeupStats.wakeups,
+              (unsigned long long)wakeupStats.expirations,
+              (unsigned long long)wakeupStats.wakeupsAvoided);
 }
 
 /// <summary>
@@ -36,31 +36,68 @@
 #include "parson.h"
 
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include <math.h>
 #include <errno.h>
+#include <float.h>
+
+/* The NEON string scan has not yet been built or tested with the Azure Sphere toolchain, so it is
+   only used when PARSON_ENABLE_NEON is defined. */
+#if defined(PARSON_ENABLE_NEON) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define PARSON_NEON
+#endif
 
 /* Apparently sscanf is not implemented in some "standard" libraries, so don't use it, if you
  * don't have to. */
 #define sscanf THINK_TWICE_ABOUT_USING_SSCANF
 
 #define STARTING_CAPACITY 16
+#define OBJECT_HASH_THRESHOLD 16 /* objects with at least this many members get a hash index */
+#define OBJECT_HASH_EMPTY_SLOT 0 /* hash slots hold member index + 1 */
 #define MAX_NESTING 2048
 
 #define FLOAT_FORMAT "%1.17g" /* do not increase precision without incresing NUM_BUF_SIZE */
 /* double printed with "%1.17g" shouldn't be longer than 25 bytes so let's use 64 */
 #define NUM_BUF_SIZE 64
+#define MAX_FIXED_DECIMALS 15
+#define MAX_EXACT_INTEGER 9007199254740992.0 /* 2^53 */
+#define MAX_FAST_NUMBER_DIGITS 19 /* significant digits which always fit in a uint64_t */
+#define MAX_EXACT_POWER_OF_TEN 22
 
 #define SIZEOF_TOKEN(a) (sizeof(a) - 1)
 #define SKIP_CHAR(str) ((*str)++)
-#define SKIP_WHITESPACES(str)                 \
-    while (isspace((unsigned char)(**str))) { \
-        SKIP_CHAR(str);                       \
-    }
+/* The characters isspace accepts in the "C" locale: ' ' and '\t' to '\r' */
+#define IS_WHITESPACE(c) ((c) == ' ' || (unsigned char)((c) - '\t') < 5)
+#define SKIP_WHITESPACES(str)      \
+    while (IS_WHITESPACE(**str)) { \
+        SKIP_CHAR(str);            \
+    }
+/* Characters which end a run of plain string contents: quote, backslash and control characters,
+   including the terminating NUL */
+#define IS_STRING_SPECIAL(c) ((c) == '\"' || (c) == '\\' || (unsigned char)(c) < 0x20)
+#define IS_DIGIT(c) ((unsigned char)((c) - '0') < 10)
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 
+/* String contents are scanned a block at a time: 16 bytes with NEON, otherwise a machine word
+   tested with bit tricks (SWAR). Bytes of a word w equal to zero are detected by
+   WORD_HAS_ZERO_BYTE(w), and bytes less than n (at most 0x80) by WORD_HAS_BYTE_LESS_THAN(w, n). */
+#ifdef PARSON_NEON
+#define SCAN_BLOCK_SIZE 16
+#else
+#define SCAN_BLOCK_SIZE sizeof(size_t)
+#endif
+#define WORD_ONES ((size_t)-1 / 0xFF)
+#define WORD_HIGHS (WORD_ONES * 0x80)
+#define WORD_HAS_ZERO_BYTE(w) (((w) - WORD_ONES) & ~(w) & WORD_HIGHS)
+#define WORD_HAS_BYTE_LESS_THAN(w, n) (((w) - WORD_ONES * (n)) & ~(w) & WORD_HIGHS)
+#define WORD_HAS_STRING_SPECIAL(w)                      \
+    (WORD_HAS_ZERO_BYTE((w) ^ (WORD_ONES * '\"')) |     \
+     WORD_HAS_ZERO_BYTE((w) ^ (WORD_ONES * '\\')) |     \
+     WORD_HAS_BYTE_LESS_THAN(w, 0x20))
+
 #undef malloc
 #undef free
 
@@ -79,20 +116,57 @@ typedef union json_value_value {
     int null;
 } JSON_Value_Value;
 
+/* value.string points into an in-situ parse buffer, so it is not freed */
+#define JSON_VALUE_FLAG_BORROWED_STRING 0x1
+/* Number of decimals plus one for a number serialized with fixed precision, or 0 for the shortest
+   form which round-trips */
+#define JSON_VALUE_DECIMALS_MASK 0xFF00
+#define JSON_VALUE_DECIMALS_SHIFT 8
+
 struct json_value_t {
     JSON_Value *parent;
-    JSON_Value_Type type;
+    short type;           /* JSON_Value_Type; short, so that flags fit without growing the struct */
+    unsigned short flags; /* JSON_VALUE_FLAG_* */
     JSON_Value_Value value;
 };
 
 struct json_object_t {
     JSON_Value *wrapping_value;
     char **names;
+    size_t *name_lengths;
     JSON_Value **values;
     size_t count;
     size_t capacity;
+    /* Open-addressing (linear probing) index from name to member, built lazily once the object
+       reaches OBJECT_HASH_THRESHOLD members. NULL until then, or if it could not be allocated. */
+    size_t *hash_slots;
+    size_t hash_capacity; /* power of two */
+    /* Names between these bounds point into an in-situ parse buffer, so they are not freed. Both
+       are NULL unless the object was created by json_parse_string_insitu. */
+    const char *insitu_begin;
+    const char *insitu_end;
+};
+
+/* Compiled dot-notation path: the segments, followed by a copy of the names they point to */
+typedef struct json_path_segment_t {
+    const char *name;
+    size_t name_len;
+    unsigned long hash;
+} JSON_Path_Segment;
+
+struct json_path_t {
+    size_t count;
+    JSON_Path_Segment segments[1];
 };
 
+/* Input buffer of a parse; end points to its terminating NUL. Strings are unescaped in place when
+   insitu is set, as the buffer came from json_parse_string_insitu. */
+typedef struct json_input_t {
+    const char *begin;
+    const char *end;
+    int insitu;
+} JSON_Input;
+
 struct json_array_t {
     JSON_Value *wrapping_value;
     JSON_Value **items;
@@ -100,6 +174,24 @@ struct json_array_t {
     size_t capacity;
 };
 
+/* Node pool */
+typedef struct json_node_pool_t {
+    void *free_list; /* linked through the first pointer of each free header */
+    size_t count;
+    size_t node_size;
+} JSON_Node_Pool;
+
+static JSON_Node_Pool value_pool = {NULL, 0, sizeof(struct json_value_t)};
+static JSON_Node_Pool object_pool = {NULL, 0, sizeof(struct json_object_t)};
+static JSON_Node_Pool array_pool = {NULL, 0, sizeof(struct json_array_t)};
+static size_t node_pool_limit = 0;
+static size_t node_pool_bytes = 0;
+static JSON_Node_Pool_Stats node_pool_stats;
+
+static void *node_pool_alloc(JSON_Node_Pool *pool);
+static void node_pool_free(JSON_Node_Pool *pool, void *node);
+static void node_pool_trim(JSON_Node_Pool *pool, size_t limit);
+
 /* Various */
 static void remove_comments(char *string, const char *start_token, const char *end_token);
 static char *parson_strndup(const char *string, size_t n);
@@ -116,7 +208,20 @@ static JSON_Object *json_object_init(JSON_Value *wrapping_value);
 static JSON_Status json_object_add(JSON_Object *object, const char *name, JSON_Value *value);
 static JSON_Status json_object_addn(JSON_Object *object, const char *name, size_t name_len,
                                     JSON_Value *value);
+static JSON_Status json_object_addn_no_copy(JSON_Object *object, char *name, size_t name_len,
+                                            JSON_Value *value);
+static int json_object_name_is_borrowed(const JSON_Object *object, size_t index);
 static JSON_Status json_object_resize(JSON_Object *object, size_t new_capacity);
+static unsigned long json_object_hash_name(const char *name, size_t name_len);
+static int json_object_hash_build(JSON_Object *object, size_t new_capacity);
+static size_t *json_object_hash_find_slot(const JSON_Object *object, const char *name,
+                                          size_t name_len, unsigned long hash);
+static void json_object_hash_insert(JSON_Object *object, size_t index);
+static void json_object_hash_remove(JSON_Object *object, size_t index);
+static int json_object_find_index(const JSON_Object *object, const char *name, size_t name_len,
+                                  size_t *index);
+static int json_object_find_index_hashed(const JSON_Object *object, const char *name,
+                                         size_t name_len, const unsigned long *hash, size_t *index);
 static JSON_Value *json_object_getn_value(const JSON_Object *object, const char *name,
                                           size_t name_len);
 static JSON_Status json_object_remove_internal(JSON_Object *object, const char *name,
@@ -133,26 +238,126 @@ static void json_array_free(JSON_Array *array);
 
 /* JSON Value */
 static JSON_Value *json_value_init_string_no_copy(char *string);
+static int json_value_equals_internal(const JSON_Value *a, const JSON_Value *b,
+                                      int exact_numbers);
 
 /* Parser */
-static JSON_Status skip_quotes(const char **string);
+static size_t scan_block(const char *string);
+static const char *scan_string(const char *string, const char *end);
+static size_t scan_plain_length(const char *string, size_t len);
+static JSON_Status skip_quotes(const char **string, const char *end);
 static int parse_utf16(const char **unprocessed, char **processed);
+static JSON_Status unescape_string(const char *input, size_t len, char *output,
+                                   size_t *output_len);
 static char *process_string(const char *input, size_t len);
-static char *get_quoted_string(const char **string);
-static JSON_Value *parse_object_value(const char **string, size_t nesting);
-static JSON_Value *parse_array_value(const char **string, size_t nesting);
-static JSON_Value *parse_string_value(const char **string);
+static char *get_quoted_string(const char **string, const JSON_Input *input);
+static JSON_Value *parse_object_value(const char **string, size_t nesting,
+                                      const JSON_Input *input);
+static JSON_Value *parse_array_value(const char **string, size_t nesting,
+                                     const JSON_Input *input);
+static JSON_Value *parse_string_value(const char **string, const JSON_Input *input);
 static JSON_Value *parse_boolean_value(const char **string);
+static int parse_number_fast(const char **string, double *number);
 static JSON_Value *parse_number_value(const char **string);
 static JSON_Value *parse_null_value(const char **string);
-static JSON_Value *parse_value(const char **string, size_t nesting);
+static JSON_Value *parse_value(const char **string, size_t nesting, const JSON_Input *input);
+
+/* Number formatting */
+typedef struct json_diy_fp_t {
+    uint64_t f;
+    int e;
+} JSON_Diy_Fp;
+
+static JSON_Diy_Fp diy_fp_multiply(JSON_Diy_Fp x, JSON_Diy_Fp y);
+static JSON_Diy_Fp diy_fp_normalize(JSON_Diy_Fp x);
+static int count_decimal_digits(uint32_t n);
+static void grisu_round(char *buffer, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa,
+                        uint64_t wp_w);
+static void grisu_digit_gen(JSON_Diy_Fp w, JSON_Diy_Fp mp, uint64_t delta, char *buffer,
+                            int *len, int *k);
+static void grisu2(double value, char *buffer, int *len, int *k);
+static int write_exponent(int k, char *buffer);
+static int prettify_number(char *buffer, int len, int k);
+static int format_uint64(uint64_t value, char *buffer);
+static int format_number(double number, char *buffer);
+static int format_number_fixed(double number, int decimals, char *buffer);
 
 /* Serialization */
-static int json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int level, int is_pretty,
-                                      char *num_buf);
-static int json_serialize_string(const char *string, char *buf);
-static int append_indent(char *buf, int level);
-static int append_string(char *buf, const char *string);
+typedef struct json_writer_t {
+    char *buf;       /* NULL when only measuring */
+    size_t capacity; /* size of buf, including room for the terminator */
+    size_t length;   /* bytes of output so far; exceeds capacity - 1 if buf was too small */
+    int is_growable; /* reallocate buf, rather than truncating, when it is too small */
+    int owns_buf;    /* buf was allocated with parson_malloc */
+    int failed;      /* an allocation failed */
+    char num_buf[NUM_BUF_SIZE];
+} JSON_Writer;
+
+static void json_writer_init(JSON_Writer *writer, char *buf, size_t capacity, int is_growable,
+                             int owns_buf);
+static int json_writer_grow(JSON_Writer *writer, size_t min_capacity);
+static void json_writer_append(JSON_Writer *writer, const char *data, size_t len);
+static int json_writer_finish(JSON_Writer *writer);
+static int json_serialize_to_writer_r(const JSON_Value *value, JSON_Writer *writer, int level,
+                                      int is_pretty);
+static void json_serialize_string(const char *string, size_t len, JSON_Writer *writer);
+static void append_indent(JSON_Writer *writer, int level);
+static char *json_serialize_to_string_internal(const JSON_Value *value, int is_pretty);
+static JSON_Status json_serialize_to_buffer_internal(const JSON_Value *value, char *buf,
+                                                     size_t buf_size_in_bytes, int is_pretty,
+                                                     size_t *out_len);
+
+/* Node pool */
+static void *node_pool_alloc(JSON_Node_Pool *pool)
+{
+    void *node = pool->free_list;
+    if (node == NULL) {
+        node_pool_stats.misses++;
+        return parson_malloc(pool->node_size);
+    }
+    pool->free_list = *(void **)node;
+    pool->count--;
+    node_pool_bytes -= pool->node_size;
+    node_pool_stats.hits++;
+    node_pool_stats.heap_bytes_saved += pool->node_size;
+    node_pool_stats.pooled_nodes--;
+    return node;
+}
+
+static void node_pool_free(JSON_Node_Pool *pool, void *node)
+{
+    if (node == NULL) {
+        return;
+    }
+    if (pool->count >= node_pool_limit) {
+        node_pool_stats.released++;
+        parson_free(node);
+        return;
+    }
+    *(void **)node = pool->free_list;
+    pool->free_list = node;
+    pool->count++;
+    node_pool_bytes += pool->node_size;
+    node_pool_stats.recycled++;
+    node_pool_stats.pooled_nodes++;
+    if (node_pool_bytes > node_pool_stats.pooled_bytes_high_water) {
+        node_pool_stats.pooled_bytes_high_water = node_pool_bytes;
+    }
+}
+
+/* Frees headers from the free list until it holds at most limit. */
+static void node_pool_trim(JSON_Node_Pool *pool, size_t limit)
+{
+    void *node = NULL;
+    while (pool->count > limit) {
+        node = pool->free_list;
+        pool->free_list = *(void **)node;
+        pool->count--;
+        node_pool_bytes -= pool->node_size;
+        node_pool_stats.pooled_nodes--;
+        parson_free(node);
+    }
+}
 
 /* Various */
 static char *parson_strndup(const char *string, size_t n)
@@ -161,8 +366,8 @@ static char *parson_strndup(const char *string, size_t n)
     if (!output_string) {
         return NULL;
     }
+    memcpy(output_string, string, n);
     output_string[n] = '\0';
-    strncpy(output_string, string, n);
     return output_string;
 }
 
@@ -325,15 +530,20 @@ static void remove_comments(char *string, const char *start_token, const char *e
 /* JSON Object */
 static JSON_Object *json_object_init(JSON_Value *wrapping_value)
 {
-    JSON_Object *new_obj = (JSON_Object *)parson_malloc(sizeof(JSON_Object));
+    JSON_Object *new_obj = (JSON_Object *)node_pool_alloc(&object_pool);
     if (new_obj == NULL) {
         return NULL;
     }
     new_obj->wrapping_value = wrapping_value;
     new_obj->names = (char **)NULL;
+    new_obj->name_lengths = (size_t *)NULL;
     new_obj->values = (JSON_Value **)NULL;
     new_obj->capacity = 0;
     new_obj->count = 0;
+    new_obj->hash_slots = (size_t *)NULL;
+    new_obj->hash_capacity = 0;
+    new_obj->insitu_begin = NULL;
+    new_obj->insitu_end = NULL;
     return new_obj;
 }
 
@@ -347,6 +557,25 @@ static JSON_Status json_object_add(JSON_Object *object, const char *name, JSON_V
 
 static JSON_Status json_object_addn(JSON_Object *object, const char *name, size_t name_len,
                                     JSON_Value *value)
+{
+    char *name_copy = NULL;
+    if (object == NULL || name == NULL || value == NULL) {
+        return JSONFailure;
+    }
+    name_copy = parson_strndup(name, name_len);
+    if (name_copy == NULL) {
+        return JSONFailure;
+    }
+    if (json_object_addn_no_copy(object, name_copy, name_len, value) == JSONFailure) {
+        parson_free(name_copy);
+        return JSONFailure;
+    }
+    return JSONSuccess;
+}
+
+/* Adds a member whose name the object takes over; on failure, the caller still owns name. */
+static JSON_Status json_object_addn_no_copy(JSON_Object *object, char *name, size_t name_len,
+                                            JSON_Value *value)
 {
     size_t index = 0;
     if (object == NULL || name == NULL || value == NULL) {
@@ -362,19 +591,25 @@ static JSON_Status json_object_addn(JSON_Object *object, const char *name, size_
         }
     }
     index = object->count;
-    object->names[index] = parson_strndup(name, name_len);
-    if (object->names[index] == NULL) {
-        return JSONFailure;
-    }
+    object->names[index] = name;
+    object->name_lengths[index] = name_len;
     value->parent = json_object_get_wrapping_value(object);
     object->values[index] = value;
     object->count++;
+    json_object_hash_insert(object, index);
     return JSONSuccess;
 }
 
+static int json_object_name_is_borrowed(const JSON_Object *object, size_t index)
+{
+    uintptr_t name = (uintptr_t)object->names[index];
+    return name >= (uintptr_t)object->insitu_begin && name < (uintptr_t)object->insitu_end;
+}
+
 static JSON_Status json_object_resize(JSON_Object *object, size_t new_capacity)
 {
     char **temp_names = NULL;
+    size_t *temp_name_lengths = NULL;
     JSON_Value **temp_values = NULL;
 
     if ((object->names == NULL && object->values != NULL) ||
@@ -385,62 +620,212 @@ static JSON_Status json_object_resize(JSON_Object *object, size_t new_capacity)
     if (temp_names == NULL) {
         return JSONFailure;
     }
+    temp_name_lengths = (size_t *)parson_malloc(new_capacity * sizeof(size_t));
+    if (temp_name_lengths == NULL) {
+        parson_free(temp_names);
+        return JSONFailure;
+    }
     temp_values = (JSON_Value **)parson_malloc(new_capacity * sizeof(JSON_Value *));
     if (temp_values == NULL) {
         parson_free(temp_names);
+        parson_free(temp_name_lengths);
         return JSONFailure;
     }
     if (object->names != NULL && object->values != NULL && object->count > 0) {
         memcpy(temp_names, object->names, object->count * sizeof(char *));
+        memcpy(temp_name_lengths, object->name_lengths, object->count * sizeof(size_t));
         memcpy(temp_values, object->values, object->count * sizeof(JSON_Value *));
     }
     parson_free(object->names);
+    parson_free(object->name_lengths);
     parson_free(object->values);
     object->names = temp_names;
+    object->name_lengths = temp_name_lengths;
     object->values = temp_values;
     object->capacity = new_capacity;
     return JSONSuccess;
 }
 
-static JSON_Value *json_object_getn_value(const JSON_Object *object, const char *name,
-                                          size_t name_len)
+/* FNV-1a */
+static unsigned long json_object_hash_name(const char *name, size_t name_len)
 {
-    size_t i, name_length;
-    for (i = 0; i < json_object_get_count(object); i++) {
-        name_length = strlen(object->names[i]);
-        if (name_length != name_len) {
-            continue;
+    unsigned long hash = 2166136261UL;
+    size_t i;
+    for (i = 0; i < name_len; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+/* Replaces the hash index with one of new_capacity slots holding every member. On allocation
+   failure the object is left without an index, and lookups fall back to a linear scan. */
+static int json_object_hash_build(JSON_Object *object, size_t new_capacity)
+{
+    size_t i;
+    parson_free(object->hash_slots);
+    object->hash_capacity = 0;
+    object->hash_slots = (size_t *)parson_malloc(new_capacity * sizeof(size_t));
+    if (object->hash_slots == NULL) {
+        return 0;
+    }
+    for (i = 0; i < new_capacity; i++) {
+        object->hash_slots[i] = OBJECT_HASH_EMPTY_SLOT;
+    }
+    object->hash_capacity = new_capacity;
+    for (i = 0; i < object->count; i++) {
+        *json_object_hash_find_slot(
+            object, object->names[i], object->name_lengths[i],
+            json_object_hash_name(object->names[i], object->name_lengths[i])) = i + 1;
+    }
+    return 1;
+}
+
+/* Returns the slot which refers to the member with this name, or else the empty slot where it
+   would be inserted. The index always has at least one empty slot. */
+static size_t *json_object_hash_find_slot(const JSON_Object *object, const char *name,
+                                          size_t name_len, unsigned long hash)
+{
+    size_t mask = object->hash_capacity - 1;
+    size_t slot = (size_t)hash & mask;
+    size_t member;
+    for (;;) {
+        member = object->hash_slots[slot];
+        if (member == OBJECT_HASH_EMPTY_SLOT ||
+            (object->name_lengths[member - 1] == name_len &&
+             memcmp(object->names[member - 1], name, name_len) == 0)) {
+            return &object->hash_slots[slot];
         }
-        if (strncmp(object->names[i], name, name_len) == 0) {
-            return object->values[i];
+        slot = (slot + 1) & mask;
+    }
+}
+
+/* Adds the member at index to the hash index, keeping the load factor at or below 1/2. */
+static void json_object_hash_insert(JSON_Object *object, size_t index)
+{
+    if (object->hash_slots == NULL) {
+        return;
+    }
+    if ((object->count * 2) > object->hash_capacity) {
+        json_object_hash_build(object, object->hash_capacity * 2);
+        return;
+    }
+    *json_object_hash_find_slot(
+        object, object->names[index], object->name_lengths[index],
+        json_object_hash_name(object->names[index], object->name_lengths[index])) = index + 1;
+}
+
+/* Removes the member at index from the hash index, before it is removed from the object. */
+static void json_object_hash_remove(JSON_Object *object, size_t index)
+{
+    size_t mask, hole, slot, home;
+    if (object->hash_slots == NULL) {
+        return;
+    }
+    mask = object->hash_capacity - 1;
+    hole = (size_t)(json_object_hash_find_slot(
+                        object, object->names[index], object->name_lengths[index],
+                        json_object_hash_name(object->names[index], object->name_lengths[index])) -
+                    object->hash_slots);
+    object->hash_slots[hole] = OBJECT_HASH_EMPTY_SLOT;
+    /* Backward-shift deletion: move later members of the probe sequence into the hole if their
+       home slot does not lie between the hole and their current slot. */
+    slot = (hole + 1) & mask;
+    while (object->hash_slots[slot] != OBJECT_HASH_EMPTY_SLOT) {
+        size_t member = object->hash_slots[slot] - 1;
+        home = (size_t)json_object_hash_name(object->names[member], object->name_lengths[member]) &
+               mask;
+        if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+            object->hash_slots[hole] = object->hash_slots[slot];
+            object->hash_slots[slot] = OBJECT_HASH_EMPTY_SLOT;
+            hole = slot;
         }
+        slot = (slot + 1) & mask;
     }
-    return NULL;
+}
+
+static int json_object_find_index(const JSON_Object *object, const char *name, size_t name_len,
+                                  size_t *index)
+{
+    return json_object_find_index_hashed(object, name, name_len, NULL, index);
+}
+
+/* Like json_object_find_index, for a caller which may already know the hash of the name. */
+static int json_object_find_index_hashed(const JSON_Object *object, const char *name,
+                                         size_t name_len, const unsigned long *hash, size_t *index)
+{
+    size_t i, member;
+    if (object == NULL || name == NULL) {
+        return 0;
+    }
+    if (object->hash_slots == NULL && object->count >= OBJECT_HASH_THRESHOLD) {
+        /* The index is a cache, so it may be built through a const pointer. */
+        size_t capacity = OBJECT_HASH_THRESHOLD * 2;
+        while (capacity < object->count * 2) {
+            capacity *= 2;
+        }
+        json_object_hash_build((JSON_Object *)object, capacity);
+    }
+    if (object->hash_slots != NULL) {
+        member = *json_object_hash_find_slot(
+            object, name, name_len, hash != NULL ? *hash : json_object_hash_name(name, name_len));
+        if (member == OBJECT_HASH_EMPTY_SLOT) {
+            return 0;
+        }
+        *index = member - 1;
+        return 1;
+    }
+    for (i = 0; i < object->count; i++) {
+        if (object->name_lengths[i] == name_len &&
+            memcmp(object->names[i], name, name_len) == 0) {
+            *index = i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static JSON_Value *json_object_getn_value(const JSON_Object *object, const char *name,
+                                          size_t name_len)
+{
+    size_t index;
+    if (!json_object_find_index(object, name, name_len, &index)) {
+        return NULL;
+    }
+    return object->values[index];
 }
 
 static JSON_Status json_object_remove_internal(JSON_Object *object, const char *name,
                                                int free_value)
 {
     size_t i = 0, last_item_index = 0;
-    if (object == NULL || json_object_get_value(object, name) == NULL) {
+    if (object == NULL || name == NULL || !json_object_find_index(object, name, strlen(name), &i)) {
         return JSONFailure;
     }
     last_item_index = json_object_get_count(object) - 1;
-    for (i = 0; i < json_object_get_count(object); i++) {
-        if (strcmp(object->names[i], name) == 0) {
-            parson_free(object->names[i]);
-            if (free_value) {
-                json_value_free(object->values[i]);
-            }
-            if (i != last_item_index) { /* Replace key value pair with one from the end */
-                object->names[i] = object->names[last_item_index];
-                object->values[i] = object->values[last_item_index];
-            }
-            object->count -= 1;
-            return JSONSuccess;
-        }
+    json_object_hash_remove(object, i);
+    if (i != last_item_index) {
+        /* The last member is about to move to i, so re-point its slot. */
+        json_object_hash_remove(object, last_item_index);
+    }
+    if (!json_object_name_is_borrowed(object, i)) {
+        parson_free(object->names[i]);
+    }
+    if (free_value) {
+        json_value_free(object->values[i]);
     }
-    return JSONFailure; /* No execution path should end here */
+    if (i != last_item_index) { /* Replace key value pair with one from the end */
+        object->names[i] = object->names[last_item_index];
+        object->name_lengths[i] = object->name_lengths[last_item_index];
+        object->values[i] = object->values[last_item_index];
+    }
+    object->count -= 1;
+    if (i != last_item_index && object->hash_slots != NULL) {
+        *json_object_hash_find_slot(
+            object, object->names[i], object->name_lengths[i],
+            json_object_hash_name(object->names[i], object->name_lengths[i])) = i + 1;
+    }
+    return JSONSuccess;
 }
 
 static JSON_Status json_object_dotremove_internal(JSON_Object *object, const char *name,
@@ -464,18 +849,22 @@ static void json_object_free(JSON_Object *object)
 {
     size_t i;
     for (i = 0; i < object->count; i++) {
-        parson_free(object->names[i]);
+        if (!json_object_name_is_borrowed(object, i)) {
+            parson_free(object->names[i]);
+        }
         json_value_free(object->values[i]);
     }
     parson_free(object->names);
+    parson_free(object->name_lengths);
     parson_free(object->values);
-    parson_free(object);
+    parson_free(object->hash_slots);
+    node_pool_free(&object_pool, object);
 }
 
 /* JSON Array */
 static JSON_Array *json_array_init(JSON_Value *wrapping_value)
 {
-    JSON_Array *new_array = (JSON_Array *)parson_malloc(sizeof(JSON_Array));
+    JSON_Array *new_array = (JSON_Array *)node_pool_alloc(&array_pool);
     if (new_array == NULL) {
         return NULL;
     }
@@ -526,31 +915,98 @@ static void json_array_free(JSON_Array *array)
         json_value_free(array->items[i]);
     }
     parson_free(array->items);
-    parson_free(array);
+    node_pool_free(&array_pool, array);
 }
 
 /* JSON Value */
 static JSON_Value *json_value_init_string_no_copy(char *string)
 {
-    JSON_Value *new_value = (JSON_Value *)parson_malloc(sizeof(JSON_Value));
+    JSON_Value *new_value = (JSON_Value *)node_pool_alloc(&value_pool);
     if (!new_value) {
         return NULL;
     }
     new_value->parent = NULL;
     new_value->type = JSONString;
+    new_value->flags = 0;
     new_value->value.string = string;
     return new_value;
 }
 
 /* Parser */
-static JSON_Status skip_quotes(const char **string)
+/* Returns the offset of the first special character in the SCAN_BLOCK_SIZE bytes at string, or
+   SCAN_BLOCK_SIZE if there is none. */
+static size_t scan_block(const char *string)
+{
+#ifdef PARSON_NEON
+    uint8x16_t block = vld1q_u8((const uint8_t *)string);
+    uint8x16_t special = vorrq_u8(vorrq_u8(vceqq_u8(block, vdupq_n_u8('\"')),
+                                           vceqq_u8(block, vdupq_n_u8('\\'))),
+                                  vcltq_u8(block, vdupq_n_u8(0x20)));
+    /* Narrow each byte of the 0x00/0xFF comparison result to a nibble. */
+    uint64_t nibbles = vget_lane_u64(
+        vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(special), 4)), 0);
+    if (nibbles == 0) {
+        return SCAN_BLOCK_SIZE;
+    }
+    return (size_t)__builtin_ctzll(nibbles) >> 2;
+#else
+    size_t word, i;
+    memcpy(&word, string, sizeof(word));
+    if (!WORD_HAS_STRING_SPECIAL(word)) {
+        return SCAN_BLOCK_SIZE;
+    }
+    for (i = 0; !IS_STRING_SPECIAL(string[i]); i++) {
+    }
+    return i;
+#endif
+}
+
+/* Returns the first special character at or after string, or end, the terminating NUL, if there
+   is none. Blocks are only read while a whole one remains before end. */
+static const char *scan_string(const char *string, const char *end)
+{
+    size_t offset;
+    while ((size_t)(end - string) >= SCAN_BLOCK_SIZE) {
+        offset = scan_block(string);
+        if (offset < SCAN_BLOCK_SIZE) {
+            return string + offset;
+        }
+        string += SCAN_BLOCK_SIZE;
+    }
+    while (string < end && !IS_STRING_SPECIAL(*string)) {
+        string++;
+    }
+    return string;
+}
+
+/* Returns the number of characters at the start of string, up to len, which are not special. */
+static size_t scan_plain_length(const char *string, size_t len)
+{
+    size_t i = 0, offset;
+    while (len - i >= SCAN_BLOCK_SIZE) {
+        offset = scan_block(string + i);
+        i += offset;
+        if (offset < SCAN_BLOCK_SIZE) {
+            return i;
+        }
+    }
+    while (i < len && !IS_STRING_SPECIAL(string[i])) {
+        i++;
+    }
+    return i;
+}
+
+static JSON_Status skip_quotes(const char **string, const char *end)
 {
     if (**string != '\"') {
         return JSONFailure;
     }
     SKIP_CHAR(string);
-    while (**string != '\"') {
-        if (**string == '\0') {
+    for (;;) {
+        *string = scan_string(*string, end);
+        if (**string == '\"') {
+            break;
+        } else if (**string == '\0') {
             return JSONFailure;
         } else if (**string == '\\') {
             SKIP_CHAR(string);
@@ -558,7 +1014,7 @@ static JSON_Status skip_quotes(const char **string)
                 return JSONFailure;
             }
         }
-        SKIP_CHAR(string);
+        SKIP_CHAR(string); /* escaped or control character */
     }
     SKIP_CHAR(string);
     return JSONSuccess;
@@ -613,20 +1069,25 @@ static int parse_utf16(const char **unprocessed, char **processed)
     return JSONSuccess;
 }
 
-/* Copies and processes passed string up to supplied length.
+/* Unescapes passed string up to supplied length into output, which may be input itself, since
+   the output is never longer.
 Example: "\u006Corem ipsum" -> lorem ipsum */
-static char *process_string(const char *input, size_t len)
+static JSON_Status unescape_string(const char *input, size_t len, char *output,
+                                   size_t *output_len)
 {
     const char *input_ptr = input;
-    size_t initial_size = (len + 1) * sizeof(char);
-    size_t final_size = 0;
-    char *output = NULL, *output_ptr = NULL, *resized_output = NULL;
-    output = (char *)parson_malloc(initial_size);
-    if (output == NULL) {
-        goto error;
-    }
-    output_ptr = output;
+    char *output_ptr = output;
+    size_t run = 0;
     while ((*input_ptr != '\0') && (size_t)(input_ptr - input) < len) {
+        run = scan_plain_length(input_ptr, len - (size_t)(input_ptr - input));
+        if (run > 0) { /* copy a run of plain characters at once */
+            if (output_ptr != input_ptr) {
+                memmove(output_ptr, input_ptr, run);
+            }
+            output_ptr += run;
+            input_ptr += run;
+            continue;
+        }
         if (*input_ptr == '\\') {
             input_ptr++;
             switch (*input_ptr) {
@@ -656,15 +1117,15 @@ static char *process_string(const char *input, size_t len)
                 break;
             case 'u':
                 if (parse_utf16(&input_ptr, &output_ptr) == JSONFailure) {
-                    goto error;
+                    return JSONFailure;
                 }
                 break;
             default:
-                goto error;
+                return JSONFailure;
             }
         } else if ((unsigned char)*input_ptr < 0x20) {
-            goto error; /* 0x00-0x19 are invalid characters for json string
-                           (http://www.ietf.org/rfc/rfc4627.txt) */
+            return JSONFailure; /* 0x00-0x19 are invalid characters for json string
+                                   (http://www.ietf.org/rfc/rfc4627.txt) */
         } else {
             *output_ptr = *input_ptr;
         }
@@ -672,36 +1133,63 @@ static char *process_string(const char *input, size_t len)
         input_ptr++;
     }
     *output_ptr = '\0';
-    /* resize to new length */
-    final_size = (size_t)(output_ptr - output) + 1;
-    /* todo: don't resize if final_size == initial_size */
+    *output_len = (size_t)(output_ptr - output);
+    return JSONSuccess;
+}
+
+/* Copies and processes passed string up to supplied length. */
+static char *process_string(const char *input, size_t len)
+{
+    size_t initial_size = (len + 1) * sizeof(char);
+    size_t final_size = 0, output_len = 0;
+    char *output = NULL, *resized_output = NULL;
+    output = (char *)parson_malloc(initial_size);
+    if (output == NULL) {
+        return NULL;
+    }
+    if (unescape_string(input, len, output, &output_len) == JSONFailure) {
+        parson_free(output);
+        return NULL;
+    }
+    /* resize to new length, unless there were no escapes to shorten it */
+    final_size = output_len + 1;
+    if (final_size == initial_size) {
+        return output;
+    }
     resized_output = (char *)parson_malloc(final_size);
     if (resized_output == NULL) {
-        goto error;
+        parson_free(output);
+        return NULL;
     }
     memcpy(resized_output, output, final_size);
     parson_free(output);
     return resized_output;
-error:
-    parson_free(output);
-    return NULL;
 }
 
 /* Return processed contents of a string between quotes and
-   skips passed argument to a matching quote. */
-static char *get_quoted_string(const char **string)
+   skips passed argument to a matching quote. In-situ, the contents are unescaped in place, and
+   the terminator overwrites the closing quote at the latest. */
+static char *get_quoted_string(const char **string, const JSON_Input *input)
 {
     const char *string_start = *string;
-    size_t string_len = 0;
-    JSON_Status status = skip_quotes(string);
+    size_t string_len = 0, output_len = 0;
+    char *output = NULL;
+    JSON_Status status = skip_quotes(string, input->end);
     if (status != JSONSuccess) {
         return NULL;
     }
     string_len = (size_t)(*string - string_start - 2); /* length without quotes */
-    return process_string(string_start + 1, string_len);
+    if (!input->insitu) {
+        return process_string(string_start + 1, string_len);
+    }
+    output = (char *)string_start + 1; /* writable, as it came from json_parse_string_insitu */
+    if (unescape_string(string_start + 1, string_len, output, &output_len) == JSONFailure) {
+        return NULL;
+    }
+    return output;
 }
 
-static JSON_Value *parse_value(const char **string, size_t nesting)
+static JSON_Value *parse_value(const char **string, size_t nesting, const JSON_Input *input)
 {
     if (nesting > MAX_NESTING) {
         return NULL;
@@ -709,11 +1197,11 @@ static JSON_Value *parse_value(const char **string, size_t nesting)
     SKIP_WHITESPACES(string);
     switch (**string) {
     case '{':
-        return parse_object_value(string, nesting + 1);
+        return parse_object_value(string, nesting + 1, input);
     case '[':
-        return parse_array_value(string, nesting + 1);
+        return parse_array_value(string, nesting + 1, input);
     case '\"':
-        return parse_string_value(string);
+        return parse_string_value(string, input);
     case 'f':
     case 't':
         return parse_boolean_value(string);
@@ -736,7 +1224,8 @@ static JSON_Value *parse_value(const char **string, size_t nesting)
     }
 }
 
-static JSON_Value *parse_object_value(const char **string, size_t nesting)
+static JSON_Value *parse_object_value(const char **string, size_t nesting,
+                                      const JSON_Input *input)
 {
     JSON_Value *output_value = NULL, *new_value = NULL;
     JSON_Object *output_object = NULL;
@@ -750,6 +1239,10 @@ static JSON_Value *parse_object_value(const char **string, size_t nesting)
         return NULL;
     }
     output_object = json_value_get_object(output_value);
+    if (input->insitu) {
+        output_object->insitu_begin = input->begin;
+        output_object->insitu_end = input->end;
+    }
     SKIP_CHAR(string);
     SKIP_WHITESPACES(string);
     if (**string == '}') { /* empty object */
@@ -757,31 +1250,38 @@ static JSON_Value *parse_object_value(const char **string, size_t nesting)
         return output_value;
     }
     while (**string != '\0') {
-        new_key = get_quoted_string(string);
+        new_key = get_quoted_string(string, input);
         if (new_key == NULL) {
             json_value_free(output_value);
             return NULL;
         }
         SKIP_WHITESPACES(string);
         if (**string != ':') {
-            parson_free(new_key);
+            if (!input->insitu) {
+                parson_free(new_key);
+            }
             json_value_free(output_value);
             return NULL;
         }
         SKIP_CHAR(string);
-        new_value = parse_value(string, nesting);
+        new_value = parse_value(string, nesting, input);
         if (new_value == NULL) {
-            parson_free(new_key);
+            if (!input->insitu) {
+                parson_free(new_key);
+            }
             json_value_free(output_value);
             return NULL;
         }
-        if (json_object_add(output_object, new_key, new_value) == JSONFailure) {
-            parson_free(new_key);
+        /* The object takes over the key, rather than copying it again. */
+        if (json_object_addn_no_copy(output_object, new_key, strlen(new_key), new_value) ==
+            JSONFailure) {
+            if (!input->insitu) {
+                parson_free(new_key);
+            }
             json_value_free(new_value);
             json_value_free(output_value);
             return NULL;
         }
-        parson_free(new_key);
         SKIP_WHITESPACES(string);
         if (**string != ',') {
             break;
@@ -799,7 +1299,8 @@ static JSON_Value *parse_object_value(const char **string, size_t nesting)
     return output_value;
 }
 
-static JSON_Value *parse_array_value(const char **string, size_t nesting)
+static JSON_Value *parse_array_value(const char **string, size_t nesting,
+                                     const JSON_Input *input)
 {
     JSON_Value *output_value = NULL, *new_array_value = NULL;
     JSON_Array *output_array = NULL;
@@ -819,7 +1320,7 @@ static JSON_Value *parse_array_value(const char **string, size_t nesting)
         return output_value;
     }
     while (**string != '\0') {
-        new_array_value = parse_value(string, nesting);
+        new_array_value = parse_value(string, nesting, input);
         if (new_array_value == NULL) {
             json_value_free(output_value);
             return NULL;
@@ -846,18 +1347,23 @@ static JSON_Value *parse_array_value(const char **string, size_t nesting)
     return output_value;
 }
 
-static JSON_Value *parse_string_value(const char **string)
+static JSON_Value *parse_string_value(const char **string, const JSON_Input *input)
 {
     JSON_Value *value = NULL;
-    char *new_string = get_quoted_string(string);
+    char *new_string = get_quoted_string(string, input);
     if (new_string == NULL) {
         return NULL;
     }
     value = json_value_init_string_no_copy(new_string);
     if (value == NULL) {
-        parson_free(new_string);
+        if (!input->insitu) {
+            parson_free(new_string);
+        }
         return NULL;
     }
+    if (input->insitu) {
+        value->flags |= JSON_VALUE_FLAG_BORROWED_STRING;
+    }
     return value;
 }
 
@@ -872,67 +1378,580 @@ static JSON_Value *parse_boolean_value(const char **string)
         *string += false_token_size;
         return json_value_init_boolean(0);
     }
-    return NULL;
+    return NULL;
+}
+
+/* Powers of ten which are exactly representable as doubles */
+static const double exact_powers_of_ten[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                             1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                             1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+/* Parses a number whose digits fit in 53 bits and whose power of ten is exact, so that one
+   multiplication or division rounds it exactly as strtod would (Clinger's fast path). Returns 0,
+   having consumed nothing, for anything else, including literals which are not strict JSON. */
+static int parse_number_fast(const char **string, double *number)
+{
+    const char *ptr = *string;
+    uint64_t mantissa = 0;
+    int negative = 0, digits = 0, exponent = 0, explicit_exponent = 0, exponent_negative = 0;
+    double value = 0.0;
+    if (*ptr == '-') {
+        negative = 1;
+        ptr++;
+    }
+    if (*ptr == '0') {
+        ptr++;
+        if (*ptr == 'e' || *ptr == 'E') { /* is_decimal rejects "0e1" */
+            return 0;
+        }
+    } else if (IS_DIGIT(*ptr)) {
+        while (IS_DIGIT(*ptr)) {
+            if (digits == MAX_FAST_NUMBER_DIGITS) {
+                return 0;
+            }
+            mantissa = mantissa * 10 + (uint64_t)(*ptr - '0');
+            digits++;
+            ptr++;
+        }
+    } else {
+        return 0;
+    }
+    if (*ptr == '.') {
+        ptr++;
+        if (!IS_DIGIT(*ptr)) {
+            return 0;
+        }
+        while (IS_DIGIT(*ptr)) {
+            if (digits == MAX_FAST_NUMBER_DIGITS) {
+                return 0;
+            }
+            mantissa = mantissa * 10 + (uint64_t)(*ptr - '0');
+            if (mantissa != 0) { /* leading zeros are not significant */
+                digits++;
+            }
+            exponent--;
+            ptr++;
+        }
+    }
+    if (*ptr == 'e' || *ptr == 'E') {
+        ptr++;
+        if (*ptr == '-' || *ptr == '+') {
+            exponent_negative = *ptr == '-';
+            ptr++;
+        }
+        if (!IS_DIGIT(*ptr)) {
+            return 0;
+        }
+        while (IS_DIGIT(*ptr)) {
+            if (explicit_exponent > 1000) {
+                return 0;
+            }
+            explicit_exponent = explicit_exponent * 10 + (*ptr - '0');
+            ptr++;
+        }
+        exponent += exponent_negative ? -explicit_exponent : explicit_exponent;
+    }
+    /* Leave literals such as "01", "1." and "0x1" to strtod and is_decimal. */
+    if (IS_DIGIT(*ptr) || *ptr == '.' || *ptr == 'x' || *ptr == 'X') {
+        return 0;
+    }
+    if (mantissa > (UINT64_C(1) << 53)) {
+        return 0;
+    }
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD != 0
+    if (exponent != 0) { /* extended precision intermediates would round twice */
+        return 0;
+    }
+#endif
+    value = (double)mantissa;
+    if (exponent < 0) {
+        if (exponent < -MAX_EXACT_POWER_OF_TEN) {
+            return 0;
+        }
+        value /= exact_powers_of_ten[-exponent];
+    } else if (exponent > 0 && mantissa != 0) {
+        if (exponent > MAX_EXACT_POWER_OF_TEN) {
+            /* 12e30 = 12000000000e22, if the first product is still an exact integer */
+            if (exponent > MAX_EXACT_POWER_OF_TEN * 2) {
+                return 0;
+            }
+            value *= exact_powers_of_ten[exponent - MAX_EXACT_POWER_OF_TEN];
+            if (value > MAX_EXACT_INTEGER) {
+                return 0;
+            }
+            exponent = MAX_EXACT_POWER_OF_TEN;
+        }
+        value *= exact_powers_of_ten[exponent];
+    }
+    *number = negative ? -value : value;
+    *string = ptr;
+    return 1;
+}
+
+static JSON_Value *parse_number_value(const char **string)
+{
+    char *end;
+    double number = 0;
+    if (parse_number_fast(string, &number)) {
+        return json_value_init_number(number);
+    }
+    errno = 0;
+    number = strtod(*string, &end);
+    if (errno || !is_decimal(*string, (size_t)(end - *string))) {
+        return NULL;
+    }
+    *string = end;
+    return json_value_init_number(number);
+}
+
+static JSON_Value *parse_null_value(const char **string)
+{
+    size_t token_size = SIZEOF_TOKEN("null");
+    if (strncmp("null", *string, token_size) == 0) {
+        *string += token_size;
+        return json_value_init_null();
+    }
+    return NULL;
+}
+
+/* Number formatting. Doubles are formatted with Grisu2 (Loitsch, "Printing Floating-Point Numbers
+   Quickly and Accurately with Integers", PLDI 2010), which yields the shortest digits that
+   round-trip for almost all doubles, and digits that still round-trip for the rest. */
+
+/* Normalized 64-bit approximations of 10^k for k = -348, -340, ..., 340 */
+static const uint64_t grisu_cached_powers_f[] = {
+    UINT64_C(0xfa8fd5a0081c0288), UINT64_C(0xbaaee17fa23ebf76), UINT64_C(0x8b16fb203055ac76),
+    UINT64_C(0xcf42894a5dce35ea), UINT64_C(0x9a6bb0aa55653b2d), UINT64_C(0xe61acf033d1a45df),
+    UINT64_C(0xab70fe17c79ac6ca), UINT64_C(0xff77b1fcbebcdc4f), UINT64_C(0xbe5691ef416bd60c),
+    UINT64_C(0x8dd01fad907ffc3c), UINT64_C(0xd3515c2831559a83), UINT64_C(0x9d71ac8fada6c9b5),
+    UINT64_C(0xea9c227723ee8bcb), UINT64_C(0xaecc49914078536d), UINT64_C(0x823c12795db6ce57),
+    UINT64_C(0xc21094364dfb5637), UINT64_C(0x9096ea6f3848984f), UINT64_C(0xd77485cb25823ac7),
+    UINT64_C(0xa086cfcd97bf97f4), UINT64_C(0xef340a98172aace5), UINT64_C(0xb23867fb2a35b28e),
+    UINT64_C(0x84c8d4dfd2c63f3b), UINT64_C(0xc5dd44271ad3cdba), UINT64_C(0x936b9fcebb25c996),
+    UINT64_C(0xdbac6c247d62a584), UINT64_C(0xa3ab66580d5fdaf6), UINT64_C(0xf3e2f893dec3f126),
+    UINT64_C(0xb5b5ada8aaff80b8), UINT64_C(0x87625f056c7c4a8b), UINT64_C(0xc9bcff6034c13053),
+    UINT64_C(0x964e858c91ba2655), UINT64_C(0xdff9772470297ebd), UINT64_C(0xa6dfbd9fb8e5b88f),
+    UINT64_C(0xf8a95fcf88747d94), UINT64_C(0xb94470938fa89bcf), UINT64_C(0x8a08f0f8bf0f156b),
+    UINT64_C(0xcdb02555653131b6), UINT64_C(0x993fe2c6d07b7fac), UINT64_C(0xe45c10c42a2b3b06),
+    UINT64_C(0xaa242499697392d3), UINT64_C(0xfd87b5f28300ca0e), UINT64_C(0xbce5086492111aeb),
+    UINT64_C(0x8cbccc096f5088cc), UINT64_C(0xd1b71758e219652c), UINT64_C(0x9c40000000000000),
+    UINT64_C(0xe8d4a51000000000), UINT64_C(0xad78ebc5ac620000), UINT64_C(0x813f3978f8940984),
+    UINT64_C(0xc097ce7bc90715b3), UINT64_C(0x8f7e32ce7bea5c70), UINT64_C(0xd5d238a4abe98068),
+    UINT64_C(0x9f4f2726179a2245), UINT64_C(0xed63a231d4c4fb27), UINT64_C(0xb0de65388cc8ada8),
+    UINT64_C(0x83c7088e1aab65db), UINT64_C(0xc45d1df942711d9a), UINT64_C(0x924d692ca61be758),
+    UINT64_C(0xda01ee641a708dea), UINT64_C(0xa26da3999aef774a), UINT64_C(0xf209787bb47d6b85),
+    UINT64_C(0xb454e4a179dd1877), UINT64_C(0x865b86925b9bc5c2), UINT64_C(0xc83553c5c8965d3d),
+    UINT64_C(0x952ab45cfa97a0b3), UINT64_C(0xde469fbd99a05fe3), UINT64_C(0xa59bc234db398c25),
+    UINT64_C(0xf6c69a72a3989f5c), UINT64_C(0xb7dcbf5354e9bece), UINT64_C(0x88fcf317f22241e2),
+    UINT64_C(0xcc20ce9bd35c78a5), UINT64_C(0x98165af37b2153df), UINT64_C(0xe2a0b5dc971f303a),
+    UINT64_C(0xa8d9d1535ce3b396), UINT64_C(0xfb9b7cd9a4a7443c), UINT64_C(0xbb764c4ca7a44410),
+    UINT64_C(0x8bab8eefb6409c1a), UINT64_C(0xd01fef10a657842c), UINT64_C(0x9b10a4e5e9913129),
+    UINT64_C(0xe7109bfba19c0c9d), UINT64_C(0xac2820d9623bf429), UINT64_C(0x80444b5e7aa7cf85),
+    UINT64_C(0xbf21e44003acdd2d), UINT64_C(0x8e679c2f5e44ff8f), UINT64_C(0xd433179d9c8cb841),
+    UINT64_C(0x9e19db92b4e31ba9), UINT64_C(0xeb96bf6ebadf77d9), UINT64_C(0xaf87023b9bf0ee6b),
+};
+static const short grisu_cached_powers_e[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+static const uint64_t pow10_table[] = {UINT64_C(1),
+                                       UINT64_C(10),
+                                       UINT64_C(100),
+                                       UINT64_C(1000),
+                                       UINT64_C(10000),
+                                       UINT64_C(100000),
+                                       UINT64_C(1000000),
+                                       UINT64_C(10000000),
+                                       UINT64_C(100000000),
+                                       UINT64_C(1000000000),
+                                       UINT64_C(10000000000),
+                                       UINT64_C(100000000000),
+                                       UINT64_C(1000000000000),
+                                       UINT64_C(10000000000000),
+                                       UINT64_C(100000000000000),
+                                       UINT64_C(1000000000000000),
+                                       UINT64_C(10000000000000000),
+                                       UINT64_C(100000000000000000),
+                                       UINT64_C(1000000000000000000),
+                                       UINT64_C(10000000000000000000)};
+
+/* Upper 64 bits of the 128-bit product, rounded */
+static JSON_Diy_Fp diy_fp_multiply(JSON_Diy_Fp x, JSON_Diy_Fp y)
+{
+    const uint64_t m32 = UINT64_C(0xFFFFFFFF);
+    uint64_t a = x.f >> 32, b = x.f & m32, c = y.f >> 32, d = y.f & m32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & m32) + (bc & m32) + (UINT64_C(1) << 31);
+    JSON_Diy_Fp result;
+    result.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+    result.e = x.e + y.e + 64;
+    return result;
+}
+
+static JSON_Diy_Fp diy_fp_normalize(JSON_Diy_Fp x)
+{
+    while (!(x.f & (UINT64_C(1) << 63))) {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+static int count_decimal_digits(uint32_t n)
+{
+    int digits = 1;
+    while (digits < 10 && n >= (uint32_t)pow10_table[digits]) {
+        digits++;
+    }
+    return digits;
+}
+
+/* Moves the last digit towards the exact value while the result stays within the boundaries */
+static void grisu_round(char *buffer, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa,
+                        uint64_t wp_w)
+{
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        buffer[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static void grisu_digit_gen(JSON_Diy_Fp w, JSON_Diy_Fp mp, uint64_t delta, char *buffer,
+                            int *len, int *k)
+{
+    JSON_Diy_Fp one;
+    uint64_t wp_w = mp.f - w.f, p2 = 0, rest = 0;
+    uint32_t p1 = 0, digit = 0;
+    int kappa = 0;
+    one.f = UINT64_C(1) << -mp.e;
+    one.e = mp.e;
+    p1 = (uint32_t)(mp.f >> -one.e);
+    p2 = mp.f & (one.f - 1);
+    kappa = count_decimal_digits(p1);
+    *len = 0;
+    while (kappa > 0) {
+        digit = p1 / (uint32_t)pow10_table[kappa - 1];
+        p1 %= (uint32_t)pow10_table[kappa - 1];
+        if (digit || *len) {
+            buffer[(*len)++] = (char)('0' + digit);
+        }
+        kappa--;
+        rest = ((uint64_t)p1 << -one.e) + p2;
+        if (rest <= delta) {
+            *k += kappa;
+            grisu_round(buffer, *len, delta, rest, pow10_table[kappa] << -one.e, wp_w);
+            return;
+        }
+    }
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        digit = (uint32_t)(p2 >> -one.e);
+        if (digit || *len) {
+            buffer[(*len)++] = (char)('0' + digit);
+        }
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta) {
+            *k += kappa;
+            grisu_round(buffer, *len, delta, p2, one.f,
+                        wp_w * (-kappa < 20 ? pow10_table[-kappa] : 0));
+            return;
+        }
+    }
+}
+
+/* Writes the digits of a positive, finite value such that value = digits * 10^k */
+static void grisu2(double value, char *buffer, int *len, int *k)
+{
+    JSON_Diy_Fp v, w_p, w_m, c_mk, w, wp, wm;
+    uint64_t bits = 0;
+    int biased_e = 0, cached_k = 0;
+    unsigned int index = 0;
+    double dk = 0.0;
+    memcpy(&bits, &value, sizeof(bits));
+    biased_e = (int)((bits >> 52) & 0x7FF);
+    v.f = bits & ((UINT64_C(1) << 52) - 1);
+    if (biased_e != 0) {
+        v.f += UINT64_C(1) << 52;
+        v.e = biased_e - 1075;
+    } else {
+        v.e = -1074;
+    }
+    /* Boundaries halfway to the neighbouring doubles; m+ normalized, m- at the same exponent */
+    w_p.f = (v.f << 1) + 1;
+    w_p.e = v.e - 1;
+    while (!(w_p.f & (UINT64_C(1) << 53))) {
+        w_p.f <<= 1;
+        w_p.e--;
+    }
+    w_p.f <<= 10;
+    w_p.e -= 10;
+    if (v.f == (UINT64_C(1) << 52)) {
+        w_m.f = (v.f << 2) - 1;
+        w_m.e = v.e - 2;
+    } else {
+        w_m.f = (v.f << 1) - 1;
+        w_m.e = v.e - 1;
+    }
+    w_m.f <<= w_m.e - w_p.e;
+    w_m.e = w_p.e;
+    /* Cached power of ten which brings the binary exponent into [-60, -32] */
+    dk = (-61 - w_p.e) * 0.30102999566398114 + 347;
+    cached_k = (int)dk;
+    if (dk - cached_k > 0.0) {
+        cached_k++;
+    }
+    index = (unsigned int)((cached_k >> 3) + 1);
+    *k = -(-348 + (int)(index << 3));
+    c_mk.f = grisu_cached_powers_f[index];
+    c_mk.e = grisu_cached_powers_e[index];
+    w = diy_fp_multiply(diy_fp_normalize(v), c_mk);
+    wp = diy_fp_multiply(w_p, c_mk);
+    wm = diy_fp_multiply(w_m, c_mk);
+    wm.f++;
+    wp.f--;
+    grisu_digit_gen(w, wp, wp.f - wm.f, buffer, len, k);
+}
+
+static int write_exponent(int k, char *buffer)
+{
+    int len = 0;
+    if (k < 0) {
+        buffer[len++] = '-';
+        k = -k;
+    }
+    if (k >= 100) {
+        buffer[len++] = (char)('0' + k / 100);
+        k %= 100;
+        buffer[len++] = (char)('0' + k / 10);
+    } else if (k >= 10) {
+        buffer[len++] = (char)('0' + k / 10);
+    }
+    buffer[len++] = (char)('0' + k % 10);
+    return len;
+}
+
+/* Lays out digits * 10^k in plain or exponent notation, as JavaScript does */
+static int prettify_number(char *buffer, int len, int k)
+{
+    int kk = len + k; /* 10^(kk - 1) <= value < 10^kk */
+    int i = 0, offset = 0;
+    if (k >= 0 && kk <= 21) { /* 1234e7 -> 12340000000 */
+        for (i = len; i < kk; i++) {
+            buffer[i] = '0';
+        }
+        return kk;
+    } else if (kk > 0 && kk <= 21) { /* 1234e-2 -> 12.34 */
+        memmove(&buffer[kk + 1], &buffer[kk], (size_t)(len - kk));
+        buffer[kk] = '.';
+        return len + 1;
+    } else if (kk > -6 && kk <= 0) { /* 1234e-6 -> 0.001234 */
+        offset = 2 - kk;
+        memmove(&buffer[offset], &buffer[0], (size_t)len);
+        buffer[0] = '0';
+        buffer[1] = '.';
+        for (i = 2; i < offset; i++) {
+            buffer[i] = '0';
+        }
+        return len + offset;
+    } else if (len == 1) { /* 1e30 */
+        buffer[1] = 'e';
+        return 2 + write_exponent(kk - 1, &buffer[2]);
+    }
+    /* 1234e30 -> 1.234e33 */
+    memmove(&buffer[2], &buffer[1], (size_t)(len - 1));
+    buffer[1] = '.';
+    buffer[len + 1] = 'e';
+    return len + 2 + write_exponent(kk - 1, &buffer[len + 2]);
+}
+
+static int format_uint64(uint64_t value, char *buffer)
+{
+    char digits[20];
+    int len = 0, i = 0;
+    do {
+        digits[len++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    for (i = 0; i < len; i++) {
+        buffer[i] = digits[len - 1 - i];
+    }
+    return len;
+}
+
+/* Formats the shortest representation which parses back to the same double */
+static int format_number(double number, char *buffer)
+{
+    int len = 0, k = 0, sign = 0;
+    if ((number * 0.0) != 0.0) { /* nan and inf, which parson never stores */
+        return sprintf(buffer, FLOAT_FORMAT, number);
+    }
+    if (number < 0.0 || (number == 0.0 && 1.0 / number < 0.0)) {
+        buffer[0] = '-';
+        number = -number;
+        sign = 1;
+    }
+    if (number < MAX_EXACT_INTEGER && number == floor(number)) { /* integers are common */
+        return sign + format_uint64((uint64_t)number, buffer + sign);
+    }
+    grisu2(number, buffer + sign, &len, &k);
+    return sign + prettify_number(buffer + sign, len, k);
+}
+
+/* Formats a number rounded to at most the given number of decimals, dropping trailing zeros. It is
+   rounded as printf's "%.*f" rounds: by the exact value of the double, with ties to even. */
+static int format_number_fixed(double number, int decimals, char *buffer)
+{
+    char digits[20];
+    double scale = (double)pow10_table[decimals];
+    double scaled = fabs(number) * scale;
+    double scaled_error = 0.0, fraction = 0.0;
+    uint64_t rounded = 0;
+    int len = 0, out = 0, i = 0;
+    if (!(scaled < MAX_EXACT_INTEGER)) { /* also catches nan and inf */
+        return format_number(number, buffer);
+    }
+    /* scaled + scaled_error is the product exactly; scaled alone may have been rounded to or
+       across a midpoint, e.g. 2.675 * 100 rounds to 267.5 although 2.675 is just below it. */
+    scaled_error = fma(fabs(number), scale, -scaled);
+    rounded = (uint64_t)scaled;
+    fraction = scaled - (double)rounded; /* exact */
+    if (fraction > 0.5 ||
+        (fraction == 0.5 && (scaled_error > 0.0 || (scaled_error == 0.0 && (rounded & 1))))) {
+        rounded++;
+    }
+    while (decimals > 0 && rounded % 10 == 0) {
+        rounded /= 10;
+        decimals--;
+    }
+    if (rounded == 0) {
+        buffer[0] = '0';
+        return 1;
+    }
+    if (number < 0.0) {
+        buffer[out++] = '-';
+    }
+    len = format_uint64(rounded, digits);
+    if (len <= decimals) { /* 12 with 4 decimals -> 0.0012 */
+        buffer[out++] = '0';
+        buffer[out++] = '.';
+        for (i = len; i < decimals; i++) {
+            buffer[out++] = '0';
+        }
+        memcpy(&buffer[out], digits, (size_t)len);
+        return out + len;
+    }
+    memcpy(&buffer[out], digits, (size_t)(len - decimals));
+    out += len - decimals;
+    if (decimals > 0) {
+        buffer[out++] = '.';
+        memcpy(&buffer[out], &digits[len - decimals], (size_t)decimals);
+        out += decimals;
+    }
+    return out;
+}
+
+/* Serialization */
+#define APPEND_STRING(str) json_writer_append(writer, (str), SIZEOF_TOKEN(str))
+
+static void json_writer_init(JSON_Writer *writer, char *buf, size_t capacity, int is_growable,
+                             int owns_buf)
+{
+    writer->buf = buf;
+    writer->capacity = buf != NULL ? capacity : 0;
+    writer->length = 0;
+    writer->is_growable = is_growable;
+    writer->owns_buf = owns_buf;
+    writer->failed = 0;
+}
+
+static int json_writer_grow(JSON_Writer *writer, size_t min_capacity)
+{
+    size_t new_capacity = MAX(writer->capacity * 2, STARTING_CAPACITY * 4);
+    char *new_buf = NULL;
+    while (new_capacity < min_capacity) {
+        new_capacity *= 2;
+    }
+    new_buf = (char *)parson_malloc(new_capacity);
+    if (new_buf == NULL) {
+        return 0;
+    }
+    if (writer->buf != NULL && writer->length > 0) {
+        memcpy(new_buf, writer->buf, writer->length);
+    }
+    if (writer->owns_buf) {
+        parson_free(writer->buf);
+    }
+    writer->buf = new_buf;
+    writer->capacity = new_capacity;
+    writer->owns_buf = 1;
+    return 1;
+}
+
+static void json_writer_append(JSON_Writer *writer, const char *data, size_t len)
+{
+    if (writer->failed || len == 0) {
+        return;
+    }
+    if (writer->length + len >= writer->capacity) {
+        if (writer->is_growable) {
+            if (!json_writer_grow(writer, writer->length + len + 1)) {
+                writer->failed = 1;
+                return;
+            }
+        } else {
+            /* Copy what fits, leaving room for the terminator, and keep counting, so that the
+               caller gets a truncated prefix and learns how much space is needed. */
+            if (writer->capacity > 0 && writer->length < writer->capacity - 1) {
+                memcpy(writer->buf + writer->length, data,
+                       writer->capacity - 1 - writer->length);
+            }
+            writer->length += len;
+            return;
+        }
+    }
+    memcpy(writer->buf + writer->length, data, len);
+    writer->length += len;
 }
 
-static JSON_Value *parse_number_value(const char **string)
+/* Terminates the output. Returns 0 if it is complete, or -1 if an allocation failed or the buffer
+   was too small. */
+static int json_writer_finish(JSON_Writer *writer)
 {
-    char *end;
-    double number = 0;
-    errno = 0;
-    number = strtod(*string, &end);
-    if (errno || !is_decimal(*string, (size_t)(end - *string))) {
-        return NULL;
+    if (writer->failed) {
+        return -1;
     }
-    *string = end;
-    return json_value_init_number(number);
-}
-
-static JSON_Value *parse_null_value(const char **string)
-{
-    size_t token_size = SIZEOF_TOKEN("null");
-    if (strncmp("null", *string, token_size) == 0) {
-        *string += token_size;
-        return json_value_init_null();
+    if (writer->buf == NULL) {
+        return 0;
     }
-    return NULL;
+    if (writer->length >= writer->capacity) {
+        if (writer->capacity > 0) {
+            writer->buf[writer->capacity - 1] = '\0';
+        }
+        return -1;
+    }
+    writer->buf[writer->length] = '\0';
+    return 0;
 }
 
-/* Serialization */
-#define APPEND_STRING(str)                   \
-    do {                                     \
-        written = append_string(buf, (str)); \
-        if (written < 0) {                   \
-            return -1;                       \
-        }                                    \
-        if (buf != NULL) {                   \
-            buf += written;                  \
-        }                                    \
-        written_total += written;            \
-    } while (0)
-
-#define APPEND_INDENT(level)                   \
-    do {                                       \
-        written = append_indent(buf, (level)); \
-        if (written < 0) {                     \
-            return -1;                         \
-        }                                      \
-        if (buf != NULL) {                     \
-            buf += written;                    \
-        }                                      \
-        written_total += written;              \
-    } while (0)
-
-static int json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int level, int is_pretty,
-                                      char *num_buf)
-{
-    const char *key = NULL, *string = NULL;
-    JSON_Value *temp_value = NULL;
+static int json_serialize_to_writer_r(const JSON_Value *value, JSON_Writer *writer, int level,
+                                      int is_pretty)
+{
+    const char *string = NULL;
     JSON_Array *array = NULL;
     JSON_Object *object = NULL;
     size_t i = 0, count = 0;
-    double num = 0.0;
-    int written = -1, written_total = 0;
+    int written = -1, decimals = -1;
 
     switch (json_value_get_type(value)) {
     case JSONArray:
@@ -944,17 +1963,11 @@ static int json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int le
         }
         for (i = 0; i < count; i++) {
             if (is_pretty) {
-                APPEND_INDENT(level + 1);
+                append_indent(writer, level + 1);
             }
-            temp_value = json_array_get_value(array, i);
-            written = json_serialize_to_buffer_r(temp_value, buf, level + 1, is_pretty, num_buf);
-            if (written < 0) {
+            if (json_serialize_to_writer_r(array->items[i], writer, level + 1, is_pretty) < 0) {
                 return -1;
             }
-            if (buf != NULL) {
-                buf += written;
-            }
-            written_total += written;
             if (i < (count - 1)) {
                 APPEND_STRING(",");
             }
@@ -963,10 +1976,10 @@ static int json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int le
             }
         }
         if (count > 0 && is_pretty) {
-            APPEND_INDENT(level);
+            append_indent(writer, level);
         }
         APPEND_STRING("]");
-        return written_total;
+        return 0;
     case JSONObject:
         object = json_value_get_object(value);
         count = json_object_get_count(object);
@@ -975,34 +1988,17 @@ static int json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int le
             APPEND_STRING("\n");
         }
         for (i = 0; i < count; i++) {
-            key = json_object_get_name(object, i);
-            if (key == NULL) {
-                return -1;
-            }
             if (is_pretty) {
-                APPEND_INDENT(level + 1);
+                append_indent(writer, level + 1);
             }
-            written = json_serialize_string(key, buf);
-            if (written < 0) {
-                return -1;
-            }
-            if (buf != NULL) {
-                buf += written;
-            }
-            written_total += written;
+            json_serialize_string(object->names[i], object->name_lengths[i], writer);
             APPEND_STRING(":");
             if (is_pretty) {
                 APPEND_STRING(" ");
             }
-            temp_value = json_object_get_value(object, key);
-            written = json_serialize_to_buffer_r(temp_value, buf, level + 1, is_pretty, num_buf);
-            if (written < 0) {
+            if (json_serialize_to_writer_r(object->values[i], writer, level + 1, is_pretty) < 0) {
                 return -1;
             }
-            if (buf != NULL) {
-                buf += written;
-            }
-            written_total += written;
             if (i < (count - 1)) {
                 APPEND_STRING(",");
             }
@@ -1011,48 +2007,39 @@ static int json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int le
             }
         }
         if (count > 0 && is_pretty) {
-            APPEND_INDENT(level);
+            append_indent(writer, level);
         }
         APPEND_STRING("}");
-        return written_total;
+        return 0;
     case JSONString:
         string = json_value_get_string(value);
         if (string == NULL) {
             return -1;
         }
-        written = json_serialize_string(string, buf);
-        if (written < 0) {
-            return -1;
-        }
-        if (buf != NULL) {
-            buf += written;
-        }
-        written_total += written;
-        return written_total;
+        json_serialize_string(string, strlen(string), writer);
+        return 0;
     case JSONBoolean:
         if (json_value_get_boolean(value)) {
             APPEND_STRING("true");
         } else {
             APPEND_STRING("false");
         }
-        return written_total;
+        return 0;
     case JSONNumber:
-        num = json_value_get_number(value);
-        if (buf != NULL) {
-            num_buf = buf;
+        decimals = ((value->flags & JSON_VALUE_DECIMALS_MASK) >> JSON_VALUE_DECIMALS_SHIFT) - 1;
+        if (decimals >= 0) {
+            written = format_number_fixed(json_value_get_number(value), decimals, writer->num_buf);
+        } else {
+            written = format_number(json_value_get_number(value), writer->num_buf);
         }
-        written = sprintf(num_buf, FLOAT_FORMAT, num);
         if (written < 0) {
             return -1;
         }
-        if (buf != NULL) {
-            buf += written;
-        }
-        written_total += written;
-        return written_total;
+        json_writer_append(writer, writer->num_buf, (size_t)written);
+        return 0;
     case JSONNull:
         APPEND_STRING("null");
-        return written_total;
+        return 0;
     case JSONError:
         return -1;
     default:
@@ -1060,174 +2047,107 @@ static int json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int le
     }
 }
 
-static int json_serialize_string(const char *string, char *buf)
+static void json_serialize_string(const char *string, size_t len, JSON_Writer *writer)
 {
-    size_t i = 0, len = strlen(string);
-    char c = '\0';
-    int written = -1, written_total = 0;
+    static const char hex_digits[] = "0123456789abcdef";
+    size_t i = 0, run_start = 0;
+    const char *escape = NULL;
+    char unicode_escape[6] = {'\\', 'u', '0', '0', '0', '0'};
+    unsigned char c = '\0';
     APPEND_STRING("\"");
     for (i = 0; i < len; i++) {
-        c = string[i];
+        c = (unsigned char)string[i];
         switch (c) {
         case '\"':
-            APPEND_STRING("\\\"");
+            escape = "\\\"";
             break;
         case '\\':
-            APPEND_STRING("\\\\");
+            escape = "\\\\";
             break;
         case '/':
-            APPEND_STRING("\\/");
-            break; /* to make json embeddable in xml\/html */
+            escape = "\\/"; /* to make json embeddable in xml\/html */
+            break;
         case '\b':
-            APPEND_STRING("\\b");
+            escape = "\\b";
             break;
         case '\f':
-            APPEND_STRING("\\f");
+            escape = "\\f";
             break;
         case '\n':
-            APPEND_STRING("\\n");
+            escape = "\\n";
             break;
         case '\r':
-            APPEND_STRING("\\r");
+            escape = "\\r";
             break;
         case '\t':
-            APPEND_STRING("\\t");
-            break;
-        case '\x00':
-            APPEND_STRING("\\u0000");
-            break;
-        case '\x01':
-            APPEND_STRING("\\u0001");
-            break;
-        case '\x02':
-            APPEND_STRING("\\u0002");
-            break;
-        case '\x03':
-            APPEND_STRING("\\u0003");
-            break;
-        case '\x04':
-            APPEND_STRING("\\u0004");
-            break;
-        case '\x05':
-            APPEND_STRING("\\u0005");
-            break;
-        case '\x06':
-            APPEND_STRING("\\u0006");
-            break;
-        case '\x07':
-            APPEND_STRING("\\u0007");
-            break;
-        /* '\x08' duplicate: '\b' */
-        /* '\x09' duplicate: '\t' */
-        /* '\x0a' duplicate: '\n' */
-        case '\x0b':
-            APPEND_STRING("\\u000b");
-            break;
-        /* '\x0c' duplicate: '\f' */
-        /* '\x0d' duplicate: '\r' */
-        case '\x0e':
-            APPEND_STRING("\\u000e");
-            break;
-        case '\x0f':
-            APPEND_STRING("\\u000f");
-            break;
-        case '\x10':
-            APPEND_STRING("\\u0010");
-            break;
-        case '\x11':
-            APPEND_STRING("\\u0011");
-            break;
-        case '\x12':
-            APPEND_STRING("\\u0012");
-            break;
-        case '\x13':
-            APPEND_STRING("\\u0013");
-            break;
-        case '\x14':
-            APPEND_STRING("\\u0014");
-            break;
-        case '\x15':
-            APPEND_STRING("\\u0015");
-            break;
-        case '\x16':
-            APPEND_STRING("\\u0016");
-            break;
-        case '\x17':
-            APPEND_STRING("\\u0017");
-            break;
-        case '\x18':
-            APPEND_STRING("\\u0018");
-            break;
-        case '\x19':
-            APPEND_STRING("\\u0019");
-            break;
-        case '\x1a':
-            APPEND_STRING("\\u001a");
-            break;
-        case '\x1b':
-            APPEND_STRING("\\u001b");
-            break;
-        case '\x1c':
-            APPEND_STRING("\\u001c");
-            break;
-        case '\x1d':
-            APPEND_STRING("\\u001d");
-            break;
-        case '\x1e':
-            APPEND_STRING("\\u001e");
-            break;
-        case '\x1f':
-            APPEND_STRING("\\u001f");
+            escape = "\\t";
             break;
         default:
-            if (buf != NULL) {
-                buf[0] = c;
-                buf += 1;
+            if (c >= 0x20) {
+                continue; /* part of the current run of unescaped characters */
             }
-            written_total += 1;
+            unicode_escape[4] = hex_digits[c >> 4];
+            unicode_escape[5] = hex_digits[c & 0xF];
+            escape = NULL;
             break;
         }
+        json_writer_append(writer, string + run_start, i - run_start);
+        if (escape != NULL) {
+            json_writer_append(writer, escape, strlen(escape));
+        } else {
+            json_writer_append(writer, unicode_escape, sizeof(unicode_escape));
+        }
+        run_start = i + 1;
     }
+    json_writer_append(writer, string + run_start, len - run_start);
     APPEND_STRING("\"");
-    return written_total;
 }
 
-static int append_indent(char *buf, int level)
+static void append_indent(JSON_Writer *writer, int level)
 {
     int i;
-    int written = -1, written_total = 0;
     for (i = 0; i < level; i++) {
         APPEND_STRING("    ");
     }
-    return written_total;
-}
-
-static int append_string(char *buf, const char *string)
-{
-    if (buf == NULL) {
-        return (int)strlen(string);
-    }
-    return sprintf(buf, "%s", string);
 }
 
 #undef APPEND_STRING
-#undef APPEND_INDENT
 
 /* Parser API */
 JSON_Value *json_parse_string(const char *string)
 {
+    JSON_Input input;
+    if (string == NULL) {
+        return NULL;
+    }
+    if (string[0] == '\xEF' && string[1] == '\xBB' && string[2] == '\xBF') {
+        string = string + 3; /* Support for UTF-8 BOM */
+    }
+    input.begin = string;
+    input.end = string + strlen(string);
+    input.insitu = 0;
+    return parse_value((const char **)&string, 0, &input);
+}
+
+JSON_Value *json_parse_string_insitu(char *string)
+{
+    JSON_Input input;
     if (string == NULL) {
         return NULL;
     }
     if (string[0] == '\xEF' && string[1] == '\xBB' && string[2] == '\xBF') {
         string = string + 3; /* Support for UTF-8 BOM */
     }
-    return parse_value((const char **)&string, 0);
+    input.begin = string;
+    input.end = string + strlen(string);
+    input.insitu = 1;
+    return parse_value((const char **)&string, 0, &input);
 }
 
 JSON_Value *json_parse_string_with_comments(const char *string)
 {
     JSON_Value *result = NULL;
+    JSON_Input input;
     char *string_mutable_copy = NULL, *string_mutable_copy_ptr = NULL;
     string_mutable_copy = parson_strdup(string);
     if (string_mutable_copy == NULL) {
@@ -1236,7 +2156,10 @@ JSON_Value *json_parse_string_with_comments(const char *string)
     remove_comments(string_mutable_copy, "/*", "*/");
     remove_comments(string_mutable_copy, "//", "\n");
     string_mutable_copy_ptr = string_mutable_copy;
-    result = parse_value((const char **)&string_mutable_copy_ptr, 0);
+    input.begin = string_mutable_copy;
+    input.end = string_mutable_copy + strlen(string_mutable_copy);
+    input.insitu = 0;
+    result = parse_value((const char **)&string_mutable_copy_ptr, 0, &input);
     parson_free(string_mutable_copy);
     return result;
 }
@@ -1312,6 +2235,92 @@ int json_object_dotget_boolean(const JSON_Object *object, const char *name)
     return json_value_get_boolean(json_object_dotget_value(object, name));
 }
 
+JSON_Path *json_path_compile(const char *name)
+{
+    JSON_Path *path = NULL;
+    const char *segment_start = NULL, *dot_position = NULL;
+    char *names = NULL;
+    size_t count = 1, name_len = 0, i = 0;
+    if (name == NULL) {
+        return NULL;
+    }
+    for (dot_position = strchr(name, '.'); dot_position != NULL;
+         dot_position = strchr(dot_position + 1, '.')) {
+        count++;
+    }
+    name_len = strlen(name);
+    path = (JSON_Path *)parson_malloc(sizeof(JSON_Path) + (count - 1) * sizeof(JSON_Path_Segment) +
+                                      name_len + 1);
+    if (path == NULL) {
+        return NULL;
+    }
+    names = (char *)&path->segments[count];
+    memcpy(names, name, name_len + 1);
+    path->count = count;
+    segment_start = names;
+    for (i = 0; i < count; i++) {
+        dot_position = strchr(segment_start, '.');
+        path->segments[i].name = segment_start;
+        path->segments[i].name_len =
+            dot_position ? (size_t)(dot_position - segment_start) : strlen(segment_start);
+        path->segments[i].hash =
+            json_object_hash_name(segment_start, path->segments[i].name_len);
+        segment_start = dot_position + 1;
+    }
+    return path;
+}
+
+void json_path_free(JSON_Path *path)
+{
+    parson_free(path);
+}
+
+JSON_Value *json_path_get_value(const JSON_Object *object, const JSON_Path *path)
+{
+    const JSON_Path_Segment *segment = NULL;
+    size_t i = 0, index = 0;
+    if (path == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < path->count; i++) {
+        segment = &path->segments[i];
+        if (!json_object_find_index_hashed(object, segment->name, segment->name_len,
+                                           &segment->hash, &index)) {
+            return NULL;
+        }
+        if (i + 1 == path->count) {
+            return object->values[index];
+        }
+        object = json_value_get_object(object->values[index]);
+    }
+    return NULL;
+}
+
+const char *json_path_get_string(const JSON_Object *object, const JSON_Path *path)
+{
+    return json_value_get_string(json_path_get_value(object, path));
+}
+
+double json_path_get_number(const JSON_Object *object, const JSON_Path *path)
+{
+    return json_value_get_number(json_path_get_value(object, path));
+}
+
+JSON_Object *json_path_get_object(const JSON_Object *object, const JSON_Path *path)
+{
+    return json_value_get_object(json_path_get_value(object, path));
+}
+
+JSON_Array *json_path_get_array(const JSON_Object *object, const JSON_Path *path)
+{
+    return json_value_get_array(json_path_get_value(object, path));
+}
+
+int json_path_get_boolean(const JSON_Object *object, const JSON_Path *path)
+{
+    return json_value_get_boolean(json_path_get_value(object, path));
+}
+
 size_t json_object_get_count(const JSON_Object *object)
 {
     return object ? object->count : 0;
@@ -1448,7 +2457,9 @@ void json_value_free(JSON_Value *value)
         json_object_free(value->value.object);
         break;
     case JSONString:
-        parson_free(value->value.string);
+        if (!(value->flags & JSON_VALUE_FLAG_BORROWED_STRING)) {
+            parson_free(value->value.string);
+        }
         break;
     case JSONArray:
         json_array_free(value->value.array);
@@ -1456,20 +2467,21 @@ void json_value_free(JSON_Value *value)
     default:
         break;
     }
-    parson_free(value);
+    node_pool_free(&value_pool, value);
 }
 
 JSON_Value *json_value_init_object(void)
 {
-    JSON_Value *new_value = (JSON_Value *)parson_malloc(sizeof(JSON_Value));
+    JSON_Value *new_value = (JSON_Value *)node_pool_alloc(&value_pool);
     if (!new_value) {
         return NULL;
     }
     new_value->parent = NULL;
     new_value->type = JSONObject;
+    new_value->flags = 0;
     new_value->value.object = json_object_init(new_value);
     if (!new_value->value.object) {
-        parson_free(new_value);
+        node_pool_free(&value_pool, new_value);
         return NULL;
     }
     return new_value;
@@ -1477,15 +2489,16 @@ JSON_Value *json_value_init_object(void)
 
 JSON_Value *json_value_init_array(void)
 {
-    JSON_Value *new_value = (JSON_Value *)parson_malloc(sizeof(JSON_Value));
+    JSON_Value *new_value = (JSON_Value *)node_pool_alloc(&value_pool);
     if (!new_value) {
         return NULL;
     }
     new_value->parent = NULL;
     new_value->type = JSONArray;
+    new_value->flags = 0;
     new_value->value.array = json_array_init(new_value);
     if (!new_value->value.array) {
-        parson_free(new_value);
+        node_pool_free(&value_pool, new_value);
         return NULL;
     }
     return new_value;
@@ -1520,36 +2533,53 @@ JSON_Value *json_value_init_number(double number)
     if ((number * 0.0) != 0.0) { /* nan and inf test */
         return NULL;
     }
-    new_value = (JSON_Value *)parson_malloc(sizeof(JSON_Value));
+    new_value = (JSON_Value *)node_pool_alloc(&value_pool);
     if (new_value == NULL) {
         return NULL;
     }
     new_value->parent = NULL;
     new_value->type = JSONNumber;
+    new_value->flags = 0;
     new_value->value.number = number;
     return new_value;
 }
 
+JSON_Value *json_value_init_number_fixed(double number, int decimals)
+{
+    JSON_Value *new_value = NULL;
+    if (decimals < 0 || decimals > MAX_FIXED_DECIMALS) {
+        return NULL;
+    }
+    new_value = json_value_init_number(number);
+    if (new_value == NULL) {
+        return NULL;
+    }
+    new_value->flags |= (unsigned short)((decimals + 1) << JSON_VALUE_DECIMALS_SHIFT);
+    return new_value;
+}
+
 JSON_Value *json_value_init_boolean(int boolean)
 {
-    JSON_Value *new_value = (JSON_Value *)parson_malloc(sizeof(JSON_Value));
+    JSON_Value *new_value = (JSON_Value *)node_pool_alloc(&value_pool);
     if (!new_value) {
         return NULL;
     }
     new_value->parent = NULL;
     new_value->type = JSONBoolean;
+    new_value->flags = 0;
     new_value->value.boolean = boolean ? 1 : 0;
     return new_value;
 }
 
 JSON_Value *json_value_init_null(void)
 {
-    JSON_Value *new_value = (JSON_Value *)parson_malloc(sizeof(JSON_Value));
+    JSON_Value *new_value = (JSON_Value *)node_pool_alloc(&value_pool);
     if (!new_value) {
         return NULL;
     }
     new_value->parent = NULL;
     new_value->type = JSONNull;
+    new_value->flags = 0;
     return new_value;
 }
 
@@ -1609,7 +2639,11 @@ JSON_Value *json_value_deep_copy(const JSON_Value *value)
     case JSONBoolean:
         return json_value_init_boolean(json_value_get_boolean(value));
     case JSONNumber:
-        return json_value_init_number(json_value_get_number(value));
+        return_value = json_value_init_number(json_value_get_number(value));
+        if (return_value != NULL) {
+            return_value->flags |= value->flags & JSON_VALUE_DECIMALS_MASK;
+        }
+        return return_value;
     case JSONString:
         temp_string = json_value_get_string(value);
         if (temp_string == NULL) {
@@ -1635,87 +2669,131 @@ JSON_Value *json_value_deep_copy(const JSON_Value *value)
 
 size_t json_serialization_size(const JSON_Value *value)
 {
-    char num_buf[NUM_BUF_SIZE]; /* recursively allocating buffer on stack is a bad idea, so let's do
-                                   it only once */
-    int res = json_serialize_to_buffer_r(value, NULL, 0, 0, num_buf);
-    return res < 0 ? 0 : (size_t)(res + 1);
+    JSON_Writer writer;
+    json_writer_init(&writer, NULL, 0, 0, 0);
+    if (json_serialize_to_writer_r(value, &writer, 0, 0) < 0) {
+        return 0;
+    }
+    return writer.length + 1;
 }
 
-JSON_Status json_serialize_to_buffer(const JSON_Value *value, char *buf, size_t buf_size_in_bytes)
+static JSON_Status json_serialize_to_buffer_internal(const JSON_Value *value, char *buf,
+                                                     size_t buf_size_in_bytes, int is_pretty,
+                                                     size_t *out_len)
 {
-    int written = -1;
-    size_t needed_size_in_bytes = json_serialization_size(value);
-    if (needed_size_in_bytes == 0 || buf_size_in_bytes < needed_size_in_bytes) {
+    JSON_Writer writer;
+    if (buf == NULL) {
         return JSONFailure;
     }
-    written = json_serialize_to_buffer_r(value, buf, 0, 0, NULL);
-    if (written < 0) {
+    json_writer_init(&writer, buf, buf_size_in_bytes, 0, 0);
+    if (json_serialize_to_writer_r(value, &writer, 0, is_pretty) < 0) {
         return JSONFailure;
     }
-    return JSONSuccess;
+    if (out_len != NULL) {
+        *out_len = writer.length;
+    }
+    return json_writer_finish(&writer) < 0 ? JSONFailure : JSONSuccess;
 }
 
-char *json_serialize_to_string(const JSON_Value *value)
+JSON_Status json_serialize_to_buffer(const JSON_Value *value, char *buf, size_t buf_size_in_bytes)
+{
+    return json_serialize_to_buffer_internal(value, buf, buf_size_in_bytes, 0, NULL);
+}
+
+JSON_Status json_serialize_to_buffer_n(const JSON_Value *value, char *buf,
+                                       size_t buf_size_in_bytes, size_t *out_len)
+{
+    return json_serialize_to_buffer_internal(value, buf, buf_size_in_bytes, 0, out_len);
+}
+
+/* Serializes into a stack buffer first, so that small values need a single allocation of the
+   exact size, and only spills to a growing heap buffer for large ones. */
+static char *json_serialize_to_string_internal(const JSON_Value *value, int is_pretty)
 {
-    JSON_Status serialization_result = JSONFailure;
-    size_t buf_size_bytes = json_serialization_size(value);
-    char *buf = NULL;
-    if (buf_size_bytes == 0) {
+    char stack_buf[256];
+    char *result = NULL;
+    JSON_Writer writer;
+    json_writer_init(&writer, stack_buf, sizeof(stack_buf), 1, 0);
+    if (json_serialize_to_writer_r(value, &writer, 0, is_pretty) < 0 ||
+        json_writer_finish(&writer) < 0) {
+        if (writer.owns_buf) {
+            parson_free(writer.buf);
+        }
         return NULL;
     }
-    buf = (char *)parson_malloc(buf_size_bytes);
-    if (buf == NULL) {
-        return NULL;
+    if (writer.owns_buf) {
+        return writer.buf;
     }
-    serialization_result = json_serialize_to_buffer(value, buf, buf_size_bytes);
-    if (serialization_result == JSONFailure) {
-        json_free_serialized_string(buf);
+    result = (char *)parson_malloc(writer.length + 1);
+    if (result == NULL) {
         return NULL;
     }
-    return buf;
+    memcpy(result, stack_buf, writer.length + 1);
+    return result;
+}
+
+char *json_serialize_to_string(const JSON_Value *value)
+{
+    return json_serialize_to_string_internal(value, 0);
 }
 
 size_t json_serialization_size_pretty(const JSON_Value *value)
 {
-    char num_buf[NUM_BUF_SIZE]; /* recursively allocating buffer on stack is a bad idea, so let's do
-                                   it only once */
-    int res = json_serialize_to_buffer_r(value, NULL, 0, 1, num_buf);
-    return res < 0 ? 0 : (size_t)(res + 1);
+    JSON_Writer writer;
+    json_writer_init(&writer, NULL, 0, 0, 0);
+    if (json_serialize_to_writer_r(value, &writer, 0, 1) < 0) {
+        return 0;
+    }
+    return writer.length + 1;
 }
 
 JSON_Status json_serialize_to_buffer_pretty(const JSON_Value *value, char *buf,
                                             size_t buf_size_in_bytes)
 {
-    int written = -1;
-    size_t needed_size_in_bytes = json_serialization_size_pretty(value);
-    if (needed_size_in_bytes == 0 || buf_size_in_bytes < needed_size_in_bytes) {
-        return JSONFailure;
-    }
-    written = json_serialize_to_buffer_r(value, buf, 0, 1, NULL);
-    if (written < 0) {
-        return JSONFailure;
-    }
-    return JSONSuccess;
+    return json_serialize_to_buffer_internal(value, buf, buf_size_in_bytes, 1, NULL);
 }
 
 char *json_serialize_to_string_pretty(const JSON_Value *value)
 {
-    JSON_Status serialization_result = JSONFailure;
-    size_t buf_size_bytes = json_serialization_size_pretty(value);
-    char *buf = NULL;
-    if (buf_size_bytes == 0) {
-        return NULL;
+    return json_serialize_to_string_internal(value, 1);
+}
+
+void json_buffer_init(JSON_Buffer *buffer, char *storage, size_t storage_size)
+{
+    buffer->data = storage;
+    buffer->length = 0;
+    buffer->capacity = storage != NULL ? storage_size : 0;
+    buffer->owns_data = 0;
+    if (buffer->data != NULL && buffer->capacity > 0) {
+        buffer->data[0] = '\0';
     }
-    buf = (char *)parson_malloc(buf_size_bytes);
-    if (buf == NULL) {
-        return NULL;
+}
+
+JSON_Status json_serialize_to_growable_buffer(const JSON_Value *value, JSON_Buffer *buffer)
+{
+    JSON_Writer writer;
+    JSON_Status status = JSONSuccess;
+    if (buffer == NULL) {
+        return JSONFailure;
     }
-    serialization_result = json_serialize_to_buffer_pretty(value, buf, buf_size_bytes);
-    if (serialization_result == JSONFailure) {
-        json_free_serialized_string(buf);
-        return NULL;
+    json_writer_init(&writer, buffer->data, buffer->capacity, 1, buffer->owns_data);
+    if (json_serialize_to_writer_r(value, &writer, 0, 0) < 0 || json_writer_finish(&writer) < 0) {
+        status = JSONFailure;
+    }
+    /* Keep any larger buffer for the next call, even if this one failed. */
+    buffer->data = writer.buf;
+    buffer->capacity = writer.capacity;
+    buffer->owns_data = writer.owns_buf;
+    buffer->length = status == JSONSuccess ? writer.length : 0;
+    return status;
+}
+
+void json_buffer_free(JSON_Buffer *buffer)
+{
+    if (buffer->owns_data) {
+        parson_free(buffer->data);
     }
-    return buf;
+    json_buffer_init(buffer, NULL, 0);
 }
 
 void json_free_serialized_string(char *string)
@@ -1875,24 +2953,19 @@ JSON_Status json_array_append_null(JSON_Array *array)
 
 JSON_Status json_object_set_value(JSON_Object *object, const char *name, JSON_Value *value)
 {
-    size_t i = 0;
-    JSON_Value *old_value;
+    size_t i = 0, name_len;
     if (object == NULL || name == NULL || value == NULL || value->parent != NULL) {
         return JSONFailure;
     }
-    old_value = json_object_get_value(object, name);
-    if (old_value != NULL) { /* free and overwrite old value */
-        json_value_free(old_value);
-        for (i = 0; i < json_object_get_count(object); i++) {
-            if (strcmp(object->names[i], name) == 0) {
-                value->parent = json_object_get_wrapping_value(object);
-                object->values[i] = value;
-                return JSONSuccess;
-            }
-        }
+    name_len = strlen(name);
+    if (json_object_find_index(object, name, name_len, &i)) { /* free and overwrite old value */
+        json_value_free(object->values[i]);
+        value->parent = json_object_get_wrapping_value(object);
+        object->values[i] = value;
+        return JSONSuccess;
     }
     /* add new key value pair */
-    return json_object_add(object, name, value);
+    return json_object_addn(object, name, name_len, value);
 }
 
 JSON_Status json_object_set_string(JSON_Object *object, const char *name, const char *string)
@@ -1905,6 +2978,12 @@ JSON_Status json_object_set_number(JSON_Object *object, const char *name, double
     return json_object_set_value(object, name, json_value_init_number(number));
 }
 
+JSON_Status json_object_set_number_fixed(JSON_Object *object, const char *name, double number,
+                                        int decimals)
+{
+    return json_object_set_value(object, name, json_value_init_number_fixed(number, decimals));
+}
+
 JSON_Status json_object_set_boolean(JSON_Object *object, const char *name, int boolean)
 {
     return json_object_set_value(object, name, json_value_init_boolean(boolean));
@@ -1985,6 +3064,20 @@ JSON_Status json_object_dotset_number(JSON_Object *object, const char *name, dou
     return JSONSuccess;
 }
 
+JSON_Status json_object_dotset_number_fixed(JSON_Object *object, const char *name, double number,
+                                           int decimals)
+{
+    JSON_Value *value = json_value_init_number_fixed(number, decimals);
+    if (value == NULL) {
+        return JSONFailure;
+    }
+    if (json_object_dotset_value(object, name, value) == JSONFailure) {
+        json_value_free(value);
+        return JSONFailure;
+    }
+    return JSONSuccess;
+}
+
 JSON_Status json_object_dotset_boolean(JSON_Object *object, const char *name, int boolean)
 {
     JSON_Value *value = json_value_init_boolean(boolean);
@@ -2028,10 +3121,15 @@ JSON_Status json_object_clear(JSON_Object *object)
         return JSONFailure;
     }
     for (i = 0; i < json_object_get_count(object); i++) {
-        parson_free(object->names[i]);
+        if (!json_object_name_is_borrowed(object, i)) {
+            parson_free(object->names[i]);
+        }
         json_value_free(object->values[i]);
     }
     object->count = 0;
+    parson_free(object->hash_slots);
+    object->hash_slots = (size_t *)NULL;
+    object->hash_capacity = 0;
     return JSONSuccess;
 }
 
@@ -2101,6 +3199,13 @@ JSON_Status json_validate(const JSON_Value *schema, const JSON_Value *value)
 }
 
 int json_value_equals(const JSON_Value *a, const JSON_Value *b)
+{
+    return json_value_equals_internal(a, b, 0);
+}
+
+/* exact_numbers compares numbers bit for bit rather than within EPSILON. */
+static int json_value_equals_internal(const JSON_Value *a, const JSON_Value *b,
+                                      int exact_numbers)
 {
     JSON_Object *a_object = NULL, *b_object = NULL;
     JSON_Array *a_array = NULL, *b_array = NULL;
@@ -2123,8 +3228,8 @@ int json_value_equals(const JSON_Value *a, const JSON_Value *b)
             return 0;
         }
         for (i = 0; i < a_count; i++) {
-            if (!json_value_equals(json_array_get_value(a_array, i),
-                                   json_array_get_value(b_array, i))) {
+            if (!json_value_equals_internal(json_array_get_value(a_array, i),
+                                            json_array_get_value(b_array, i), exact_numbers)) {
                 return 0;
             }
         }
@@ -2139,8 +3244,8 @@ int json_value_equals(const JSON_Value *a, const JSON_Value *b)
         }
         for (i = 0; i < a_count; i++) {
             key = json_object_get_name(a_object, i);
-            if (!json_value_equals(json_object_get_value(a_object, key),
-                                   json_object_get_value(b_object, key))) {
+            if (!json_value_equals_internal(json_object_get_value(a_object, key),
+                                            json_object_get_value(b_object, key), exact_numbers)) {
                 return 0;
             }
         }
@@ -2155,6 +3260,9 @@ int json_value_equals(const JSON_Value *a, const JSON_Value *b)
     case JSONBoolean:
         return json_value_get_boolean(a) == json_value_get_boolean(b);
     case JSONNumber:
+        if (exact_numbers) {
+            return json_value_get_number(a) == json_value_get_number(b);
+        }
         return fabs(json_value_get_number(a) - json_value_get_number(b)) < 0.000001; /* EPSILON */
     case JSONError:
         return 1;
@@ -2165,6 +3273,99 @@ int json_value_equals(const JSON_Value *a, const JSON_Value *b)
     }
 }
 
+JSON_Value *json_object_merge_patch_diff(const JSON_Object *from, const JSON_Object *to)
+{
+    JSON_Value *patch_value = NULL, *member_patch = NULL, *from_member = NULL, *to_member = NULL;
+    JSON_Object *patch = NULL;
+    const char *name = NULL;
+    size_t i = 0;
+    patch_value = json_value_init_object();
+    if (patch_value == NULL) {
+        return NULL;
+    }
+    patch = json_value_get_object(patch_value);
+    for (i = 0; i < json_object_get_count(from); i++) {
+        name = json_object_get_name(from, i);
+        if (!json_object_has_value(to, name) && json_object_set_null(patch, name) == JSONFailure) {
+            json_value_free(patch_value);
+            return NULL;
+        }
+    }
+    for (i = 0; i < json_object_get_count(to); i++) {
+        name = json_object_get_name(to, i);
+        to_member = json_object_get_value_at(to, i);
+        from_member = json_object_get_value(from, name);
+        member_patch = NULL;
+        if (json_value_get_type(from_member) == JSONObject &&
+            json_value_get_type(to_member) == JSONObject) {
+            member_patch = json_object_merge_patch_diff(json_value_get_object(from_member),
+                                                        json_value_get_object(to_member));
+            if (member_patch != NULL &&
+                json_object_get_count(json_value_get_object(member_patch)) == 0) {
+                json_value_free(member_patch);
+                continue;
+            }
+        } else if (from_member == NULL ||
+                   !json_value_equals_internal(from_member, to_member, 1)) {
+            member_patch = json_value_deep_copy(to_member);
+        } else {
+            continue;
+        }
+        if (json_object_set_value(patch, name, member_patch) == JSONFailure) {
+            json_value_free(member_patch);
+            json_value_free(patch_value);
+            return NULL;
+        }
+    }
+    return patch_value;
+}
+
+JSON_Status json_object_merge_patch(JSON_Object *target, const JSON_Object *patch)
+{
+    JSON_Value *patch_member = NULL, *target_member = NULL, *new_member = NULL;
+    const char *name = NULL;
+    size_t i = 0;
+    if (target == NULL || patch == NULL) {
+        return JSONFailure;
+    }
+    for (i = 0; i < json_object_get_count(patch); i++) {
+        name = json_object_get_name(patch, i);
+        patch_member = json_object_get_value_at(patch, i);
+        if (json_value_get_type(patch_member) == JSONNull) {
+            json_object_remove(target, name);
+            continue;
+        }
+        if (json_value_get_type(patch_member) == JSONObject) {
+            target_member = json_object_get_value(target, name);
+            if (json_value_get_type(target_member) != JSONObject) {
+                new_member = json_value_init_object();
+                if (new_member == NULL) {
+                    return JSONFailure;
+                }
+                if (json_object_set_value(target, name, new_member) == JSONFailure) {
+                    json_value_free(new_member);
+                    return JSONFailure;
+                }
+                target_member = new_member;
+            }
+            if (json_object_merge_patch(json_value_get_object(target_member),
+                                        json_value_get_object(patch_member)) == JSONFailure) {
+                return JSONFailure;
+            }
+            continue;
+        }
+        new_member = json_value_deep_copy(patch_member);
+        if (new_member == NULL) {
+            return JSONFailure;
+        }
+        if (json_object_set_value(target, name, new_member) == JSONFailure) {
+            json_value_free(new_member);
+            return JSONFailure;
+        }
+    }
+    return JSONSuccess;
+}
+
 JSON_Value_Type json_type(const JSON_Value *value)
 {
     return json_value_get_type(value);
@@ -2197,6 +3398,25 @@ int json_boolean(const JSON_Value *value)
 
 void json_set_allocation_functions(JSON_Malloc_Function malloc_fun, JSON_Free_Function free_fun)
 {
+    /* Pooled headers belong to the old allocator. */
+    node_pool_trim(&value_pool, 0);
+    node_pool_trim(&object_pool, 0);
+    node_pool_trim(&array_pool, 0);
     parson_malloc = malloc_fun;
     parson_free = free_fun;
 }
+
+void json_set_node_pool_limit(size_t max_nodes_per_type)
+{
+    node_pool_limit = max_nodes_per_type;
+    node_pool_trim(&value_pool, max_nodes_per_type);
+    node_pool_trim(&object_pool, max_nodes_per_type);
+    node_pool_trim(&array_pool, max_nodes_per_type);
+}
+
+void json_get_node_pool_stats(JSON_Node_Pool_Stats *stats)
+{
+    if (stats != NULL) {
+        *stats = node_pool_stats;
+    }
+}
@@ -0,0 +1,18 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <stddef.h>
+
+#include <applibs/application.h>
+
+int Application_IsDeviceAuthReady(bool *outIsReady)
+{
+    if (outIsReady == NULL) {
+        errno = EFAULT;
+        return -1;
+    }
+
+    *outIsReady = true;
+    return 0;
+}
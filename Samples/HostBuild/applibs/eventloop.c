@@ -0,0 +1,322 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <applibs/eventloop.h>
+
+// Maximum number of events fetched by one epoll_wait call.
+#define MAX_EVENTS_PER_WAIT 16
+
+struct EventRegistration {
+    int fd;
+    EventLoopIoCallback *callback;
+    void *context;
+    // Set when the registration is released while its event loop is dispatching, in which case
+    // freeing it is deferred until the dispatch loop has finished with it.
+    bool isUnregistered;
+    EventRegistration *nextUnregistered;
+};
+
+struct EventLoop {
+    int epollFd;
+    // Written by EventLoop_Stop to wake the loop.
+    int stopFd;
+    // Every registration which has not been released, so that EventLoop_Close can free them.
+    EventRegistration **registrations;
+    size_t registrationCount;
+    size_t registrationCapacity;
+    bool isDispatching;
+    EventRegistration *unregistered;
+};
+
+static uint32_t ToEpollEvents(EventLoop_IoEvents events)
+{
+    uint32_t epollEvents = 0;
+    if (events & EventLoop_Input) {
+        epollEvents |= EPOLLIN;
+    }
+    if (events & EventLoop_Output) {
+        epollEvents |= EPOLLOUT;
+    }
+    if (events & EventLoop_Error) {
+        epollEvents |= EPOLLERR;
+    }
+    return epollEvents;
+}
+
+static EventLoop_IoEvents FromEpollEvents(uint32_t epollEvents)
+{
+    EventLoop_IoEvents events = EventLoop_None;
+    if (epollEvents & EPOLLIN) {
+        events |= EventLoop_Input;
+    }
+    if (epollEvents & EPOLLOUT) {
+        events |= EventLoop_Output;
+    }
+    // A hung-up descriptor is reported as an error, as it is on the device.
+    if (epollEvents & (EPOLLERR | EPOLLHUP)) {
+        events |= EventLoop_Error;
+    }
+    return events;
+}
+
+static int64_t GetMonotonicMilliseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static int AddRegistration(EventLoop *el, EventRegistration *reg)
+{
+    if (el->registrationCount == el->registrationCapacity) {
+        size_t newCapacity = el->registrationCapacity == 0 ? 16 : el->registrationCapacity * 2;
+        EventRegistration **newRegistrations =
+            realloc(el->registrations, newCapacity * sizeof(EventRegistration *));
+        if (newRegistrations == NULL) {
+            return -1;
+        }
+        el->registrations = newRegistrations;
+        el->registrationCapacity = newCapacity;
+    }
+
+    el->registrations[el->registrationCount++] = reg;
+    return 0;
+}
+
+static void RemoveRegistration(EventLoop *el, EventRegistration *reg)
+{
+    for (size_t i = 0; i < el->registrationCount; ++i) {
+        if (el->registrations[i] == reg) {
+            el->registrations[i] = el->registrations[--el->registrationCount];
+            return;
+        }
+    }
+}
+
+static void FreeUnregistered(EventLoop *el)
+{
+    while (el->unregistered != NULL) {
+        EventRegistration *reg = el->unregistered;
+        el->unregistered = reg->nextUnregistered;
+        free(reg);
+    }
+}
+
+EventLoop *EventLoop_Create(void)
+{
+    EventLoop *el = calloc(1, sizeof(EventLoop));
+    if (el == NULL) {
+        return NULL;
+    }
+
+    el->stopFd = -1;
+
+    el->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (el->epollFd == -1) {
+        goto failed;
+    }
+
+    el->stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (el->stopFd == -1) {
+        goto failed;
+    }
+
+    // The stop descriptor is identified by a NULL registration.
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+    if (epoll_ctl(el->epollFd, EPOLL_CTL_ADD, el->stopFd, &event) == -1) {
+        goto failed;
+    }
+
+    return el;
+
+failed:
+    EventLoop_Close(el);
+    return NULL;
+}
+
+void EventLoop_Close(EventLoop *el)
+{
+    if (el == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < el->registrationCount; ++i) {
+        free(el->registrations[i]);
+    }
+    free(el->registrations);
+    FreeUnregistered(el);
+
+    if (el->stopFd != -1) {
+        close(el->stopFd);
+    }
+
+    if (el->epollFd != -1) {
+        close(el->epollFd);
+    }
+
+    free(el);
+}
+
+EventLoop_Run_Result EventLoop_Run(EventLoop *el, int duration_in_milliseconds,
+                                   bool process_one_event)
+{
+    if (el == NULL || el->isDispatching) {
+        errno = EINVAL;
+        return EventLoop_Run_Failed;
+    }
+
+    int64_t endMs =
+        duration_in_milliseconds < 0 ? -1 : GetMonotonicMilliseconds() + duration_in_milliseconds;
+    bool hasProcessedEvent = false;
+
+    for (;;) {
+        int timeoutMs = -1;
+        if (endMs >= 0) {
+            int64_t remainingMs = endMs - GetMonotonicMilliseconds();
+            timeoutMs = remainingMs > 0 ? (int)remainingMs : 0;
+        }
+
+        struct epoll_event events[MAX_EVENTS_PER_WAIT];
+        int eventCount =
+            epoll_wait(el->epollFd, events, process_one_event ? 1 : MAX_EVENTS_PER_WAIT, timeoutMs);
+        if (eventCount == -1) {
+            return EventLoop_Run_Failed;
+        }
+
+        bool isStopRequested = false;
+        el->isDispatching = true;
+        for (int i = 0; i < eventCount; ++i) {
+            EventRegistration *reg = events[i].data.ptr;
+            if (reg == NULL) {
+                // Consume the stop request. The eventfd is non-blocking, so this cannot block.
+                uint64_t value;
+                if (read(el->stopFd, &value, sizeof(value)) > 0) {
+                    isStopRequested = true;
+                }
+                continue;
+            }
+
+            // An earlier callback in this batch may have released the registration.
+            if (reg->isUnregistered) {
+                continue;
+            }
+
+            reg->callback(el, reg->fd, FromEpollEvents(events[i].events), reg->context);
+            hasProcessedEvent = true;
+        }
+        el->isDispatching = false;
+        FreeUnregistered(el);
+
+        if (isStopRequested) {
+            return EventLoop_Run_Finished;
+        }
+
+        if (process_one_event && hasProcessedEvent) {
+            return EventLoop_Run_Finished;
+        }
+
+        if (endMs >= 0 && GetMonotonicMilliseconds() >= endMs) {
+            return hasProcessedEvent ? EventLoop_Run_Finished : EventLoop_Run_FinishedEmpty;
+        }
+    }
+}
+
+int EventLoop_Stop(EventLoop *el)
+{
+    uint64_t value = 1;
+    if (write(el->stopFd, &value, sizeof(value)) == -1 && errno != EAGAIN) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int EventLoop_GetWaitDescriptor(EventLoop *el)
+{
+    return el->epollFd;
+}
+
+EventRegistration *EventLoop_RegisterIo(EventLoop *el, int fd, EventLoop_IoEvents eventBitmask,
+                                        EventLoopIoCallback *callback, void *context)
+{
+    if (el == NULL || callback == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    EventRegistration *reg = calloc(1, sizeof(EventRegistration));
+    if (reg == NULL) {
+        return NULL;
+    }
+
+    reg->fd = fd;
+    reg->callback = callback;
+    reg->context = context;
+
+    struct epoll_event event = {.events = ToEpollEvents(eventBitmask), .data.ptr = reg};
+    if (epoll_ctl(el->epollFd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        free(reg);
+        return NULL;
+    }
+
+    if (AddRegistration(el, reg) == -1) {
+        int savedErrno = errno;
+        epoll_ctl(el->epollFd, EPOLL_CTL_DEL, fd, NULL);
+        free(reg);
+        errno = savedErrno;
+        return NULL;
+    }
+
+    return reg;
+}
+
+int EventLoop_ModifyIoEvents(EventLoop *el, EventRegistration *reg,
+                             EventLoop_IoEvents eventBitmask)
+{
+    if (el == NULL || reg == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct epoll_event event = {.events = ToEpollEvents(eventBitmask), .data.ptr = reg};
+    return epoll_ctl(el->epollFd, EPOLL_CTL_MOD, reg->fd, &event);
+}
+
+int EventLoop_UnregisterIo(EventLoop *el, EventRegistration *reg)
+{
+    if (reg == NULL) {
+        return 0;
+    }
+
+    if (el == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // The descriptor may already have been closed, which removes it from the epoll set.
+    int result = epoll_ctl(el->epollFd, EPOLL_CTL_DEL, reg->fd, NULL);
+    if (result == -1 && (errno == EBADF || errno == ENOENT)) {
+        result = 0;
+    }
+
+    RemoveRegistration(el, reg);
+
+    if (el->isDispatching) {
+        reg->isUnregistered = true;
+        reg->nextUnregistered = el->unregistered;
+        el->unregistered = reg;
+    } else {
+        free(reg);
+    }
+
+    return result;
+}
@@ -0,0 +1,25 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host Linux implementation of the subset of the Azure Sphere applibs Application API which the
+// samples use before connecting to Azure IoT. The host has no device certificate to wait for, so
+// device authentication is always reported as ready.
+
+#pragma once
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// <summary>
+/// Determine whether the application can authenticate with the device certificate.
+/// </summary>
+/// <param name="outIsReady">Set to true.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int Application_IsDeviceAuthReady(bool *outIsReady);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,145 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host Linux implementation of the Azure Sphere applibs EventLoop API, built on epoll. It has the
+// same signatures and semantics as the device library, so that high-level application code can be
+// built and profiled on a development machine.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// <summary>
+/// An object that waits for and dispatches events for registered file descriptors.
+/// </summary>
+typedef struct EventLoop EventLoop;
+
+/// <summary>
+/// A registration of a file descriptor with an <see cref="EventLoop" />.
+/// </summary>
+typedef struct EventRegistration EventRegistration;
+
+/// <summary>
+/// A bitmask of the I/O events which a registration is interested in, or which have occurred.
+/// </summary>
+typedef uint32_t EventLoop_IoEvents;
+
+/// <summary>
+/// I/O events. The values match the corresponding EPOLL* flags.
+/// </summary>
+enum {
+    /// <summary>No events.</summary>
+    EventLoop_None = 0x0,
+    /// <summary>The file descriptor is readable.</summary>
+    EventLoop_Input = 0x1,
+    /// <summary>The file descriptor is writable.</summary>
+    EventLoop_Output = 0x4,
+    /// <summary>An error occurred on the file descriptor. Always reported.</summary>
+    EventLoop_Error = 0x8,
+};
+
+/// <summary>
+/// The result of <see cref="EventLoop_Run" />.
+/// </summary>
+typedef enum {
+    /// <summary>The loop failed; errno contains more information.</summary>
+    EventLoop_Run_Failed = -1,
+    /// <summary>The loop finished without processing any events.</summary>
+    EventLoop_Run_FinishedEmpty = 0,
+    /// <summary>The loop processed at least one event, or was stopped.</summary>
+    EventLoop_Run_Finished = 1,
+} EventLoop_Run_Result;
+
+/// <summary>
+/// Callback invoked on the event loop when a registered file descriptor has events.
+/// </summary>
+/// <param name="el">The event loop.</param>
+/// <param name="fd">The file descriptor.</param>
+/// <param name="events">The events which occurred.</param>
+/// <param name="context">Context supplied to <see cref="EventLoop_RegisterIo" />.</param>
+typedef void EventLoopIoCallback(EventLoop *el, int fd, EventLoop_IoEvents events, void *context);
+
+/// <summary>
+/// Create an event loop.
+/// </summary>
+/// <returns>The event loop, or NULL on failure, in which case errno contains more
+/// information.</returns>
+EventLoop *EventLoop_Create(void);
+
+/// <summary>
+/// Close an event loop. Any registrations which remain are released. It is safe to call this
+/// function with a NULL pointer.
+/// </summary>
+/// <param name="el">The event loop, or NULL.</param>
+void EventLoop_Close(EventLoop *el);
+
+/// <summary>
+/// Wait for and dispatch events.
+/// </summary>
+/// <param name="el">The event loop.</param>
+/// <param name="duration_in_milliseconds">How long to run for, or -1 to run until
+/// <see cref="EventLoop_Stop" /> is called or, if <paramref name="process_one_event" /> is true,
+/// until an event is processed.</param>
+/// <param name="process_one_event">Whether to return after processing one event.</param>
+/// <returns>The outcome. If a signal interrupts the wait, EventLoop_Run_Failed is returned with
+/// errno set to EINTR.</returns>
+EventLoop_Run_Result EventLoop_Run(EventLoop *el, int duration_in_milliseconds,
+                                   bool process_one_event);
+
+/// <summary>
+/// Cause <see cref="EventLoop_Run" /> to return once the current callback, if any, returns.
+/// </summary>
+/// <param name="el">The event loop.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int EventLoop_Stop(EventLoop *el);
+
+/// <summary>
+/// Get a file descriptor which becomes readable when the event loop has events to process, so
+/// that it can be nested in another event loop.
+/// </summary>
+/// <param name="el">The event loop.</param>
+/// <returns>The file descriptor, or -1 on failure, in which case errno contains more
+/// information.</returns>
+int EventLoop_GetWaitDescriptor(EventLoop *el);
+
+/// <summary>
+/// Register a file descriptor with the event loop.
+/// </summary>
+/// <param name="el">The event loop.</param>
+/// <param name="fd">The file descriptor.</param>
+/// <param name="eventBitmask">The events to wait for.</param>
+/// <param name="callback">Invoked on the event loop when an event occurs.</param>
+/// <param name="context">Passed to <paramref name="callback" />.</param>
+/// <returns>The registration, which should be released with
+/// <see cref="EventLoop_UnregisterIo" />, or NULL on failure, in which case errno contains more
+/// information.</returns>
+EventRegistration *EventLoop_RegisterIo(EventLoop *el, int fd, EventLoop_IoEvents eventBitmask,
+                                        EventLoopIoCallback *callback, void *context);
+
+/// <summary>
+/// Change the events which a registration waits for.
+/// </summary>
+/// <param name="el">The event loop.</param>
+/// <param name="reg">The registration.</param>
+/// <param name="eventBitmask">The events to wait for.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int EventLoop_ModifyIoEvents(EventLoop *el, EventRegistration *reg,
+                             EventLoop_IoEvents eventBitmask);
+
+/// <summary>
+/// Release a registration. This may be called from any callback, including the registration's
+/// own. It is safe to call this function with a NULL registration.
+/// </summary>
+/// <param name="el">The event loop.</param>
+/// <param name="reg">The registration, or NULL.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int EventLoop_UnregisterIo(EventLoop *el, EventRegistration *reg);
+
+#ifdef __cplusplus
+}
+#endif
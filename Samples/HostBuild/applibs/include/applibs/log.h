@@ -0,0 +1,31 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host Linux implementation of the Azure Sphere applibs Log API. Messages are written to stderr.
+
+#pragma once
+
+#include <stdarg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// <summary>
+/// Write a formatted debug message.
+/// </summary>
+/// <param name="fmt">printf-style format string.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int Log_Debug(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/// <summary>
+/// Write a formatted debug message, as <see cref="Log_Debug" />.
+/// </summary>
+/// <param name="fmt">printf-style format string.</param>
+/// <param name="args">Arguments for <paramref name="fmt" />.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int Log_DebugVarArgs(const char *fmt, va_list args);
+
+#ifdef __cplusplus
+}
+#endif
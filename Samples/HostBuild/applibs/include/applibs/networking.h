@@ -0,0 +1,25 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host Linux implementation of the subset of the Azure Sphere applibs Networking API which the
+// samples use to wait for connectivity. The host's own network configuration is used, so
+// networking is always reported as ready.
+
+#pragma once
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// <summary>
+/// Determine whether the device has internet connectivity.
+/// </summary>
+/// <param name="outIsNetworkingReady">Set to true.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int Networking_IsNetworkingReady(bool *outIsNetworkingReady);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,24 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host Linux implementation of the Azure Sphere applibs curl proxy API. Proxy settings on the host
+// come from curl's own environment variables, so no proxy is configured here.
+
+#pragma once
+
+#include <curl/curl.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// <summary>
+/// Apply the device's default proxy settings to a curl handle. This does nothing on the host.
+/// </summary>
+/// <param name="curlHandle">The curl easy handle.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int Networking_Curl_SetDefaultProxy(CURL *curlHandle);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,47 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host Linux implementation of the Azure Sphere applibs Storage API.
+//
+// The mutable storage file is a regular file, by default "mutable_storage.bin" in the working
+// directory; set APPLIBS_HOST_MUTABLE_STORAGE to use another path. Files in the image package are
+// looked up relative to the working directory, or to APPLIBS_HOST_IMAGE_PACKAGE_DIR if it is set.
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// <summary>
+/// Open the application's mutable storage file for reading and writing, creating it if needed.
+/// </summary>
+/// <returns>A file descriptor which the caller must close, or -1 on failure, in which case errno
+/// contains more information.</returns>
+int Storage_OpenMutableFile(void);
+
+/// <summary>
+/// Delete the application's mutable storage file.
+/// </summary>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int Storage_DeleteMutableFile(void);
+
+/// <summary>
+/// Open a file in the image package for reading.
+/// </summary>
+/// <param name="relativePath">Path of the file relative to the image package root.</param>
+/// <returns>A file descriptor which the caller must close, or -1 on failure, in which case errno
+/// contains more information.</returns>
+int Storage_OpenFileInImagePackage(const char *relativePath);
+
+/// <summary>
+/// Get the absolute path of a file in the image package.
+/// </summary>
+/// <param name="relativePath">Path of the file relative to the image package root.</param>
+/// <returns>The path, which the caller must free, or NULL on failure, in which case errno
+/// contains more information.</returns>
+char *Storage_GetAbsolutePathInImagePackage(const char *relativePath);
+
+#ifdef __cplusplus
+}
+#endif
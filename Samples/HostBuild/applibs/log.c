@@ -0,0 +1,21 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include <applibs/log.h>
+
+int Log_Debug(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int result = Log_DebugVarArgs(fmt, args);
+    va_end(args);
+    return result;
+}
+
+int Log_DebugVarArgs(const char *fmt, va_list args)
+{
+    return vfprintf(stderr, fmt, args) < 0 ? -1 : 0;
+}
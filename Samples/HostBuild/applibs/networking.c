@@ -0,0 +1,18 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <stddef.h>
+
+#include <applibs/networking.h>
+
+int Networking_IsNetworkingReady(bool *outIsNetworkingReady)
+{
+    if (outIsNetworkingReady == NULL) {
+        errno = EFAULT;
+        return -1;
+    }
+
+    *outIsNetworkingReady = true;
+    return 0;
+}
@@ -0,0 +1,9 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <applibs/networking_curl.h>
+
+int Networking_Curl_SetDefaultProxy(CURL *curlHandle)
+{
+    return 0;
+}
@@ -0,0 +1,68 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <applibs/storage.h>
+
+static const char *GetMutableStoragePath(void)
+{
+    const char *path = getenv("APPLIBS_HOST_MUTABLE_STORAGE");
+    return path != NULL ? path : "mutable_storage.bin";
+}
+
+int Storage_OpenMutableFile(void)
+{
+    return open(GetMutableStoragePath(), O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+}
+
+int Storage_DeleteMutableFile(void)
+{
+    return unlink(GetMutableStoragePath());
+}
+
+char *Storage_GetAbsolutePathInImagePackage(const char *relativePath)
+{
+    if (relativePath == NULL || relativePath[0] == '/') {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    const char *packageDir = getenv("APPLIBS_HOST_IMAGE_PACKAGE_DIR");
+    char *cwd = NULL;
+    if (packageDir == NULL) {
+        cwd = getcwd(NULL, 0);
+        if (cwd == NULL) {
+            return NULL;
+        }
+        packageDir = cwd;
+    }
+
+    size_t pathLength = strlen(packageDir) + 1 + strlen(relativePath) + 1;
+    char *path = malloc(pathLength);
+    if (path != NULL) {
+        snprintf(path, pathLength, "%s/%s", packageDir, relativePath);
+    }
+
+    free(cwd);
+    return path;
+}
+
+int Storage_OpenFileInImagePackage(const char *relativePath)
+{
+    char *path = Storage_GetAbsolutePathInImagePackage(relativePath);
+    if (path == NULL) {
+        return -1;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    int savedErrno = errno;
+    free(path);
+    errno = savedErrno;
+    return fd;
+}
@@ -0,0 +1,7 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host Linux version of the Azure C shared utility option names. The samples include it, but
+// the options they set are in azureiot/iothub_client_options.h.
+
+#pragma once
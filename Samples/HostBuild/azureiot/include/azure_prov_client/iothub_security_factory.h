@@ -0,0 +1,9 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host Linux version of the Azure IoT C SDK IoT Hub security factory. The samples include it, but
+// use nothing from it on the host; see prov_device_ll_client.h.
+
+#pragma once
+
+#include "prov_security_factory.h"
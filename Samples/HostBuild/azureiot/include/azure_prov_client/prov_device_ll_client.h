@@ -0,0 +1,86 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host Linux version of the subset of the Azure IoT C SDK provisioning device client (LL) API
+// which the Azure IoT sample's DPS connection uses. The host build has no implementation of its
+// own: an in-process stand-in for the Device Provisioning Service, such as
+// loadtest/dps_stand_in.c, implements it.
+
+#pragma once
+
+#include <azureiot/iothub_device_client_ll.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PROV_DEVICE_RESULT_VALUE                                                                 \
+    PROV_DEVICE_RESULT_OK, PROV_DEVICE_RESULT_INVALID_ARG, PROV_DEVICE_RESULT_SUCCESS,           \
+        PROV_DEVICE_RESULT_MEMORY, PROV_DEVICE_RESULT_PARSING, PROV_DEVICE_RESULT_TRANSPORT,     \
+        PROV_DEVICE_RESULT_INVALID_STATE, PROV_DEVICE_RESULT_DEV_AUTH_ERROR,                     \
+        PROV_DEVICE_RESULT_TIMEOUT, PROV_DEVICE_RESULT_KEY_ERROR, PROV_DEVICE_RESULT_ERROR,      \
+        PROV_DEVICE_RESULT_HUB_NOT_SPECIFIED, PROV_DEVICE_RESULT_UNAUTHORIZED,                   \
+        PROV_DEVICE_RESULT_DISABLED
+typedef enum { PROV_DEVICE_RESULT_VALUE } PROV_DEVICE_RESULT;
+
+typedef enum {
+    PROV_DEVICE_REG_STATUS_CONNECTED,
+    PROV_DEVICE_REG_STATUS_REGISTERING,
+    PROV_DEVICE_REG_STATUS_ASSIGNING,
+    PROV_DEVICE_REG_STATUS_ASSIGNED,
+    PROV_DEVICE_REG_STATUS_ERROR,
+    PROV_DEVICE_REG_HUB_NOT_SPECIFIED
+} PROV_DEVICE_REG_STATUS;
+
+typedef struct PROV_INSTANCE_INFO_TAG *PROV_DEVICE_LL_HANDLE;
+
+typedef struct PROV_DEVICE_TRANSPORT_PROVIDER_TAG PROV_DEVICE_TRANSPORT_PROVIDER;
+typedef const PROV_DEVICE_TRANSPORT_PROVIDER *(*PROV_DEVICE_TRANSPORT_PROVIDER_FUNCTION)(void);
+
+typedef void (*PROV_DEVICE_CLIENT_REGISTER_DEVICE_CALLBACK)(PROV_DEVICE_RESULT register_result,
+                                                            const char *iothub_uri,
+                                                            const char *device_id,
+                                                            void *user_context);
+typedef void (*PROV_DEVICE_CLIENT_REGISTER_STATUS_CALLBACK)(PROV_DEVICE_REG_STATUS reg_status,
+                                                            void *user_context);
+
+/// <summary>
+/// Create a provisioning client for an ID scope.
+/// </summary>
+PROV_DEVICE_LL_HANDLE Prov_Device_LL_Create(const char *uri, const char *scope_id,
+                                            PROV_DEVICE_TRANSPORT_PROVIDER_FUNCTION protocol);
+
+/// <summary>
+/// Destroy the client, abandoning any registration in progress.
+/// </summary>
+void Prov_Device_LL_Destroy(PROV_DEVICE_LL_HANDLE handle);
+
+/// <summary>
+/// Start registering the device. The callback is invoked from Prov_Device_LL_DoWork once the
+/// device has been assigned to an IoT Hub, or registration has failed.
+/// </summary>
+PROV_DEVICE_RESULT Prov_Device_LL_Register_Device(
+    PROV_DEVICE_LL_HANDLE handle, PROV_DEVICE_CLIENT_REGISTER_DEVICE_CALLBACK register_callback,
+    void *user_context, PROV_DEVICE_CLIENT_REGISTER_STATUS_CALLBACK reg_status_cb,
+    void *status_user_ctext);
+
+/// <summary>
+/// Send and receive; invokes the registration callback when registration completes.
+/// </summary>
+void Prov_Device_LL_DoWork(PROV_DEVICE_LL_HANDLE handle);
+
+/// <summary>
+/// Set an option. Options are accepted and ignored.
+/// </summary>
+PROV_DEVICE_RESULT Prov_Device_LL_SetOption(PROV_DEVICE_LL_HANDLE handle, const char *optionName,
+                                            const void *value);
+
+/// <summary>
+/// Set the JSON payload sent with the registration, such as the model ID.
+/// </summary>
+PROV_DEVICE_RESULT Prov_Device_LL_Set_Provisioning_Payload(PROV_DEVICE_LL_HANDLE handle,
+                                                           const char *json);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,34 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host Linux version of the Azure IoT C SDK provisioning security factory; see
+// prov_device_ll_client.h.
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    SECURE_DEVICE_TYPE_UNKNOWN,
+    SECURE_DEVICE_TYPE_TPM,
+    SECURE_DEVICE_TYPE_X509,
+    SECURE_DEVICE_TYPE_HTTP_EDGE,
+    SECURE_DEVICE_TYPE_SYMMETRIC_KEY
+} SECURE_DEVICE_TYPE;
+
+/// <summary>
+/// Initialize the security module which the device registers with.
+/// </summary>
+/// <returns>0 on success.</returns>
+int prov_dev_security_init(SECURE_DEVICE_TYPE hsm_type);
+
+/// <summary>
+/// Release the security module.
+/// </summary>
+void prov_dev_security_deinit(void);
+
+#ifdef __cplusplus
+}
+#endif
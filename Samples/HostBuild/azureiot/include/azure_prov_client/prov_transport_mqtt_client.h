@@ -0,0 +1,19 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host Linux version of the Azure IoT C SDK provisioning MQTT transport provider; see
+// prov_device_ll_client.h.
+
+#pragma once
+
+#include "prov_device_ll_client.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+const PROV_DEVICE_TRANSPORT_PROVIDER *Prov_Device_MQTT_Protocol(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,25 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host Linux implementation of the Azure Sphere device authentication entry point of the Azure IoT
+// C SDK; see iothub_device_client_ll.h. The host has no device certificate, so the client connects
+// as the device ID in AZUREIOT_HOST_DEVICE_ID, or "host-device" if it is not set.
+
+#pragma once
+
+#include "iothub_device_client_ll.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// <summary>
+/// Create a client for an IoT Hub, given as "host[:port]", which authenticates the device with its
+/// certificate.
+/// </summary>
+IOTHUB_DEVICE_CLIENT_LL_HANDLE IoTHubDeviceClient_LL_CreateWithAzureSphereFromDeviceAuth(
+    const char *iothub_uri, IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,11 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host Linux implementation of the Azure IoT C SDK client option names; see
+// iothub_device_client_ll.h.
+
+#pragma once
+
+#define OPTION_MODEL_ID "model_id"
+#define OPTION_AUTO_URL_ENCODE_DECODE "auto_url_encode_decode"
+#define OPTION_KEEP_ALIVE "keepalive"
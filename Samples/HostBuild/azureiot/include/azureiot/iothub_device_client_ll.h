@@ -0,0 +1,189 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host Linux implementation of the subset of the Azure IoT C SDK device client (LL) API which the
+// Azure IoT sample uses. It speaks the IoT Hub MQTT topic conventions over plain TCP, to a local
+// stand-in for the IoT Hub such as loadtest/iothub_stand_in.py; it does not use TLS, and does not
+// authenticate. As with the SDK, nothing is sent or received except in
+// IoTHubDeviceClient_LL_DoWork.
+//
+// Unlike the SDK, a lost connection is not retried: the connection status callback reports it,
+// and the application creates a new client.
+
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IOTHUB_CLIENT_RESULT_VALUES                                                 \
+    IOTHUB_CLIENT_OK, IOTHUB_CLIENT_INVALID_ARG, IOTHUB_CLIENT_ERROR,               \
+        IOTHUB_CLIENT_INVALID_SIZE, IOTHUB_CLIENT_INDEFINITE_TIME
+typedef enum { IOTHUB_CLIENT_RESULT_VALUES } IOTHUB_CLIENT_RESULT;
+// The name which the samples use with MU_DEFINE_ENUM_STRINGS_WITHOUT_INVALID.
+#define IOTHUB_CLIENT_RESULT_VALUE IOTHUB_CLIENT_RESULT_VALUES
+
+typedef enum {
+    IOTHUB_CLIENT_CONFIRMATION_OK,
+    IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY,
+    IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT,
+    IOTHUB_CLIENT_CONFIRMATION_ERROR
+} IOTHUB_CLIENT_CONFIRMATION_RESULT;
+
+typedef enum {
+    IOTHUB_CLIENT_CONNECTION_AUTHENTICATED,
+    IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED
+} IOTHUB_CLIENT_CONNECTION_STATUS;
+
+#define IOTHUB_CLIENT_CONNECTION_STATUS_REASON_VALUES                                            \
+    IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN, IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED,        \
+        IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL, IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED,         \
+        IOTHUB_CLIENT_CONNECTION_NO_NETWORK, IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR,       \
+        IOTHUB_CLIENT_CONNECTION_OK, IOTHUB_CLIENT_CONNECTION_NO_PING_RESPONSE
+typedef enum { IOTHUB_CLIENT_CONNECTION_STATUS_REASON_VALUES } IOTHUB_CLIENT_CONNECTION_STATUS_REASON;
+
+typedef enum { DEVICE_TWIN_UPDATE_COMPLETE, DEVICE_TWIN_UPDATE_PARTIAL } DEVICE_TWIN_UPDATE_STATE;
+
+typedef enum {
+    IOTHUB_MESSAGE_OK,
+    IOTHUB_MESSAGE_INVALID_ARG,
+    IOTHUB_MESSAGE_INVALID_TYPE,
+    IOTHUB_MESSAGE_ERROR
+} IOTHUB_MESSAGE_RESULT;
+
+/// <summary>
+/// Returns the name of the <paramref name="index" />th of the comma-separated enum value names in
+/// <paramref name="names" />, in a static buffer; used by MU_DEFINE_ENUM_STRINGS_WITHOUT_INVALID.
+/// </summary>
+const char *IoTHubHost_EnumValueName(const char *names, int index);
+
+#define IOTHUB_HOST_STRINGIFY(...) #__VA_ARGS__
+
+/// <summary>
+/// Defines <c>const char *enumName##Strings(enumName value)</c>, as the SDK's macro utilities do.
+/// </summary>
+#define MU_DEFINE_ENUM_STRINGS_WITHOUT_INVALID(enumName, ...)         \
+    const char *enumName##Strings(enumName value)                     \
+    {                                                                 \
+        return IoTHubHost_EnumValueName(IOTHUB_HOST_STRINGIFY(__VA_ARGS__), (int)value); \
+    }
+
+typedef struct IOTHUB_CLIENT_LL_HANDLE_DATA_TAG *IOTHUB_DEVICE_CLIENT_LL_HANDLE;
+typedef struct IOTHUB_MESSAGE_HANDLE_DATA_TAG *IOTHUB_MESSAGE_HANDLE;
+
+typedef struct TRANSPORT_PROVIDER_TAG TRANSPORT_PROVIDER;
+typedef const TRANSPORT_PROVIDER *(*IOTHUB_CLIENT_TRANSPORT_PROVIDER)(void);
+
+typedef void (*IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK)(IOTHUB_CLIENT_CONFIRMATION_RESULT result,
+                                                          void *userContextCallback);
+typedef void (*IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK)(
+    IOTHUB_CLIENT_CONNECTION_STATUS result, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason,
+    void *userContextCallback);
+typedef void (*IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK)(DEVICE_TWIN_UPDATE_STATE updateState,
+                                                   const unsigned char *payLoad, size_t size,
+                                                   void *userContextCallback);
+typedef void (*IOTHUB_CLIENT_REPORTED_STATE_CALLBACK)(int status_code, void *userContextCallback);
+typedef int (*IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC)(const char *method_name,
+                                                          const unsigned char *payload, size_t size,
+                                                          unsigned char **response,
+                                                          size_t *response_size,
+                                                          void *userContextCallback);
+
+/// <summary>
+/// Create a message holding a copy of a NULL-terminated string.
+/// </summary>
+IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char *source);
+
+/// <summary>
+/// Create a message holding a copy of a byte array.
+/// </summary>
+IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(const unsigned char *byteArray,
+                                                        size_t size);
+
+/// <summary>
+/// Add an application property, which is sent URL-encoded in the topic.
+/// </summary>
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetProperty(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle,
+                                                const char *key, const char *value);
+
+/// <summary>
+/// Set the content type system property, sent as "$.ct".
+/// </summary>
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetContentTypeSystemProperty(
+    IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, const char *contentType);
+
+/// <summary>
+/// Set the content encoding system property, sent as "$.ce".
+/// </summary>
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetContentEncodingSystemProperty(
+    IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, const char *contentEncoding);
+
+void IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle);
+
+/// <summary>
+/// Create a client from a connection string of the form
+/// "HostName=host[:port];DeviceId=id[;SharedAccessKey=key]". The port, which is not part of the
+/// SDK's syntax, defaults to 1883. The key is ignored.
+/// </summary>
+IOTHUB_DEVICE_CLIENT_LL_HANDLE IoTHubDeviceClient_LL_CreateFromConnectionString(
+    const char *connectionString, IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol);
+
+/// <summary>
+/// Destroy the client. Telemetry and reports awaiting confirmation are completed with
+/// IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY and status 408 respectively; reports are also
+/// completed with status 408 as soon as the connection fails.
+/// </summary>
+void IoTHubDeviceClient_LL_Destroy(IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle);
+
+/// <summary>
+/// Connect if not yet connected, send what is queued, and invoke callbacks for what has been
+/// received. Never blocks.
+/// </summary>
+void IoTHubDeviceClient_LL_DoWork(IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle);
+
+/// <summary>
+/// Queue a copy of the message to be published with QoS 1; the callback is invoked on PUBACK.
+/// </summary>
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SendEventAsync(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle,
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback,
+    void *userContextCallback);
+
+/// <summary>
+/// Queue a reported properties patch; the callback is invoked with the status of the response.
+/// </summary>
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SendReportedState(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle, const unsigned char *reportedState,
+    size_t size, IOTHUB_CLIENT_REPORTED_STATE_CALLBACK reportedStateCallback,
+    void *userContextCallback);
+
+/// <summary>
+/// Subscribe to desired property patches, and request the whole twin once subscribed.
+/// </summary>
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetDeviceTwinCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle,
+    IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK deviceTwinCallback, void *userContextCallback);
+
+/// <summary>
+/// Subscribe to direct method requests.
+/// </summary>
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetDeviceMethodCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle,
+    IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC deviceMethodCallback, void *userContextCallback);
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetConnectionStatusCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle,
+    IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connectionStatusCallback, void *userContextCallback);
+
+/// <summary>
+/// Set an option. OPTION_MODEL_ID and OPTION_KEEP_ALIVE are used; others are accepted and
+/// ignored.
+/// </summary>
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetOption(IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle,
+                                                     const char *optionName, const void *value);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,19 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host Linux implementation of the Azure IoT C SDK MQTT transport provider; see
+// iothub_device_client_ll.h. MQTT is the only transport.
+
+#pragma once
+
+#include "iothub_device_client_ll.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+const TRANSPORT_PROVIDER *MQTT_Protocol(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,1258 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host implementation of the Azure IoT C SDK device client (LL) API: an MQTT 3.1.1 client over a
+// non-blocking TCP socket, driven entirely by IoTHubDeviceClient_LL_DoWork. See
+// include/azureiot/iothub_device_client_ll.h.
+
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <azureiot/azure_sphere_provisioning.h>
+#include <azureiot/iothub_client_options.h>
+#include <azureiot/iothub_device_client_ll.h>
+#include <azureiot/iothubtransportmqtt.h>
+
+#define DEFAULT_PORT "1883"
+#define DEFAULT_DEVICE_AUTH_DEVICE_ID "host-device"
+#define DEFAULT_KEEP_ALIVE_SECONDS 240
+#define API_VERSION "2020-09-30"
+#define RECEIVE_CHUNK_SIZE 4096
+// The status which the SDK gives a report that gets no response.
+#define REPORT_STATUS_TIMEOUT 408
+
+// MQTT control packet types, in the top four bits of the first byte.
+enum {
+    Packet_Connect = 1,
+    Packet_Connack = 2,
+    Packet_Publish = 3,
+    Packet_Puback = 4,
+    Packet_Subscribe = 8,
+    Packet_Suback = 9,
+    Packet_Pingreq = 12,
+    Packet_Pingresp = 13,
+    Packet_Disconnect = 14
+};
+
+struct TRANSPORT_PROVIDER_TAG {
+    const char *name;
+};
+
+static const TRANSPORT_PROVIDER mqttProvider = {.name = "MQTT"};
+
+const TRANSPORT_PROVIDER *MQTT_Protocol(void)
+{
+    return &mqttProvider;
+}
+
+typedef struct MessageProperty {
+    char *key;
+    char *value;
+    struct MessageProperty *next;
+} MessageProperty;
+
+struct IOTHUB_MESSAGE_HANDLE_DATA_TAG {
+    unsigned char *data;
+    size_t length;
+    char *contentType;
+    char *contentEncoding;
+    MessageProperty *properties;
+};
+
+typedef struct {
+    uint8_t *data;
+    size_t length;
+    size_t capacity;
+} ByteBuffer;
+
+// Telemetry awaiting PUBACK, or a reported state patch or twin request awaiting its response.
+typedef struct PendingRequest {
+    uint16_t packetId;
+    unsigned int requestId;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventCallback;
+    IOTHUB_CLIENT_REPORTED_STATE_CALLBACK reportedStateCallback;
+    void *context;
+    // The whole PUBLISH packet, kept until the client is connected.
+    ByteBuffer packet;
+    bool sent;
+    struct PendingRequest *next;
+} PendingRequest;
+
+typedef enum {
+    ClientState_Idle,
+    ClientState_Connecting,
+    ClientState_AwaitingConnack,
+    ClientState_Connected,
+    ClientState_Failed
+} ClientState;
+
+struct IOTHUB_CLIENT_LL_HANDLE_DATA_TAG {
+    char *host;
+    char *port;
+    char *deviceId;
+    char *modelId;
+    int keepAliveSeconds;
+
+    ClientState state;
+    int fd;
+    ByteBuffer outgoing;
+    size_t outgoingSent;
+    ByteBuffer incoming;
+    struct timespec lastSendTime;
+    struct timespec pingSentTime;
+    bool pingOutstanding;
+
+    uint16_t nextPacketId;
+    unsigned int nextRequestId;
+    PendingRequest *telemetry;
+    PendingRequest *reports;
+
+    uint16_t twinSubscribePacketId;
+    bool twinSubscribed;
+    unsigned int twinGetRequestId;
+    bool methodsSubscribed;
+
+    IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connectionStatusCallback;
+    void *connectionStatusContext;
+    IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK twinCallback;
+    void *twinContext;
+    IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC methodCallback;
+    void *methodContext;
+};
+
+const char *IoTHubHost_EnumValueName(const char *names, int index)
+{
+    static char name[128];
+
+    const char *start = names;
+    for (int i = 0; i < index && start != NULL; ++i) {
+        start = strchr(start, ',');
+        if (start != NULL) {
+            ++start;
+        }
+    }
+    if (start == NULL) {
+        return "UNKNOWN";
+    }
+
+    start += strspn(start, " ");
+    size_t length = strcspn(start, ", ");
+    if (length >= sizeof(name)) {
+        length = sizeof(name) - 1;
+    }
+    memcpy(name, start, length);
+    name[length] = '\0';
+    return name;
+}
+
+static bool ByteBuffer_Reserve(ByteBuffer *buffer, size_t extra)
+{
+    if (buffer->capacity - buffer->length >= extra) {
+        return true;
+    }
+
+    size_t capacity = buffer->capacity == 0 ? 256 : buffer->capacity;
+    while (capacity - buffer->length < extra) {
+        capacity *= 2;
+    }
+    uint8_t *data = realloc(buffer->data, capacity);
+    if (data == NULL) {
+        return false;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return true;
+}
+
+static bool ByteBuffer_Append(ByteBuffer *buffer, const void *bytes, size_t length)
+{
+    // An empty payload, such as that of a twin GET, may be NULL.
+    if (length == 0) {
+        return true;
+    }
+    if (!ByteBuffer_Reserve(buffer, length)) {
+        return false;
+    }
+    memcpy(buffer->data + buffer->length, bytes, length);
+    buffer->length += length;
+    return true;
+}
+
+static void ByteBuffer_Free(ByteBuffer *buffer)
+{
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->length = buffer->capacity = 0;
+}
+
+static char *DuplicateString(const char *string, size_t length)
+{
+    char *copy = malloc(length + 1);
+    if (copy != NULL) {
+        memcpy(copy, string, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+static long MillisecondsSince(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(const unsigned char *byteArray,
+                                                        size_t size)
+{
+    IOTHUB_MESSAGE_HANDLE message = calloc(1, sizeof(*message));
+    if (message == NULL) {
+        return NULL;
+    }
+
+    // Always allocate, so that an empty message has a non-NULL body.
+    message->data = malloc(size > 0 ? size : 1);
+    if (message->data == NULL) {
+        free(message);
+        return NULL;
+    }
+    if (size > 0) {
+        memcpy(message->data, byteArray, size);
+    }
+    message->length = size;
+    return message;
+}
+
+IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char *source)
+{
+    if (source == NULL) {
+        return NULL;
+    }
+    return IoTHubMessage_CreateFromByteArray((const unsigned char *)source, strlen(source));
+}
+
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetProperty(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle,
+                                                const char *key, const char *value)
+{
+    if (iotHubMessageHandle == NULL || key == NULL || value == NULL) {
+        return IOTHUB_MESSAGE_INVALID_ARG;
+    }
+
+    MessageProperty *property = calloc(1, sizeof(*property));
+    if (property == NULL) {
+        return IOTHUB_MESSAGE_ERROR;
+    }
+    property->key = DuplicateString(key, strlen(key));
+    property->value = DuplicateString(value, strlen(value));
+    if (property->key == NULL || property->value == NULL) {
+        free(property->key);
+        free(property->value);
+        free(property);
+        return IOTHUB_MESSAGE_ERROR;
+    }
+
+    // Keep the properties in the order in which they were set.
+    MessageProperty **last = &iotHubMessageHandle->properties;
+    while (*last != NULL) {
+        last = &(*last)->next;
+    }
+    *last = property;
+    return IOTHUB_MESSAGE_OK;
+}
+
+static IOTHUB_MESSAGE_RESULT SetSystemProperty(char **property, const char *value)
+{
+    if (value == NULL) {
+        return IOTHUB_MESSAGE_INVALID_ARG;
+    }
+    char *copy = DuplicateString(value, strlen(value));
+    if (copy == NULL) {
+        return IOTHUB_MESSAGE_ERROR;
+    }
+    free(*property);
+    *property = copy;
+    return IOTHUB_MESSAGE_OK;
+}
+
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetContentTypeSystemProperty(
+    IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, const char *contentType)
+{
+    if (iotHubMessageHandle == NULL) {
+        return IOTHUB_MESSAGE_INVALID_ARG;
+    }
+    return SetSystemProperty(&iotHubMessageHandle->contentType, contentType);
+}
+
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetContentEncodingSystemProperty(
+    IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, const char *contentEncoding)
+{
+    if (iotHubMessageHandle == NULL) {
+        return IOTHUB_MESSAGE_INVALID_ARG;
+    }
+    return SetSystemProperty(&iotHubMessageHandle->contentEncoding, contentEncoding);
+}
+
+void IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    if (iotHubMessageHandle == NULL) {
+        return;
+    }
+
+    MessageProperty *property = iotHubMessageHandle->properties;
+    while (property != NULL) {
+        MessageProperty *next = property->next;
+        free(property->key);
+        free(property->value);
+        free(property);
+        property = next;
+    }
+    free(iotHubMessageHandle->contentType);
+    free(iotHubMessageHandle->contentEncoding);
+    free(iotHubMessageHandle->data);
+    free(iotHubMessageHandle);
+}
+
+/// <summary>
+///     Appends a string to a topic, percent-encoding everything but RFC 3986 unreserved
+///     characters, as the SDK does for message properties.
+/// </summary>
+static bool AppendUrlEncoded(ByteBuffer *topic, const char *string)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    for (const unsigned char *c = (const unsigned char *)string; *c != '\0'; ++c) {
+        bool unreserved = (*c >= 'A' && *c <= 'Z') || (*c >= 'a' && *c <= 'z') ||
+                          (*c >= '0' && *c <= '9') || *c == '-' || *c == '.' || *c == '_' ||
+                          *c == '~';
+        if (unreserved) {
+            if (!ByteBuffer_Append(topic, c, 1)) {
+                return false;
+            }
+        } else {
+            char escaped[3] = {'%', hex[*c >> 4], hex[*c & 0xF]};
+            if (!ByteBuffer_Append(topic, escaped, sizeof(escaped))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool AppendTopicProperty(ByteBuffer *topic, bool *first, const char *key, const char *value)
+{
+    if (!*first && !ByteBuffer_Append(topic, "&", 1)) {
+        return false;
+    }
+    *first = false;
+    return AppendUrlEncoded(topic, key) && ByteBuffer_Append(topic, "=", 1) &&
+           AppendUrlEncoded(topic, value);
+}
+
+static bool AppendUint16(ByteBuffer *buffer, uint16_t value)
+{
+    uint8_t bytes[2] = {(uint8_t)(value >> 8), (uint8_t)value};
+    return ByteBuffer_Append(buffer, bytes, sizeof(bytes));
+}
+
+static bool AppendMqttString(ByteBuffer *buffer, const void *string, size_t length)
+{
+    return length <= UINT16_MAX && AppendUint16(buffer, (uint16_t)length) &&
+           ByteBuffer_Append(buffer, string, length);
+}
+
+/// <summary>
+///     Appends a fixed header, whose remaining length is a base-128 variable-length integer.
+/// </summary>
+static bool AppendFixedHeader(ByteBuffer *buffer, uint8_t firstByte, size_t remainingLength)
+{
+    if (remainingLength > 268435455) {
+        return false;
+    }
+
+    uint8_t header[5];
+    size_t headerLength = 0;
+    header[headerLength++] = firstByte;
+    do {
+        uint8_t digit = remainingLength % 128;
+        remainingLength /= 128;
+        header[headerLength++] = remainingLength > 0 ? (digit | 0x80) : digit;
+    } while (remainingLength > 0);
+    return ByteBuffer_Append(buffer, header, headerLength);
+}
+
+/// <summary>
+///     Builds a PUBLISH packet; a packet identifier of 0 means QoS 0.
+/// </summary>
+static bool BuildPublish(ByteBuffer *packet, const char *topic, size_t topicLength,
+                         uint16_t packetId, const unsigned char *payload, size_t payloadLength)
+{
+    size_t remainingLength = 2 + topicLength + (packetId != 0 ? 2 : 0) + payloadLength;
+    uint8_t firstByte = (uint8_t)(Packet_Publish << 4 | (packetId != 0 ? 0x02 : 0));
+    return AppendFixedHeader(packet, firstByte, remainingLength) &&
+           AppendMqttString(packet, topic, topicLength) &&
+           (packetId == 0 || AppendUint16(packet, packetId)) &&
+           ByteBuffer_Append(packet, payload, payloadLength);
+}
+
+static uint16_t NextPacketId(IOTHUB_DEVICE_CLIENT_LL_HANDLE client)
+{
+    if (++client->nextPacketId == 0) {
+        client->nextPacketId = 1;
+    }
+    return client->nextPacketId;
+}
+
+static bool QueuePacket(IOTHUB_DEVICE_CLIENT_LL_HANDLE client, const ByteBuffer *packet)
+{
+    return ByteBuffer_Append(&client->outgoing, packet->data, packet->length);
+}
+
+static bool QueuePublish(IOTHUB_DEVICE_CLIENT_LL_HANDLE client, const char *topic,
+                         const unsigned char *payload, size_t payloadLength)
+{
+    ByteBuffer packet = {0};
+    bool queued = BuildPublish(&packet, topic, strlen(topic), 0, payload, payloadLength) &&
+                  QueuePacket(client, &packet);
+    ByteBuffer_Free(&packet);
+    return queued;
+}
+
+static bool QueueSubscribe(IOTHUB_DEVICE_CLIENT_LL_HANDLE client, uint16_t packetId,
+                           const char *const *topics, size_t topicCount)
+{
+    ByteBuffer packet = {0};
+    size_t remainingLength = 2;
+    for (size_t i = 0; i < topicCount; ++i) {
+        remainingLength += 2 + strlen(topics[i]) + 1;
+    }
+
+    bool built = AppendFixedHeader(&packet, Packet_Subscribe << 4 | 0x02, remainingLength) &&
+                 AppendUint16(&packet, packetId);
+    for (size_t i = 0; i < topicCount && built; ++i) {
+        static const uint8_t qos = 0;
+        built = AppendMqttString(&packet, topics[i], strlen(topics[i])) &&
+                ByteBuffer_Append(&packet, &qos, 1);
+    }
+
+    bool queued = built && QueuePacket(client, &packet);
+    ByteBuffer_Free(&packet);
+    return queued;
+}
+
+static bool QueueConnect(IOTHUB_DEVICE_CLIENT_LL_HANDLE client)
+{
+    // The IoT Hub takes the API version, and the model ID, from the user name.
+    ByteBuffer userName = {0};
+    bool built = ByteBuffer_Append(&userName, client->host, strlen(client->host)) &&
+                 ByteBuffer_Append(&userName, "/", 1) &&
+                 ByteBuffer_Append(&userName, client->deviceId, strlen(client->deviceId)) &&
+                 ByteBuffer_Append(&userName, "/?api-version=" API_VERSION,
+                                   strlen("/?api-version=" API_VERSION));
+    if (built && client->modelId != NULL) {
+        built = ByteBuffer_Append(&userName, "&model-id=", strlen("&model-id=")) &&
+                AppendUrlEncoded(&userName, client->modelId);
+    }
+
+    static const uint8_t protocol[] = {0, 4, 'M', 'Q', 'T', 'T', 4, 0x82};
+    size_t clientIdLength = strlen(client->deviceId);
+    size_t remainingLength = sizeof(protocol) + 2 + 2 + clientIdLength + 2 + userName.length;
+
+    ByteBuffer packet = {0};
+    built = built && AppendFixedHeader(&packet, Packet_Connect << 4, remainingLength) &&
+            ByteBuffer_Append(&packet, protocol, sizeof(protocol)) &&
+            AppendUint16(&packet, (uint16_t)client->keepAliveSeconds) &&
+            AppendMqttString(&packet, client->deviceId, clientIdLength) &&
+            AppendMqttString(&packet, userName.data, userName.length);
+
+    bool queued = built && QueuePacket(client, &packet);
+    ByteBuffer_Free(&packet);
+    ByteBuffer_Free(&userName);
+    return queued;
+}
+
+static void QueueTwinGet(IOTHUB_DEVICE_CLIENT_LL_HANDLE client)
+{
+    char topic[64];
+    client->twinGetRequestId = ++client->nextRequestId;
+    snprintf(topic, sizeof(topic), "$iothub/twin/GET/?$rid=%u", client->twinGetRequestId);
+    QueuePublish(client, topic, NULL, 0);
+}
+
+static void QueueSubscriptions(IOTHUB_DEVICE_CLIENT_LL_HANDLE client)
+{
+    if (client->twinCallback != NULL && !client->twinSubscribed) {
+        static const char *const twinTopics[] = {"$iothub/twin/res/#",
+                                                 "$iothub/twin/PATCH/properties/desired/#"};
+        client->twinSubscribePacketId = NextPacketId(client);
+        client->twinSubscribed =
+            QueueSubscribe(client, client->twinSubscribePacketId, twinTopics, 2);
+    }
+
+    if (client->methodCallback != NULL && !client->methodsSubscribed) {
+        static const char *const methodTopics[] = {"$iothub/methods/POST/#"};
+        client->methodsSubscribed =
+            QueueSubscribe(client, NextPacketId(client), methodTopics, 1);
+    }
+}
+
+/// <summary>
+///     Queues the requests made before the client was connected.
+/// </summary>
+static void QueueUnsentRequests(IOTHUB_DEVICE_CLIENT_LL_HANDLE client, PendingRequest *request)
+{
+    for (; request != NULL; request = request->next) {
+        if (!request->sent && QueuePacket(client, &request->packet)) {
+            request->sent = true;
+            ByteBuffer_Free(&request->packet);
+        }
+    }
+}
+
+static void ReportConnectionStatus(IOTHUB_DEVICE_CLIENT_LL_HANDLE client,
+                                   IOTHUB_CLIENT_CONNECTION_STATUS status,
+                                   IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason)
+{
+    if (client->connectionStatusCallback != NULL) {
+        client->connectionStatusCallback(status, reason, client->connectionStatusContext);
+    }
+}
+
+static void CloseSocket(IOTHUB_DEVICE_CLIENT_LL_HANDLE client)
+{
+    if (client->fd >= 0) {
+        close(client->fd);
+        client->fd = -1;
+    }
+}
+
+/// <summary>
+///     Completes and frees requests which will get no response: telemetry with
+///     IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, and reports with status 408, as the SDK does.
+/// </summary>
+static void FreeRequests(PendingRequest *request)
+{
+    while (request != NULL) {
+        PendingRequest *next = request->next;
+        if (request->eventCallback != NULL) {
+            request->eventCallback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, request->context);
+        }
+        if (request->reportedStateCallback != NULL) {
+            request->reportedStateCallback(REPORT_STATUS_TIMEOUT, request->context);
+        }
+        ByteBuffer_Free(&request->packet);
+        free(request);
+        request = next;
+    }
+}
+
+/// <summary>
+///     Drops the connection and reports it. The client stays failed until it is destroyed; the
+///     application is expected to create a new one.
+/// </summary>
+static void Fail(IOTHUB_DEVICE_CLIENT_LL_HANDLE client,
+                 IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason)
+{
+    CloseSocket(client);
+    client->state = ClientState_Failed;
+    ReportConnectionStatus(client, IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED, reason);
+
+    // No response can arrive now, so fail the reports rather than leave them until Destroy.
+    PendingRequest *reports = client->reports;
+    client->reports = NULL;
+    FreeRequests(reports);
+}
+
+static void StartConnect(IOTHUB_DEVICE_CLIENT_LL_HANDLE client)
+{
+    // Resolution blocks, but the host is expected to be a literal address or localhost.
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *addresses = NULL;
+    if (getaddrinfo(client->host, client->port, &hints, &addresses) != 0 || addresses == NULL) {
+        Fail(client, IOTHUB_CLIENT_CONNECTION_NO_NETWORK);
+        return;
+    }
+
+    client->fd = socket(addresses->ai_family,
+                        addresses->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                        addresses->ai_protocol);
+    if (client->fd < 0 ||
+        (connect(client->fd, addresses->ai_addr, addresses->ai_addrlen) != 0 &&
+         errno != EINPROGRESS)) {
+        freeaddrinfo(addresses);
+        Fail(client, IOTHUB_CLIENT_CONNECTION_NO_NETWORK);
+        return;
+    }
+    freeaddrinfo(addresses);
+
+    client->state = ClientState_Connecting;
+}
+
+/// <summary>
+///     Sends the CONNECT packet once the TCP connection is established.
+/// </summary>
+static void CompleteConnect(IOTHUB_DEVICE_CLIENT_LL_HANDLE client)
+{
+    struct pollfd pollFd = {.fd = client->fd, .events = POLLOUT};
+    if (poll(&pollFd, 1, 0) <= 0) {
+        return;
+    }
+
+    int error = 0;
+    socklen_t errorLength = sizeof(error);
+    if (getsockopt(client->fd, SOL_SOCKET, SO_ERROR, &error, &errorLength) != 0 || error != 0) {
+        Fail(client, IOTHUB_CLIENT_CONNECTION_NO_NETWORK);
+        return;
+    }
+
+    if (!QueueConnect(client)) {
+        Fail(client, IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR);
+        return;
+    }
+    client->state = ClientState_AwaitingConnack;
+}
+
+static bool Flush(IOTHUB_DEVICE_CLIENT_LL_HANDLE client)
+{
+    while (client->outgoingSent < client->outgoing.length) {
+        ssize_t sent = send(client->fd, client->outgoing.data + client->outgoingSent,
+                            client->outgoing.length - client->outgoingSent, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        client->outgoingSent += (size_t)sent;
+        clock_gettime(CLOCK_MONOTONIC, &client->lastSendTime);
+    }
+
+    client->outgoing.length = 0;
+    client->outgoingSent = 0;
+    return true;
+}
+
+/// <summary>
+///     Finds the value of a query parameter, such as "$rid", in a topic.
+/// </summary>
+static bool GetTopicParameter(const char *topic, size_t topicLength, const char *name,
+                              unsigned int *value)
+{
+    const char *query = memchr(topic, '?', topicLength);
+    if (query == NULL) {
+        return false;
+    }
+
+    size_t nameLength = strlen(name);
+    const char *end = topic + topicLength;
+    for (const char *parameter = query + 1; parameter < end;) {
+        const char *next = memchr(parameter, '&', (size_t)(end - parameter));
+        if (next == NULL) {
+            next = end;
+        }
+        if ((size_t)(next - parameter) > nameLength && memcmp(parameter, name, nameLength) == 0 &&
+            parameter[nameLength] == '=') {
+            *value = (unsigned int)strtoul(parameter + nameLength + 1, NULL, 10);
+            return true;
+        }
+        parameter = next + 1;
+    }
+    return false;
+}
+
+static bool TopicStartsWith(const char *topic, size_t topicLength, const char *prefix,
+                            size_t prefixLength)
+{
+    return topicLength >= prefixLength && memcmp(topic, prefix, prefixLength) == 0;
+}
+
+#define TOPIC_PREFIX(literal) literal, sizeof(literal) - 1
+
+static void HandleTwinResponse(IOTHUB_DEVICE_CLIENT_LL_HANDLE client, const char *topic,
+                               size_t topicLength, const uint8_t *payload, size_t payloadLength)
+{
+    // $iothub/twin/res/{status}/?$rid={request id}
+    unsigned int requestId;
+    if (!GetTopicParameter(topic, topicLength, "$rid", &requestId)) {
+        return;
+    }
+    int status = atoi(topic + strlen("$iothub/twin/res/"));
+
+    if (requestId == client->twinGetRequestId) {
+        client->twinGetRequestId = 0;
+        if (client->twinCallback != NULL && status == 200) {
+            client->twinCallback(DEVICE_TWIN_UPDATE_COMPLETE, payload, payloadLength,
+                                 client->twinContext);
+        }
+        return;
+    }
+
+    for (PendingRequest **link = &client->reports; *link != NULL; link = &(*link)->next) {
+        PendingRequest *report = *link;
+        if (report->requestId == requestId) {
+            *link = report->next;
+            if (report->reportedStateCallback != NULL) {
+                report->reportedStateCallback(status, report->context);
+            }
+            ByteBuffer_Free(&report->packet);
+            free(report);
+            return;
+        }
+    }
+}
+
+static void HandleMethodRequest(IOTHUB_DEVICE_CLIENT_LL_HANDLE client, const char *topic,
+                                size_t topicLength, const uint8_t *payload, size_t payloadLength)
+{
+    // $iothub/methods/POST/{method name}/?$rid={request id}
+    unsigned int requestId;
+    const char *name = topic + strlen("$iothub/methods/POST/");
+    const char *nameEnd = memchr(name, '/', (size_t)(topic + topicLength - name));
+    if (client->methodCallback == NULL || nameEnd == NULL ||
+        !GetTopicParameter(topic, topicLength, "$rid", &requestId)) {
+        return;
+    }
+
+    char *methodName = DuplicateString(name, (size_t)(nameEnd - name));
+    if (methodName == NULL) {
+        return;
+    }
+
+    unsigned char *response = NULL;
+    size_t responseSize = 0;
+    int status = client->methodCallback(methodName, payload, payloadLength, &response,
+                                        &responseSize, client->methodContext);
+    free(methodName);
+
+    char responseTopic[64];
+    snprintf(responseTopic, sizeof(responseTopic), "$iothub/methods/res/%d/?$rid=%u", status,
+             requestId);
+    QueuePublish(client, responseTopic, response, response != NULL ? responseSize : 0);
+    free(response);
+}
+
+static void HandlePublish(IOTHUB_DEVICE_CLIENT_LL_HANDLE client, uint8_t flags,
+                          const uint8_t *body, size_t length)
+{
+    if (length < 2) {
+        return;
+    }
+    size_t topicLength = (size_t)(body[0] << 8 | body[1]);
+    size_t offset = 2 + topicLength;
+    unsigned int qos = (flags >> 1) & 0x3;
+    if (offset + (qos > 0 ? 2 : 0) > length) {
+        return;
+    }
+
+    // Copy the topic, so that it is NULL-terminated.
+    char *topic = DuplicateString((const char *)body + 2, topicLength);
+    if (topic == NULL) {
+        return;
+    }
+
+    if (qos > 0) {
+        uint8_t puback[4] = {Packet_Puback << 4, 2, body[offset], body[offset + 1]};
+        ByteBuffer_Append(&client->outgoing, puback, sizeof(puback));
+        offset += 2;
+    }
+
+    const uint8_t *payload = body + offset;
+    size_t payloadLength = length - offset;
+    if (TopicStartsWith(topic, topicLength, TOPIC_PREFIX("$iothub/twin/res/"))) {
+        HandleTwinResponse(client, topic, topicLength, payload, payloadLength);
+    } else if (TopicStartsWith(topic, topicLength,
+                               TOPIC_PREFIX("$iothub/twin/PATCH/properties/desired/"))) {
+        if (client->twinCallback != NULL) {
+            client->twinCallback(DEVICE_TWIN_UPDATE_PARTIAL, payload, payloadLength,
+                                 client->twinContext);
+        }
+    } else if (TopicStartsWith(topic, topicLength, TOPIC_PREFIX("$iothub/methods/POST/"))) {
+        HandleMethodRequest(client, topic, topicLength, payload, payloadLength);
+    }
+
+    free(topic);
+}
+
+static void HandlePuback(IOTHUB_DEVICE_CLIENT_LL_HANDLE client, uint16_t packetId)
+{
+    for (PendingRequest **link = &client->telemetry; *link != NULL; link = &(*link)->next) {
+        PendingRequest *message = *link;
+        if (message->packetId == packetId) {
+            *link = message->next;
+            message->eventCallback(IOTHUB_CLIENT_CONFIRMATION_OK, message->context);
+            ByteBuffer_Free(&message->packet);
+            free(message);
+            return;
+        }
+    }
+}
+
+/// <summary>
+///     Handles one complete packet.
+/// </summary>
+/// <returns>false if the connection should be dropped.</returns>
+static bool HandlePacket(IOTHUB_DEVICE_CLIENT_LL_HANDLE client, uint8_t firstByte,
+                         const uint8_t *body, size_t length)
+{
+    switch (firstByte >> 4) {
+    case Packet_Connack:
+        if (length < 2 || body[1] != 0) {
+            Fail(client, IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL);
+            return false;
+        }
+        client->state = ClientState_Connected;
+        QueueSubscriptions(client);
+        QueueUnsentRequests(client, client->telemetry);
+        QueueUnsentRequests(client, client->reports);
+        ReportConnectionStatus(client, IOTHUB_CLIENT_CONNECTION_AUTHENTICATED,
+                               IOTHUB_CLIENT_CONNECTION_OK);
+        return client->state == ClientState_Connected;
+    case Packet_Publish:
+        HandlePublish(client, firstByte & 0xF, body, length);
+        return client->state == ClientState_Connected;
+    case Packet_Puback:
+        if (length >= 2) {
+            HandlePuback(client, (uint16_t)(body[0] << 8 | body[1]));
+        }
+        return client->state == ClientState_Connected;
+    case Packet_Suback:
+        // The whole twin is requested once the response topic is subscribed to.
+        if (length >= 2 && client->twinSubscribePacketId != 0 &&
+            (uint16_t)(body[0] << 8 | body[1]) == client->twinSubscribePacketId) {
+            client->twinSubscribePacketId = 0;
+            QueueTwinGet(client);
+        }
+        return true;
+    case Packet_Pingresp:
+        client->pingOutstanding = false;
+        return true;
+    default:
+        return true;
+    }
+}
+
+/// <summary>
+///     Reads what is available, and handles each complete packet.
+/// </summary>
+/// <returns>false if the connection was dropped.</returns>
+static bool Receive(IOTHUB_DEVICE_CLIENT_LL_HANDLE client)
+{
+    for (;;) {
+        if (!ByteBuffer_Reserve(&client->incoming, RECEIVE_CHUNK_SIZE)) {
+            Fail(client, IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR);
+            return false;
+        }
+        ssize_t received = recv(client->fd, client->incoming.data + client->incoming.length,
+                                client->incoming.capacity - client->incoming.length, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (received <= 0) {
+            Fail(client, IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR);
+            return false;
+        }
+        client->incoming.length += (size_t)received;
+    }
+
+    size_t offset = 0;
+    while (client->state != ClientState_Failed) {
+        const uint8_t *packet = client->incoming.data + offset;
+        size_t available = client->incoming.length - offset;
+
+        size_t remainingLength = 0;
+        size_t headerLength = 1;
+        bool complete = false;
+        for (unsigned int shift = 0; headerLength < available && headerLength <= 4; shift += 7) {
+            uint8_t digit = packet[headerLength++];
+            remainingLength |= (size_t)(digit & 0x7F) << shift;
+            if ((digit & 0x80) == 0) {
+                complete = true;
+                break;
+            }
+        }
+        if (!complete || available - headerLength < remainingLength) {
+            break;
+        }
+
+        offset += headerLength + remainingLength;
+        if (!HandlePacket(client, packet[0], packet + headerLength, remainingLength)) {
+            break;
+        }
+    }
+
+    if (client->state == ClientState_Failed) {
+        return false;
+    }
+
+    memmove(client->incoming.data, client->incoming.data + offset,
+            client->incoming.length - offset);
+    client->incoming.length -= offset;
+    return true;
+}
+
+static void KeepAlive(IOTHUB_DEVICE_CLIENT_LL_HANDLE client)
+{
+    if (client->keepAliveSeconds <= 0) {
+        return;
+    }
+
+    long keepAliveMs = client->keepAliveSeconds * 1000L;
+    if (client->pingOutstanding) {
+        if (MillisecondsSince(&client->pingSentTime) > keepAliveMs) {
+            Fail(client, IOTHUB_CLIENT_CONNECTION_NO_PING_RESPONSE);
+        }
+        return;
+    }
+
+    if (MillisecondsSince(&client->lastSendTime) >= keepAliveMs / 2) {
+        static const uint8_t pingreq[2] = {Packet_Pingreq << 4, 0};
+        if (ByteBuffer_Append(&client->outgoing, pingreq, sizeof(pingreq))) {
+            client->pingOutstanding = true;
+            clock_gettime(CLOCK_MONOTONIC, &client->pingSentTime);
+        }
+    }
+}
+
+void IoTHubDeviceClient_LL_DoWork(IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE client = iotHubClientHandle;
+    if (client == NULL) {
+        return;
+    }
+
+    if (client->state == ClientState_Idle) {
+        StartConnect(client);
+    }
+    if (client->state == ClientState_Connecting) {
+        CompleteConnect(client);
+    }
+    if (client->state != ClientState_AwaitingConnack && client->state != ClientState_Connected) {
+        return;
+    }
+
+    if (!Flush(client)) {
+        Fail(client, IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR);
+        return;
+    }
+    if (!Receive(client)) {
+        return;
+    }
+    if (client->state == ClientState_Connected) {
+        KeepAlive(client);
+    }
+    // Send what the callbacks queued: acknowledgements, method responses and new requests.
+    if (client->state != ClientState_Failed && !Flush(client)) {
+        Fail(client, IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR);
+    }
+}
+
+/// <summary>
+///     Parses a connection string into the client's host, port and device ID.
+/// </summary>
+static bool ParseConnectionString(IOTHUB_DEVICE_CLIENT_LL_HANDLE client,
+                                  const char *connectionString)
+{
+    for (const char *field = connectionString; *field != '\0';) {
+        size_t fieldLength = strcspn(field, ";");
+        const char *equals = memchr(field, '=', fieldLength);
+        if (equals != NULL) {
+            size_t keyLength = (size_t)(equals - field);
+            const char *value = equals + 1;
+            size_t valueLength = fieldLength - keyLength - 1;
+            if (keyLength == strlen("HostName") && memcmp(field, "HostName", keyLength) == 0) {
+                const char *colon = memchr(value, ':', valueLength);
+                size_t hostLength = colon != NULL ? (size_t)(colon - value) : valueLength;
+                free(client->host);
+                free(client->port);
+                client->host = DuplicateString(value, hostLength);
+                client->port = colon != NULL
+                                   ? DuplicateString(colon + 1, valueLength - hostLength - 1)
+                                   : DuplicateString(DEFAULT_PORT, strlen(DEFAULT_PORT));
+            } else if (keyLength == strlen("DeviceId") &&
+                       memcmp(field, "DeviceId", keyLength) == 0) {
+                free(client->deviceId);
+                client->deviceId = DuplicateString(value, valueLength);
+            }
+        }
+
+        field += fieldLength;
+        if (*field == ';') {
+            ++field;
+        }
+    }
+
+    return client->host != NULL && client->port != NULL && client->deviceId != NULL &&
+           client->host[0] != '\0' && client->deviceId[0] != '\0';
+}
+
+IOTHUB_DEVICE_CLIENT_LL_HANDLE IoTHubDeviceClient_LL_CreateFromConnectionString(
+    const char *connectionString, IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol)
+{
+    if (connectionString == NULL || protocol == NULL) {
+        return NULL;
+    }
+
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE client = calloc(1, sizeof(*client));
+    if (client == NULL) {
+        return NULL;
+    }
+    client->fd = -1;
+    client->keepAliveSeconds = DEFAULT_KEEP_ALIVE_SECONDS;
+
+    if (!ParseConnectionString(client, connectionString)) {
+        IoTHubDeviceClient_LL_Destroy(client);
+        return NULL;
+    }
+    return client;
+}
+
+IOTHUB_DEVICE_CLIENT_LL_HANDLE IoTHubDeviceClient_LL_CreateWithAzureSphereFromDeviceAuth(
+    const char *iothub_uri, IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol)
+{
+    if (iothub_uri == NULL) {
+        return NULL;
+    }
+
+    const char *deviceId = getenv("AZUREIOT_HOST_DEVICE_ID");
+    if (deviceId == NULL) {
+        deviceId = DEFAULT_DEVICE_AUTH_DEVICE_ID;
+    }
+    size_t size = strlen("HostName=;DeviceId=") + strlen(iothub_uri) + strlen(deviceId) + 1;
+    char *connectionString = malloc(size);
+    if (connectionString == NULL) {
+        return NULL;
+    }
+    snprintf(connectionString, size, "HostName=%s;DeviceId=%s", iothub_uri, deviceId);
+
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE client =
+        IoTHubDeviceClient_LL_CreateFromConnectionString(connectionString, protocol);
+    free(connectionString);
+    return client;
+}
+
+void IoTHubDeviceClient_LL_Destroy(IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE client = iotHubClientHandle;
+    if (client == NULL) {
+        return;
+    }
+
+    if (client->state == ClientState_Connected) {
+        static const uint8_t disconnect[2] = {Packet_Disconnect << 4, 0};
+        send(client->fd, disconnect, sizeof(disconnect), MSG_NOSIGNAL | MSG_DONTWAIT);
+    }
+    CloseSocket(client);
+
+    // Detach the lists first, in case a callback sends more.
+    PendingRequest *telemetry = client->telemetry;
+    PendingRequest *reports = client->reports;
+    client->telemetry = client->reports = NULL;
+    FreeRequests(telemetry);
+    FreeRequests(reports);
+
+    ByteBuffer_Free(&client->outgoing);
+    ByteBuffer_Free(&client->incoming);
+    free(client->host);
+    free(client->port);
+    free(client->deviceId);
+    free(client->modelId);
+    free(client);
+}
+
+/// <summary>
+///     Adds a request to a list, sending it at once if the client is connected.
+/// </summary>
+static IOTHUB_CLIENT_RESULT AddRequest(IOTHUB_DEVICE_CLIENT_LL_HANDLE client,
+                                       PendingRequest **list, PendingRequest *request)
+{
+    if (client->state == ClientState_Connected) {
+        if (!QueuePacket(client, &request->packet)) {
+            ByteBuffer_Free(&request->packet);
+            free(request);
+            return IOTHUB_CLIENT_ERROR;
+        }
+        request->sent = true;
+        ByteBuffer_Free(&request->packet);
+    }
+
+    // Append, so that requests made before the client connected are sent in order.
+    while (*list != NULL) {
+        list = &(*list)->next;
+    }
+    *list = request;
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SendEventAsync(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle,
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback,
+    void *userContextCallback)
+{
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE client = iotHubClientHandle;
+    if (client == NULL || eventMessageHandle == NULL) {
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+    if (client->state == ClientState_Failed) {
+        return IOTHUB_CLIENT_ERROR;
+    }
+
+    // devices/{device id}/messages/events/{URL-encoded properties}
+    ByteBuffer topic = {0};
+    bool first = true;
+    bool built = ByteBuffer_Append(&topic, "devices/", strlen("devices/")) &&
+                 ByteBuffer_Append(&topic, client->deviceId, strlen(client->deviceId)) &&
+                 ByteBuffer_Append(&topic, "/messages/events/", strlen("/messages/events/"));
+    if (built && eventMessageHandle->contentType != NULL) {
+        built = AppendTopicProperty(&topic, &first, "$.ct", eventMessageHandle->contentType);
+    }
+    if (built && eventMessageHandle->contentEncoding != NULL) {
+        built = AppendTopicProperty(&topic, &first, "$.ce", eventMessageHandle->contentEncoding);
+    }
+    for (const MessageProperty *property = eventMessageHandle->properties;
+         built && property != NULL; property = property->next) {
+        built = AppendTopicProperty(&topic, &first, property->key, property->value);
+    }
+
+    PendingRequest *message = calloc(1, sizeof(*message));
+    if (message == NULL) {
+        ByteBuffer_Free(&topic);
+        return IOTHUB_CLIENT_ERROR;
+    }
+    message->packetId = NextPacketId(client);
+    message->eventCallback = eventConfirmationCallback;
+    message->context = userContextCallback;
+    built = built && BuildPublish(&message->packet, (const char *)topic.data, topic.length,
+                                  message->packetId, eventMessageHandle->data,
+                                  eventMessageHandle->length);
+    ByteBuffer_Free(&topic);
+    if (!built) {
+        ByteBuffer_Free(&message->packet);
+        free(message);
+        return IOTHUB_CLIENT_ERROR;
+    }
+
+    // The SDK does not call back for messages sent without a callback.
+    if (message->eventCallback == NULL) {
+        IOTHUB_CLIENT_RESULT result = IOTHUB_CLIENT_OK;
+        if (client->state == ClientState_Connected && !QueuePacket(client, &message->packet)) {
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        ByteBuffer_Free(&message->packet);
+        free(message);
+        return result;
+    }
+    return AddRequest(client, &client->telemetry, message);
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SendReportedState(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle, const unsigned char *reportedState,
+    size_t size, IOTHUB_CLIENT_REPORTED_STATE_CALLBACK reportedStateCallback,
+    void *userContextCallback)
+{
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE client = iotHubClientHandle;
+    if (client == NULL || reportedState == NULL || size == 0) {
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+    if (client->state == ClientState_Failed) {
+        return IOTHUB_CLIENT_ERROR;
+    }
+
+    PendingRequest *report = calloc(1, sizeof(*report));
+    if (report == NULL) {
+        return IOTHUB_CLIENT_ERROR;
+    }
+    report->requestId = ++client->nextRequestId;
+    report->reportedStateCallback = reportedStateCallback;
+    report->context = userContextCallback;
+
+    char topic[64];
+    int topicLength = snprintf(topic, sizeof(topic),
+                               "$iothub/twin/PATCH/properties/reported/?$rid=%u", report->requestId);
+    if (!BuildPublish(&report->packet, topic, (size_t)topicLength, 0, reportedState, size)) {
+        ByteBuffer_Free(&report->packet);
+        free(report);
+        return IOTHUB_CLIENT_ERROR;
+    }
+    return AddRequest(client, &client->reports, report);
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetDeviceTwinCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle,
+    IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK deviceTwinCallback, void *userContextCallback)
+{
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE client = iotHubClientHandle;
+    if (client == NULL) {
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+
+    client->twinCallback = deviceTwinCallback;
+    client->twinContext = userContextCallback;
+    if (client->state == ClientState_Connected) {
+        QueueSubscriptions(client);
+    }
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetDeviceMethodCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle,
+    IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC deviceMethodCallback, void *userContextCallback)
+{
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE client = iotHubClientHandle;
+    if (client == NULL) {
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+
+    client->methodCallback = deviceMethodCallback;
+    client->methodContext = userContextCallback;
+    if (client->state == ClientState_Connected) {
+        QueueSubscriptions(client);
+    }
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetConnectionStatusCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle,
+    IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connectionStatusCallback, void *userContextCallback)
+{
+    if (iotHubClientHandle == NULL) {
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+
+    iotHubClientHandle->connectionStatusCallback = connectionStatusCallback;
+    iotHubClientHandle->connectionStatusContext = userContextCallback;
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetOption(IOTHUB_DEVICE_CLIENT_LL_HANDLE iotHubClientHandle,
+                                                     const char *optionName, const void *value)
+{
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE client = iotHubClientHandle;
+    if (client == NULL || optionName == NULL || value == NULL) {
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+
+    if (strcmp(optionName, OPTION_MODEL_ID) == 0) {
+        char *modelId = DuplicateString(value, strlen(value));
+        if (modelId == NULL) {
+            return IOTHUB_CLIENT_ERROR;
+        }
+        free(client->modelId);
+        client->modelId = modelId;
+    } else if (strcmp(optionName, OPTION_KEEP_ALIVE) == 0) {
+        client->keepAliveSeconds = *(const int *)value;
+    }
+    return IOTHUB_CLIENT_OK;
+}
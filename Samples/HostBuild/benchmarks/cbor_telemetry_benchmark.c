@@ -0,0 +1,339 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Compares the size and CPU cost of telemetry messages encoded as JSON with parson, as
+// Cloud_SendTelemetry does, and as CBOR with CborEncoder, as Cloud_SendTelemetryBinary does, for
+// the sample's temperature reading and for a richer reading of seven values. It checks that every
+// CBOR message decodes to exactly the values which were encoded.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cbor_encoder.h"
+#include "json_arena.h"
+#include "parson.h"
+
+// As in cloud.c.
+#define JSON_ARENA_SIZE 2048
+#define MESSAGE_BUFFER_SIZE 1024
+#define CBOR_MESSAGE_BUFFER_SIZE 64
+#define TEMPERATURE_DECIMALS 2
+
+#define READING_COUNT 1024
+#define TIMED_MESSAGES 2000000
+#define RICH_CBOR_BUFFER_SIZE 128
+
+typedef struct {
+    float temperature;
+    float humidity;
+    int64_t pressure;
+    int64_t sequence;
+    bool doorOpen;
+    int64_t acceleration[4];
+} Reading;
+
+static Reading readings[READING_COUNT];
+static unsigned char arenaBuffer[JSON_ARENA_SIZE];
+static JsonArena arena;
+static char messageBuffer[MESSAGE_BUFFER_SIZE];
+static uint8_t cborBuffer[RICH_CBOR_BUFFER_SIZE];
+
+static size_t EncodeJson(const Reading *reading)
+{
+    JsonArena_Begin(&arena);
+    JSON_Value *value = json_value_init_object();
+    json_object_dotset_number_fixed(json_value_get_object(value), "temperature",
+                                    reading->temperature, TEMPERATURE_DECIMALS);
+    size_t length = 0;
+    json_serialize_to_buffer_n(value, messageBuffer, sizeof(messageBuffer), &length);
+    json_value_free(value);
+    JsonArena_End(&arena);
+    return length;
+}
+
+static size_t EncodeCbor(const Reading *reading)
+{
+    CborEncoder encoder;
+    CborEncoder_Init(&encoder, cborBuffer, CBOR_MESSAGE_BUFFER_SIZE);
+    CborEncoder_StartMap(&encoder, 1);
+    CborEncoder_String(&encoder, "temperature");
+    CborEncoder_Float(&encoder, reading->temperature);
+    return CborEncoder_Finish(&encoder);
+}
+
+static size_t EncodeRichJson(const Reading *reading)
+{
+    JsonArena_Begin(&arena);
+    JSON_Value *value = json_value_init_object();
+    JSON_Object *object = json_value_get_object(value);
+    json_object_dotset_number_fixed(object, "temperature", reading->temperature,
+                                    TEMPERATURE_DECIMALS);
+    json_object_dotset_number_fixed(object, "humidity", reading->humidity, TEMPERATURE_DECIMALS);
+    json_object_dotset_number(object, "pressure", (double)reading->pressure);
+    json_object_dotset_number(object, "sequence", (double)reading->sequence);
+    json_object_dotset_boolean(object, "doorOpen", reading->doorOpen);
+    json_object_dotset_string(object, "status", "ok");
+    JSON_Value *acceleration = json_value_init_array();
+    for (size_t i = 0; i < 4; i++) {
+        json_array_append_number(json_value_get_array(acceleration),
+                                 (double)reading->acceleration[i]);
+    }
+    json_object_set_value(object, "acceleration", acceleration);
+    size_t length = 0;
+    json_serialize_to_buffer_n(value, messageBuffer, sizeof(messageBuffer), &length);
+    json_value_free(value);
+    JsonArena_End(&arena);
+    return length;
+}
+
+static size_t EncodeRichCbor(const Reading *reading)
+{
+    CborEncoder encoder;
+    CborEncoder_Init(&encoder, cborBuffer, sizeof(cborBuffer));
+    CborEncoder_StartMap(&encoder, 7);
+    CborEncoder_String(&encoder, "temperature");
+    CborEncoder_Float(&encoder, reading->temperature);
+    CborEncoder_String(&encoder, "humidity");
+    CborEncoder_Float(&encoder, reading->humidity);
+    CborEncoder_String(&encoder, "pressure");
+    CborEncoder_Int(&encoder, reading->pressure);
+    CborEncoder_String(&encoder, "sequence");
+    CborEncoder_Int(&encoder, reading->sequence);
+    CborEncoder_String(&encoder, "doorOpen");
+    CborEncoder_Bool(&encoder, reading->doorOpen);
+    CborEncoder_String(&encoder, "status");
+    CborEncoder_String(&encoder, "ok");
+    CborEncoder_String(&encoder, "acceleration");
+    CborEncoder_StartArray(&encoder, 4);
+    for (size_t i = 0; i < 4; i++) {
+        CborEncoder_Int(&encoder, reading->acceleration[i]);
+    }
+    return CborEncoder_Finish(&encoder);
+}
+
+/// <summary>
+///     Builds the JSON value which a reading's CBOR should decode to, with every number exact.
+/// </summary>
+static JSON_Value *ExpectedValue(const Reading *reading, bool rich)
+{
+    JSON_Value *value = json_value_init_object();
+    JSON_Object *object = json_value_get_object(value);
+    json_object_set_number(object, "temperature", reading->temperature);
+    if (rich) {
+        json_object_set_number(object, "humidity", reading->humidity);
+        json_object_set_number(object, "pressure", (double)reading->pressure);
+        json_object_set_number(object, "sequence", (double)reading->sequence);
+        json_object_set_boolean(object, "doorOpen", reading->doorOpen);
+        json_object_set_string(object, "status", "ok");
+        JSON_Value *acceleration = json_value_init_array();
+        for (size_t i = 0; i < 4; i++) {
+            json_array_append_number(json_value_get_array(acceleration),
+                                     (double)reading->acceleration[i]);
+        }
+        json_object_set_value(object, "acceleration", acceleration);
+    }
+    return value;
+}
+
+/// <summary>
+///     Reads the argument of a CBOR data item's initial byte.
+/// </summary>
+static bool DecodeArgument(const uint8_t **cbor, const uint8_t *end, uint64_t *argument)
+{
+    uint8_t additional = **cbor & 0x1F;
+    ++*cbor;
+    if (additional < 24) {
+        *argument = additional;
+        return true;
+    }
+    if (additional > 27) {
+        return false;
+    }
+    size_t size = (size_t)1 << (additional - 24);
+    if ((size_t)(end - *cbor) < size) {
+        return false;
+    }
+    *argument = 0;
+    for (size_t i = 0; i < size; i++) {
+        *argument = (*argument << 8) | (*cbor)[i];
+    }
+    *cbor += size;
+    return true;
+}
+
+static double DecodeHalf(uint16_t half)
+{
+    int exponent = (half >> 10) & 0x1F;
+    double mantissa = half & 0x3FF;
+    double magnitude = exponent == 0    ? mantissa * 0x1p-24
+                       : exponent == 31 ? (mantissa == 0 ? 1.0 / 0.0 : 0.0 / 0.0)
+                                        : (mantissa + 1024) * (double)(1u << exponent) * 0x1p-25;
+    return (half & 0x8000) != 0 ? -magnitude : magnitude;
+}
+
+/// <summary>
+///     Decodes the subset of CBOR which the messages use into a JSON value, or returns NULL if it
+///     is malformed.
+/// </summary>
+static JSON_Value *DecodeCbor(const uint8_t **cbor, const uint8_t *end)
+{
+    if (*cbor >= end) {
+        return NULL;
+    }
+    uint8_t majorType = **cbor >> 5;
+    uint8_t additional = **cbor & 0x1F;
+    uint64_t argument;
+    if (!DecodeArgument(cbor, end, &argument)) {
+        return NULL;
+    }
+    switch (majorType) {
+    case 0:
+        return json_value_init_number((double)argument);
+    case 1:
+        return json_value_init_number(-1.0 - (double)argument);
+    case 3: {
+        if ((uint64_t)(end - *cbor) < argument || argument > 255) {
+            return NULL;
+        }
+        char string[256];
+        memcpy(string, *cbor, (size_t)argument);
+        string[argument] = '\0';
+        *cbor += argument;
+        return json_value_init_string(string);
+    }
+    case 4: {
+        JSON_Value *array = json_value_init_array();
+        for (uint64_t i = 0; i < argument; i++) {
+            JSON_Value *element = DecodeCbor(cbor, end);
+            if (element == NULL) {
+                json_value_free(array);
+                return NULL;
+            }
+            json_array_append_value(json_value_get_array(array), element);
+        }
+        return array;
+    }
+    case 5: {
+        JSON_Value *map = json_value_init_object();
+        for (uint64_t i = 0; i < argument; i++) {
+            JSON_Value *key = DecodeCbor(cbor, end);
+            JSON_Value *member = key != NULL ? DecodeCbor(cbor, end) : NULL;
+            if (member == NULL || json_value_get_type(key) != JSONString) {
+                json_value_free(key);
+                json_value_free(member);
+                json_value_free(map);
+                return NULL;
+            }
+            json_object_set_value(json_value_get_object(map), json_value_get_string(key), member);
+            json_value_free(key);
+        }
+        return map;
+    }
+    case 7:
+        if (additional == 20 || additional == 21) {
+            return json_value_init_boolean(additional == 21);
+        }
+        if (additional == 22) {
+            return json_value_init_null();
+        }
+        if (additional == 25) {
+            return json_value_init_number(DecodeHalf((uint16_t)argument));
+        }
+        if (additional == 26) {
+            uint32_t bits = (uint32_t)argument;
+            float single;
+            memcpy(&single, &bits, sizeof(single));
+            return json_value_init_number(single);
+        }
+        if (additional == 27) {
+            double number;
+            memcpy(&number, &argument, sizeof(number));
+            return json_value_init_number(number);
+        }
+        return NULL;
+    default:
+        return NULL;
+    }
+}
+
+/// <summary>
+///     Returns false unless a reading's CBOR decodes to exactly the values which were encoded.
+/// </summary>
+static bool CheckCbor(const Reading *reading, bool rich)
+{
+    size_t length = rich ? EncodeRichCbor(reading) : EncodeCbor(reading);
+    const uint8_t *cbor = cborBuffer;
+    JSON_Value *decoded = length > 0 ? DecodeCbor(&cbor, cborBuffer + length) : NULL;
+    JSON_Value *expected = ExpectedValue(reading, rich);
+    bool ok =
+        decoded != NULL && cbor == cborBuffer + length && json_value_equals(decoded, expected);
+    if (!ok) {
+        printf("The %sCBOR for a temperature of %.9g does not decode to the values encoded\n",
+               rich ? "rich " : "", (double)reading->temperature);
+    }
+    json_value_free(decoded);
+    json_value_free(expected);
+    return ok;
+}
+
+static double ElapsedNanoseconds(const struct timespec *start, const struct timespec *end)
+{
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 + (double)(end->tv_nsec - start->tv_nsec);
+}
+
+/// <summary>
+///     Prints the mean bytes and nanoseconds per message of an encoding.
+/// </summary>
+static void MeasureEncoding(const char *label, size_t (*encode)(const Reading *))
+{
+    size_t bytes = 0;
+    for (size_t i = 0; i < READING_COUNT; i++) {
+        bytes += encode(&readings[i]);
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < TIMED_MESSAGES; i++) {
+        encode(&readings[i % READING_COUNT]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("%-30s %10.1f %12.1f\n", label, (double)bytes / READING_COUNT,
+           ElapsedNanoseconds(&start, &end) / TIMED_MESSAGES);
+}
+
+int main(void)
+{
+    // The sample's simulated temperature: a float random walk around 50.
+    float temperature = 50.f;
+    srand(1);
+    for (size_t i = 0; i < READING_COUNT; i++) {
+        temperature += ((float)(rand() % 41)) / 20.0f - 1.0f;
+        readings[i] = (Reading){.temperature = temperature,
+                                .humidity = temperature * 0.8f,
+                                .pressure = 101325 + rand() % 1000,
+                                .sequence = (int64_t)i * 1000,
+                                .doorOpen = i % 7 == 0,
+                                .acceleration = {rand() % 2000 - 1000, rand() % 2000 - 1000,
+                                                 rand() % 2000 - 1000, -70000}};
+    }
+    JsonArena_Init(&arena, arenaBuffer, sizeof(arenaBuffer));
+
+    bool ok = true;
+    for (size_t i = 0; i < READING_COUNT; i++) {
+        ok = CheckCbor(&readings[i], false) && ok;
+        ok = CheckCbor(&readings[i], true) && ok;
+    }
+    printf("%d CBOR messages %s\n\n", 2 * READING_COUNT,
+           ok ? "decode to the values encoded" : "FAILED");
+
+    printf("%-30s %10s %12s\n", "", "bytes", "ns/message");
+    MeasureEncoding("temperature, JSON", EncodeJson);
+    MeasureEncoding("temperature, CBOR", EncodeCbor);
+    MeasureEncoding("rich reading, JSON", EncodeRichJson);
+    MeasureEncoding("rich reading, CBOR", EncodeRichCbor);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
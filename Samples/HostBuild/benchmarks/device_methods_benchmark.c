@@ -0,0 +1,179 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Invokes 50 registered direct methods at a high rate through DeviceMethods_Dispatch, with
+// payloads of up to 900 bytes, and compares the time per call with the chain of strcmp calls,
+// fixed 512 byte payload copy and malloc per response which cloud.c used before. It reports the
+// heap in use before and after the burst, and the dispatch time with 1, 20 and 400 registered
+// methods. It checks that every invocation reached the right handler with its whole payload.
+
+#include <malloc.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "device_methods.h"
+
+#define METHOD_COUNT 50
+#define METHOD_NAME_SIZE 48
+#define TIMED_CALLS 5000000
+#define PAYLOAD_SIZE 2048
+#define RESPONSE_SIZE 64
+
+static char methodNames[METHOD_COUNT][METHOD_NAME_SIZE];
+static unsigned long invocations[METHOD_COUNT];
+static bool payloadsIntact = true;
+
+/// <summary>
+///     Handler for every method; the context is the method's index. It checks the payload, and
+///     builds its response in the module's response buffer.
+/// </summary>
+static int MethodHandler(const unsigned char *payload, size_t payloadSize, const char **response,
+                         size_t *responseSize, void *context)
+{
+    size_t index = (size_t)context;
+    ++invocations[index];
+    const char *copy = DeviceMethods_CopyPayload(payload, payloadSize);
+    if (copy == NULL || copy[payloadSize] != '\0' || memcmp(copy, payload, payloadSize) != 0) {
+        payloadsIntact = false;
+    }
+    char *buffer = DeviceMethods_GetResponseBuffer(RESPONSE_SIZE);
+    *responseSize = (size_t)snprintf(buffer, RESPONSE_SIZE, "{\"method\":%zu,\"bytes\":%zu}",
+                                     index, payloadSize);
+    *response = buffer;
+    return 200;
+}
+
+/// <summary>
+///     Dispatches a method as cloud.c did before: by comparing the name with each method's in
+///     turn, copying the payload into a fixed buffer, and allocating the response.
+/// </summary>
+static int DispatchWithStrcmpChain(const char *methodName, const unsigned char *payload,
+                                   size_t payloadSize, unsigned char **response,
+                                   size_t *responseSize)
+{
+    static char payloadCopy[512 + 1];
+    char buffer[RESPONSE_SIZE];
+    const char *responseString = "{}";
+    size_t length = 2;
+    int result = -1;
+
+    for (size_t i = 0; i < METHOD_COUNT; i++) {
+        if (strcmp(methodNames[i], methodName) == 0) {
+            size_t copied =
+                payloadSize < sizeof(payloadCopy) ? payloadSize : sizeof(payloadCopy) - 1;
+            memcpy(payloadCopy, payload, copied);
+            payloadCopy[copied] = '\0';
+            ++invocations[i];
+            length = (size_t)snprintf(buffer, sizeof(buffer), "{\"method\":%zu,\"bytes\":%zu}", i,
+                                      payloadSize);
+            responseString = buffer;
+            result = 200;
+            break;
+        }
+    }
+    *response = malloc(length);
+    memcpy(*response, responseString, length);
+    *responseSize = length;
+    return result;
+}
+
+static double ElapsedNanoseconds(const struct timespec *start, const struct timespec *end)
+{
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 + (double)(end->tv_nsec - start->tv_nsec);
+}
+
+/// <summary>
+///     Returns the nanoseconds per call to dispatch one method repeatedly, with the given number
+///     of methods registered.
+/// </summary>
+static double TimeDispatchWithMethods(size_t methodCount, const unsigned char *payload)
+{
+    char name[METHOD_NAME_SIZE];
+    for (size_t i = 0; i < methodCount; i++) {
+        snprintf(name, sizeof(name), "m%03zuSetThreshold", i);
+        DeviceMethods_Register(name, MethodHandler, (void *)(i % METHOD_COUNT));
+    }
+    unsigned char *response;
+    size_t responseSize;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < TIMED_CALLS; i++) {
+        DeviceMethods_Dispatch("m000SetThreshold", payload, 8, &response, &responseSize);
+        free(response);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    DeviceMethods_Cleanup();
+    return ElapsedNanoseconds(&start, &end) / TIMED_CALLS;
+}
+
+int main(void)
+{
+    static unsigned char payload[PAYLOAD_SIZE];
+    memset(payload, 'x', sizeof(payload));
+    unsigned char *response;
+    size_t responseSize;
+    bool ok = true;
+
+    for (size_t i = 0; i < METHOD_COUNT; i++) {
+        snprintf(methodNames[i], METHOD_NAME_SIZE, "method%02zuSetThreshold", i);
+        ok = DeviceMethods_Register(methodNames[i], MethodHandler, (void *)i) && ok;
+    }
+
+    // A payload longer than the 512 bytes cloud.c used to copy, and an unknown method.
+    int status = DeviceMethods_Dispatch(methodNames[7], payload, 2000, &response, &responseSize);
+    ok = ok && status == 200 && responseSize == strlen("{\"method\":7,\"bytes\":2000}") &&
+         memcmp(response, "{\"method\":7,\"bytes\":2000}", responseSize) == 0;
+    free(response);
+    status = DeviceMethods_Dispatch("unknownMethod", payload, 0, &response, &responseSize);
+    ok = ok && status == -1;
+    free(response);
+    memset(invocations, 0, sizeof(invocations));
+
+    struct mallinfo2 heapBefore = mallinfo2();
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < TIMED_CALLS; i++) {
+        DeviceMethods_Dispatch(methodNames[(i * 7) % METHOD_COUNT], payload,
+                               (size_t)(i % 4) * 300, &response, &responseSize);
+        free(response);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    struct mallinfo2 heapAfter = mallinfo2();
+    double registryNs = ElapsedNanoseconds(&start, &end) / TIMED_CALLS;
+
+    for (size_t i = 0; i < METHOD_COUNT; i++) {
+        ok = ok && invocations[i] == TIMED_CALLS / METHOD_COUNT;
+    }
+    ok = ok && payloadsIntact;
+    DeviceMethods_Stats stats;
+    DeviceMethods_GetStats(&stats);
+    DeviceMethods_Cleanup();
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < TIMED_CALLS; i++) {
+        DispatchWithStrcmpChain(methodNames[(i * 7) % METHOD_COUNT], payload,
+                                (size_t)(i % 4) * 300, &response, &responseSize);
+        free(response);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double chainNs = ElapsedNanoseconds(&start, &end) / TIMED_CALLS;
+
+    printf("Invocations %s\n\n", ok ? "reached the right handlers" : "FAILED");
+    printf("%d invocations of %d methods     %12s\n", TIMED_CALLS, METHOD_COUNT, "ns/call");
+    printf("%-36s %12.1f\n", "DeviceMethods_Dispatch", registryNs);
+    printf("%-36s %12.1f\n", "strcmp chain, as before", chainNs);
+    printf("Heap in use before the burst %zu bytes, after %zu bytes; the buffers grew %lu times, "
+           "to %zu and %zu bytes\n\n",
+           heapBefore.uordblks, heapAfter.uordblks, stats.bufferGrowths, stats.payloadBufferSize,
+           stats.responseBufferSize);
+
+    printf("%-36s %12s\n", "registered methods", "ns/call");
+    for (size_t methodCount = 1; methodCount <= 400; methodCount *= 20) {
+        printf("%-36zu %12.1f\n", methodCount, TimeDispatchWithMethods(methodCount, payload));
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,178 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Runs 10, 100 and 1000 periodic EventLoopTimers, with periods of 10 to 100 ms, first without slack
+// and then with slack of a quarter of each period, and reports for each run the file descriptors
+// open, event loop wakeups and timer expirations per second, the dispatch latency, and the CPU
+// time per expiration.
+//
+// eventloop_timer_benchmark is built with EVENTLOOP_TIMER_SHARED_TIMERFD, as the Azure IoT sample
+// is; eventloop_timer_benchmark_per_timerfd is built without it, where each timer has its own
+// timerfd and slack has no effect.
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <applibs/eventloop.h>
+
+#include "eventloop_timer_utilities.h"
+
+#define MAX_TIMERS 1000
+
+static const unsigned int TimerCounts[] = {10, 100, 1000};
+static const long NanosecondsPerMillisecond = 1000 * 1000;
+
+static EventLoopTimer *timers[MAX_TIMERS];
+
+static void TimerEventHandler(EventLoopTimer *timer)
+{
+    ConsumeEventLoopTimerEvent(timer);
+}
+
+static unsigned int CountOpenFileDescriptors(void)
+{
+    unsigned int count = 0;
+    DIR *directory = opendir("/proc/self/fd");
+    if (directory == NULL) {
+        return 0;
+    }
+    while (readdir(directory) != NULL) {
+        ++count;
+    }
+    closedir(directory);
+    // Exclude ".", ".." and the directory's own descriptor.
+    return count > 3 ? count - 3 : 0;
+}
+
+static double ElapsedSeconds(clockid_t clock, const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/// <summary>
+///     Returns the upper bound, in microseconds, of the latency histogram bucket which holds the
+///     given fraction of all dispatches.
+/// </summary>
+static unsigned long LatencyPercentileMicroseconds(const uint64_t *histogram, uint64_t total,
+                                                   double fraction)
+{
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < EVENTLOOP_TIMER_LATENCY_BUCKETS; ++bucket) {
+        seen += histogram[bucket];
+        if ((double)seen >= fraction * (double)total) {
+            return 1UL << bucket;
+        }
+    }
+    return 1UL << (EVENTLOOP_TIMER_LATENCY_BUCKETS - 1);
+}
+
+static bool Run(unsigned int timerCount, bool withSlack, double durationSeconds)
+{
+    EventLoop *eventLoop = EventLoop_Create();
+    if (eventLoop == NULL) {
+        fprintf(stderr, "Could not create the event loop.\n");
+        return false;
+    }
+
+    unsigned int created = 0;
+    for (; created < timerCount; ++created) {
+        long periodMs = 10 + (long)(created * 37 % 91);
+        struct timespec period = {.tv_sec = 0, .tv_nsec = periodMs * NanosecondsPerMillisecond};
+        struct timespec slack = {.tv_sec = 0, .tv_nsec = period.tv_nsec / 4};
+        timers[created] = CreateEventLoopPeriodicTimerWithSlack(
+            eventLoop, &TimerEventHandler, &period, withSlack ? &slack : NULL);
+        if (timers[created] == NULL) {
+            break;
+        }
+    }
+
+    bool ok = created == timerCount;
+    if (!ok) {
+        printf("%6u %-5s could not create more than %u timers\n", timerCount,
+               withSlack ? "yes" : "no", created);
+    } else {
+        unsigned int fileDescriptors = CountOpenFileDescriptors();
+        EventLoopTimerWakeupStats startStats;
+        GetEventLoopTimerWakeupStats(&startStats);
+
+        struct timespec startTime;
+        struct timespec startCpuTime;
+        clock_gettime(CLOCK_MONOTONIC, &startTime);
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &startCpuTime);
+        while (ElapsedSeconds(CLOCK_MONOTONIC, &startTime) < durationSeconds) {
+            EventLoop_Run(eventLoop, 100, true);
+        }
+        double seconds = ElapsedSeconds(CLOCK_MONOTONIC, &startTime);
+        double cpuSeconds = ElapsedSeconds(CLOCK_PROCESS_CPUTIME_ID, &startCpuTime);
+
+        EventLoopTimerWakeupStats endStats;
+        GetEventLoopTimerWakeupStats(&endStats);
+        uint64_t wakeups = endStats.wakeups - startStats.wakeups;
+        uint64_t expirations = endStats.expirations - startStats.expirations;
+
+        uint64_t histogram[EVENTLOOP_TIMER_LATENCY_BUCKETS] = {0};
+        uint64_t dispatches = 0;
+        uint64_t missed = 0;
+        uint64_t maxLatencyNs = 0;
+        for (unsigned int i = 0; i < timerCount; ++i) {
+            EventLoopTimerStats stats;
+            GetEventLoopTimerStats(timers[i], &stats);
+            for (size_t bucket = 0; bucket < EVENTLOOP_TIMER_LATENCY_BUCKETS; ++bucket) {
+                histogram[bucket] += stats.latencyHistogram[bucket];
+                dispatches += stats.latencyHistogram[bucket];
+            }
+            missed += stats.missedExpirations;
+            if (stats.maxLatencyNs > maxLatencyNs) {
+                maxLatencyNs = stats.maxLatencyNs;
+            }
+        }
+
+        unsigned long maxLatencyUs = (unsigned long)(maxLatencyNs / 1000);
+        unsigned long p50Us = LatencyPercentileMicroseconds(histogram, dispatches, 0.5);
+        unsigned long p99Us = LatencyPercentileMicroseconds(histogram, dispatches, 0.99);
+        printf("%6u %-5s %5u %10.0f %10.0f %8llu %8lu %8lu %8lu %8.2f\n", timerCount,
+               withSlack ? "yes" : "no", fileDescriptors, (double)wakeups / seconds,
+               (double)expirations / seconds, (unsigned long long)missed,
+               p50Us < maxLatencyUs ? p50Us : maxLatencyUs,
+               p99Us < maxLatencyUs ? p99Us : maxLatencyUs, maxLatencyUs,
+               expirations > 0 ? cpuSeconds * 1e6 / (double)expirations : 0);
+    }
+
+    for (unsigned int i = 0; i < created; ++i) {
+        DisposeEventLoopTimer(timers[i]);
+    }
+    EventLoop_Close(eventLoop);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    double durationSeconds = argc > 1 ? atof(argv[1]) : 2;
+    if (durationSeconds <= 0) {
+        fprintf(stderr, "Usage: %s [seconds per run]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+#if defined(EVENTLOOP_TIMER_SHARED_TIMERFD)
+    printf("Timers share one timerfd.\n");
+#else
+    printf("Each timer has its own timerfd.\n");
+#endif
+    // Latency percentiles are the upper bounds of the statistics' power-of-two buckets, limited to
+    // the maximum.
+    printf("%6s %-5s %5s %10s %10s %8s %8s %8s %8s %8s\n", "timers", "slack", "fds", "wakeups/s",
+           "expiries/s", "missed", "p50_us", "p99_us", "max_us", "cpu_us");
+
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(TimerCounts) / sizeof(TimerCounts[0]); ++i) {
+        for (int withSlack = 0; withSlack < 2; ++withSlack) {
+            ok = Run(TimerCounts[i], withSlack, durationSeconds) && ok;
+        }
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,184 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Builds, serializes and frees the JSON messages which cloud.c sends, as cloud.c does, with parson
+// allocating on the heap and then in a JsonArena. It counts the heap allocations per message and
+// the peak heap in use, and times each message. It checks that both ways produce the same
+// messages, and that the arena needs no heap at all.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "json_arena.h"
+#include "parson.h"
+
+// As in cloud.c.
+#define JSON_ARENA_SIZE 2048
+#define MESSAGE_BUFFER_SIZE 1024
+#define TEMPERATURE_DECIMALS 2
+
+#define TIMED_ROUNDS 100000
+
+typedef enum {
+    Message_Telemetry,
+    Message_ThermometerMoved,
+    Message_UploadEnabledChanged,
+    Message_DeviceDetails,
+    Message_Count
+} Message;
+
+static const char *MessageNames[Message_Count] = {"telemetry", "thermometer moved",
+                                                  "upload enabled report", "device details"};
+
+static char messageBuffer[MESSAGE_BUFFER_SIZE];
+
+// Heap use by parson, when it allocates with CountingMalloc and CountingFree.
+static size_t heapAllocations = 0;
+static size_t heapInUse = 0;
+static size_t heapPeak = 0;
+
+typedef union {
+    size_t size;
+    max_align_t align;
+} AllocationHeader;
+
+static void *CountingMalloc(size_t size)
+{
+    AllocationHeader *header = malloc(sizeof(AllocationHeader) + size);
+    if (header == NULL) {
+        return NULL;
+    }
+    header->size = size;
+    ++heapAllocations;
+    heapInUse += size;
+    if (heapInUse > heapPeak) {
+        heapPeak = heapInUse;
+    }
+    return header + 1;
+}
+
+static void CountingFree(void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    AllocationHeader *header = (AllocationHeader *)ptr - 1;
+    heapInUse -= header->size;
+    free(header);
+}
+
+/// <summary>
+///     Builds one of cloud.c's messages, serializes it as SerializeOutgoingMessage does, and frees
+///     it; returns the length of the message in messageBuffer.
+/// </summary>
+static size_t BuildMessage(Message message, float temperature)
+{
+    JSON_Value *value = json_value_init_object();
+    JSON_Object *root = json_value_get_object(value);
+    switch (message) {
+    case Message_Telemetry:
+        json_object_dotset_number_fixed(root, "temperature", temperature, TEMPERATURE_DECIMALS);
+        break;
+    case Message_ThermometerMoved:
+        json_object_dotset_boolean(root, "thermometerMoved", 1);
+        break;
+    case Message_UploadEnabledChanged:
+        json_object_dotset_boolean(root, "thermometerTelemetryUploadEnabled.value", 1);
+        json_object_dotset_number(root, "thermometerTelemetryUploadEnabled.ac", 200);
+        json_object_dotset_number(root, "thermometerTelemetryUploadEnabled.av", 3);
+        json_object_dotset_string(root, "thermometerTelemetryUploadEnabled.ad",
+                                  "Updated from Device Twin's desired value.");
+        break;
+    default:
+        json_object_dotset_string(root, "serialNumber", "TEMPMON-01234");
+        break;
+    }
+
+    size_t length = 0;
+    char *allocatedMessage = NULL;
+    if (json_serialize_to_buffer_n(value, messageBuffer, sizeof(messageBuffer), &length) !=
+        JSONSuccess) {
+        allocatedMessage = json_serialize_to_string(value);
+    }
+    json_free_serialized_string(allocatedMessage);
+    json_value_free(value);
+    return length;
+}
+
+static double ElapsedNanoseconds(const struct timespec *start, const struct timespec *end)
+{
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 + (double)(end->tv_nsec - start->tv_nsec);
+}
+
+/// <summary>
+///     Returns the nanoseconds to build a message, on the heap or in the given arena.
+/// </summary>
+static double TimeMessage(Message message, JsonArena *arena)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < TIMED_ROUNDS; i++) {
+        if (arena != NULL) {
+            JsonArena_Begin(arena);
+        }
+        BuildMessage(message, 50.f + (float)(i % 100) / 20.f);
+        if (arena != NULL) {
+            JsonArena_End(arena);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return ElapsedNanoseconds(&start, &end) / TIMED_ROUNDS;
+}
+
+int main(void)
+{
+    static unsigned char arenaBuffer[JSON_ARENA_SIZE];
+    JsonArena arena;
+    char heapMessage[MESSAGE_BUFFER_SIZE];
+    bool ok = true;
+
+    printf("%-22s %25s %25s %18s\n", "", "on the heap", "in the arena", "ns/message");
+    printf("%-22s %12s %12s %12s %12s %8s %9s\n", "message", "allocations", "peak bytes",
+           "heap allocs", "arena bytes", "heap", "arena");
+    for (Message message = 0; message < Message_Count; message++) {
+        json_set_allocation_functions(CountingMalloc, CountingFree);
+        heapAllocations = heapPeak = 0;
+        size_t length = BuildMessage(message, 50.35f);
+        memcpy(heapMessage, messageBuffer, length + 1);
+        size_t allocations = heapAllocations, peak = heapPeak;
+        json_set_allocation_functions(malloc, free);
+        if (heapInUse != 0) {
+            printf("%s leaked %zu bytes on the heap\n", MessageNames[message], heapInUse);
+            ok = false;
+        }
+
+        // Allocations which do not fit in the arena fall back to the heap, and are counted there.
+        JsonArena_Init(&arena, arenaBuffer, sizeof(arenaBuffer));
+        JsonArena_Begin(&arena);
+        BuildMessage(message, 50.35f);
+        JsonArena_End(&arena);
+        if (strcmp(heapMessage, messageBuffer) != 0) {
+            printf("%s differs in the arena: %s and %s\n", MessageNames[message], heapMessage,
+                   messageBuffer);
+            ok = false;
+        }
+        if (arena.fallbackCount != 0) {
+            printf("%s fell back to the heap %zu times\n", MessageNames[message],
+                   arena.fallbackCount);
+            ok = false;
+        }
+
+        size_t fallbacks = arena.fallbackCount, arenaPeak = arena.peakUsed;
+        double heapNs = TimeMessage(message, NULL);
+        double arenaNs = TimeMessage(message, &arena);
+        printf("%-22s %12zu %12zu %12zu %12zu %8.0f %9.0f\n", MessageNames[message], allocations,
+               peak, fallbacks, arenaPeak, heapNs, arenaNs);
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
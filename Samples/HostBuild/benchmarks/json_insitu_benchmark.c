@@ -0,0 +1,170 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Compares json_parse_string_insitu with json_parse_string on a complete Device Twin: the
+// allocations per parse and the time per parse, the in-situ time including the copy of the
+// payload it needs as a writable buffer. It first checks that both parse a set of documents to
+// the same values, including escapes and invalid documents, and that a DOM parsed in situ can be
+// modified and copied.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "parson.h"
+
+#define TIMED_PARSES 100000
+#define LARGE_OBJECT_MEMBERS 300
+
+static const char Twin[] =
+    "{\"desired\":{\"thermometerTelemetryUploadEnabled\":true,\"NextFlavor\":{\"Name\":\"Lime "
+    "\\u00e9\",\"Color\":\"green\"},\"list\":[\"a\",\"b\\n\",{\"k\":\"v\"}],\"$metadata\":{\"$"
+    "lastUpdated\":\"2023-01-01T00:00:00.0000000Z\",\"$lastUpdatedVersion\":12,"
+    "\"thermometerTelemetryUploadEnabled\":{\"$lastUpdated\":\"2023-01-01T00:00:00.0000000Z\",\"$"
+    "lastUpdatedVersion\":12}},\"$version\":12},\"reported\":{\"serialNumber\":\"TEMPMON-01335\","
+    "\"thermometerTelemetryUploadEnabled\":{\"value\":true,\"ac\":200,\"av\":12,\"ad\":\"Updated "
+    "from Device Twin's desired value.\"},\"$metadata\":{\"$lastUpdated\":\"2023-01-01T00:00:00."
+    "0000000Z\"},\"$version\":40}}";
+
+static size_t allocations = 0;
+
+static void *CountingMalloc(size_t size)
+{
+    ++allocations;
+    return malloc(size);
+}
+
+static double ElapsedNanoseconds(const struct timespec *start, const struct timespec *end)
+{
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 + (double)(end->tv_nsec - start->tv_nsec);
+}
+
+/// <summary>
+///     Parses a document both ways and returns false if the results serialize differently. A DOM
+///     which is an object is then modified, copied and cleared, so that names and strings which
+///     point into the buffer are replaced and freed alongside ones which were allocated.
+/// </summary>
+static bool CheckDocument(const char *document)
+{
+    char *buffer = strdup(document);
+    JSON_Value *copied = json_parse_string(document);
+    JSON_Value *insitu = json_parse_string_insitu(buffer);
+    char *copiedText = copied != NULL ? json_serialize_to_string(copied) : NULL;
+    char *insituText = insitu != NULL ? json_serialize_to_string(insitu) : NULL;
+    bool ok = (copiedText == NULL) == (insituText == NULL) &&
+              (copiedText == NULL || strcmp(copiedText, insituText) == 0);
+    if (!ok) {
+        printf("%s\nparses to %s, and in situ to %s\n", document,
+               copiedText != NULL ? copiedText : "nothing",
+               insituText != NULL ? insituText : "nothing");
+    }
+
+    JSON_Object *object = json_value_get_object(insitu);
+    if (object != NULL) {
+        json_object_set_string(object, "added", "value");
+        json_object_set_number(object, "desired", 5);
+        json_object_remove(object, "reported");
+        json_value_free(json_value_deep_copy(insitu));
+        json_object_clear(object);
+    }
+
+    json_free_serialized_string(copiedText);
+    json_free_serialized_string(insituText);
+    json_value_free(copied);
+    json_value_free(insitu);
+    free(buffer);
+    return ok;
+}
+
+/// <summary>
+///     Parses a large object in situ, so that it gets a hash index over names in the buffer, and
+///     checks lookups after removing half of its members.
+/// </summary>
+static bool CheckLargeObject(void)
+{
+    char *buffer = malloc(LARGE_OBJECT_MEMBERS * 32);
+    char name[32], expected[32];
+    size_t length = (size_t)sprintf(buffer, "{");
+    for (int i = 0; i < LARGE_OBJECT_MEMBERS; i++) {
+        length += (size_t)sprintf(buffer + length, "%s\"key%d\":\"v%d\"", i > 0 ? "," : "", i, i);
+    }
+    strcpy(buffer + length, "}");
+
+    JSON_Value *value = json_parse_string_insitu(buffer);
+    JSON_Object *object = json_value_get_object(value);
+    bool ok = object != NULL;
+    for (int i = 0; i < LARGE_OBJECT_MEMBERS && ok; i += 2) {
+        snprintf(name, sizeof(name), "key%d", i);
+        ok = json_object_remove(object, name) == JSONSuccess;
+    }
+    for (int i = 1; i < LARGE_OBJECT_MEMBERS && ok; i += 2) {
+        snprintf(name, sizeof(name), "key%d", i);
+        snprintf(expected, sizeof(expected), "v%d", i);
+        const char *string = json_object_get_string(object, name);
+        ok = string != NULL && strcmp(string, expected) == 0;
+    }
+    json_value_free(value);
+    free(buffer);
+    return ok;
+}
+
+int main(void)
+{
+    static const char *documents[] = {Twin,
+                                      "[]",
+                                      "\"x\\\"y\\ud83d\\ude00\"",
+                                      "{\"a\":{\"b\":[1,\"s\",{\"c\":\"d\"}]}}",
+                                      "{\"a\":1,\"a\":2}",
+                                      "{\"a\":\"\\q\"}",
+                                      "{\"a\" 1}",
+                                      "[\"\\u0000z\"]",
+                                      "\xEF\xBB\xBF{\"bom\":1}"};
+    const size_t documentCount = sizeof(documents) / sizeof(documents[0]);
+    bool ok = true;
+    for (size_t i = 0; i < documentCount; i++) {
+        ok = CheckDocument(documents[i]) && ok;
+    }
+    if (!CheckLargeObject()) {
+        printf("Lookups in a large object parsed in situ failed\n");
+        ok = false;
+    }
+    printf("%zu documents and a %d member object checked: %s\n\n", documentCount,
+           LARGE_OBJECT_MEMBERS, ok ? "OK" : "FAILED");
+
+    json_set_allocation_functions(CountingMalloc, free);
+    allocations = 0;
+    json_value_free(json_parse_string(Twin));
+    size_t copyingAllocations = allocations;
+
+    char *buffer = malloc(sizeof(Twin));
+    memcpy(buffer, Twin, sizeof(Twin));
+    allocations = 0;
+    json_value_free(json_parse_string_insitu(buffer));
+    size_t insituAllocations = allocations;
+    json_set_allocation_functions(malloc, free);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < TIMED_PARSES; i++) {
+        json_value_free(json_parse_string(Twin));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double copyingNs = ElapsedNanoseconds(&start, &end) / TIMED_PARSES;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < TIMED_PARSES; i++) {
+        memcpy(buffer, Twin, sizeof(Twin));
+        json_value_free(json_parse_string_insitu(buffer));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double insituNs = ElapsedNanoseconds(&start, &end) / TIMED_PARSES;
+    free(buffer);
+
+    printf("%zu byte Device Twin      %12s %12s\n", sizeof(Twin) - 1, "allocations", "ns/parse");
+    printf("%-26s %12zu %12.0f\n", "json_parse_string", copyingAllocations, copyingNs);
+    printf("%-26s %12zu %12.0f\n", "json_parse_string_insitu", insituAllocations, insituNs);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
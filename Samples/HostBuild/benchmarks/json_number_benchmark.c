@@ -0,0 +1,243 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Checks parson's number parsing against the strtod based parsing it replaced, on a large random
+// corpus of number literals: integers, short and long decimals, exponents, edge cases and
+// malformed literals. parson must accept the same literals, and parse each to exactly the double
+// strtod gives. It then measures the parse throughput in MB/s of a batched sensor array and of an
+// integer-heavy twin, and the rate at which strtod alone converts their numbers, which bounded
+// the throughput before.
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "parson.h"
+
+#define CORPUS_SIZE 5000000
+#define TIMED_NUMBERS 4000
+#define TIMED_PARSES 1000
+#define MAX_LITERAL 128
+
+static uint64_t randomState = 88172645463325252ULL;
+
+static uint64_t NextRandom(void)
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return randomState;
+}
+
+/// <summary>
+///     Writes a random number literal, valid or not.
+/// </summary>
+static void MakeLiteral(char *literal)
+{
+    static const char *const EdgeCases[] = {
+        "-0",        "0",          "-0.0",        "0e5",
+        "0.0e-400",  "1e23",       "9007199254740993",
+        "9007199254740992",        "123456789012345678",
+        "1.7976931348623157e308",  "2.2250738585072014e-308",
+        "4.9e-324",  "1e-400",     "1e400",       "-",
+        "-.5",       ".5",         "1.",          "01",
+        "-01",       "1e",         "1e+",         "0x10",
+        "1.5e22",    "1.5e37",     "8.98846567431158e307",
+        "-inf",      "1E2",        "12345678901234567890",
+        "0.1",       "2.5e-22",    "1e-23"};
+    char *p = literal;
+
+    switch (NextRandom() % 10) {
+    case 0: // Characters from number literals, in any order.
+        for (int n = 1 + (int)(NextRandom() % 12); n > 0; n--) {
+            *p++ = "0123456789.-+eExX"[NextRandom() % 17];
+        }
+        *p = '\0';
+        break;
+    case 1: { // Any finite double, to 1 to 17 significant digits.
+        uint64_t bits = NextRandom();
+        double number;
+        memcpy(&number, &bits, sizeof(number));
+        if (number != number || number - number != 0) {
+            number = 1.5;
+        }
+        sprintf(literal, "%.*g", (int)(1 + NextRandom() % 17), number);
+        break;
+    }
+    case 2: // Integers of up to 64 bits.
+        sprintf(literal, "%s%llu", NextRandom() % 2 == 0 ? "-" : "",
+                (unsigned long long)(NextRandom() >> (NextRandom() % 64)));
+        break;
+    case 3:
+        sprintf(literal, "%.*f", (int)(NextRandom() % 8),
+                (double)(NextRandom() % 10000000) / (double)(1 + NextRandom() % 1000));
+        break;
+    case 4:
+        sprintf(literal, "%llue%d", (unsigned long long)(NextRandom() % 100000000000ULL),
+                (int)(NextRandom() % 90) - 45);
+        break;
+    case 5: // Long mantissas and large exponents.
+        if (NextRandom() % 2 == 0) {
+            *p++ = '-';
+        }
+        *p++ = (char)('1' + NextRandom() % 9);
+        for (int n = (int)(NextRandom() % 25); n > 0; n--) {
+            *p++ = (char)('0' + NextRandom() % 10);
+        }
+        if (NextRandom() % 2 == 0) {
+            *p++ = '.';
+            for (int n = 1 + (int)(NextRandom() % 22); n > 0; n--) {
+                *p++ = (char)('0' + NextRandom() % 10);
+            }
+        }
+        if (NextRandom() % 3 == 0) {
+            *p++ = "eE"[NextRandom() % 2];
+            if (NextRandom() % 2 == 0) {
+                *p++ = "+-"[NextRandom() % 2];
+            }
+            p += sprintf(p, "%d", (int)(NextRandom() % 340));
+        }
+        *p = '\0';
+        break;
+    case 6:
+        sprintf(literal, "0.%0*llu", (int)(1 + NextRandom() % 20),
+                (unsigned long long)(NextRandom() % 1000000));
+        break;
+    case 7:
+        sprintf(literal, "%.17g", (double)(NextRandom() % 1000000) / 100.0);
+        break;
+    case 8:
+        strcpy(literal, EdgeCases[NextRandom() % (sizeof(EdgeCases) / sizeof(EdgeCases[0]))]);
+        break;
+    default: // Sensor readings.
+        sprintf(literal, "%d.%02d", (int)(NextRandom() % 100), (int)(NextRandom() % 100));
+        break;
+    }
+}
+
+/// <summary>
+///     Parses a number literal as parson did before it had its own number parsing: with strtod,
+///     for a literal starting with '-' or a digit, rejecting out of range values, hexadecimal and
+///     leading zeros. Unlike before, infinities such as "-inf", which JSON cannot represent, are
+///     rejected too. Returns false if the literal is rejected.
+/// </summary>
+static bool StrtodParse(const char *literal, double *number)
+{
+    char *end;
+    if (literal[0] != '-' && (literal[0] < '0' || literal[0] > '9')) {
+        return false;
+    }
+    errno = 0;
+    *number = strtod(literal, &end);
+    size_t length = (size_t)(end - literal);
+    if (errno != 0 || *end != '\0' || strpbrk(literal, "xX") != NULL || *number - *number != 0) {
+        return false;
+    }
+    if (length > 1 && literal[0] == '0' && literal[1] != '.') {
+        return false;
+    }
+    return !(length > 2 && strncmp(literal, "-0", 2) == 0 && literal[2] != '.');
+}
+
+/// <summary>
+///     Parses a literal as the only element of an array, and returns false unless parson accepts
+///     it exactly when StrtodParse does, with the same double.
+/// </summary>
+static bool CheckLiteral(const char *literal)
+{
+    char document[MAX_LITERAL + 3];
+    snprintf(document, sizeof(document), "[%s]", literal);
+
+    JSON_Value *value = json_parse_string(document);
+    double expected = 0;
+    bool expectedAccepted = StrtodParse(literal, &expected);
+    bool ok = (value != NULL) == expectedAccepted;
+    if (!ok) {
+        printf("%s is %s by parson but %s by strtod\n", literal,
+               value != NULL ? "accepted" : "rejected", expectedAccepted ? "accepted" : "rejected");
+    } else if (value != NULL) {
+        double parsed = json_array_get_number(json_value_get_array(value), 0);
+        if (memcmp(&parsed, &expected, sizeof(parsed)) != 0) {
+            printf("%s parses to %.17g, but strtod gives %.17g\n", literal, parsed, expected);
+            ok = false;
+        }
+    }
+    json_value_free(value);
+    return ok;
+}
+
+static double ElapsedSeconds(const struct timespec *start, const struct timespec *end)
+{
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/// <summary>
+///     Prints the MB/s at which parson parses a document, and at which strtod alone converts the
+///     numbers in it, each of which follows a '[', ',' or ':'.
+/// </summary>
+static void MeasureThroughput(const char *label, const char *document)
+{
+    size_t length = strlen(document);
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < TIMED_PARSES; i++) {
+        json_value_free(json_parse_string(document));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double parseSeconds = ElapsedSeconds(&start, &end);
+
+    volatile double sum = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < TIMED_PARSES; i++) {
+        for (const char *p = document; (p = strpbrk(p, "[,:")) != NULL; p++) {
+            sum += strtod(p + 1, NULL);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double strtodSeconds = ElapsedSeconds(&start, &end);
+
+    double megabytes = (double)length * TIMED_PARSES / 1e6;
+    printf("%-22s %8zu %10.1f %10.1f\n", label, length, megabytes / parseSeconds,
+           megabytes / strtodSeconds);
+}
+
+int main(void)
+{
+    char literal[MAX_LITERAL];
+    long mismatches = 0;
+    for (long i = 0; i < CORPUS_SIZE && mismatches < 10; i++) {
+        MakeLiteral(literal);
+        if (!CheckLiteral(literal)) {
+            mismatches++;
+        }
+    }
+    printf("%d literals checked against strtod, %ld mismatches\n\n", CORPUS_SIZE, mismatches);
+
+    static char sensorArray[TIMED_NUMBERS * 8];
+    char *p = sensorArray;
+    *p++ = '[';
+    for (int i = 0; i < TIMED_NUMBERS; i++) {
+        p += sprintf(p, "%s%d.%02d", i > 0 ? "," : "", (int)(NextRandom() % 60),
+                     (int)(NextRandom() % 100));
+    }
+    strcpy(p, "]");
+
+    static char integerTwin[TIMED_NUMBERS * 8];
+    p = integerTwin;
+    p += sprintf(p, "{\"$version\":12345,\"values\":[");
+    for (int i = 0; i < TIMED_NUMBERS; i++) {
+        p += sprintf(p, "%s%d", i > 0 ? "," : "", (int)(NextRandom() % 100000));
+    }
+    strcpy(p, "]}");
+
+    printf("%-22s %8s %10s %10s\n", "", "bytes", "parse MB/s", "strtod MB/s");
+    MeasureThroughput("sensor decimals", sensorArray);
+    MeasureThroughput("integers", integerTwin);
+
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,173 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Measures parson's objects with 10, 100 and 1000 members, the size of a large Device Twin: the
+// time per member to build an object, to parse one, and to look up each member, which uses the
+// object's hash index once it has enough members. For comparison, it also looks up each member by
+// scanning the names with strlen and strcmp, as parson did before the index. It first checks
+// lookups, inserts and removals against a plain array over a random sequence of operations.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "parson.h"
+
+#define CHECKED_KEYS 600
+#define CHECKED_OPERATIONS 200000
+#define TIMED_MEMBERS_PER_SIZE 100000
+
+static double ElapsedNanoseconds(const struct timespec *start, const struct timespec *end)
+{
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 + (double)(end->tv_nsec - start->tv_nsec);
+}
+
+/// <summary>
+///     Applies random sets, removals and lookups to an object and to an array of the expected
+///     values, and returns false if they ever disagree.
+/// </summary>
+static bool CheckOperations(void)
+{
+    static bool present[CHECKED_KEYS];
+    static double expected[CHECKED_KEYS];
+    JSON_Value *value = json_value_init_object();
+    JSON_Object *object = json_value_get_object(value);
+    char name[32];
+    bool ok = true;
+
+    srand(1);
+    for (int i = 0; i < CHECKED_OPERATIONS && ok; i++) {
+        int key = rand() % CHECKED_KEYS;
+        snprintf(name, sizeof(name), "key%d", key);
+        switch (rand() % 4) {
+        case 0:
+        case 1:
+            expected[key] = rand();
+            present[key] = true;
+            ok = json_object_set_number(object, name, expected[key]) == JSONSuccess;
+            break;
+        case 2:
+            ok = (json_object_remove(object, name) == JSONSuccess) == present[key];
+            present[key] = false;
+            break;
+        default: {
+            JSON_Value *member = json_object_get_value(object, name);
+            ok = (member != NULL) == present[key] &&
+                 (member == NULL || json_value_get_number(member) == expected[key]);
+            break;
+        }
+        }
+        if (i == CHECKED_OPERATIONS / 2) {
+            json_object_clear(object);
+            memset(present, 0, sizeof(present));
+        }
+    }
+    size_t count = 0;
+    for (int key = 0; key < CHECKED_KEYS; key++) {
+        count += present[key] ? 1 : 0;
+    }
+    ok = ok && json_object_get_count(object) == count;
+
+    char *serialized = json_serialize_to_string(value);
+    JSON_Value *parsed = json_parse_string(serialized);
+    ok = ok && json_value_equals(parsed, value);
+    json_value_free(parsed);
+    json_free_serialized_string(serialized);
+    json_value_free(value);
+    return ok;
+}
+
+/// <summary>
+///     Looks up a member by comparing its name with each member's in turn.
+/// </summary>
+static JSON_Value *ScanForMember(const JSON_Object *object, const char *name)
+{
+    size_t nameLength = strlen(name);
+    for (size_t i = 0; i < json_object_get_count(object); i++) {
+        const char *memberName = json_object_get_name(object, i);
+        if (strlen(memberName) == nameLength && strcmp(memberName, name) == 0) {
+            return json_object_get_value_at(object, i);
+        }
+    }
+    return NULL;
+}
+
+/// <summary>
+///     Times objects of the given size, and prints a row of nanoseconds per member.
+/// </summary>
+static bool TimeObjects(size_t members)
+{
+    char **names = malloc(members * sizeof(char *));
+    for (size_t i = 0; i < members; i++) {
+        names[i] = malloc(40);
+        snprintf(names[i], 40, "desiredProperty%zu", i);
+    }
+    size_t rounds = TIMED_MEMBERS_PER_SIZE / members;
+    double buildNs = 0, parseNs = 0, lookupNs = 0, scanNs = 0;
+    bool ok = true;
+    struct timespec start, end;
+
+    for (size_t round = 0; round < rounds && ok; round++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        JSON_Value *value = json_value_init_object();
+        JSON_Object *object = json_value_get_object(value);
+        for (size_t i = 0; i < members; i++) {
+            json_object_set_number(object, names[i], (double)i);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        buildNs += ElapsedNanoseconds(&start, &end);
+
+        char *serialized = json_serialize_to_string(value);
+        json_value_free(value);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        value = json_parse_string(serialized);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        parseNs += ElapsedNanoseconds(&start, &end);
+        json_free_serialized_string(serialized);
+        object = json_value_get_object(value);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (size_t i = 0; i < members; i++) {
+            ok = ok && json_value_get_number(json_object_get_value(object, names[i])) == (double)i;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        lookupNs += ElapsedNanoseconds(&start, &end);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (size_t i = 0; i < members; i++) {
+            ok = ok && json_value_get_number(ScanForMember(object, names[i])) == (double)i;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        scanNs += ElapsedNanoseconds(&start, &end);
+        json_value_free(value);
+    }
+
+    double perMember = (double)(rounds * members);
+    printf("%8zu %10.1f %10.1f %10.1f %10.1f\n", members, buildNs / perMember,
+           parseNs / perMember, lookupNs / perMember, scanNs / perMember);
+    for (size_t i = 0; i < members; i++) {
+        free(names[i]);
+    }
+    free(names);
+    return ok;
+}
+
+int main(void)
+{
+    bool ok = CheckOperations();
+    printf("%d random operations on %d keys %s\n\n", CHECKED_OPERATIONS, CHECKED_KEYS,
+           ok ? "matched" : "did not match");
+
+    printf("%8s %43s\n", "", "ns/member");
+    printf("%8s %10s %10s %10s %10s\n", "members", "build", "parse", "lookup", "scan");
+    for (size_t members = 10; members <= 1000; members *= 10) {
+        if (!TimeObjects(members)) {
+            printf("A lookup of an object with %zu members failed\n", members);
+            ok = false;
+        }
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,127 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Compares compiled JSON_Path lookups with json_object_dotget lookups of the same dotted names, in
+// the time per lookup, on a Device Twin update and on a twin with 64 nested properties. It first
+// checks that both find the same value for a set of names, including missing and malformed ones.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "parson.h"
+
+#define TIMED_ROUNDS 1000000
+#define NESTED_PROPERTIES 64
+
+static const char TwinUpdate[] =
+    "{\"desired\":{\"$version\":12,\"thermometerTelemetryUploadEnabled\":true,\"NextFlavor\":{"
+    "\"Name\":\"Cola\",\"Color\":{\"R\":1,\"G\":2,\"B\":3}}},\"reported\":{\"a\":1}}";
+
+// The names which a twin handler looks up on each update.
+static const char *const TwinNames[] = {"desired.$version",
+                                        "desired.thermometerTelemetryUploadEnabled",
+                                        "desired.NextFlavor.Color.B"};
+#define TWIN_NAME_COUNT (sizeof(TwinNames) / sizeof(TwinNames[0]))
+
+static const char NestedName[] = "prop42.inner.leaf";
+
+static double ElapsedNanoseconds(const struct timespec *start, const struct timespec *end)
+{
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 + (double)(end->tv_nsec - start->tv_nsec);
+}
+
+/// <summary>
+///     Returns false if a compiled path finds a different value from json_object_dotget_value for
+///     any of the given names.
+/// </summary>
+static bool CheckNames(const JSON_Object *object, const char *const *names, size_t count)
+{
+    bool ok = true;
+    for (size_t i = 0; i < count; i++) {
+        JSON_Path *path = json_path_compile(names[i]);
+        if (json_path_get_value(object, path) != json_object_dotget_value(object, names[i])) {
+            printf("The path and dotget differ for \"%s\"\n", names[i]);
+            ok = false;
+        }
+        json_path_free(path);
+    }
+    return ok;
+}
+
+/// <summary>
+///     Prints the nanoseconds per lookup of the given names with dotget and with compiled paths.
+/// </summary>
+static void TimeLookups(const char *label, const JSON_Object *object, const char *const *names,
+                        size_t count)
+{
+    JSON_Path *paths[TWIN_NAME_COUNT];
+    volatile double sum = 0;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < TIMED_ROUNDS; round++) {
+        for (size_t i = 0; i < count; i++) {
+            sum += json_object_dotget_number(object, names[i]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double dotgetNs = ElapsedNanoseconds(&start, &end) / (double)(TIMED_ROUNDS * count);
+
+    for (size_t i = 0; i < count; i++) {
+        paths[i] = json_path_compile(names[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < TIMED_ROUNDS; round++) {
+        for (size_t i = 0; i < count; i++) {
+            sum += json_path_get_number(object, paths[i]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double pathNs = ElapsedNanoseconds(&start, &end) / (double)(TIMED_ROUNDS * count);
+    for (size_t i = 0; i < count; i++) {
+        json_path_free(paths[i]);
+    }
+
+    printf("%-28s %10.1f %10.1f\n", label, dotgetNs, pathNs);
+}
+
+int main(void)
+{
+    static const char *const checkedNames[] = {
+        "desired.$version",        "desired.thermometerTelemetryUploadEnabled",
+        "desired.NextFlavor.Name", "desired.NextFlavor.Color.B",
+        "desired.missing",         "desired.$version.x",
+        "",                        "desired..x",
+        "reported.a",              "desired.NextFlavor."};
+
+    JSON_Value *twin = json_parse_string(TwinUpdate);
+    JSON_Object *twinObject = json_value_get_object(twin);
+
+    JSON_Value *nested = json_value_init_object();
+    JSON_Object *nestedObject = json_value_get_object(nested);
+    char name[32];
+    for (int i = 0; i < NESTED_PROPERTIES; i++) {
+        snprintf(name, sizeof(name), "prop%d.inner.leaf", i);
+        json_object_dotset_number(nestedObject, name, i);
+    }
+
+    bool ok = CheckNames(twinObject, checkedNames, sizeof(checkedNames) / sizeof(checkedNames[0]));
+    const char *nestedNames[] = {NestedName};
+    ok = CheckNames(nestedObject, nestedNames, 1) && ok;
+    JSON_Path *nestedPath = json_path_compile(NestedName);
+    ok = ok && json_path_get_number(nestedObject, nestedPath) == 42;
+    json_path_free(nestedPath);
+    ok = ok && json_path_get_boolean(twinObject, NULL) == -1 && json_path_compile(NULL) == NULL;
+    printf("Paths %s dotget\n\n", ok ? "match" : "do not match");
+
+    printf("%-28s %21s\n", "", "ns/lookup");
+    printf("%-28s %10s %10s\n", "", "dotget", "path");
+    TimeLookups("twin update", twinObject, TwinNames, TWIN_NAME_COUNT);
+    TimeLookups("64 nested properties", nestedObject, nestedNames, 1);
+
+    json_value_free(twin);
+    json_value_free(nested);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
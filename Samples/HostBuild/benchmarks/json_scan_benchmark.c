@@ -0,0 +1,198 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Measures parson's parse throughput in MB/s on payloads like those the IoT Hub sends: a Device
+// Twin of long plain strings, a direct method payload, and an array of small objects with some
+// escapes. These are dominated by scanning strings and whitespace, which parson does a word at a
+// time. It first checks the scanning against json_stream.c, which reads a byte at a time, on
+// random strings with escapes, control characters and whitespace at every alignment.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "json_stream.h"
+#include "parson.h"
+
+#define CHECKED_DOCUMENTS 300000
+#define MAX_CHECKED_DOCUMENT 512
+#define TIMED_BYTES (100 * 1000 * 1000)
+#define PAYLOAD_SIZE 8192
+
+static uint64_t randomState = 88172645463325252ULL;
+
+static uint64_t NextRandom(void)
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return randomState;
+}
+
+// The string found by StreamStringHandler.
+static char streamString[MAX_CHECKED_DOCUMENT];
+static size_t streamStringLength = 0;
+static bool streamFoundString = false;
+
+static void StreamStringHandler(const char *path, const JsonStream_Value *value, void *context)
+{
+    if (value->type == JsonStream_ValueType_String) {
+        memcpy(streamString, value->string, value->stringLength);
+        streamStringLength = value->stringLength;
+        streamFoundString = true;
+    }
+}
+
+/// <summary>
+///     Writes a random document holding one string, either alone or in an array, with random
+///     whitespace around its tokens. The string mixes plain characters with escapes, UTF-8,
+///     control characters and invalid escapes, and may lack its closing quote.
+/// </summary>
+static void MakeCheckedDocument(char *document)
+{
+    static const char Whitespace[] = " \t\n\r";
+    static const char *const Specials[] = {
+        "\\/", "\\\\", "\\\"", "\\n", "\\u00e9", "\\ud83d\\ude00", "\xc3\xa9", "\x7f", // valid
+        "\x01", "\t", "\\q"};                                                       // invalid
+    size_t length = 0;
+    bool inArray = NextRandom() % 2 == 0;
+
+    for (int i = (int)(NextRandom() % 4); i > 0; i--) {
+        document[length++] = Whitespace[NextRandom() % 4];
+    }
+    if (inArray) {
+        document[length++] = '[';
+        for (int i = (int)(NextRandom() % 20); i > 0; i--) {
+            document[length++] = Whitespace[NextRandom() % 4];
+        }
+    }
+    document[length++] = '"';
+    for (int i = (int)(NextRandom() % 60); i > 0; i--) {
+        if (NextRandom() % 4 != 0) {
+            document[length++] = "abcdefghijklmnop"[NextRandom() % 16];
+        } else if (NextRandom() % 64 != 0) {
+            // Invalid tokens are rarer, so that most strings are valid and compared.
+            const char *special = Specials[NextRandom() % 8];
+            length += (size_t)sprintf(document + length, "%s", special);
+        } else {
+            const char *special = Specials[8 + NextRandom() % 3];
+            length += (size_t)sprintf(document + length, "%s", special);
+        }
+    }
+    if (NextRandom() % 8 != 0) {
+        document[length++] = '"';
+    }
+    if (inArray) {
+        for (int i = (int)(NextRandom() % 20); i > 0; i--) {
+            document[length++] = Whitespace[NextRandom() % 4];
+        }
+        document[length++] = ']';
+    }
+    document[length] = '\0';
+}
+
+/// <summary>
+///     Parses a document with parson and with json_stream.c, and returns false unless both accept
+///     it with the same string, or both reject it.
+/// </summary>
+static bool CheckDocument(const char *document)
+{
+    static const JsonStream_PathHandler handlers[] = {{"", StreamStringHandler},
+                                                      {"[]", StreamStringHandler}};
+    static char tokenBuffer[MAX_CHECKED_DOCUMENT];
+
+    streamFoundString = false;
+    bool streamAccepted = JsonStream_Parse(document, strlen(document), handlers, 2, tokenBuffer,
+                                           sizeof(tokenBuffer), NULL) == JsonStream_Result_OK &&
+                          streamFoundString;
+
+    JSON_Value *value = json_parse_string(document);
+    JSON_Value *string = value;
+    if (json_value_get_type(value) == JSONArray) {
+        string = json_array_get_value(json_value_get_array(value), 0);
+    }
+    bool parsonAccepted = json_value_get_type(string) == JSONString;
+    bool ok = parsonAccepted == streamAccepted;
+    if (ok && parsonAccepted) {
+        ok = strlen(json_value_get_string(string)) == streamStringLength &&
+             memcmp(json_value_get_string(string), streamString, streamStringLength) == 0;
+    }
+    json_value_free(value);
+    if (!ok) {
+        printf("parson %s and json_stream.c %s: %s\n", parsonAccepted ? "accepts" : "rejects",
+               streamAccepted ? "accepts" : "rejects", document);
+    }
+    return ok;
+}
+
+/// <summary>
+///     Returns the MB/s at which parson parses a payload.
+/// </summary>
+static double MeasureThroughput(const char *payload)
+{
+    size_t length = strlen(payload);
+    size_t parses = TIMED_BYTES / length;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < parses; i++) {
+        json_value_free(json_parse_string(payload));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds =
+        (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    return (double)(length * parses) / seconds / 1e6;
+}
+
+int main(void)
+{
+    // Documents are placed at every offset from a word boundary, so that the word at a time
+    // scanning starts and ends part way through words.
+    static char buffer[MAX_CHECKED_DOCUMENT + 16];
+    long mismatches = 0;
+    for (int i = 0; i < CHECKED_DOCUMENTS; i++) {
+        char *document = buffer + NextRandom() % 16;
+        MakeCheckedDocument(document);
+        if (!CheckDocument(document) && ++mismatches == 10) {
+            break;
+        }
+    }
+    printf("%d random documents checked, %ld mismatches\n\n", CHECKED_DOCUMENTS, mismatches);
+
+    static char twin[PAYLOAD_SIZE];
+    size_t length = (size_t)sprintf(twin, "{\"desired\":{");
+    for (int i = 0; i < 20; i++) {
+        length += (size_t)sprintf(twin + length,
+                                  "%s\"property%02d\":\"https://contoso-iot-hub.azure-devices.net/"
+                                  "devices/device-%04d/firmware/v1.2.3/image.bin?sig="
+                                  "abcdefghijklmnopqrstuvwxyz0123456789\"",
+                                  i > 0 ? "," : "", i, i);
+    }
+    sprintf(twin + length, "},\"$version\":42}");
+
+    static const char method[] =
+        "{\"displayAlert\":\"The quick brown fox jumps over the lazy dog while the thermometer "
+        "reads a perfectly normal temperature of twenty degrees\",\"severity\":\"informational\","
+        "\"source\":\"cloud-dashboard-operator-console\"}";
+
+    static char objects[PAYLOAD_SIZE];
+    length = (size_t)sprintf(objects, "[");
+    for (int i = 0; i < 60; i++) {
+        length += (size_t)sprintf(objects + length,
+                                  "%s{\"id\":\"sensor\\/reading\",\"unit\":\"celsius\","
+                                  "\"location\":\"building-1 floor-3\"}",
+                                  i > 0 ? ",\n  " : "");
+    }
+    sprintf(objects + length, "]");
+
+    printf("%-30s %8s %8s\n", "payload", "bytes", "MB/s");
+    printf("%-30s %8zu %8.1f\n", "twin of long strings", strlen(twin), MeasureThroughput(twin));
+    printf("%-30s %8zu %8.1f\n", "direct method payload", strlen(method),
+           MeasureThroughput(method));
+    printf("%-30s %8zu %8.1f\n", "array of objects with escapes", strlen(objects),
+           MeasureThroughput(objects));
+
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,236 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Measures how parson serializes numbers. It checks that the shortest form of a large random
+// corpus of doubles parses back to the same double, and that numbers with a fixed precision are
+// rounded exactly as printf's "%.*f" rounds them. It then times serializing numbers against the
+// "%1.17g" sprintf parson used before, and counts the bytes of the sample's temperature telemetry
+// in each form.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "parson.h"
+
+#define CORPUS_SIZE 1000000
+#define TIMED_NUMBERS 100000
+#define TELEMETRY_READINGS 1000
+#define MAX_DECIMALS 6
+
+static const int TemperatureDecimals = 2;
+
+static uint64_t randomState = 88172645463325252ULL;
+
+/// <summary>
+///     Returns the next value of a xorshift generator, so that each run uses the same corpus.
+/// </summary>
+static uint64_t NextRandom(void)
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return randomState;
+}
+
+/// <summary>
+///     Returns a finite double from the corpus: any bit pattern, a float, or a value with a few
+///     decimals, the last two being what telemetry mostly carries.
+/// </summary>
+static double NextCorpusNumber(void)
+{
+    for (;;) {
+        uint64_t bits = NextRandom();
+        double number;
+        memcpy(&number, &bits, sizeof(number));
+        switch (bits % 4) {
+        case 0:
+            number = (double)(int64_t)(NextRandom() % 2000001 - 1000000) / 1000.0;
+            break;
+        case 1:
+            number = (float)number;
+            break;
+        default:
+            break;
+        }
+        if (isfinite(number)) {
+            return number;
+        }
+    }
+}
+
+static double ElapsedNanoseconds(const struct timespec *start, const struct timespec *end)
+{
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 + (double)(end->tv_nsec - start->tv_nsec);
+}
+
+/// <summary>
+///     Serializes a single JSON value into the given buffer, exiting if it does not fit.
+/// </summary>
+static size_t Serialize(const JSON_Value *value, char *buffer, size_t bufferSize)
+{
+    size_t length = 0;
+    if (json_serialize_to_buffer_n(value, buffer, bufferSize, &length) != JSONSuccess) {
+        fprintf(stderr, "Could not serialize a number.\n");
+        exit(EXIT_FAILURE);
+    }
+    return length;
+}
+
+/// <summary>
+///     Formats a number with printf's "%.*f" and drops trailing zeros, as the fixed precision form
+///     does; returns false if the fixed form falls back to the shortest form for this number.
+/// </summary>
+static bool FormatFixedReference(double number, int decimals, char *buffer, size_t bufferSize)
+{
+    if (!(fabs(number) * pow(10.0, decimals) < 9007199254740992.0)) {
+        return false;
+    }
+    snprintf(buffer, bufferSize, "%.*f", decimals, number);
+    char *point = strchr(buffer, '.');
+    if (point != NULL) {
+        char *end = point + strlen(point) - 1;
+        while (*end == '0') {
+            *end-- = '\0';
+        }
+        if (end == point) {
+            *point = '\0';
+        }
+    }
+    if (strcmp(buffer, "-0") == 0) {
+        strcpy(buffer, "0");
+    }
+    return true;
+}
+
+/// <summary>
+///     Checks the shortest and the fixed precision forms over the corpus, and returns the number
+///     of mismatches, printing the first few.
+/// </summary>
+static long CheckCorpus(void)
+{
+    static const double edgeCases[] = {0.0, -0.0, 0.1, 0.5, 2.675, 1.005, 0.125, 0.375, 2.5,
+                                       -2.5, 1e21, 1e-7, 5e-324, 1.7976931348623157e308,
+                                       2.2250738585072014e-308, 9007199254740993.0,
+                                       50.349998474121094, 1.0 / 3.0};
+    const size_t edgeCaseCount = sizeof(edgeCases) / sizeof(edgeCases[0]);
+    char buffer[64];
+    char reference[400];
+    long mismatches = 0;
+
+    for (size_t i = 0; i < edgeCaseCount + CORPUS_SIZE; i++) {
+        double number = i < edgeCaseCount ? edgeCases[i] : NextCorpusNumber();
+
+        JSON_Value *value = json_value_init_number(number);
+        Serialize(value, buffer, sizeof(buffer));
+        json_value_free(value);
+        double parsed = strtod(buffer, NULL);
+        if (memcmp(&parsed, &number, sizeof(number)) != 0 && !(parsed == 0.0 && number == 0.0)) {
+            if (mismatches++ < 10) {
+                printf("Shortest form of %.17g is %s\n", number, buffer);
+            }
+        }
+
+        int decimals = (int)(i % (MAX_DECIMALS + 1));
+        if (!FormatFixedReference(number, decimals, reference, sizeof(reference))) {
+            continue;
+        }
+        value = json_value_init_number_fixed(number, decimals);
+        Serialize(value, buffer, sizeof(buffer));
+        json_value_free(value);
+        if (strcmp(buffer, reference) != 0) {
+            if (mismatches++ < 10) {
+                printf("%.17g with %d decimals is %s, \"%%.*f\" gives %s\n", number, decimals,
+                       buffer, reference);
+            }
+        }
+    }
+    return mismatches;
+}
+
+/// <summary>
+///     Returns the nanoseconds per number to serialize an array of the given numbers, in the
+///     shortest form if decimals is negative, or else with that fixed precision.
+/// </summary>
+static double TimeSerialization(const double *numbers, size_t count, int decimals, char *buffer,
+                                size_t bufferSize)
+{
+    JSON_Value *array = json_value_init_array();
+    for (size_t i = 0; i < count; i++) {
+        json_array_append_value(json_value_get_array(array),
+                                decimals < 0 ? json_value_init_number(numbers[i])
+                                             : json_value_init_number_fixed(numbers[i], decimals));
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    Serialize(array, buffer, bufferSize);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    json_value_free(array);
+    return ElapsedNanoseconds(&start, &end) / (double)count;
+}
+
+/// <summary>
+///     Returns the nanoseconds per number to write the given numbers with "%1.17g", as parson did.
+/// </summary>
+static double TimeSprintf(const double *numbers, size_t count, char *buffer)
+{
+    size_t offset = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < count; i++) {
+        offset += (size_t)sprintf(buffer + offset, "%1.17g,", numbers[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return ElapsedNanoseconds(&start, &end) / (double)count;
+}
+
+int main(void)
+{
+    long mismatches = CheckCorpus();
+    printf("%d numbers checked, %ld mismatches\n\n", CORPUS_SIZE, mismatches);
+
+    // Time the sample's temperature readings: a float random walk around 50.
+    static double numbers[TIMED_NUMBERS];
+    float temperature = 50.f;
+    srand(1);
+    for (size_t i = 0; i < TIMED_NUMBERS; i++) {
+        temperature += ((float)(rand() % 41)) / 20.0f - 1.0f;
+        numbers[i] = temperature;
+    }
+    static char buffer[TIMED_NUMBERS * 32];
+    printf("%-28s %12s\n", "", "ns/number");
+    printf("%-28s %12.1f\n", "sprintf \"%1.17g\"", TimeSprintf(numbers, TIMED_NUMBERS, buffer));
+    printf("%-28s %12.1f\n", "shortest form",
+           TimeSerialization(numbers, TIMED_NUMBERS, -1, buffer, sizeof(buffer)));
+    printf("%-28s %12.1f\n\n", "2 decimals",
+           TimeSerialization(numbers, TIMED_NUMBERS, TemperatureDecimals, buffer,
+                             sizeof(buffer)));
+
+    // Count the bytes of the telemetry messages Cloud_SendTelemetry builds for the same readings.
+    size_t sprintfBytes = 0, shortestBytes = 0, fixedBytes = 0;
+    char message[128];
+    for (size_t i = 0; i < TELEMETRY_READINGS; i++) {
+        sprintfBytes += (size_t)snprintf(message, sizeof(message), "{\"temperature\":%1.17g}",
+                                         numbers[i]);
+        JSON_Value *value = json_value_init_object();
+        json_object_dotset_number(json_value_get_object(value), "temperature", numbers[i]);
+        shortestBytes += Serialize(value, message, sizeof(message));
+        json_object_dotset_number_fixed(json_value_get_object(value), "temperature", numbers[i],
+                                        TemperatureDecimals);
+        fixedBytes += Serialize(value, message, sizeof(message));
+        json_value_free(value);
+    }
+    printf("%-28s %12s %12s\n", "telemetry message", "bytes", "% of before");
+    printf("%-28s %12.1f %11.0f%%\n", "sprintf \"%1.17g\"",
+           (double)sprintfBytes / TELEMETRY_READINGS, 100.0);
+    printf("%-28s %12.1f %11.0f%%\n", "shortest form", (double)shortestBytes / TELEMETRY_READINGS,
+           100.0 * (double)shortestBytes / (double)sprintfBytes);
+    printf("%-28s %12.1f %11.0f%%\n", "2 decimals", (double)fixedBytes / TELEMETRY_READINGS,
+           100.0 * (double)fixedBytes / (double)sprintfBytes);
+
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,186 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Simulates 1000 devices which lose their IoT Hub at the same moment, against a stand-in hub
+// which is down for a minute and then, as IoT Hub throttles connections, accepts at most 50
+// connections a second. It compares the reconnect storm with the 1 s connect polling and doubling
+// 10 s to 600 s backoff which azure_iot.c used before, and with ReconnectBackoff as azure_iot.c
+// uses it now: a jittered first attempt, then decorrelated jitter. It reports the attempts made,
+// the peak attempts in a second, the attempts in each minute, and how long the devices took to
+// reconnect. The simulation is deterministic, and runs in simulated rather than real time.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "reconnect_backoff.h"
+
+#define DEVICE_COUNT 1000
+#define STEP_MS 10
+#define SIMULATED_MS (12L * 60 * 60 * 1000)
+#define MINUTES_SHOWN 10
+
+// The stand-in hub, and how long attempts take to fail.
+static const long OutageMs = 60 * 1000;
+static const int AcceptedPerSecond = 50;
+static const long TimeoutWhileDownMs = 2000;
+static const long RejectionMs = 1000;
+
+// As in azure_iot.c.
+static const long PollPeriodMs = 1000;
+static const long MinReconnectPeriodMs = 10 * 1000;
+static const long MaxReconnectPeriodMs = 10 * 60 * 1000;
+static const uint32_t ReconnectBaseMs = 10 * 1000;
+static const uint32_t ReconnectCapMs = 10 * 60 * 1000;
+
+typedef enum { Strategy_Polling, Strategy_Jittered } Strategy;
+
+typedef struct {
+    bool connected;
+    long nextAttemptMs;
+    long resultMs; // When the attempt in progress completes, or -1 if there is none.
+    long periodMs; // Strategy_Polling: the connect timer's period.
+    ReconnectBackoff backoff;
+} Device;
+
+typedef struct {
+    long attempts;
+    long peakAttemptsPerSecond;
+    long attemptsPerMinute[MINUTES_SHOWN];
+    long halfConnectedMs;
+    long mostConnectedMs; // 99%
+    long allConnectedMs;
+} StormResult;
+
+static Device devices[DEVICE_COUNT];
+
+/// <summary>
+///     Returns when a device next attempts to connect after a failed attempt at the given time.
+/// </summary>
+static long NextAttemptAfterFailure(Strategy strategy, Device *device, long nowMs)
+{
+    if (strategy == Strategy_Jittered) {
+        return nowMs + (long)ReconnectBackoff_Next(&device->backoff);
+    }
+    // The connect timer's period was raised to 10 s after the first failure, and then doubled.
+    device->periodMs =
+        device->periodMs == PollPeriodMs ? MinReconnectPeriodMs : device->periodMs * 2;
+    if (device->periodMs > MaxReconnectPeriodMs) {
+        device->periodMs = MaxReconnectPeriodMs;
+    }
+    return nowMs + device->periodMs;
+}
+
+static void SimulateStorm(Strategy strategy, StormResult *result)
+{
+    srand(1);
+    for (size_t i = 0; i < DEVICE_COUNT; i++) {
+        Device *device = &devices[i];
+        device->connected = false;
+        device->resultMs = -1;
+        device->periodMs = PollPeriodMs;
+        ReconnectBackoff_Init(&device->backoff, ReconnectBaseMs, ReconnectCapMs,
+                              (uint32_t)rand() * 2654435761u + 1);
+        // The connection is lost at time 0. Polling devices attempt at their next 1 s tick; the
+        // others after a jittered delay, as when the network comes back.
+        device->nextAttemptMs = strategy == Strategy_Polling
+                                    ? rand() % PollPeriodMs
+                                    : (long)ReconnectBackoff_Jitter(&device->backoff);
+    }
+
+    *result = (StormResult){.halfConnectedMs = -1, .mostConnectedMs = -1, .allConnectedMs = -1};
+    long attemptsThisSecond = 0, acceptedThisSecond = 0, connected = 0, second = 0;
+    long nextEventMs = 0;
+    for (long now = 0; now < SIMULATED_MS && connected < DEVICE_COUNT; now += STEP_MS) {
+        if (now < nextEventMs) {
+            // Skip the steps in which nothing happens.
+            now = (nextEventMs + STEP_MS - 1) / STEP_MS * STEP_MS;
+        }
+        if (now / 1000 != second) {
+            second = now / 1000;
+            attemptsThisSecond = 0;
+            acceptedThisSecond = 0;
+        }
+        nextEventMs = SIMULATED_MS;
+        for (size_t i = 0; i < DEVICE_COUNT; i++) {
+            Device *device = &devices[i];
+            if (device->connected) {
+                continue;
+            }
+            if (device->resultMs >= 0 && now >= device->resultMs) {
+                device->resultMs = -1;
+                if (now >= OutageMs && acceptedThisSecond < AcceptedPerSecond) {
+                    ++acceptedThisSecond;
+                    device->connected = true;
+                    ++connected;
+                    continue;
+                }
+                device->nextAttemptMs = NextAttemptAfterFailure(strategy, device, now);
+            }
+            if (device->resultMs < 0 && now >= device->nextAttemptMs) {
+                ++result->attempts;
+                ++attemptsThisSecond;
+                if (now / 60000 < MINUTES_SHOWN) {
+                    ++result->attemptsPerMinute[now / 60000];
+                }
+                device->resultMs = now + (now < OutageMs ? TimeoutWhileDownMs : RejectionMs);
+            }
+            long deviceEventMs = device->resultMs >= 0 ? device->resultMs : device->nextAttemptMs;
+            if (deviceEventMs < nextEventMs) {
+                nextEventMs = deviceEventMs;
+            }
+        }
+        if (attemptsThisSecond > result->peakAttemptsPerSecond) {
+            result->peakAttemptsPerSecond = attemptsThisSecond;
+        }
+        if (result->halfConnectedMs < 0 && connected >= DEVICE_COUNT / 2) {
+            result->halfConnectedMs = now;
+        }
+        if (result->mostConnectedMs < 0 && connected >= DEVICE_COUNT * 99 / 100) {
+            result->mostConnectedMs = now;
+        }
+        if (connected == DEVICE_COUNT) {
+            result->allConnectedMs = now;
+        }
+    }
+}
+
+static void PrintResult(const char *label, const StormResult *result)
+{
+    printf("%-22s %9ld %10ld %10.1f %10.1f %10.1f\n", label, result->attempts,
+           result->peakAttemptsPerSecond, (double)result->halfConnectedMs / 1000.0,
+           (double)result->mostConnectedMs / 1000.0, (double)result->allConnectedMs / 1000.0);
+}
+
+int main(void)
+{
+    StormResult polling, jittered;
+    SimulateStorm(Strategy_Polling, &polling);
+    SimulateStorm(Strategy_Jittered, &jittered);
+
+    printf("%d devices; the hub is down for %ld s, then accepts %d connections a second\n\n",
+           DEVICE_COUNT, OutageMs / 1000, AcceptedPerSecond);
+    printf("%-22s %9s %10s %32s\n", "", "attempts", "peak", "seconds until reconnected");
+    printf("%-22s %9s %10s %10s %10s %10s\n", "", "", "per second", "50%", "99%", "100%");
+    PrintResult("1 s polling, doubling", &polling);
+    PrintResult("jittered backoff", &jittered);
+
+    printf("\n%-22s", "attempts in minute");
+    for (int minute = 0; minute < MINUTES_SHOWN; minute++) {
+        printf(" %5d", minute + 1);
+    }
+    printf("\n%-22s", "1 s polling, doubling");
+    for (int minute = 0; minute < MINUTES_SHOWN; minute++) {
+        printf(" %5ld", polling.attemptsPerMinute[minute]);
+    }
+    printf("\n%-22s", "jittered backoff");
+    for (int minute = 0; minute < MINUTES_SHOWN; minute++) {
+        printf(" %5ld", jittered.attemptsPerMinute[minute]);
+    }
+    printf("\n");
+
+    // Every device must reconnect within the simulated time.
+    return polling.allConnectedMs >= 0 && jittered.allConnectedMs >= 0 ? EXIT_SUCCESS
+                                                                       : EXIT_FAILURE;
+}
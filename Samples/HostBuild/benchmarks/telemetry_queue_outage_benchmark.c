@@ -0,0 +1,254 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Simulates network outages of the Azure IoT sample's telemetry queue, as cloud.c uses it: a
+// reading every 5 seconds is queued while offline, the application restarts, and once connected
+// the queue is drained in bursts of 8 messages, each acknowledged after a round trip and followed
+// by the 250 ms drain interval. For each outage and drop policy it reports the messages held and
+// dropped, the simulated time to recover, the time taken by the queue's own calls, and the header
+// writes per message queued, which cloud.c batches over TELEMETRY_QUEUE_FLUSH_INTERVAL messages.
+//
+// It checks that the messages recovered after the restart are in order and, with DropOldest, end
+// with the last one produced; that a message longer than the queue accepts is rejected; and that a
+// message too long for the reader's buffer can be discarded so that those after it are sent; and
+// that a restart without closing the queue loses fewer messages than the flush interval.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "telemetry_queue.h"
+
+// As in cloud.c.
+#define REGION_SIZE (6 * 1024)
+#define MESSAGE_BUFFER_SIZE 1024
+#define DRAIN_BURST 8
+#define FLUSH_INTERVAL 8
+static const double DrainIntervalSeconds = 0.25;
+
+static const double ReadingIntervalSeconds = 5;
+static const double RoundTripSeconds = 0.06;
+static const unsigned int OutageMinutes[] = {1, 10, 30, 60, 360};
+
+static char storagePath[] = "/tmp/telemetry_queue_outage_XXXXXX";
+static int failures = 0;
+
+static double MonotonicSeconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static void Check(bool condition, const char *description)
+{
+    if (!condition) {
+        fprintf(stderr, "FAILED: %s\n", description);
+        ++failures;
+    }
+}
+
+static void FormatReading(unsigned int index, char *message, size_t messageSize, char *dateTime,
+                          size_t dateTimeSize)
+{
+    unsigned int seconds = index * (unsigned int)ReadingIntervalSeconds;
+    snprintf(message, messageSize, "{\"temperature\":%.2f}", 20 + (index % 200) / 100.0);
+    snprintf(dateTime, dateTimeSize, "2026-10-%02uT%02u:%02u:%02uZ", 1 + seconds / 86400,
+             seconds / 3600 % 24, seconds / 60 % 60, seconds % 60);
+}
+
+static bool OpenQueue(TelemetryQueue *queue, TelemetryQueue_DropPolicy policy)
+{
+    if (!TelemetryQueue_Open(queue, 0, REGION_SIZE, policy, MESSAGE_BUFFER_SIZE - 1)) {
+        fprintf(stderr, "Could not open the telemetry queue in %s.\n", storagePath);
+        return false;
+    }
+    TelemetryQueue_SetFlushInterval(queue, FLUSH_INTERVAL);
+    return true;
+}
+
+static bool SimulateOutage(unsigned int minutes, TelemetryQueue_DropPolicy policy)
+{
+    unlink(storagePath);
+    TelemetryQueue queue;
+    if (!OpenQueue(&queue, policy)) {
+        return false;
+    }
+
+    char message[MESSAGE_BUFFER_SIZE];
+    char dateTime[32];
+    char lastProduced[32] = "";
+    unsigned int produced = (unsigned int)(minutes * 60 / ReadingIntervalSeconds);
+
+    double start = MonotonicSeconds();
+    for (unsigned int i = 0; i < produced; ++i) {
+        FormatReading(i, message, sizeof(message), dateTime, sizeof(dateTime));
+        TelemetryQueue_Push(&queue, message, dateTime);
+        strcpy(lastProduced, dateTime);
+    }
+    double pushMicroseconds = (MonotonicSeconds() - start) * 1e6 / produced;
+    double headerWritesPerMessage = (double)queue.headerWrites / produced;
+
+    // Restart, and recover the queue from storage.
+    TelemetryQueue_Close(&queue);
+    if (!OpenQueue(&queue, policy)) {
+        return false;
+    }
+    uint32_t held = queue.count;
+
+    char previous[32] = "";
+    char first[32] = "";
+    unsigned int sent = 0;
+    double recoverySeconds = 0;
+    bool ordered = true;
+
+    start = MonotonicSeconds();
+    while (queue.count > 0) {
+        TelemetryQueue_Cursor cursor;
+        TelemetryQueue_StartRead(&queue, &cursor);
+        size_t burst = 0;
+        while (burst < DRAIN_BURST && TelemetryQueue_Read(&queue, &cursor, message,
+                                                          sizeof(message), dateTime,
+                                                          sizeof(dateTime))) {
+            ordered = ordered && strcmp(previous, dateTime) < 0;
+            strcpy(previous, dateTime);
+            if (sent == 0 && burst == 0) {
+                strcpy(first, dateTime);
+            }
+            ++burst;
+        }
+        if (burst == 0 || !TelemetryQueue_Pop(&queue, burst)) {
+            fprintf(stderr, "Could not drain the telemetry queue.\n");
+            TelemetryQueue_Close(&queue);
+            return false;
+        }
+        sent += (unsigned int)burst;
+        recoverySeconds += RoundTripSeconds + DrainIntervalSeconds;
+    }
+    double drainMicroseconds = (MonotonicSeconds() - start) * 1e6 / (sent > 0 ? sent : 1);
+
+    printf("%-11s %5u %8u %5u %7u %8.1f %21s %21s %7.1f %7.1f %7.3f\n",
+           policy == TelemetryQueue_DropPolicy_DropOldest ? "DropOldest" : "DropNewest", minutes,
+           produced, held, queue.dropped, recoverySeconds, first, previous, pushMicroseconds,
+           drainMicroseconds, headerWritesPerMessage);
+
+    Check(ordered, "recovered messages are in order");
+    Check(held + queue.dropped == produced, "every message was either held or dropped");
+    if (policy == TelemetryQueue_DropPolicy_DropOldest) {
+        Check(strcmp(previous, lastProduced) == 0, "DropOldest keeps the last message produced");
+    }
+
+    TelemetryQueue_Close(&queue);
+    return true;
+}
+
+/// <summary>
+///     Checks that a message longer than the queue accepts is rejected, and that one queued with a
+///     higher limit, before a restart, can be discarded so that the next is read.
+/// </summary>
+static bool CheckLongMessages(void)
+{
+    unlink(storagePath);
+    TelemetryQueue queue;
+    if (!TelemetryQueue_Open(&queue, 0, REGION_SIZE, TelemetryQueue_DropPolicy_DropOldest,
+                             2 * MESSAGE_BUFFER_SIZE)) {
+        return false;
+    }
+
+    char longMessage[MESSAGE_BUFFER_SIZE + 16];
+    memset(longMessage, 'x', sizeof(longMessage) - 1);
+    longMessage[sizeof(longMessage) - 1] = '\0';
+    Check(TelemetryQueue_Push(&queue, longMessage, NULL), "a long message is queued");
+    Check(TelemetryQueue_Push(&queue, "{\"temperature\":20.00}", NULL),
+          "a short message is queued");
+    TelemetryQueue_Close(&queue);
+
+    if (!OpenQueue(&queue, TelemetryQueue_DropPolicy_DropOldest)) {
+        return false;
+    }
+    Check(!TelemetryQueue_Push(&queue, longMessage, NULL),
+          "a message longer than the queue accepts is rejected");
+
+    char message[MESSAGE_BUFFER_SIZE];
+    char dateTime[32];
+    TelemetryQueue_Cursor cursor;
+    TelemetryQueue_StartRead(&queue, &cursor);
+    Check(!TelemetryQueue_Read(&queue, &cursor, message, sizeof(message), dateTime,
+                               sizeof(dateTime)),
+          "a message longer than the buffer is not read");
+    Check(TelemetryQueue_Discard(&queue), "an unreadable message is discarded");
+    TelemetryQueue_StartRead(&queue, &cursor);
+    Check(TelemetryQueue_Read(&queue, &cursor, message, sizeof(message), dateTime,
+                              sizeof(dateTime)) &&
+              strcmp(message, "{\"temperature\":20.00}") == 0,
+          "the message after a discarded one is read");
+    Check(queue.dropped == 2, "rejected and discarded messages are counted as dropped");
+
+    TelemetryQueue_Close(&queue);
+    return true;
+}
+
+/// <summary>
+///     Checks that a restart without closing the queue recovers all but the messages queued since
+///     its header was last written.
+/// </summary>
+static bool CheckRestartWithoutClose(void)
+{
+    unlink(storagePath);
+    TelemetryQueue queue;
+    if (!OpenQueue(&queue, TelemetryQueue_DropPolicy_DropOldest)) {
+        return false;
+    }
+
+    char message[MESSAGE_BUFFER_SIZE];
+    char dateTime[32];
+    const unsigned int produced = 3 * FLUSH_INTERVAL + FLUSH_INTERVAL / 2;
+    for (unsigned int i = 0; i < produced; ++i) {
+        FormatReading(i, message, sizeof(message), dateTime, sizeof(dateTime));
+        TelemetryQueue_Push(&queue, message, dateTime);
+    }
+
+    // Simulate a crash: the storage is closed without writing the header.
+    close(queue.fd);
+    if (!OpenQueue(&queue, TelemetryQueue_DropPolicy_DropOldest)) {
+        return false;
+    }
+    Check(queue.count + FLUSH_INTERVAL > produced && queue.count <= produced,
+          "a restart without closing loses fewer messages than the flush interval");
+
+    TelemetryQueue_Close(&queue);
+    return true;
+}
+
+int main(void)
+{
+    int fd = mkstemp(storagePath);
+    if (fd == -1) {
+        perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    setenv("APPLIBS_HOST_MUTABLE_STORAGE", storagePath, 1);
+
+    printf("%-11s %5s %8s %5s %7s %8s %21s %21s %7s %7s %7s\n", "policy", "min", "produced",
+           "held", "dropped", "recov_s", "first_sent", "last_sent", "push_us", "drain_us",
+           "hdr/msg");
+    bool ok = true;
+    for (int policy = 0; ok && policy < 2; ++policy) {
+        for (size_t i = 0; ok && i < sizeof(OutageMinutes) / sizeof(OutageMinutes[0]); ++i) {
+            ok = SimulateOutage(OutageMinutes[i], (TelemetryQueue_DropPolicy)policy);
+        }
+    }
+    ok = ok && CheckLongMessages();
+    ok = ok && CheckRestartWithoutClose();
+
+    unlink(storagePath);
+    if (!ok || failures > 0) {
+        fprintf(stderr, "%d checks failed.\n", failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,165 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Replays a day of the Azure IoT sample's Device Twin reports, and counts the reported property
+// publishes and bytes with one publish for each report, and with the reports coalesced over the
+// sample's 500 ms window and published as merge-patch deltas from the last published state, as
+// azure_iot.c does. It also applies the deltas to a copy of the twin, as the IoT Hub would, and
+// checks that the copy ends up exactly equal to the device's reported state.
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parson.h"
+
+#define MAX_REPORTS 256
+#define MAX_REPORT_SIZE 192
+
+static const long CoalesceWindowMs = 500;
+static const long MillisecondsPerHour = 60 * 60 * 1000;
+
+typedef struct {
+    long timeMs;
+    char json[MAX_REPORT_SIZE];
+} Report;
+
+static Report reports[MAX_REPORTS];
+static size_t reportCount = 0;
+
+static void AddReport(long timeMs, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+static void AddReport(long timeMs, const char *format, ...)
+{
+    if (reportCount == MAX_REPORTS) {
+        fprintf(stderr, "Too many reports.\n");
+        exit(EXIT_FAILURE);
+    }
+    va_list args;
+    va_start(args, format);
+    vsnprintf(reports[reportCount].json, MAX_REPORT_SIZE, format, args);
+    va_end(args);
+    reports[reportCount++].timeMs = timeMs;
+}
+
+static void AddUploadEnabledReport(long timeMs, bool enabled, bool fromCloud, int version)
+{
+    AddReport(timeMs,
+              "{\"thermometerTelemetryUploadEnabled\":"
+              "{\"value\":%s,\"ac\":%d,\"av\":%d,\"ad\":\"%s\"}}",
+              enabled ? "true" : "false", fromCloud ? 200 : 203, fromCloud ? version : 0,
+              fromCloud ? "Updated from Device Twin's desired value." : "Updated locally.");
+}
+
+static int CompareReportTimes(const void *a, const void *b)
+{
+    long difference = ((const Report *)a)->timeMs - ((const Report *)b)->timeMs;
+    return (difference > 0) - (difference < 0);
+}
+
+/// <summary>
+///     Builds the day: the serial number on each of 24 reconnections; the telemetry upload setting
+///     changed 30 times from the cloud or a button, and 10 times as bursts of three presses within
+///     300 ms; the DeviceToCloud next flavor acknowledged 20 times, half of them repeating the
+///     current flavor; and a calibration offset which changes by less than 1e-6 each hour.
+/// </summary>
+static void BuildDay(void)
+{
+    bool enabled = false;
+    for (int hour = 0; hour < 24; ++hour) {
+        AddReport(hour * MillisecondsPerHour + 1000, "{\"serialNumber\":\"TEMPMON-01234\"}");
+        AddReport(hour * MillisecondsPerHour + 2000, "{\"calibrationOffset\":%.17g}",
+                  0.25 + hour * 1e-7);
+    }
+    for (int i = 0; i < 30; ++i) {
+        enabled = !enabled;
+        AddUploadEnabledReport(i * 2800000L + 5000, enabled, i % 2 == 1, i);
+    }
+    for (int i = 0; i < 10; ++i) {
+        for (int press = 0; press < 3; ++press) {
+            enabled = !enabled;
+            AddUploadEnabledReport(i * 8000000L + 7000 + press * 100, enabled, false, 0);
+        }
+    }
+    static const char *const flavors[] = {"{\"Name\":\"Cola\",\"Color\":\"#FF0000\"}",
+                                          "{\"Name\":\"Lemonade\",\"Color\":\"#FFFF00\"}"};
+    for (int i = 0; i < 20; ++i) {
+        AddReport(i * 4000000L + 9000, "{\"NextFlavor\":%s}", flavors[(i / 2) % 2]);
+    }
+    qsort(reports, reportCount, sizeof(Report), CompareReportTimes);
+}
+
+static JSON_Value *ParseObject(const char *json)
+{
+    JSON_Value *value = json_parse_string(json);
+    if (json_value_get_type(value) != JSONObject) {
+        fprintf(stderr, "Not a JSON object: %s\n", json);
+        exit(EXIT_FAILURE);
+    }
+    return value;
+}
+
+int main(void)
+{
+    BuildDay();
+
+    size_t unbatchedBytes = 0;
+    for (size_t i = 0; i < reportCount; ++i) {
+        unbatchedBytes += strlen(reports[i].json);
+    }
+
+    JSON_Value *published = json_value_init_object();
+    JSON_Value *cloudTwin = json_value_init_object();
+    size_t publishes = 0, skipped = 0, bytes = 0;
+    bool publishWhole = true;
+
+    for (size_t i = 0; i < reportCount;) {
+        long windowEndMs = reports[i].timeMs + CoalesceWindowMs;
+        JSON_Value *state = json_value_deep_copy(published);
+        for (; i < reportCount && reports[i].timeMs < windowEndMs; ++i) {
+            JSON_Value *patch = ParseObject(reports[i].json);
+            json_object_merge_patch(json_object(state), json_object(patch));
+            json_value_free(patch);
+        }
+
+        JSON_Value *delta = publishWhole ? json_value_deep_copy(state)
+                                         : json_object_merge_patch_diff(json_object(published),
+                                                                        json_object(state));
+        if (json_object_get_count(json_object(delta)) == 0) {
+            ++skipped;
+        } else {
+            char *serialized = json_serialize_to_string(delta);
+            bytes += strlen(serialized);
+            ++publishes;
+            json_free_serialized_string(serialized);
+            json_object_merge_patch(json_object(cloudTwin), json_object(delta));
+        }
+
+        json_value_free(delta);
+        json_value_free(published);
+        published = state;
+        publishWhole = false;
+    }
+
+    // Numbers are compared exactly here, unlike json_value_equals.
+    char *deviceState = json_serialize_to_string(published);
+    char *cloudState = json_serialize_to_string(cloudTwin);
+    bool match = strcmp(deviceState, cloudState) == 0;
+
+    printf("%-26s %10s %10s\n", "", "publishes", "bytes");
+    printf("%-26s %10zu %10zu\n", "one publish per report", reportCount, unbatchedBytes);
+    printf("%-26s %10zu %10zu\n", "coalesced merge patches", publishes, bytes);
+    printf("%zu windows had nothing to publish; publishes %.0f%%, bytes %.0f%% of unbatched\n",
+           skipped, 100.0 * (double)publishes / (double)reportCount,
+           100.0 * (double)bytes / (double)unbatchedBytes);
+    printf("IoT Hub copy of the twin %s the device's reported state\n",
+           match ? "matches" : "DOES NOT MATCH");
+
+    json_free_serialized_string(deviceState);
+    json_free_serialized_string(cloudState);
+    json_value_free(published);
+    json_value_free(cloudTwin);
+    return match ? EXIT_SUCCESS : EXIT_FAILURE;
+}
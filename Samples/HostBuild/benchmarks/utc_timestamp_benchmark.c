@@ -0,0 +1,134 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Measures the cost of formatting telemetry timestamps with UtcTimestamp, against gmtime and
+// strftime as cloud.c and azure_iot.c did before, both to the second for a reading every 5 s and
+// to the millisecond for the current time. It first checks that UtcTimestamp's output is identical
+// to strftime's for every second over a year change, and for random times to the millisecond,
+// including times before 1970 and far in the future.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "utc_timestamp.h"
+
+#define RANDOM_TIMES 2000000
+#define TIMED_CALLS 5000000
+#define TIMESTAMP_SIZE 64
+
+// 2027-01-01T00:00:00Z, a year, month and day change.
+static const time_t YearChange = 1798761600;
+static const time_t ReadingIntervalSeconds = 5;
+
+static double ElapsedNanoseconds(const struct timespec *start, const struct timespec *end)
+{
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 + (double)(end->tv_nsec - start->tv_nsec);
+}
+
+/// <summary>
+///     Formats a time to the second, as the samples did before UtcTimestamp.
+/// </summary>
+static void FormatWithStrftime(time_t t, char *text)
+{
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(text, TIMESTAMP_SIZE, "%Y-%m-%dT%H:%M:%SZ", &tm);
+}
+
+/// <summary>
+///     Formats a time to the millisecond with strftime and snprintf.
+/// </summary>
+static void FormatMillisecondsWithStrftime(const struct timespec *t, char *text)
+{
+    char seconds[TIMESTAMP_SIZE];
+    struct tm tm;
+    gmtime_r(&t->tv_sec, &tm);
+    strftime(seconds, sizeof(seconds), "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(text, TIMESTAMP_SIZE, "%.32s.%03ldZ", seconds, t->tv_nsec / 1000000);
+}
+
+/// <summary>
+///     Returns the number of timestamps which differ from strftime's, printing the first few.
+/// </summary>
+static long CheckTimestamps(UtcTimestamp *timestamp, long *checked)
+{
+    char expected[TIMESTAMP_SIZE];
+    long mismatches = 0;
+
+    for (time_t t = YearChange - 86400; t < YearChange + 2 * 86400; t++, (*checked)++) {
+        FormatWithStrftime(t, expected);
+        const char *text = UtcTimestamp_Format(timestamp, t);
+        if (strcmp(expected, text) != 0 && mismatches++ < 3) {
+            printf("%s formatted as %s\n", expected, text);
+        }
+    }
+
+    srand(2);
+    for (int i = 0; i < RANDOM_TIMES; i++, (*checked)++) {
+        struct timespec t = {
+            .tv_sec = (time_t)((((long long)rand() << 20) ^ rand()) % 400000000000LL) -
+                      100000000000LL,
+            .tv_nsec = rand() % 1000000000};
+        FormatMillisecondsWithStrftime(&t, expected);
+        const char *text = UtcTimestamp_FormatMilliseconds(timestamp, &t);
+        if ((text == NULL || strcmp(expected, text) != 0) && mismatches++ < 3) {
+            printf("%s formatted as %s\n", expected, text != NULL ? text : "nothing");
+        }
+    }
+    return mismatches;
+}
+
+int main(void)
+{
+    UtcTimestamp timestamp;
+    UtcTimestamp_Init(&timestamp);
+    char text[TIMESTAMP_SIZE];
+    volatile char sink = 0;
+    struct timespec start, end;
+
+    long checked = 0;
+    long mismatches = CheckTimestamps(&timestamp, &checked);
+    printf("%ld timestamps checked against strftime, %ld mismatches\n\n", checked, mismatches);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < TIMED_CALLS; i++) {
+        FormatWithStrftime(YearChange + i * ReadingIntervalSeconds, text);
+        sink ^= text[18];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double strftimeNs = ElapsedNanoseconds(&start, &end) / TIMED_CALLS;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < TIMED_CALLS; i++) {
+        sink ^= UtcTimestamp_Format(&timestamp, YearChange + i * ReadingIntervalSeconds)[18];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double utcTimestampNs = ElapsedNanoseconds(&start, &end) / TIMED_CALLS;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < TIMED_CALLS; i++) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        FormatMillisecondsWithStrftime(&now, text);
+        sink ^= text[22];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double strftimeNowNs = ElapsedNanoseconds(&start, &end) / TIMED_CALLS;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < TIMED_CALLS; i++) {
+        sink ^= UtcTimestamp_NowMilliseconds(&timestamp)[22];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double utcTimestampNowNs = ElapsedNanoseconds(&start, &end) / TIMED_CALLS;
+
+    printf("%-40s %12s %12s\n", "ns/timestamp", "strftime", "UtcTimestamp");
+    printf("%-40s %12.1f %12.1f\n", "a reading every 5 s, to the second", strftimeNs,
+           utcTimestampNs);
+    printf("%-40s %12.1f %12.1f\n", "current time, to the millisecond", strftimeNowNs,
+           utcTimestampNowNs);
+
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,85 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Connection to the local IoT Hub stand-in, for the load harness. The connection context is an
+// IoT Hub connection string, "HostName=127.0.0.1:1883;DeviceId=...", which the host device client
+// accepts in place of device authentication.
+
+#include <stdbool.h>
+#include <string.h>
+
+#include <applibs/log.h>
+
+#include <azureiot/iothub_client_options.h>
+#include <azureiot/iothub_device_client_ll.h>
+#include <azureiot/iothubtransportmqtt.h>
+
+#include "exitcodes.h"
+
+#include "connection.h"
+
+#define MAX_MODELID_LENGTH (512)
+
+static char azureSphereModelId[MAX_MODELID_LENGTH + 1];
+static const char *connectionString = NULL;
+
+static Connection_StatusCallbackType connectionStatusCallback = NULL;
+
+ExitCode Connection_Initialise(EventLoop *el, Connection_StatusCallbackType statusCallBack,
+                               ExitCode_CallbackType failureCallback, const char *modelId,
+                               void *context)
+{
+    (void)el;
+    (void)failureCallback;
+    connectionStatusCallback = statusCallBack;
+
+    if (NULL != modelId) {
+        if (strnlen(modelId, MAX_MODELID_LENGTH) == MAX_MODELID_LENGTH) {
+            Log_Debug("ERROR: Model ID length exceeds maximum of %d\n", MAX_MODELID_LENGTH);
+            return ExitCode_Validate_ConnectionConfig;
+        }
+        strncpy(azureSphereModelId, modelId, MAX_MODELID_LENGTH);
+    } else {
+        azureSphereModelId[0] = '\0';
+    }
+
+    if (NULL == context) {
+        Log_Debug("ERROR: Stand-in connection context must be a connection string.\n");
+        return ExitCode_Validate_ConnectionConfig;
+    }
+    connectionString = context;
+
+    return ExitCode_Success;
+}
+
+void Connection_Start(void)
+{
+    connectionStatusCallback(Connection_Started, NULL);
+
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE clientHandle =
+        IoTHubDeviceClient_LL_CreateFromConnectionString(connectionString, MQTT_Protocol);
+    if (clientHandle == NULL) {
+        Log_Debug("ERROR: Invalid stand-in connection string \"%s\".\n", connectionString);
+        connectionStatusCallback(Connection_Failed, NULL);
+        return;
+    }
+
+    if (IoTHubDeviceClient_LL_SetOption(clientHandle, OPTION_MODEL_ID, azureSphereModelId) !=
+        IOTHUB_CLIENT_OK) {
+        Log_Debug("ERROR: Failed to set the Model ID on IoT Hub Client.\n");
+        IoTHubDeviceClient_LL_Destroy(clientHandle);
+        connectionStatusCallback(Connection_Failed, NULL);
+        return;
+    }
+
+    connectionStatusCallback(Connection_Complete, clientHandle);
+}
+
+void Connection_ReportAuthenticationStatus(IOTHUB_CLIENT_CONNECTION_STATUS status,
+                                           IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason)
+{
+    (void)status;
+    (void)reason;
+}
+
+void Connection_Cleanup(void) {}
@@ -0,0 +1,129 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <azure_prov_client/prov_device_ll_client.h>
+#include <azure_prov_client/prov_security_factory.h>
+#include <azure_prov_client/prov_transport_mqtt_client.h>
+
+#include "dps_stand_in.h"
+
+// As the host device client connects with device authentication; see azure_sphere_provisioning.h.
+#define DEFAULT_DEVICE_AUTH_DEVICE_ID "host-device"
+
+struct PROV_DEVICE_TRANSPORT_PROVIDER_TAG {
+    const char *name;
+};
+
+struct PROV_INSTANCE_INFO_TAG {
+    bool registering;
+    struct timespec completionTime;
+    PROV_DEVICE_CLIENT_REGISTER_DEVICE_CALLBACK registerCallback;
+    void *userContext;
+};
+
+static const PROV_DEVICE_TRANSPORT_PROVIDER mqttProvider = {.name = "MQTT"};
+
+static const char *assignedHub = "127.0.0.1:1883";
+static unsigned int registrationMilliseconds = 0;
+static unsigned long registrations = 0;
+
+void DpsStandIn_Configure(const char *hub, unsigned int milliseconds)
+{
+    assignedHub = hub;
+    registrationMilliseconds = milliseconds;
+}
+
+unsigned long DpsStandIn_GetRegistrations(void)
+{
+    return registrations;
+}
+
+const PROV_DEVICE_TRANSPORT_PROVIDER *Prov_Device_MQTT_Protocol(void)
+{
+    return &mqttProvider;
+}
+
+int prov_dev_security_init(SECURE_DEVICE_TYPE hsm_type)
+{
+    return hsm_type == SECURE_DEVICE_TYPE_X509 ? 0 : -1;
+}
+
+void prov_dev_security_deinit(void) {}
+
+PROV_DEVICE_LL_HANDLE Prov_Device_LL_Create(const char *uri, const char *scope_id,
+                                            PROV_DEVICE_TRANSPORT_PROVIDER_FUNCTION protocol)
+{
+    if (uri == NULL || scope_id == NULL || protocol == NULL) {
+        return NULL;
+    }
+    return calloc(1, sizeof(struct PROV_INSTANCE_INFO_TAG));
+}
+
+void Prov_Device_LL_Destroy(PROV_DEVICE_LL_HANDLE handle)
+{
+    free(handle);
+}
+
+PROV_DEVICE_RESULT Prov_Device_LL_Register_Device(
+    PROV_DEVICE_LL_HANDLE handle, PROV_DEVICE_CLIENT_REGISTER_DEVICE_CALLBACK register_callback,
+    void *user_context, PROV_DEVICE_CLIENT_REGISTER_STATUS_CALLBACK reg_status_cb,
+    void *status_user_ctext)
+{
+    (void)reg_status_cb;
+    (void)status_user_ctext;
+    if (handle == NULL || register_callback == NULL) {
+        return PROV_DEVICE_RESULT_INVALID_ARG;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &handle->completionTime);
+    handle->completionTime.tv_sec += registrationMilliseconds / 1000;
+    handle->completionTime.tv_nsec += (long)(registrationMilliseconds % 1000) * 1000 * 1000;
+    if (handle->completionTime.tv_nsec >= 1000 * 1000 * 1000) {
+        handle->completionTime.tv_nsec -= 1000 * 1000 * 1000;
+        ++handle->completionTime.tv_sec;
+    }
+    handle->registering = true;
+    handle->registerCallback = register_callback;
+    handle->userContext = user_context;
+    return PROV_DEVICE_RESULT_OK;
+}
+
+void Prov_Device_LL_DoWork(PROV_DEVICE_LL_HANDLE handle)
+{
+    if (handle == NULL || !handle->registering) {
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec < handle->completionTime.tv_sec ||
+        (now.tv_sec == handle->completionTime.tv_sec &&
+         now.tv_nsec < handle->completionTime.tv_nsec)) {
+        return;
+    }
+
+    const char *deviceId = getenv("AZUREIOT_HOST_DEVICE_ID");
+    handle->registering = false;
+    ++registrations;
+    handle->registerCallback(PROV_DEVICE_RESULT_OK, assignedHub,
+                             deviceId != NULL ? deviceId : DEFAULT_DEVICE_AUTH_DEVICE_ID,
+                             handle->userContext);
+}
+
+PROV_DEVICE_RESULT Prov_Device_LL_SetOption(PROV_DEVICE_LL_HANDLE handle, const char *optionName,
+                                            const void *value)
+{
+    (void)value;
+    return handle != NULL && optionName != NULL ? PROV_DEVICE_RESULT_OK
+                                                : PROV_DEVICE_RESULT_INVALID_ARG;
+}
+
+PROV_DEVICE_RESULT Prov_Device_LL_Set_Provisioning_Payload(PROV_DEVICE_LL_HANDLE handle,
+                                                           const char *json)
+{
+    return handle != NULL && json != NULL ? PROV_DEVICE_RESULT_OK : PROV_DEVICE_RESULT_INVALID_ARG;
+}
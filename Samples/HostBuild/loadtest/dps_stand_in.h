@@ -0,0 +1,22 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+// In-process stand-in for the Device Provisioning Service, for the load harness. It implements the
+// provisioning device client API in azure_prov_client/prov_device_ll_client.h: a registration
+// completes a fixed time after it starts, modelling the round trips to DPS, and assigns the device
+// to a configured IoT Hub, such as the local IoT Hub stand-in.
+
+/// <summary>
+/// Set the IoT Hub which devices are assigned to, and how long registration takes.
+/// </summary>
+/// <param name="assignedHub">The IoT Hub, as "host[:port]".</param>
+/// <param name="registrationMilliseconds">Time from starting a registration until it
+/// completes.</param>
+void DpsStandIn_Configure(const char *assignedHub, unsigned int registrationMilliseconds);
+
+/// <summary>
+/// Get the number of registrations which have completed.
+/// </summary>
+unsigned long DpsStandIn_GetRegistrations(void);
@@ -0,0 +1,454 @@
+#!/usr/bin/env python3
+
+'''
+Copyright (c) Microsoft Corporation. All rights reserved.
+Licensed under the MIT License.
+
+iothub_stand_in.py
+
+A local stand-in for an Azure IoT Hub, for load testing the Azure IoT sample's cloud stack on a
+host machine. It is an MQTT 3.1.1 server which speaks the topic conventions which the Azure IoT C
+SDK uses:
+
+  devices/{device id}/messages/events/...             telemetry, acknowledged with PUBACK
+  $iothub/twin/GET/?$rid={rid}                        answered on $iothub/twin/res/200/
+  $iothub/twin/PATCH/properties/reported/?$rid={rid}  merged, answered on $iothub/twin/res/204/
+  $iothub/twin/PATCH/properties/desired/              desired property updates, sent periodically
+  $iothub/methods/POST/{method name}/?$rid={rid}      direct method calls, sent periodically
+
+It serves plain TCP, or TLS if given a certificate and key. It does not authenticate devices, and
+it implements only what the SDK uses: QoS 0 and 1, no retained messages and no wildcards other than
+a trailing '#'. It prints what it received every interval, and the totals on exit.
+'''
+
+import argparse
+import asyncio
+import json
+import logging
+import ssl
+import sys
+import time
+from urllib.parse import parse_qs
+
+CONNECT, CONNACK, PUBLISH, PUBACK = 1, 2, 3, 4
+SUBSCRIBE, SUBACK, PINGREQ, PINGRESP, DISCONNECT = 8, 9, 12, 13, 14
+
+TELEMETRY_PREFIX = 'devices/'
+TWIN_GET_PREFIX = '$iothub/twin/GET/'
+TWIN_REPORTED_PREFIX = '$iothub/twin/PATCH/properties/reported/'
+METHOD_RESPONSE_PREFIX = '$iothub/methods/res/'
+
+# The Azure IoT sample fails if a whole device twin without a payload handler exceeds this.
+MAX_TWIN_SIZE = 512
+
+
+class Stats:
+    """
+    Counts of what the stand-in has received and sent
+    """
+
+    def __init__(self):
+        self.connects = 0
+        self.telemetry = 0
+        self.telemetry_bytes = 0
+        self.twin_gets = 0
+        self.reported_patches = 0
+        self.desired_patches = 0
+        self.method_calls = 0
+        self.method_responses = 0
+        self.method_latencies = []
+        self.forced_disconnects = 0
+
+    def snapshot(self):
+        """
+        Returns a copy of the counts, for computing the rates over an interval
+        """
+        copy = Stats()
+        copy.__dict__.update(self.__dict__)
+        copy.method_latencies = list(self.method_latencies)
+        return copy
+
+
+class DeviceTwin:
+    """
+    Desired and reported properties, shared by every connection
+    """
+
+    def __init__(self):
+        self.desired = {'thermometerTelemetryUploadEnabled': True, '$version': 1}
+        self.reported = {'$version': 1}
+
+    def document(self):
+        """
+        Returns the whole twin, as sent in response to a GET
+        """
+        return json.dumps({'desired': self.desired, 'reported': self.reported}).encode()
+
+    def patch_reported(self, patch, logger):
+        """
+        Merges a reported properties patch, and returns the new version
+        """
+        self._merge(self.reported, patch)
+        self.reported['$version'] += 1
+        if len(self.document()) > MAX_TWIN_SIZE:
+            logger.warning('The device twin is now %d bytes, more than the sample accepts (%d).',
+                           len(self.document()), MAX_TWIN_SIZE)
+        return self.reported['$version']
+
+    def patch_desired(self, patch):
+        """
+        Merges a desired properties patch, and returns it with the new version
+        """
+        self._merge(self.desired, patch)
+        self.desired['$version'] += 1
+        return dict(patch, **{'$version': self.desired['$version']})
+
+    @staticmethod
+    def _merge(target, patch):
+        for key, value in patch.items():
+            if value is None:
+                target.pop(key, None)
+            elif isinstance(value, dict) and isinstance(target.get(key), dict):
+                DeviceTwin._merge(target[key], value)
+            else:
+                target[key] = value
+
+
+def encode_remaining_length(length):
+    """
+    Encodes the remaining length of a fixed header, seven bits per byte
+    """
+    encoded = bytearray()
+    while True:
+        digit = length % 128
+        length //= 128
+        encoded.append(digit | 0x80 if length > 0 else digit)
+        if length == 0:
+            return bytes(encoded)
+
+
+def encode_string(string):
+    """
+    Encodes a string with its 16-bit length
+    """
+    data = string.encode()
+    return len(data).to_bytes(2, 'big') + data
+
+
+def packet(packet_type, flags, body):
+    """
+    Builds a control packet from its type, flags and variable header and payload
+    """
+    return bytes([packet_type << 4 | flags]) + encode_remaining_length(len(body)) + body
+
+
+def publish_packet(topic, payload):
+    """
+    Builds a QoS 0 PUBLISH
+    """
+    return packet(PUBLISH, 0, encode_string(topic) + payload)
+
+
+def topic_parameters(topic):
+    """
+    Returns the query parameters of a topic, such as $rid, as a dictionary
+    """
+    _, _, query = topic.partition('?')
+    return {key: values[0] for key, values in parse_qs(query, keep_blank_values=True).items()}
+
+
+class DeviceConnection:
+    """
+    One device's MQTT connection
+    """
+
+    def __init__(self, server, reader, writer):
+        self.server = server
+        self.reader = reader
+        self.writer = writer
+        self.client_id = None
+        self.subscriptions = []
+        self.pending_methods = {}
+        self.next_method_id = 0
+
+    def send(self, data):
+        """
+        Queues data to be written to the device
+        """
+        if not self.writer.is_closing():
+            self.writer.write(data)
+
+    def is_subscribed(self, topic):
+        """
+        Returns whether the device has subscribed to a topic
+        """
+        for pattern in self.subscriptions:
+            if pattern == topic or (pattern.endswith('#') and topic.startswith(pattern[:-1])):
+                return True
+        return False
+
+    async def read_packet(self):
+        """
+        Reads one control packet, and returns its first byte and the rest
+        """
+        first = (await self.reader.readexactly(1))[0]
+        length = 0
+        for shift in range(0, 28, 7):
+            digit = (await self.reader.readexactly(1))[0]
+            length |= (digit & 0x7F) << shift
+            if digit & 0x80 == 0:
+                break
+        return first, await self.reader.readexactly(length)
+
+    async def run(self):
+        """
+        Serves the connection until the device or the stand-in closes it
+        """
+        try:
+            while True:
+                first, body = await self.read_packet()
+                packet_type = first >> 4
+                if packet_type == CONNECT:
+                    self.handle_connect(body)
+                elif packet_type == PUBLISH:
+                    self.handle_publish(first & 0xF, body)
+                elif packet_type == SUBSCRIBE:
+                    self.handle_subscribe(body)
+                elif packet_type == PINGREQ:
+                    self.send(packet(PINGRESP, 0, b''))
+                elif packet_type == DISCONNECT:
+                    break
+                await self.writer.drain()
+        except (asyncio.IncompleteReadError, ConnectionError):
+            pass
+        finally:
+            self.server.connections.discard(self)
+            self.writer.close()
+
+    def handle_connect(self, body):
+        # Protocol name, level, flags and keepalive come before the client identifier.
+        name_length = int.from_bytes(body[0:2], 'big')
+        offset = 2 + name_length + 4
+        client_id_length = int.from_bytes(body[offset:offset + 2], 'big')
+        self.client_id = body[offset + 2:offset + 2 + client_id_length].decode()
+        self.server.stats.connects += 1
+        self.server.logger.info('Device "%s" connected.', self.client_id)
+        self.send(packet(CONNACK, 0, bytes([0, 0])))
+
+    def handle_subscribe(self, body):
+        packet_id = body[0:2]
+        offset = 2
+        granted = bytearray()
+        while offset < len(body):
+            length = int.from_bytes(body[offset:offset + 2], 'big')
+            self.subscriptions.append(body[offset + 2:offset + 2 + length].decode())
+            offset += 2 + length + 1
+            granted.append(0)
+        self.send(packet(SUBACK, 0, packet_id + bytes(granted)))
+
+    def handle_publish(self, flags, body):
+        topic_length = int.from_bytes(body[0:2], 'big')
+        topic = body[2:2 + topic_length].decode()
+        offset = 2 + topic_length
+        qos = (flags >> 1) & 3
+        packet_id = None
+        if qos > 0:
+            packet_id = body[offset:offset + 2]
+            offset += 2
+        payload = body[offset:]
+
+        stats = self.server.stats
+        if topic.startswith(TELEMETRY_PREFIX) and '/messages/events/' in topic:
+            stats.telemetry += 1
+            stats.telemetry_bytes += len(payload)
+        elif topic.startswith(TWIN_GET_PREFIX):
+            stats.twin_gets += 1
+            rid = topic_parameters(topic).get('$rid', '')
+            self.send(publish_packet(f'$iothub/twin/res/200/?$rid={rid}',
+                                     self.server.twin.document()))
+        elif topic.startswith(TWIN_REPORTED_PREFIX):
+            stats.reported_patches += 1
+            rid = topic_parameters(topic).get('$rid', '')
+            try:
+                version = self.server.twin.patch_reported(json.loads(payload),
+                                                          self.server.logger)
+                status = 204
+            except (ValueError, AttributeError):
+                version = self.server.twin.reported['$version']
+                status = 400
+            self.send(publish_packet(f'$iothub/twin/res/{status}/?$rid={rid}&$version={version}',
+                                     b''))
+        elif topic.startswith(METHOD_RESPONSE_PREFIX):
+            rid = topic_parameters(topic).get('$rid', '')
+            sent_time = self.pending_methods.pop(rid, None)
+            stats.method_responses += 1
+            if sent_time is not None:
+                stats.method_latencies.append(time.monotonic() - sent_time)
+
+        if packet_id is not None:
+            self.acknowledge(packet_id)
+
+    def acknowledge(self, packet_id):
+        """
+        Sends PUBACK, after the configured delay
+        """
+        ack = packet(PUBACK, 0, packet_id)
+        if self.server.ack_delay > 0:
+            asyncio.get_running_loop().call_later(self.server.ack_delay, self.send, ack)
+        else:
+            self.send(ack)
+
+    def call_method(self, name, payload):
+        """
+        Invokes a direct method, if the device has subscribed to them
+        """
+        if not self.is_subscribed(f'$iothub/methods/POST/{name}/'):
+            return
+        self.next_method_id += 1
+        rid = format(self.next_method_id, 'x')
+        self.pending_methods[rid] = time.monotonic()
+        self.server.stats.method_calls += 1
+        self.send(publish_packet(f'$iothub/methods/POST/{name}/?$rid={rid}', payload))
+
+    def send_desired_patch(self, patch):
+        """
+        Sends a desired properties update, if the device has subscribed to them
+        """
+        topic = f'$iothub/twin/PATCH/properties/desired/?$version={patch["$version"]}'
+        if self.is_subscribed(topic):
+            self.send(publish_packet(topic, json.dumps(patch).encode()))
+
+
+class IoTHubStandIn:
+    """
+    Accepts device connections, and drives the cloud side of the load test
+    """
+
+    def __init__(self, args, logger):
+        self.args = args
+        self.logger = logger
+        self.ack_delay = args.ack_delay_ms / 1000
+        self.stats = Stats()
+        self.twin = DeviceTwin()
+        self.connections = set()
+
+    async def handle_client(self, reader, writer):
+        connection = DeviceConnection(self, reader, writer)
+        self.connections.add(connection)
+        await connection.run()
+
+    async def every(self, seconds, action):
+        """
+        Runs an action periodically
+        """
+        while True:
+            await asyncio.sleep(seconds)
+            action()
+
+    def send_desired_patch(self):
+        enabled = not self.twin.desired.get('thermometerTelemetryUploadEnabled', True)
+        patch = self.twin.patch_desired({'thermometerTelemetryUploadEnabled': enabled})
+        self.stats.desired_patches += 1
+        for connection in list(self.connections):
+            connection.send_desired_patch(patch)
+
+    def call_methods(self):
+        for connection in list(self.connections):
+            connection.call_method('displayAlert', b'"Load test alert"')
+
+    def disconnect_all(self):
+        for connection in list(self.connections):
+            self.stats.forced_disconnects += 1
+            self.logger.info('Disconnecting device "%s".', connection.client_id)
+            connection.writer.transport.abort()
+
+    def report(self, previous, seconds):
+        """
+        Logs what was received since the previous snapshot
+        """
+        current = self.stats
+        latencies = sorted(current.method_latencies[len(previous.method_latencies):])
+        method_ms = f'{latencies[len(latencies) // 2] * 1000:.1f} ms' if latencies else 'n/a'
+        self.logger.info(
+            '%.1f telemetry msg/s (%.0f bytes/s), %.1f reported patches/s, %d twin GETs, '
+            '%d connections; direct method median %s.',
+            (current.telemetry - previous.telemetry) / seconds,
+            (current.telemetry_bytes - previous.telemetry_bytes) / seconds,
+            (current.reported_patches - previous.reported_patches) / seconds,
+            current.twin_gets - previous.twin_gets, len(self.connections), method_ms)
+
+    async def report_every(self, seconds):
+        previous = self.stats.snapshot()
+        while True:
+            await asyncio.sleep(seconds)
+            self.report(previous, seconds)
+            previous = self.stats.snapshot()
+
+    async def serve(self):
+        tls = None
+        if self.args.tls_cert:
+            tls = ssl.create_default_context(ssl.Purpose.CLIENT_AUTH)
+            tls.load_cert_chain(self.args.tls_cert, self.args.tls_key)
+
+        server = await asyncio.start_server(self.handle_client, self.args.host, self.args.port,
+                                            ssl=tls)
+        self.logger.info('IoT Hub stand-in listening on %s:%d (%s).', self.args.host,
+                         self.args.port, 'TLS' if tls else 'plain TCP')
+
+        tasks = [asyncio.create_task(self.report_every(self.args.stats_interval))]
+        if self.args.desired_interval > 0:
+            tasks.append(asyncio.create_task(
+                self.every(self.args.desired_interval, self.send_desired_patch)))
+        if self.args.method_interval > 0:
+            tasks.append(asyncio.create_task(
+                self.every(self.args.method_interval, self.call_methods)))
+        if self.args.disconnect_interval > 0:
+            tasks.append(asyncio.create_task(
+                self.every(self.args.disconnect_interval, self.disconnect_all)))
+
+        async with server:
+            await server.serve_forever()
+
+    def log_totals(self):
+        stats = self.stats
+        self.logger.info(
+            'Totals: %d connections (%d forced disconnects), %d telemetry messages (%d bytes), '
+            '%d twin GETs, %d reported patches, %d desired patches, %d of %d direct methods '
+            'answered.', stats.connects, stats.forced_disconnects, stats.telemetry,
+            stats.telemetry_bytes, stats.twin_gets, stats.reported_patches, stats.desired_patches,
+            stats.method_responses, stats.method_calls)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Local MQTT stand-in for an Azure IoT Hub.')
+    parser.add_argument('--host', default='127.0.0.1', help='address to listen on')
+    parser.add_argument('--port', type=int, default=1883, help='port to listen on')
+    parser.add_argument('--tls-cert', help='serve TLS with this certificate chain (PEM)')
+    parser.add_argument('--tls-key', help='private key for --tls-cert (PEM)')
+    parser.add_argument('--ack-delay-ms', type=float, default=0,
+                        help='delay before acknowledging telemetry, to model uplink latency')
+    parser.add_argument('--desired-interval', type=float, default=0,
+                        help='seconds between desired property updates (0 for none)')
+    parser.add_argument('--method-interval', type=float, default=0,
+                        help='seconds between displayAlert direct method calls (0 for none)')
+    parser.add_argument('--disconnect-interval', type=float, default=0,
+                        help='seconds between dropping every connection (0 for never)')
+    parser.add_argument('--stats-interval', type=float, default=5,
+                        help='seconds between statistics lines')
+    args = parser.parse_args()
+    if bool(args.tls_cert) != bool(args.tls_key):
+        parser.error('--tls-cert and --tls-key must be given together')
+
+    logging.basicConfig(stream=sys.stdout, level=logging.INFO,
+                        format='%(asctime)s %(message)s')
+    stand_in = IoTHubStandIn(args, logging.getLogger('iothub_stand_in'))
+    try:
+        asyncio.run(stand_in.serve())
+    except KeyboardInterrupt:
+        pass
+    finally:
+        stand_in.log_totals()
+
+
+if __name__ == '__main__':
+    main()
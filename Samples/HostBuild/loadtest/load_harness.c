@@ -0,0 +1,523 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+// Load harness for the Azure IoT sample's cloud stack (cloud.c and azure_iot.c), run against the
+// local IoT Hub stand-in, iothub_stand_in.py. It sends telemetry and Device Twin reports through
+// the Cloud_* API at fixed rates, and every interval writes a CSV row to stdout with the rates
+// achieved, the DoWork calls made, the time to confirmation, and the heap in use. Diagnostics from
+// the sample go to stderr, as do its summary statistics on exit, including the time from start to
+// the first telemetry confirmation. It runs with either DoWork policy, so that the two can be
+// compared.
+//
+// Built with LOAD_HARNESS_DPS, it connects through the sample's DPS connection, connection_dps.c,
+// with the in-process DPS stand-in, dps_stand_in.c, which assigns the device to the hub in the
+// connection string. The DPS assignment is cached in the mutable storage file as on the device, so
+// a run started with --dps-cold registers with DPS, and the next run connects straight to the hub.
+
+#include <errno.h>
+#include <getopt.h>
+#include <malloc.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <applibs/eventloop.h>
+#include <applibs/log.h>
+
+#include "azure_iot.h"
+#include "cloud.h"
+#include "eventloop_timer_utilities.h"
+#include "exitcodes.h"
+
+#ifdef LOAD_HARNESS_DPS
+#include "connection_dps.h"
+#include "dps_cache.h"
+#include "dps_stand_in.h"
+#include "mutable_storage_layout.h"
+#endif
+
+#define DEFAULT_CONNECTION_STRING "HostName=127.0.0.1:1883;DeviceId=loadtest"
+
+#ifdef LOAD_HARNESS_DPS
+#define SHORT_OPTIONS "c:t:r:d:i:bw:p:k"
+#define MAX_CONNECTION_STRING_FIELD 256
+#else
+#define SHORT_OPTIONS "c:t:r:d:i:bw:"
+#endif
+
+// Sends are made from a 10 ms tick, each sending what the rate allows since the last one, so that
+// rates above 100 per second need not have a timer each.
+static const struct timespec SendTickPeriod = {.tv_sec = 0, .tv_nsec = 10 * 1000 * 1000};
+
+typedef struct {
+    const char *connectionString;
+    double telemetryRate;
+    double reportRate;
+    unsigned int durationSeconds;
+    unsigned int intervalSeconds;
+    bool cbor;
+    AzureIoT_DoWorkPolicy doWorkPolicy;
+    unsigned int dpsRegistrationMs;
+    bool dpsCold;
+} HarnessOptions;
+
+typedef struct {
+    unsigned long telemetryOffered;
+    unsigned long telemetryAccepted;
+    unsigned long telemetryBusy;
+    unsigned long telemetryFailed;
+    unsigned long reportsOffered;
+    unsigned long reportsFailed;
+} HarnessCounts;
+
+static volatile sig_atomic_t exitCode = ExitCode_Success;
+
+static HarnessOptions options = {.connectionString = DEFAULT_CONNECTION_STRING,
+                                 .telemetryRate = 10,
+                                 .reportRate = 1,
+                                 .durationSeconds = 60,
+                                 .intervalSeconds = 5,
+                                 .cbor = false,
+                                 .doWorkPolicy = AzureIoT_DoWorkPolicy_Adaptive,
+                                 .dpsRegistrationMs = 3000,
+                                 .dpsCold = false};
+
+static EventLoop *eventLoop = NULL;
+static EventLoopTimer *sendTimer = NULL;
+static EventLoopTimer *intervalTimer = NULL;
+static EventLoopTimer *durationTimer = NULL;
+
+static struct timespec startTime;
+static struct timespec lastSendTime;
+static double telemetryCredit = 0;
+static double reportCredit = 0;
+static bool isConnected = false;
+static bool uploadEnabled = true;
+static double firstTelemetryConfirmedSeconds = -1;
+
+static HarnessCounts counts;
+static HarnessCounts lastCounts;
+static AzureIoT_DoWorkStats lastDoWorkStats;
+static AzureIoT_TelemetryWindowStats lastWindowStats;
+static AzureIoT_DeviceTwinReportStats lastReportStats;
+static double lastIntervalElapsed = 0;
+
+static double SecondsSince(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/// <summary>
+///     Heap in use: allocated chunks, plus large allocations which malloc maps directly.
+/// </summary>
+static size_t HeapInUse(void)
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+static void TerminationHandler(int signalNumber)
+{
+    // Don't use Log_Debug here, as it is not guaranteed to be async-signal-safe.
+    exitCode = ExitCode_TermHandler_SigTerm;
+}
+
+static void ExitCodeCallbackHandler(ExitCode ec)
+{
+    exitCode = ec;
+}
+
+static void ConnectionChangedHandler(bool connected)
+{
+    isConnected = connected;
+}
+
+static void SendTelemetry(void)
+{
+    // A temperature which changes, so that successive readings are not identical.
+    Cloud_Telemetry telemetry = {.temperature = 20.0f + (float)(counts.telemetryOffered % 100) / 8};
+    Cloud_Result result = options.cbor ? Cloud_SendTelemetryBinary(&telemetry, time(NULL))
+                                       : Cloud_SendTelemetry(&telemetry, time(NULL));
+
+    ++counts.telemetryOffered;
+    if (result == Cloud_Result_OK) {
+        ++counts.telemetryAccepted;
+    } else if (result == Cloud_Result_Busy) {
+        ++counts.telemetryBusy;
+    } else {
+        ++counts.telemetryFailed;
+    }
+}
+
+static void SendReport(void)
+{
+    // Alternate between the sample's two kinds of report, so that each one changes the twin.
+    Cloud_Result result;
+    if (counts.reportsOffered % 2 == 0) {
+        char serialNumber[32];
+        snprintf(serialNumber, sizeof(serialNumber), "LOADTEST-%lu", counts.reportsOffered);
+        result = Cloud_SendDeviceDetails(serialNumber);
+    } else {
+        uploadEnabled = !uploadEnabled;
+        result = Cloud_SendThermometerTelemetryUploadEnabledChangedEvent(uploadEnabled, false);
+    }
+
+    ++counts.reportsOffered;
+    if (result != Cloud_Result_OK) {
+        ++counts.reportsFailed;
+    }
+}
+
+static unsigned long HistogramTotal(const AzureIoT_TelemetryWindowStats *stats)
+{
+    unsigned long total = 0;
+    for (size_t i = 0; i < AZURE_IOT_LATENCY_BUCKETS; ++i) {
+        total += stats->latencyHistogram[i];
+    }
+    return total;
+}
+
+static void SendTimerEventHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        exitCode = ExitCode_TelemetryTimer_Consume;
+        return;
+    }
+
+    double elapsed = SecondsSince(&lastSendTime);
+    clock_gettime(CLOCK_MONOTONIC, &lastSendTime);
+
+    telemetryCredit += options.telemetryRate * elapsed;
+    for (; telemetryCredit >= 1; telemetryCredit -= 1) {
+        SendTelemetry();
+    }
+
+    reportCredit += options.reportRate * elapsed;
+    for (; reportCredit >= 1; reportCredit -= 1) {
+        SendReport();
+    }
+
+    if (firstTelemetryConfirmedSeconds < 0) {
+        AzureIoT_TelemetryWindowStats windowStats;
+        AzureIoT_GetTelemetryWindowStats(&windowStats);
+        if (HistogramTotal(&windowStats) > 0) {
+            firstTelemetryConfirmedSeconds = SecondsSince(&startTime);
+        }
+    }
+}
+
+static void PrintHeader(void)
+{
+    printf("elapsed_s,telemetry_offered_per_s,telemetry_accepted_per_s,telemetry_busy,"
+           "telemetry_failed,telemetry_confirmed_per_s,reports_offered_per_s,reports_published,"
+           "dowork_per_min,confirm_mean_ms,confirm_max_ms,telemetry_p50_ms,telemetry_p99_ms,"
+           "in_flight,deferred,heap_bytes,connected,disconnects\n");
+}
+
+static void IntervalTimerEventHandler(EventLoopTimer *timer)
+{
+    if (timer != NULL && ConsumeEventLoopTimerEvent(timer) != 0) {
+        exitCode = ExitCode_TelemetryTimer_Consume;
+        return;
+    }
+
+    double elapsed = SecondsSince(&startTime);
+    // The duration timer can expire just after the interval timer; skip the empty row.
+    double seconds = elapsed - lastIntervalElapsed;
+    if (seconds < 0.1) {
+        return;
+    }
+
+    AzureIoT_DoWorkStats doWorkStats;
+    AzureIoT_GetDoWorkStats(&doWorkStats);
+    AzureIoT_TelemetryWindowStats windowStats;
+    AzureIoT_GetTelemetryWindowStats(&windowStats);
+    AzureIoT_DeviceTwinReportStats reportStats;
+    AzureIoT_GetDeviceTwinReportStats(&reportStats);
+    AzureIoT_ConnectionStats connectionStats;
+    AzureIoT_GetConnectionStats(&connectionStats);
+
+    // Confirmations cover telemetry and reports; the histogram covers telemetry alone.
+    unsigned long confirmations = doWorkStats.confirmations - lastDoWorkStats.confirmations;
+    unsigned long confirmLatencyMs =
+        doWorkStats.totalConfirmLatencyMs - lastDoWorkStats.totalConfirmLatencyMs;
+    unsigned long telemetryConfirmed =
+        HistogramTotal(&windowStats) - HistogramTotal(&lastWindowStats);
+
+    printf("%.1f,%.1f,%.1f,%lu,%lu,%.1f,%.1f,%lu,%.1f,%lu,%lu,%lu,%lu,%u,%u,%zu,%d,%lu\n",
+           elapsed,
+           (double)(counts.telemetryOffered - lastCounts.telemetryOffered) / seconds,
+           (double)(counts.telemetryAccepted - lastCounts.telemetryAccepted) / seconds,
+           counts.telemetryBusy - lastCounts.telemetryBusy,
+           counts.telemetryFailed - lastCounts.telemetryFailed,
+           (double)telemetryConfirmed / seconds,
+           (double)(counts.reportsOffered - lastCounts.reportsOffered) / seconds,
+           reportStats.publishes - lastReportStats.publishes,
+           (double)(doWorkStats.doWorkCalls - lastDoWorkStats.doWorkCalls) * 60 / seconds,
+           confirmations > 0 ? confirmLatencyMs / confirmations : 0,
+           doWorkStats.maxConfirmLatencyMs, windowStats.latencyP50Ms, windowStats.latencyP99Ms,
+           windowStats.inFlight, windowStats.deferred, HeapInUse(), isConnected ? 1 : 0,
+           connectionStats.disconnects);
+    fflush(stdout);
+
+    lastCounts = counts;
+    lastDoWorkStats = doWorkStats;
+    lastWindowStats = windowStats;
+    lastReportStats = reportStats;
+    lastIntervalElapsed = elapsed;
+}
+
+static void DurationTimerEventHandler(EventLoopTimer *timer)
+{
+    ConsumeEventLoopTimerEvent(timer);
+    IntervalTimerEventHandler(NULL);
+    exitCode = ExitCode_TermHandler_SigTerm;
+}
+
+static void Usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -c, --connection-string S  stand-in to connect to (default \"%s\")\n"
+            "  -t, --telemetry-rate N     telemetry messages per second (default 10)\n"
+            "  -r, --report-rate N        Device Twin reports per second (default 1)\n"
+            "  -d, --duration S           seconds to run for, or 0 until interrupted (default 60)\n"
+            "  -i, --interval S           seconds between CSV rows (default 5)\n"
+            "  -b, --cbor                 send telemetry as CBOR rather than JSON\n"
+            "  -w, --dowork-policy P      fixed or adaptive DoWork scheduling (default adaptive)\n",
+            program, DEFAULT_CONNECTION_STRING);
+#ifdef LOAD_HARNESS_DPS
+    fprintf(stderr,
+            "  -p, --dps-registration-ms N  milliseconds the DPS stand-in takes to register "
+            "(default 3000)\n"
+            "  -k, --dps-cold             forget the cached DPS assignment before starting\n");
+#endif
+}
+
+static bool ParseArgs(int argc, char *argv[])
+{
+    static const struct option longOptions[] = {
+        {"connection-string", required_argument, NULL, 'c'},
+        {"telemetry-rate", required_argument, NULL, 't'},
+        {"report-rate", required_argument, NULL, 'r'},
+        {"duration", required_argument, NULL, 'd'},
+        {"interval", required_argument, NULL, 'i'},
+        {"cbor", no_argument, NULL, 'b'},
+        {"dowork-policy", required_argument, NULL, 'w'},
+#ifdef LOAD_HARNESS_DPS
+        {"dps-registration-ms", required_argument, NULL, 'p'},
+        {"dps-cold", no_argument, NULL, 'k'},
+#endif
+        {NULL, 0, NULL, 0}};
+
+    int option;
+    while ((option = getopt_long(argc, argv, SHORT_OPTIONS, longOptions, NULL)) != -1) {
+        switch (option) {
+        case 'c':
+            options.connectionString = optarg;
+            break;
+        case 't':
+            options.telemetryRate = atof(optarg);
+            break;
+        case 'r':
+            options.reportRate = atof(optarg);
+            break;
+        case 'd':
+            options.durationSeconds = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+        case 'i':
+            options.intervalSeconds = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+        case 'b':
+            options.cbor = true;
+            break;
+        case 'w':
+            if (strcmp(optarg, "fixed") == 0) {
+                options.doWorkPolicy = AzureIoT_DoWorkPolicy_Fixed;
+            } else if (strcmp(optarg, "adaptive") == 0) {
+                options.doWorkPolicy = AzureIoT_DoWorkPolicy_Adaptive;
+            } else {
+                return false;
+            }
+            break;
+#ifdef LOAD_HARNESS_DPS
+        case 'p':
+            options.dpsRegistrationMs = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+        case 'k':
+            options.dpsCold = true;
+            break;
+#endif
+        default:
+            return false;
+        }
+    }
+
+    return optind == argc && options.telemetryRate >= 0 && options.reportRate >= 0 &&
+           options.intervalSeconds > 0;
+}
+
+#ifdef LOAD_HARNESS_DPS
+/// <summary>
+///     Copies the value of a field of the connection string, such as "HostName".
+/// </summary>
+/// <returns>true if the field is present and its value fits; otherwise false.</returns>
+static bool GetConnectionStringField(const char *name, char *value, size_t size)
+{
+    size_t nameLength = strlen(name);
+    for (const char *field = options.connectionString; *field != '\0';) {
+        size_t fieldLength = strcspn(field, ";");
+        if (fieldLength > nameLength && strncmp(field, name, nameLength) == 0 &&
+            field[nameLength] == '=') {
+            size_t valueLength = fieldLength - nameLength - 1;
+            if (valueLength >= size) {
+                return false;
+            }
+            memcpy(value, field + nameLength + 1, valueLength);
+            value[valueLength] = '\0';
+            return true;
+        }
+        field += fieldLength;
+        if (*field == ';') {
+            ++field;
+        }
+    }
+    return false;
+}
+#endif
+
+/// <summary>
+///     Returns the connection context for Cloud_Initialize: the connection string, or with
+///     LOAD_HARNESS_DPS, the DPS configuration, having set up the DPS stand-in to assign the device
+///     to the connection string's hub.
+/// </summary>
+static void *GetConnectionContext(void)
+{
+#ifdef LOAD_HARNESS_DPS
+    static Connection_Dps_Config dpsConfig = {.scopeId = "0ne00000000",
+                                              .cacheAssignment = true,
+                                              .cacheStorageOffset = DPS_CACHE_STORAGE_OFFSET};
+    static char hub[MAX_CONNECTION_STRING_FIELD];
+    char deviceId[MAX_CONNECTION_STRING_FIELD];
+
+    if (!GetConnectionStringField("HostName", hub, sizeof(hub))) {
+        return NULL;
+    }
+    // The host device client connects as this device when it uses device authentication.
+    if (GetConnectionStringField("DeviceId", deviceId, sizeof(deviceId))) {
+        setenv("AZUREIOT_HOST_DEVICE_ID", deviceId, 1);
+    }
+    DpsStandIn_Configure(hub, options.dpsRegistrationMs);
+    if (options.dpsCold) {
+        DpsCache_Invalidate(DPS_CACHE_STORAGE_OFFSET);
+    }
+    return &dpsConfig;
+#else
+    return (void *)options.connectionString;
+#endif
+}
+
+static ExitCode InitHandlers(void)
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(struct sigaction));
+    action.sa_handler = TerminationHandler;
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+
+    eventLoop = EventLoop_Create();
+    if (eventLoop == NULL) {
+        return ExitCode_Init_EventLoop;
+    }
+
+    // The time to the first telemetry confirmation includes connecting.
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    ExitCode cloudExitCode = Cloud_Initialize(eventLoop, GetConnectionContext(),
+                                              ExitCodeCallbackHandler, NULL, NULL,
+                                              ConnectionChangedHandler);
+    if (cloudExitCode != ExitCode_Success) {
+        return cloudExitCode;
+    }
+    // Cloud_Initialize selects the adaptive policy; override it to compare the two.
+    AzureIoT_SetDoWorkPolicy(options.doWorkPolicy);
+
+    clock_gettime(CLOCK_MONOTONIC, &lastSendTime);
+
+    sendTimer = CreateEventLoopPeriodicTimer(eventLoop, SendTimerEventHandler, &SendTickPeriod);
+    if (sendTimer == NULL) {
+        return ExitCode_Init_TelemetryTimer;
+    }
+
+    struct timespec interval = {.tv_sec = options.intervalSeconds, .tv_nsec = 0};
+    intervalTimer = CreateEventLoopPeriodicTimer(eventLoop, IntervalTimerEventHandler, &interval);
+    if (intervalTimer == NULL) {
+        return ExitCode_Init_TimerStatsReporter;
+    }
+
+    if (options.durationSeconds > 0) {
+        durationTimer = CreateEventLoopDisarmedTimer(eventLoop, DurationTimerEventHandler);
+        struct timespec duration = {.tv_sec = options.durationSeconds, .tv_nsec = 0};
+        if (durationTimer == NULL || SetEventLoopTimerOneShot(durationTimer, &duration) != 0) {
+            return ExitCode_Init_TimerStatsReporter;
+        }
+    }
+
+    return ExitCode_Success;
+}
+
+static void CloseHandlers(void)
+{
+    DisposeEventLoopTimer(sendTimer);
+    DisposeEventLoopTimer(intervalTimer);
+    DisposeEventLoopTimer(durationTimer);
+    Cloud_Cleanup();
+    EventLoop_Close(eventLoop);
+}
+
+int main(int argc, char *argv[])
+{
+    if (!ParseArgs(argc, argv)) {
+        Usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    Log_Debug("INFO: Load harness: %.1f telemetry messages (%s) and %.1f reports per second, "
+              "to \"%s\", with %s DoWork scheduling.\n",
+              options.telemetryRate, options.cbor ? "CBOR" : "JSON", options.reportRate,
+              options.connectionString,
+              options.doWorkPolicy == AzureIoT_DoWorkPolicy_Fixed ? "fixed" : "adaptive");
+
+    PrintHeader();
+    exitCode = InitHandlers();
+
+    while (exitCode == ExitCode_Success) {
+        EventLoop_Run_Result result = EventLoop_Run(eventLoop, -1, true);
+        // Continue if interrupted by signal, e.g. due to breakpoint being set.
+        if (result == EventLoop_Run_Failed && errno != EINTR) {
+            exitCode = ExitCode_Main_EventLoopFail;
+        }
+    }
+
+    CloseHandlers();
+
+    Log_Debug("INFO: Sent %lu telemetry messages (%lu refused as busy, %lu failed) and %lu "
+              "reports in %.1f s; heap in use at exit %zu bytes.\n",
+              counts.telemetryAccepted, counts.telemetryBusy, counts.telemetryFailed,
+              counts.reportsOffered, SecondsSince(&startTime), HeapInUse());
+    if (firstTelemetryConfirmedSeconds >= 0) {
+        Log_Debug("INFO: First telemetry confirmed %.0f ms after start.\n",
+                  firstTelemetryConfirmedSeconds * 1000);
+    } else {
+        Log_Debug("INFO: No telemetry was confirmed.\n");
+    }
+#ifdef LOAD_HARNESS_DPS
+    Log_Debug("INFO: %lu DPS registrations.\n", DpsStandIn_GetRegistrations());
+#endif
+
+    return exitCode == ExitCode_TermHandler_SigTerm ? EXIT_SUCCESS : exitCode;
+}